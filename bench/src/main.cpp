@@ -0,0 +1,901 @@
+#include "fasta.hpp"
+#include "pna.hpp"
+#include "seqio.h"
+#include "simd.hpp"
+#include "util.h"
+
+#include <zlib.h>
+#include "kseq.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Initialize the kseq library, but disable a warning from it.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-compare"
+KSEQ_INIT(gzFile, gzread)
+#pragma GCC diagnostic pop
+
+using namespace std;
+using namespace seqio::impl;
+
+void usage(string msg = "") {
+    epf("usage: bench fasta_read [--size MB] [--path fasta]");
+    epf("       bench bgzf_read [--size MB] [--path fasta.gz] [--threads max]");
+    epf("       bench fasta_parallel [--size MB] [--path fasta] [--threads max]");
+    epf("       bench gzip_read [--size MB] [--path fasta.gz]");
+    epf("       bench region_qps [--size MB]");
+    epf("       bench pna_threads [--size MB] [--threads max]");
+    epf("       bench page_cache [--size MB]");
+    epf("       bench multi_file [--size MB]");
+    epf("       bench fastq_read [--size MB] [--path fastq]");
+    epf("       bench transform [--size MB]");
+    epf("       bench revcomp [--size MB]");
+    epf("       bench pna_unpack [--size MB]");
+    epf("       bench scan [--size MB] [--path fasta]");
+
+    if(msg.length() > 0) {
+        ep(msg.c_str());
+    }
+
+    exit(1);
+}
+
+double now_sec() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + (t.tv_nsec / 1e9);
+}
+
+uint64_t file_size(char const *path) {
+    struct stat s;
+    errif(0 != stat(path, &s), "Failed stating %s", path);
+    return s.st_size;
+}
+
+void report(char const *desc, uint64_t nbytes, double secs) {
+    printf("  %-32s %8.3f s  %9.1f MB/s\n", desc, secs, (nbytes / 1e6) / secs);
+}
+
+// Writes a multi-sequence FASTA of roughly size_mb megabytes of random
+// bases, by default soft-masked and with scattered Ns.
+void create_fasta(char const *path,
+                  uint64_t size_mb,
+                  uint64_t seqlen = 32 * 1024 * 1024,
+                  string const &bases = "ACGTacgtN") {
+    char *buf = (char *)malloc(seqlen);
+    uint32_t x = 1;
+
+    seqio_writer writer;
+    seqio_create_writer(path, SEQIO_DEFAULT_WRITER_OPTIONS, &writer);
+    seqio_dictionary metadata;
+    seqio_create_dictionary(&metadata);
+
+    for(uint64_t total = 0, i = 0; total < size_mb * 1024 * 1024; total += seqlen, i++) {
+        for(uint64_t j = 0; j < seqlen; j++) {
+            x = x * 1103515245 + 12345;
+            buf[j] = bases[(x >> 16) % bases.size()];
+        }
+
+        string name = "seq" + to_string(i);
+        seqio_set_value(metadata, SEQIO_KEY_NAME, name.c_str());
+        seqio_set_value(metadata, SEQIO_KEY_COMMENT, "bench");
+        seqio_create_sequence(writer, metadata);
+        seqio_write(writer, buf, seqlen);
+    }
+
+    seqio_dispose_dictionary(&metadata);
+    seqio_dispose_writer(&writer);
+    free(buf);
+}
+
+// Writes a FASTQ of roughly size_mb megabytes of 150bp reads in the
+// usual 4-line layout.
+void create_fastq(char const *path, uint64_t size_mb) {
+    uint32_t const readlen = 150;
+    char const bases[] = "ACGTN";
+    char seq[readlen + 1];
+    char qual[readlen + 1];
+    uint32_t x = 1;
+
+    FILE *f = fopen(path, "w");
+    errif(!f, "Failed opening %s", path);
+
+    uint64_t total = 0;
+    for(uint64_t i = 0; total < size_mb * 1024 * 1024; i++) {
+        for(uint32_t j = 0; j < readlen; j++) {
+            x = x * 1103515245 + 12345;
+            seq[j] = bases[(x >> 16) % 5];
+            qual[j] = '!' + (x >> 8) % 42;
+        }
+        seq[readlen] = qual[readlen] = '\0';
+
+        int n = fprintf(f, "@read%zu length=%u\n%s\n+\n%s\n", size_t(i), readlen, seq, qual);
+        errif(n < 0, "Failed writing %s", path);
+        total += n;
+    }
+    fclose(f);
+}
+
+// The per-character parse loop that FastaSequence::read used before bulk
+// line scanning, for comparison.
+uint64_t read_byte_loop(char const *path, seqio_base_transform transform, char *buf, uint64_t buflen) {
+    FastaRawStream stream(create_source_factory(path, SEQIO_DEFAULT_SEQUENCE_OPTIONS), 0);
+    CharInterpreter interpreter(transform);
+
+    uint64_t total = 0;
+    uint64_t n = 0;
+    bool firstCol = true;
+    bool header = false;
+    int c;
+    while((c = stream.nextChar()) != -1) {
+        if(header) {
+            header = (c != '\n');
+            continue;
+        }
+        switch(interpreter.getAction(c, firstCol)) {
+        case CharInterpreter::IGNORE:
+            firstCol = false;
+            break;
+        case CharInterpreter::NEWLINE:
+            firstCol = true;
+            break;
+        case CharInterpreter::APPEND_SEQUENCE:
+            firstCol = false;
+            buf[n++] = interpreter.getBase(c);
+            if(n == buflen) {
+                total += n;
+                n = 0;
+            }
+            break;
+        case CharInterpreter::HEADER:
+            header = true;
+            break;
+        }
+    }
+
+    return total + n;
+}
+
+uint64_t read_seqio(char const *path, seqio_sequence_options const &opts, char *buf, uint64_t buflen) {
+    seqio_sequence_iterator iterator;
+    seqio_sequence sequence;
+    seqio_create_sequence_iterator(path, opts, &iterator);
+
+    uint64_t total = 0;
+    while( (0 == seqio_next_sequence(iterator, &sequence)) && sequence) {
+        uint64_t n;
+        while( (0 == seqio_read(sequence, buf, buflen, &n)) && n ) {
+            total += n;
+        }
+        seqio_dispose_sequence(&sequence);
+    }
+    seqio_dispose_sequence_iterator(&iterator);
+
+    return total;
+}
+
+void bench_fasta_read(char const *path) {
+    uint64_t const buflen = 64 * 1024;
+    char *buf = (char *)malloc(buflen);
+    uint64_t nbytes = file_size(path);
+
+    cout << path << ": " << nbytes << " bytes, simd=" << simd_isa() << endl;
+
+    seqio_base_transform transforms[] = {SEQIO_BASE_TRANSFORM_NONE, SEQIO_BASE_TRANSFORM_CAPS_GATCN};
+    char const *transform_names[] = {"none", "caps_gatcn"};
+
+    for(int i = 0; i < 2; i++) {
+        cout << " transform=" << transform_names[i] << endl;
+
+        seqio_sequence_options opts = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+        opts.base_transform = transforms[i];
+
+        double t0 = now_sec();
+        uint64_t nbytecount = read_byte_loop(path, transforms[i], buf, buflen);
+        double t1 = now_sec();
+        uint64_t nbulk = read_seqio(path, opts, buf, buflen);
+        double t2 = now_sec();
+
+        errif(nbytecount != nbulk, "Base count mismatch: byte=%zu, bulk=%zu",
+              size_t(nbytecount), size_t(nbulk));
+
+        report("byte loop (nextChar)", nbytes, t1 - t0);
+        report("bulk line scan (seqio_read)", nbytes, t2 - t1);
+    }
+
+    free(buf);
+}
+
+void bench_bgzf_read(char const *path, uint32_t max_threads) {
+    uint64_t const buflen = 64 * 1024;
+    char *buf = (char *)malloc(buflen);
+
+    cout << path << ": " << file_size(path) << " bytes compressed" << endl;
+
+    uint64_t nbases = 0;
+    for(uint32_t nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+        seqio_sequence_options opts = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+        opts.num_threads = nthreads;
+
+        double t0 = now_sec();
+        uint64_t n = read_seqio(path, opts, buf, buflen);
+        double t1 = now_sec();
+
+        if(nthreads == 1)
+            nbases = n;
+        errif(n != nbases, "Base count mismatch: 1 thread=%zu, %u threads=%zu",
+              size_t(nbases), nthreads, size_t(n));
+
+        string desc = to_string(nthreads) + " thread(s)";
+        report(desc.c_str(), nbases, t1 - t0);
+    }
+
+    free(buf);
+}
+
+void bench_fasta_parallel(char const *path, uint32_t max_threads) {
+    uint64_t const buflen = 64 * 1024;
+    char *buf = (char *)malloc(buflen);
+
+    cout << path << ": " << file_size(path) << " bytes" << endl;
+
+    seqio_record_order orders[] = {SEQIO_RECORD_ORDER_FILE, SEQIO_RECORD_ORDER_ANY};
+    char const *order_names[] = {"file", "any"};
+
+    uint64_t nbases = 0;
+    for(int i = 0; i < 2; i++) {
+        cout << " record_order=" << order_names[i] << endl;
+
+        for(uint32_t nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+            seqio_sequence_options opts = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+            opts.num_threads = nthreads;
+            opts.record_order = orders[i];
+
+            double t0 = now_sec();
+            uint64_t n = read_seqio(path, opts, buf, buflen);
+            double t1 = now_sec();
+
+            if(nbases == 0)
+                nbases = n;
+            errif(n != nbases, "Base count mismatch: 1 thread=%zu, %u threads=%zu",
+                  size_t(nbases), nthreads, size_t(n));
+
+            string desc = to_string(nthreads) + " thread(s)";
+            report(desc.c_str(), nbases, t1 - t0);
+        }
+    }
+
+    free(buf);
+}
+
+void bench_gzip_read(char const *path) {
+    uint64_t const buflen = 64 * 1024;
+    char *buf = (char *)malloc(buflen);
+
+    cout << path << ": " << file_size(path) << " bytes compressed" << endl;
+
+    uint32_t const nbuffers[] = {0, 2, 4, 8};
+    uint64_t nbases = 0;
+    for(uint32_t n: nbuffers) {
+        seqio_sequence_options opts = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+        opts.read_ahead_buffers = n;
+
+        double t0 = now_sec();
+        uint64_t nread = read_seqio(path, opts, buf, buflen);
+        double t1 = now_sec();
+
+        if(n == 0)
+            nbases = nread;
+        errif(nread != nbases, "Base count mismatch: no read-ahead=%zu, %u buffers=%zu",
+              size_t(nbases), n, size_t(nread));
+
+        string desc = n ? to_string(n) + " read-ahead buffers" : string("no read-ahead");
+        report(desc.c_str(), nbases, t1 - t0);
+    }
+
+    free(buf);
+}
+
+// Evicts a file from the page cache, so a scan starts cold.
+void evict_file(char const *path) {
+    int fd = open(path, O_RDONLY);
+    errif(fd < 0, "Failed opening %s", path);
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+// Fraction of a file's pages in the page cache.
+double file_residency(char const *path) {
+    int fd = open(path, O_RDONLY);
+    errif(fd < 0, "Failed opening %s", path);
+    uint64_t length = file_size(path);
+    void *addr = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    errif(addr == MAP_FAILED, "Failed mmap'ing %s", path);
+
+    uint64_t const page_size = sysconf(_SC_PAGE_SIZE);
+    uint64_t npages = (length + page_size - 1) / page_size;
+    vector<unsigned char> resident(npages);
+    errif(0 != mincore(addr, length, resident.data()), "Failed mincore on %s", path);
+    uint64_t nresident = 0;
+    for(unsigned char r: resident)
+        nresident += r & 1;
+
+    munmap(addr, length);
+    close(fd);
+    return double(nresident) / npages;
+}
+
+// Scans a file from a cold cache in each page cache mode, reporting what
+// the scan left cached.
+void bench_page_cache(char const *path) {
+    uint64_t const buflen = 64 * 1024;
+    char *buf = (char *)malloc(buflen);
+    uint64_t nbytes = file_size(path);
+
+    cout << path << ": " << nbytes << " bytes" << endl;
+
+    seqio_page_cache modes[] = {SEQIO_PAGE_CACHE_KEEP, SEQIO_PAGE_CACHE_DROP_BEHIND, SEQIO_PAGE_CACHE_BYPASS};
+    char const *mode_names[] = {"keep", "drop_behind", "bypass"};
+
+    uint64_t nbases = 0;
+    for(int i = 0; i < 3; i++) {
+        seqio_sequence_options opts = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+        opts.page_cache = modes[i];
+
+        evict_file(path);
+        double t0 = now_sec();
+        uint64_t n = read_seqio(path, opts, buf, buflen);
+        double t1 = now_sec();
+
+        if(i == 0)
+            nbases = n;
+        errif(n != nbases, "Base count mismatch: keep=%zu, %s=%zu",
+              size_t(nbases), mode_names[i], size_t(n));
+
+        string desc = string(mode_names[i]) + ", " + to_string(int(100 * file_residency(path))) + "% left cached";
+        report(desc.c_str(), nbytes, t1 - t0);
+    }
+
+    free(buf);
+}
+
+// Reads shards from a cold cache one iterator at a time, and with a single
+// iterator that opens each shard while the one before it is read.
+void bench_multi_file(vector<string> const &paths) {
+    uint64_t const buflen = 64 * 1024;
+    char *buf = (char *)malloc(buflen);
+    uint64_t nbytes = 0;
+    vector<char const *> cpaths;
+    for(string const &path: paths) {
+        nbytes += file_size(path.c_str());
+        cpaths.push_back(path.c_str());
+    }
+
+    cout << paths.size() << " files: " << nbytes << " bytes" << endl;
+
+    for(string const &path: paths)
+        evict_file(path.c_str());
+    double t0 = now_sec();
+    uint64_t nserial = 0;
+    for(string const &path: paths)
+        nserial += read_seqio(path.c_str(), SEQIO_DEFAULT_SEQUENCE_OPTIONS, buf, buflen);
+    double t1 = now_sec();
+
+    for(string const &path: paths)
+        evict_file(path.c_str());
+    double t2 = now_sec();
+    uint64_t nmulti = 0;
+    {
+        seqio_sequence_iterator iterator;
+        seqio_sequence sequence;
+        seqio_create_multi_sequence_iterator(cpaths.data(), cpaths.size(), SEQIO_DEFAULT_SEQUENCE_OPTIONS, &iterator);
+        while( (0 == seqio_next_sequence(iterator, &sequence)) && sequence) {
+            uint64_t n;
+            while( (0 == seqio_read(sequence, buf, buflen, &n)) && n ) {
+                nmulti += n;
+            }
+            seqio_dispose_sequence(&sequence);
+        }
+        seqio_dispose_sequence_iterator(&iterator);
+    }
+    double t3 = now_sec();
+
+    errif(nserial != nmulti, "Base count mismatch: serial=%zu, multi=%zu",
+          size_t(nserial), size_t(nmulti));
+
+    report("iterator per file", nbytes, t1 - t0);
+    report("multi-file iterator", nbytes, t3 - t2);
+
+    free(buf);
+}
+
+// Reads random regions of up to 1000 bases, opening the sequence for each
+// as a server handling independent requests would.
+void bench_region_qps(char const *fasta_path, char const *pna_path) {
+    uint32_t const nqueries = 100000;
+    uint32_t const max_region = 1000;
+    char buf[max_region];
+
+    seqio_io_engine engines[] = {SEQIO_IO_ENGINE_DEFAULT, SEQIO_IO_ENGINE_PREAD, SEQIO_IO_ENGINE_URING};
+    char const *engine_names[] = {"default", "pread", "io_uring"};
+
+    struct query_t {
+        uint64_t sequence;
+        uint64_t offset;
+        uint64_t length;
+    };
+    vector<query_t> queries;
+    vector<string> names;
+    {
+        seqio::pna::PnaReader reader(pna_path);
+        std::mt19937_64 rng(1);
+        for(uint64_t i = 0; i < reader.getSequenceCount(); i++) {
+            names.push_back(reader.getSequenceMetadata(i).value(SEQIO_KEY_NAME));
+        }
+        for(uint32_t i = 0; i < nqueries; i++) {
+            query_t q;
+            q.sequence = rng() % reader.getSequenceCount();
+            uint64_t seqlen = reader.openSequence(q.sequence)->size();
+            q.length = 1 + rng() % max_region;
+            q.offset = rng() % (seqlen - q.length);
+            queries.push_back(q);
+        }
+    }
+
+    cout << nqueries << " regions of 1.." << max_region << " bases" << endl;
+
+    for(int i = 0; i < 3; i++) {
+        cout << " io_engine=" << engine_names[i] << endl;
+
+        {
+            seqio_sequence_options opts = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+            opts.index_mode = SEQIO_INDEX_BUILD;
+            opts.io_engine = engines[i];
+            seqio_sequence_iterator iterator;
+            seqio_create_sequence_iterator(fasta_path, opts, &iterator);
+
+            double t0 = now_sec();
+            for(query_t const &q: queries) {
+                seqio_sequence sequence;
+                seqio_open_sequence(iterator, names[q.sequence].c_str(), &sequence);
+                uint64_t n;
+                seqio_read_region(sequence, q.offset, q.length, buf, &n);
+                errif(n != q.length, "Short read");
+                seqio_dispose_sequence(&sequence);
+            }
+            double t1 = now_sec();
+            seqio_dispose_sequence_iterator(&iterator);
+
+            printf("  %-32s %8.3f s  %9.0f QPS\n", "fasta (.fai)", t1 - t0, nqueries / (t1 - t0));
+        }
+
+        {
+            seqio::pna::PnaReader reader(pna_path, nullptr, engines[i]);
+
+            double t0 = now_sec();
+            for(query_t const &q: queries) {
+                shared_ptr<seqio::pna::PnaSequenceReader> sequence = reader.openSequence(q.sequence);
+                sequence->seek(q.offset);
+                errif(q.length != sequence->read(buf, q.length), "Short read");
+            }
+            double t1 = now_sec();
+
+            printf("  %-32s %8.3f s  %9.0f QPS\n", "pna", t1 - t0, nqueries / (t1 - t0));
+        }
+    }
+}
+
+// Random regions read by threads sharing one PnaReader, each opening its own
+// sequence readers.
+void bench_pna_threads(char const *path, uint32_t max_threads) {
+    uint32_t const nqueries = 400000;
+    uint32_t const max_region = 1000;
+
+    struct query_t {
+        uint64_t sequence;
+        uint64_t offset;
+        uint64_t length;
+    };
+    vector<query_t> queries;
+    {
+        seqio::pna::PnaReader reader(path);
+        std::mt19937_64 rng(1);
+        for(uint32_t i = 0; i < nqueries; i++) {
+            query_t q;
+            q.sequence = rng() % reader.getSequenceCount();
+            uint64_t seqlen = reader.getSequenceLength(q.sequence);
+            q.length = 1 + rng() % max_region;
+            q.offset = rng() % (seqlen - q.length);
+            queries.push_back(q);
+        }
+    }
+
+    cout << nqueries << " regions of 1.." << max_region << " bases" << endl;
+
+    seqio_io_engine engines[] = {SEQIO_IO_ENGINE_DEFAULT, SEQIO_IO_ENGINE_PREAD};
+    char const *engine_names[] = {"default", "pread"};
+    for(int i = 0; i < 2; i++) {
+        cout << " io_engine=" << engine_names[i] << endl;
+
+        seqio::pna::PnaReader reader(path, nullptr, engines[i]);
+        double qps1 = 0;
+        for(uint32_t nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+            double t0 = now_sec();
+            vector<thread> threads;
+            for(uint32_t t = 0; t < nthreads; t++) {
+                threads.emplace_back([&reader, &queries, nthreads, t] () {
+                    char buf[max_region];
+                    for(uint64_t j = t; j < queries.size(); j += nthreads) {
+                        query_t const &q = queries[j];
+                        shared_ptr<seqio::pna::PnaSequenceReader> sequence = reader.openSequence(q.sequence);
+                        sequence->seek(q.offset);
+                        errif(q.length != sequence->read(buf, q.length), "Short read");
+                    }
+                });
+            }
+            for(thread &t: threads) {
+                t.join();
+            }
+            double t1 = now_sec();
+
+            double qps = nqueries / (t1 - t0);
+            if(nthreads == 1)
+                qps1 = qps;
+            string desc = to_string(nthreads) + " threads";
+            printf("  %-32s %8.3f s  %9.0f QPS  %5.1fx\n", desc.c_str(), t1 - t0, qps, qps / qps1);
+        }
+    }
+}
+
+void bench_fastq_read(char const *path) {
+    uint64_t const buflen = 64 * 1024;
+    char *buf = (char *)malloc(buflen);
+    uint64_t nbytes = file_size(path);
+
+    cout << path << ": " << nbytes << " bytes" << endl;
+
+    double t0 = now_sec();
+    uint64_t nkseq = 0;
+    {
+        gzFile fp = gzopen(path, "r");
+        kseq_t *kseq = kseq_init(fp);
+        while(kseq_read(kseq) >= 0) {
+            nkseq += kseq->seq.l + kseq->qual.l;
+        }
+        kseq_destroy(kseq);
+        gzclose(fp);
+    }
+    double t1 = now_sec();
+    uint64_t nseqio = 0;
+    {
+        seqio_sequence_iterator iterator;
+        seqio_sequence sequence;
+        seqio_create_sequence_iterator(path, SEQIO_DEFAULT_SEQUENCE_OPTIONS, &iterator);
+        while( (0 == seqio_next_sequence(iterator, &sequence)) && sequence) {
+            char const *quality;
+            uint64_t n;
+            seqio_get_quality(sequence, &quality, &n);
+            nseqio += n;
+            while( (0 == seqio_read(sequence, buf, buflen, &n)) && n ) {
+                nseqio += n;
+            }
+            seqio_dispose_sequence(&sequence);
+        }
+        seqio_dispose_sequence_iterator(&iterator);
+    }
+    double t2 = now_sec();
+    uint64_t nbatch = 0;
+    uint64_t nrecords = 0;
+    {
+        seqio_sequence_iterator iterator;
+        seqio_batch batch = SEQIO_EMPTY_BATCH;
+        seqio_create_sequence_iterator(path, SEQIO_DEFAULT_SEQUENCE_OPTIONS, &iterator);
+        while( (0 == seqio_next_batch(iterator, 1024, &batch)) && batch.count ) {
+            for(uint64_t i = 0; i < batch.count; i++) {
+                nbatch += batch.bases[i].length + batch.qualities[i].length;
+            }
+            nrecords += batch.count;
+        }
+        seqio_dispose_batch(&batch);
+        seqio_dispose_sequence_iterator(&iterator);
+    }
+    double t3 = now_sec();
+
+    errif(nkseq != nseqio, "Base count mismatch: kseq=%zu, seqio=%zu",
+          size_t(nkseq), size_t(nseqio));
+    errif(nkseq != nbatch, "Base count mismatch: kseq=%zu, seqio batch=%zu",
+          size_t(nkseq), size_t(nbatch));
+
+    report("kseq", nbytes, t1 - t0);
+    report("seqio", nbytes, t2 - t1);
+    report("seqio batch", nbytes, t3 - t2);
+    printf("  %zu records; per-record time: sequence %.1f ns, batch %.1f ns\n",
+           size_t(nrecords), (t2 - t1) * 1e9 / nrecords, (t3 - t2) * 1e9 / nrecords);
+
+    free(buf);
+}
+
+// Builds a table of contents (names and lengths) by reading every record
+// in full, and by scanning for headers with and without lengths.
+void bench_scan(char const *path) {
+    uint64_t nbytes = file_size(path);
+    cout << path << ": " << nbytes << " bytes" << endl;
+
+    seqio_scan_mode modes[] = {SEQIO_SCAN_BASES, SEQIO_SCAN_LENGTHS, SEQIO_SCAN_HEADERS};
+    char const *mode_names[] = {"bases", "lengths", "headers"};
+
+    uint64_t nrecords = 0, nbases = 0;
+    for(int i = 0; i < 3; i++) {
+        seqio_sequence_options opts = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+        opts.scan_mode = modes[i];
+
+        double t0 = now_sec();
+        seqio_sequence_iterator iterator;
+        seqio_create_sequence_iterator(path, opts, &iterator);
+        seqio_batch batch = SEQIO_EMPTY_BATCH;
+        uint64_t n = 0, length = 0;
+        while( (0 == seqio_next_batch(iterator, 1024, &batch)) && batch.count ) {
+            n += batch.count;
+            for(uint64_t j = 0; j < batch.count; j++)
+                length += batch.lengths[j];
+        }
+        seqio_dispose_batch(&batch);
+        seqio_dispose_sequence_iterator(&iterator);
+        double t1 = now_sec();
+
+        if(i == 0) {
+            nrecords = n;
+            nbases = length;
+        }
+        errif(n != nrecords, "Record count mismatch: %zu, %s=%zu", size_t(nrecords), mode_names[i], size_t(n));
+        errif((modes[i] == SEQIO_SCAN_LENGTHS) && (length != nbases),
+              "Base count mismatch: %zu, %s=%zu", size_t(nbases), mode_names[i], size_t(length));
+        report(mode_names[i], nbytes, t1 - t0);
+    }
+}
+
+void bench_transform(uint64_t size_mb) {
+    uint64_t const len = size_mb * 1024 * 1024;
+    char *src = (char *)malloc(len);
+    char *dst = (char *)malloc(len);
+    char const bases[] = "ACGTacgtN";
+    uint32_t x = 1;
+    for(uint64_t i = 0; i < len; i++) {
+        x = x * 1103515245 + 12345;
+        src[i] = bases[(x >> 16) % 9];
+    }
+    // Fault in the destination so it isn't charged to the first kernel.
+    memset(dst, 0, len);
+
+    string const isa = simd_isa();
+    char const *isas[] = {"scalar", "sse4.1", "avx2", "avx512bw"};
+    cout << "caps_gatcn transform of " << len << " bytes" << endl;
+    for(char const *name: isas) {
+        if(!set_simd_isa(name))
+            continue;
+
+        double t0 = now_sec();
+        seqio_transform(SEQIO_BASE_TRANSFORM_CAPS_GATCN, src, len, dst);
+        double t1 = now_sec();
+        report(name, len, t1 - t0);
+    }
+    set_simd_isa(isa.c_str());
+
+    free(src);
+    free(dst);
+}
+
+// Reading the reverse complement with the strand option, against reading
+// each sequence forward and reverse complementing it in a second pass.
+void bench_revcomp(char const *path) {
+    cout << path << ": " << file_size(path) << " bytes" << endl;
+
+    seqio_sequence_options opts = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    opts.base_transform = SEQIO_BASE_TRANSFORM_CAPS_GATCN;
+
+    double t0 = now_sec();
+    uint64_t ntwopass = 0;
+    {
+        char complements[256];
+        for(int c = 0; c < 256; c++)
+            complements[c] = 'N';
+        complements[int('A')] = 'T';
+        complements[int('C')] = 'G';
+        complements[int('G')] = 'C';
+        complements[int('T')] = 'A';
+
+        seqio_sequence_iterator iterator;
+        seqio_sequence sequence;
+        char *buf = nullptr;
+        uint64_t buflen;
+        seqio_create_sequence_iterator(path, opts, &iterator);
+        while( (0 == seqio_next_sequence(iterator, &sequence)) && sequence) {
+            uint64_t n;
+            seqio_read_all(sequence, &buf, &buflen, &n);
+            for(uint64_t i = 0, j = n; i < j; i++, j--) {
+                char front = buf[i];
+                buf[i] = complements[uint8_t(buf[j - 1])];
+                buf[j - 1] = complements[uint8_t(front)];
+            }
+            ntwopass += n;
+            seqio_dispose_sequence(&sequence);
+        }
+        seqio_dispose_buffer(&buf);
+        seqio_dispose_sequence_iterator(&iterator);
+    }
+    double t1 = now_sec();
+
+    uint64_t const buflen = 64 * 1024;
+    char *buf = (char *)malloc(buflen);
+    opts.strand = SEQIO_STRAND_REVERSE_COMPLEMENT;
+    uint64_t nstrand = read_seqio(path, opts, buf, buflen);
+    double t2 = now_sec();
+    free(buf);
+
+    errif(ntwopass != nstrand, "Base count mismatch: two-pass=%zu, strand=%zu",
+          size_t(ntwopass), size_t(nstrand));
+
+    report("read, then reverse complement", ntwopass, t1 - t0);
+    report("strand=reverse_complement", nstrand, t2 - t1);
+}
+
+// Unpacking whole chromosomes from a PNA file in the page cache, with each
+// instruction set, forward and reverse complemented.
+void bench_pna_unpack(char const *path) {
+    cout << path << ": " << file_size(path) << " bytes" << endl;
+
+    uint64_t const buflen = 1024 * 1024;
+    char *buf = (char *)malloc(buflen);
+    seqio_sequence_options opts = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    read_seqio(path, opts, buf, buflen);
+
+    string const isa = simd_isa();
+    char const *isas[] = {"scalar", "sse4.1", "avx2"};
+    for(char const *name: isas) {
+        if(!set_simd_isa(name))
+            continue;
+
+        for(seqio_strand strand: {SEQIO_STRAND_FORWARD, SEQIO_STRAND_REVERSE_COMPLEMENT}) {
+            opts.strand = strand;
+            double t0 = now_sec();
+            uint64_t n = read_seqio(path, opts, buf, buflen);
+            double t1 = now_sec();
+            string desc = string(name) + (strand == SEQIO_STRAND_FORWARD ? " forward" : " reverse complement");
+            report(desc.c_str(), n, t1 - t0);
+        }
+    }
+    set_simd_isa(isa.c_str());
+
+    free(buf);
+}
+
+int main(int argc, const char **argv) {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_EXIT);
+
+    if(argc < 2) {
+        usage();
+    }
+
+    int argi = 1;
+    string mode = argv[argi++];
+
+    uint64_t size_mb = 256;
+    uint32_t max_threads = 8;
+    string path;
+    for(; argi < argc; argi++) {
+        string flag = argv[argi];
+        if(flag == "--size") {
+            if(++argi == argc) usage("Missing --size arg");
+            size_mb = uint64_t(atol(argv[argi]));
+        } else if(flag == "--path") {
+            if(++argi == argc) usage("Missing --path arg");
+            path = argv[argi];
+        } else if(flag == "--threads") {
+            if(++argi == argc) usage("Missing --threads arg");
+            max_threads = uint32_t(atol(argv[argi]));
+        } else {
+            usage("Invalid flag: " + flag);
+        }
+    }
+
+    if(mode == "fasta_read") {
+        if(path.empty()) {
+            path = "/tmp/seqio_bench.fa";
+            create_fasta(path.c_str(), size_mb);
+        }
+        bench_fasta_read(path.c_str());
+    } else if(mode == "bgzf_read") {
+        if(path.empty()) {
+            path = "/tmp/seqio_bench.fa.gz";
+            create_fasta(path.c_str(), size_mb);
+        }
+        bench_bgzf_read(path.c_str(), max_threads);
+    } else if(mode == "fasta_parallel") {
+        if(path.empty()) {
+            path = "/tmp/seqio_bench_parallel.fa";
+            create_fasta(path.c_str(), size_mb, 100 * 1000);
+        }
+        bench_fasta_parallel(path.c_str(), max_threads);
+    } else if(mode == "gzip_read") {
+        if(path.empty()) {
+            // Our writer produces BGZF; plain gzip has to come from gzip.
+            create_fasta("/tmp/seqio_bench_gzip.fa", size_mb);
+            path = "/tmp/seqio_bench_gzip.fa.gz";
+            errif(0 != system(("gzip -c /tmp/seqio_bench_gzip.fa > " + path).c_str()), "Failed compressing %s", path.c_str());
+        }
+        bench_gzip_read(path.c_str());
+    } else if(mode == "region_qps") {
+        // Without Ns, which would make a PNA fragment table far larger than
+        // a genome's, and opening a sequence correspondingly slower.
+        create_fasta("/tmp/seqio_bench_qps.fa", size_mb, 32 * 1024 * 1024, "ACGT");
+        create_fasta("/tmp/seqio_bench_qps.pna", size_mb, 32 * 1024 * 1024, "ACGT");
+        unlink("/tmp/seqio_bench_qps.fa.fai");
+        bench_region_qps("/tmp/seqio_bench_qps.fa", "/tmp/seqio_bench_qps.pna");
+    } else if(mode == "pna_threads") {
+        // Without Ns, as for region_qps.
+        create_fasta("/tmp/seqio_bench_qps.pna", size_mb, 32 * 1024 * 1024, "ACGT");
+        bench_pna_threads("/tmp/seqio_bench_qps.pna", max_threads);
+    } else if(mode == "page_cache") {
+        create_fasta("/tmp/seqio_bench_cache.fa", size_mb);
+        create_fasta("/tmp/seqio_bench_cache.pna", size_mb);
+        create_fasta("/tmp/seqio_bench_cache.fa.gz", size_mb);
+        bench_page_cache("/tmp/seqio_bench_cache.fa");
+        bench_page_cache("/tmp/seqio_bench_cache.pna");
+        bench_page_cache("/tmp/seqio_bench_cache.fa.gz");
+    } else if(mode == "multi_file") {
+        // Shards of a few MB, in both formats. Without Ns, as for region_qps.
+        vector<string> paths;
+        uint64_t const nshards = 64;
+        for(uint64_t i = 0; i < nshards; i++) {
+            string path = "/tmp/seqio_bench_shard" + to_string(i) + ((i % 2) ? ".pna" : ".fa");
+            create_fasta(path.c_str(), std::max(size_mb / nshards, uint64_t(1)), 1024 * 1024, "ACGT");
+            paths.push_back(path);
+        }
+        bench_multi_file(paths);
+    } else if(mode == "fastq_read") {
+        if(path.empty()) {
+            path = "/tmp/seqio_bench.fq";
+            create_fastq(path.c_str(), size_mb);
+        }
+        bench_fastq_read(path.c_str());
+        string gzpath = path + ".gz";
+        errif(0 != system(("gzip -c " + path + " > " + gzpath).c_str()), "Failed compressing %s", path.c_str());
+        bench_fastq_read(gzpath.c_str());
+    } else if(mode == "scan") {
+        if(path.empty()) {
+            // Many short contigs, as in an assembly.
+            path = "/tmp/seqio_bench_scan.fa";
+            create_fasta(path.c_str(), size_mb, 4 * 1024);
+        }
+        bench_scan(path.c_str());
+    } else if(mode == "transform") {
+        bench_transform(size_mb);
+    } else if(mode == "revcomp") {
+        create_fasta("/tmp/seqio_bench_rc.fa", size_mb);
+        create_fasta("/tmp/seqio_bench_rc.pna", size_mb);
+        bench_revcomp("/tmp/seqio_bench_rc.fa");
+        bench_revcomp("/tmp/seqio_bench_rc.pna");
+    } else if(mode == "pna_unpack") {
+        // Chromosome-sized sequences without Ns, so that nearly all the time
+        // is spent unpacking.
+        create_fasta("/tmp/seqio_bench_unpack.pna", size_mb, 64 * 1024 * 1024, "ACGT");
+        bench_pna_unpack("/tmp/seqio_bench_unpack.pna");
+    } else {
+        usage("Invalid mode: " + mode);
+    }
+
+    return 0;
+}
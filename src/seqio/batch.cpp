@@ -0,0 +1,123 @@
+#include "batch.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace seqio::impl;
+
+#define INITIAL_RECORDS_CAPACITY 64
+#define INITIAL_ARENA_CAPACITY (64 * 1024)
+#define READ_LENGTH (64 * 1024)
+
+template<typename T>
+static void grow(T **array, uint64_t capacity) {
+    T *array_ = (T *)realloc(*array, capacity * sizeof(T));
+    if(array_ == nullptr)
+        raise_oom("Cannot allocate %zu bytes", size_t(capacity * sizeof(T)));
+    *array = array_;
+}
+
+/**********************************************************************
+ *
+ * CLASS BatchBuilder
+ *
+ **********************************************************************/
+BatchBuilder::BatchBuilder(seqio_batch *batch_)
+    : batch(batch_) {
+
+    batch->count = 0;
+    batch->arena_length = 0;
+}
+
+uint64_t BatchBuilder::getCount() {
+    return batch->count;
+}
+
+uint64_t BatchBuilder::addRecord() {
+    if(batch->count == batch->records_capacity) {
+        uint64_t capacity = batch->records_capacity
+            ? batch->records_capacity * 2
+            : INITIAL_RECORDS_CAPACITY;
+        grow(&batch->names, capacity);
+        grow(&batch->comments, capacity);
+        grow(&batch->bases, capacity);
+        grow(&batch->qualities, capacity);
+        grow(&batch->lengths, capacity);
+        batch->records_capacity = capacity;
+    }
+
+    uint64_t i = batch->count++;
+    batch->names[i] = batch->comments[i] = batch->bases[i] = batch->qualities[i] = {0, 0};
+    batch->lengths[i] = 0;
+    return i;
+}
+
+void BatchBuilder::dropRecord() {
+    uint64_t i = --batch->count;
+    batch->arena_length = batch->names[i].offset;
+}
+
+seqio_span BatchBuilder::append(char const *data, uint64_t length) {
+    uint64_t start = tell();
+    memcpy(reserve(length), data, length);
+    extend(length);
+    return finish(start);
+}
+
+uint64_t BatchBuilder::tell() {
+    return batch->arena_length;
+}
+
+char *BatchBuilder::reserve(uint64_t length) {
+    // Leave room for the null that finish() appends.
+    uint64_t needed = batch->arena_length + length + 1;
+    if(needed > batch->arena_capacity) {
+        uint64_t capacity = batch->arena_capacity ? batch->arena_capacity : INITIAL_ARENA_CAPACITY;
+        while(capacity < needed)
+            capacity *= 2;
+        grow(&batch->arena, capacity);
+        batch->arena_capacity = capacity;
+    }
+
+    return batch->arena + batch->arena_length;
+}
+
+void BatchBuilder::extend(uint64_t length) {
+    batch->arena_length += length;
+}
+
+seqio_span BatchBuilder::finish(uint64_t start) {
+    reserve(0);
+    batch->arena[batch->arena_length++] = '\0';
+    return {start, batch->arena_length - 1 - start};
+}
+
+void BatchBuilder::appendSequence(ISequence *sequence,
+                                  seqio_scan_mode scanMode) {
+    uint64_t i = addRecord();
+
+    IConstDictionary const &metadata = sequence->getMetadata();
+    char const *name = metadata.getValue(SEQIO_KEY_NAME);
+    batch->names[i] = append(name, strlen(name));
+    if(metadata.hasKey(SEQIO_KEY_COMMENT)) {
+        char const *comment = metadata.getValue(SEQIO_KEY_COMMENT);
+        batch->comments[i] = append(comment, strlen(comment));
+    }
+
+    uint64_t start = tell();
+    uint64_t n;
+    while( (n = sequence->read(reserve(READ_LENGTH), READ_LENGTH)) != 0 ) {
+        extend(n);
+    }
+    batch->bases[i] = finish(start);
+    if(scanMode == SEQIO_SCAN_BASES)
+        batch->lengths[i] = batch->bases[i].length;
+    else if(scanMode == SEQIO_SCAN_LENGTHS)
+        batch->lengths[i] = sequence->getLength();
+
+    if(sequence->hasQuality()) {
+        uint64_t length;
+        char const *quality = sequence->getQuality(&length);
+        batch->qualities[i] = append(quality, length);
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "seqio_impl.hpp"
+
+#include <stdint.h>
+
+namespace seqio {
+    namespace impl {
+
+/**********************************************************************
+ *
+ * CLASS BatchBuilder
+ *
+ * Fills a client's seqio_batch, growing its allocations as needed.
+ * Fields are appended to the arena one after another, so a record's
+ * fields must be written in turn rather than interleaved.
+ *
+ **********************************************************************/
+        class BatchBuilder {
+        public:
+            BatchBuilder(seqio_batch *batch_);
+
+            uint64_t getCount();
+
+            // Adds a record with empty fields, returning its index.
+            uint64_t addRecord();
+            // Removes the last record added, along with its fields, which
+            // must begin with its name.
+            void dropRecord();
+
+            // Appends a null-terminated copy of a field.
+            seqio_span append(char const *data, uint64_t length);
+
+            // For fields whose length isn't known in advance: reserve() room
+            // at the end of the arena, fill some of it and extend() by that
+            // much, then finish() the field begun at offset start.
+            uint64_t tell();
+            char *reserve(uint64_t length);
+            void extend(uint64_t length);
+            seqio_span finish(uint64_t start);
+
+            // Appends a record read from a sequence, including its bases and
+            // qualities. A sequence found by a scan has no bases to read, so
+            // with SEQIO_SCAN_LENGTHS its length is the one the scan counted.
+            void appendSequence(ISequence *sequence,
+                                seqio_scan_mode scanMode = SEQIO_SCAN_BASES);
+
+            seqio_batch * const batch;
+        };
+
+    }
+}
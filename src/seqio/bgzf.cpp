@@ -0,0 +1,592 @@
+#include "bgzf.hpp"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+using std::shared_ptr;
+using std::string;
+using namespace seqio::impl;
+
+// gzip header fields preceding the extra subfields.
+#define GZIP_HEADER_LENGTH 12
+// Trailing CRC32 and ISIZE.
+#define GZIP_FOOTER_LENGTH 8
+#define BGZF_READBUF_CAPACITY (1024 * 1024)
+
+static inline uint16_t get_le16(uint8_t const *p) {
+    return uint16_t(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t get_le32(uint8_t const *p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+static inline uint64_t get_le64(uint8_t const *p) {
+    return uint64_t(get_le32(p)) | (uint64_t(get_le32(p + 4)) << 32);
+}
+
+static inline void put_le16(uint8_t *p, uint16_t x) {
+    p[0] = uint8_t(x);
+    p[1] = uint8_t(x >> 8);
+}
+
+static inline void put_le32(uint8_t *p, uint32_t x) {
+    put_le16(p, uint16_t(x));
+    put_le16(p + 2, uint16_t(x >> 16));
+}
+
+static inline void put_le64(uint8_t *p, uint64_t x) {
+    put_le32(p, uint32_t(x));
+    put_le32(p + 4, uint32_t(x >> 32));
+}
+
+// Returns the total size of the block whose header is at p, or 0 if p
+// isn't a BGZF block header. avail must be at least GZIP_HEADER_LENGTH.
+static uint32_t parse_block_size(uint8_t const *p, uint32_t avail, uint32_t *header_length) {
+    if((p[0] != 31) || (p[1] != 139) || (p[2] != 8) || !(p[3] & 4))
+        return 0;
+
+    uint16_t xlen = get_le16(p + 10);
+    *header_length = GZIP_HEADER_LENGTH + xlen;
+    if(avail < *header_length)
+        return 0;
+
+    // Find the BC subfield
+    for(uint8_t const *sub = p + GZIP_HEADER_LENGTH; sub + 4 <= p + *header_length; ) {
+        uint16_t slen = get_le16(sub + 2);
+        if((sub[0] == 'B') && (sub[1] == 'C') && (slen == 2) && (sub + 6 <= p + *header_length)) {
+            return uint32_t(get_le16(sub + 4)) + 1;
+        }
+        sub += 4 + slen;
+    }
+
+    return 0;
+}
+
+namespace seqio {
+    namespace impl {
+
+        bool is_bgzf_file_content(char const *path, seqio_io_backend const *backend) {
+            uint8_t header[GZIP_HEADER_LENGTH + 64];
+            uint32_t header_length;
+            uint64_t n;
+
+            try {
+                n = File::open(backend, path)->pread(header, sizeof(header), 0);
+            } catch(Exception &) {
+                return false;
+            }
+
+            return (n >= GZIP_HEADER_LENGTH) && (0 != parse_block_size(header, n, &header_length));
+        }
+
+    }
+}
+
+/**********************************************************************
+ *
+ * CLASS BgzfIndex
+ *
+ **********************************************************************/
+BgzfIndex::BgzfIndex(char const *bgzf_path, seqio_io_backend const *backend_)
+    : path(bgzf_path)
+    , backend(backend_ ? *backend_ : SEQIO_FILE_IO_BACKEND) {
+}
+
+string BgzfIndex::getIndexPath(char const *bgzf_path) {
+    return string(bgzf_path) + ".gzi";
+}
+
+shared_ptr<BgzfIndex> BgzfIndex::open(char const *bgzf_path,
+                                      seqio_io_backend const *backend,
+                                      seqio_index_mode mode) {
+    shared_ptr<BgzfIndex> index = std::make_shared<BgzfIndex>(bgzf_path, backend);
+    if((mode == SEQIO_INDEX_NONE) || !is_file_backend(backend))
+        return index;
+
+    string index_path = getIndexPath(bgzf_path);
+    struct stat bgzf_stat, index_stat;
+    bool exists = (0 == stat(index_path.c_str(), &index_stat));
+    bool stale = exists
+        && (0 == stat(bgzf_path, &bgzf_stat))
+        && (index_stat.st_mtime < bgzf_stat.st_mtime);
+
+    if(exists && !(stale && (mode == SEQIO_INDEX_BUILD))) {
+        index->load(index_path.c_str());
+    } else if(mode == SEQIO_INDEX_BUILD) {
+        try {
+            index->save(index_path.c_str());
+        } catch(Exception x) {
+            // The index is still usable even if it can't be saved.
+        }
+    }
+
+    return index;
+}
+
+void BgzfIndex::load(char const *index_path) {
+    FILE *f = fopen(index_path, "r");
+    if(!f)
+        raise_io("Failed opening %s", index_path);
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    uint8_t buf[16];
+    if(1 != fread(buf, 8, 1, f)) {
+        fclose(f);
+        raise_io("Failed reading %s", index_path);
+    }
+    uint64_t n = get_le64(buf);
+
+    // The first block is implicit.
+    blocks.clear();
+    blocks.push_back({0, 0});
+    for(uint64_t i = 0; i < n; i++) {
+        if(1 != fread(buf, 16, 1, f)) {
+            fclose(f);
+            raise_io("Failed reading %s", index_path);
+        }
+        blocks.push_back({get_le64(buf), get_le64(buf + 8)});
+    }
+    fclose(f);
+
+    built = true;
+}
+
+void BgzfIndex::save(char const *index_path) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if(!built)
+            build();
+    }
+
+    FILE *f = fopen(index_path, "w");
+    if(!f)
+        raise_io("Failed opening %s", index_path);
+
+    uint8_t buf[16];
+    put_le64(buf, blocks.size() - 1);
+    bool ok = (1 == fwrite(buf, 8, 1, f));
+    for(size_t i = 1; ok && (i < blocks.size()); i++) {
+        put_le64(buf, blocks[i].coffset);
+        put_le64(buf + 8, blocks[i].uoffset);
+        ok = (1 == fwrite(buf, 16, 1, f));
+    }
+
+    if((0 != fclose(f)) || !ok)
+        raise_io("Failed writing %s", index_path);
+}
+
+void BgzfIndex::find(uint64_t offset,
+                     uint64_t *block_coffset,
+                     uint64_t *block_uoffset) {
+    std::lock_guard<std::mutex> guard(lock);
+    if(!built)
+        build();
+
+    struct local {
+        static bool comp(uint64_t offset, Block const &block) {
+            return offset < block.uoffset;
+        }
+    };
+    auto it = std::upper_bound(blocks.begin(), blocks.end(), offset, local::comp) - 1;
+
+    *block_coffset = it->coffset;
+    *block_uoffset = it->uoffset;
+}
+
+void BgzfIndex::build() {
+    BgzfBlockReader reader(File::open(&backend, path.c_str()));
+    uint8_t const *block;
+    uint32_t block_length;
+    uint32_t header_length;
+    uint64_t coffset = 0;
+    uint64_t uoffset = 0;
+
+    blocks.clear();
+    blocks.push_back({0, 0});
+    while(reader.read(coffset, &block, &block_length, &header_length)) {
+        uint32_t isize = BgzfBlockReader::getUncompressedLength(block, block_length);
+        coffset += block_length;
+        uoffset += isize;
+        if(isize) {
+            blocks.push_back({coffset, uoffset});
+        }
+    }
+    // The last entry is the end of the file, not a block.
+    if(blocks.size() > 1)
+        blocks.pop_back();
+
+    built = true;
+}
+
+/**********************************************************************
+ *
+ * CLASS BgzfBlockReader
+ *
+ **********************************************************************/
+BgzfBlockReader::BgzfBlockReader(shared_ptr<File> file_, bool drop_behind)
+    : file(file_)
+    , dropBehind(drop_behind && (file_->getFd() >= 0)) {
+
+    buf.data.resize(BGZF_READBUF_CAPACITY);
+}
+
+BgzfBlockReader::~BgzfBlockReader() {
+}
+
+bool BgzfBlockReader::read(uint64_t coffset,
+                           uint8_t const **block,
+                           uint32_t *block_length,
+                           uint32_t *header_length) {
+    uint64_t avail = load(coffset, GZIP_HEADER_LENGTH);
+    if(avail == 0)
+        return false;
+
+    uint8_t const *p = buf.data.data() + (coffset - buf.offset);
+    if(avail >= GZIP_HEADER_LENGTH)
+        avail = load(coffset, GZIP_HEADER_LENGTH + get_le16(p + 10));
+    p = buf.data.data() + (coffset - buf.offset);
+
+    *block_length = (avail >= GZIP_HEADER_LENGTH) ? parse_block_size(p, avail, header_length) : 0;
+    if(*block_length == 0)
+        raise_io("Invalid BGZF block at offset %zu of %s", size_t(coffset), file->getPath());
+
+    if(load(coffset, *block_length) < *block_length)
+        raise_io("Truncated BGZF block at offset %zu of %s", size_t(coffset), file->getPath());
+
+    *block = buf.data.data() + (coffset - buf.offset);
+    return true;
+}
+
+uint32_t BgzfBlockReader::getUncompressedLength(uint8_t const *block,
+                                                uint32_t block_length) {
+    return get_le32(block + block_length - 4);
+}
+
+// Ensures [offset, offset + length) is buffered, reading from offset if
+// it isn't. Returns the number of bytes available from offset, which is
+// less than length only at end of file.
+uint64_t BgzfBlockReader::load(uint64_t offset, uint32_t length) {
+    if((offset >= buf.offset) && ((offset + length) <= (buf.offset + buf.len)))
+        return buf.offset + buf.len - offset;
+
+    uint64_t n = file->pread(buf.data.data(), buf.data.size(), offset);
+    if(dropBehind)
+        drop_cached(file->getFd(), offset, n);
+
+    buf.offset = offset;
+    buf.len = n;
+    return n;
+}
+
+/**********************************************************************
+ *
+ * CLASS BgzfInflater
+ *
+ **********************************************************************/
+BgzfInflater::BgzfInflater() {
+    memset(&zs, 0, sizeof(zs));
+    if(Z_OK != inflateInit2(&zs, -15))
+        raise_oom("Failed initializing inflate");
+}
+
+BgzfInflater::~BgzfInflater() {
+    inflateEnd(&zs);
+}
+
+uint32_t BgzfInflater::inflate(uint8_t const *block,
+                               uint32_t block_length,
+                               uint32_t header_length,
+                               char *out) {
+    uint32_t isize = BgzfBlockReader::getUncompressedLength(block, block_length);
+    uint32_t crc = get_le32(block + block_length - GZIP_FOOTER_LENGTH);
+    if(isize > BGZF_MAX_BLOCK_SIZE)
+        raise_io("Invalid BGZF block size: %zu", size_t(isize));
+
+    if(Z_OK != inflateReset(&zs))
+        raise_io("Failed resetting inflate");
+
+    zs.next_in = (Bytef *)block + header_length;
+    zs.avail_in = block_length - header_length - GZIP_FOOTER_LENGTH;
+    zs.next_out = (Bytef *)out;
+    zs.avail_out = BGZF_MAX_BLOCK_SIZE;
+
+    int rc = ::inflate(&zs, Z_FINISH);
+    if((rc != Z_STREAM_END) || (zs.total_out != isize))
+        raise_io("Failed inflating BGZF block");
+
+    if(crc != crc32(crc32(0L, Z_NULL, 0), (Bytef const *)out, isize))
+        raise_io("BGZF block CRC mismatch");
+
+    return isize;
+}
+
+/**********************************************************************
+ *
+ * CLASS BgzfSource
+ *
+ **********************************************************************/
+BgzfSource::BgzfSource(shared_ptr<File> file,
+                       shared_ptr<BgzfIndex> index_,
+                       bool drop_behind)
+    : reader(file, drop_behind)
+    , index(index_) {
+}
+
+BgzfSource::~BgzfSource() {
+}
+
+bool BgzfSource::next(char const **data, uint64_t *length) {
+    uint8_t const *block;
+    uint32_t block_length;
+    uint32_t header_length;
+
+    while(reader.read(coffset, &block, &block_length, &header_length)) {
+        coffset += block_length;
+
+        uint32_t isize = BgzfBlockReader::getUncompressedLength(block, block_length);
+        if(skip >= isize) {
+            // Nothing wanted from this block, so don't bother inflating it.
+            skip -= isize;
+            continue;
+        }
+
+        inflater.inflate(block, block_length, header_length, buf);
+        *data = buf + skip;
+        *length = isize - skip;
+        skip = 0;
+        return true;
+    }
+
+    return false;
+}
+
+void BgzfSource::seek(uint64_t offset) {
+    uint64_t uoffset;
+    index->find(offset, &coffset, &uoffset);
+    skip = offset - uoffset;
+}
+
+/**********************************************************************
+ *
+ * CLASS ParallelBgzfSource
+ *
+ **********************************************************************/
+ParallelBgzfSource::ParallelBgzfSource(shared_ptr<File> file,
+                                       shared_ptr<BgzfIndex> index_,
+                                       uint32_t nthreads_,
+                                       bool drop_behind)
+    : reader(file, drop_behind)
+    , index(index_)
+    , nthreads(nthreads_) {
+
+    // Enough slots that every worker can be inflating while the consumer
+    // holds one and others wait to be consumed.
+    for(uint32_t i = 0; i < 2 * nthreads; i++) {
+        ring.emplace_back(new Slot());
+    }
+}
+
+ParallelBgzfSource::~ParallelBgzfSource() {
+    stop();
+}
+
+bool ParallelBgzfSource::next(char const **data, uint64_t *length) {
+    if(workers.empty())
+        start();
+
+    std::unique_lock<std::mutex> guard(lock);
+    while(true) {
+        if(holdingHead) {
+            ring[head % ring.size()]->state = Slot::FREE;
+            head++;
+            holdingHead = false;
+            slotFree.notify_all();
+        }
+
+        Slot &slot = *ring[head % ring.size()];
+        slotReady.wait(guard, [&slot] () {return slot.state == Slot::READY;});
+
+        if(slot.error)
+            std::rethrow_exception(slot.error);
+        if(slot.eof)
+            return false;
+
+        holdingHead = true;
+        if(skip >= slot.len) {
+            skip -= slot.len;
+            continue;
+        }
+
+        *data = slot.buf + skip;
+        *length = slot.len - skip;
+        skip = 0;
+        return true;
+    }
+}
+
+void ParallelBgzfSource::seek(uint64_t offset) {
+    stop();
+
+    uint64_t uoffset;
+    index->find(offset, &coffset, &uoffset);
+    skip = offset - uoffset;
+}
+
+void ParallelBgzfSource::start() {
+    for(auto &slot: ring) {
+        slot->state = Slot::FREE;
+    }
+    head = tail = 0;
+    holdingHead = false;
+    stopping = false;
+    eof = false;
+
+    for(uint32_t i = 0; i < nthreads; i++) {
+        workers.emplace_back(&ParallelBgzfSource::work, this);
+    }
+}
+
+void ParallelBgzfSource::stop() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    slotFree.notify_all();
+
+    for(auto &worker: workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+void ParallelBgzfSource::work() {
+    BgzfInflater inflater;
+    std::unique_lock<std::mutex> guard(lock);
+
+    while(true) {
+        slotFree.wait(guard, [this] () {
+                return stopping || eof || (ring[tail % ring.size()]->state == Slot::FREE);
+            });
+        if(stopping || eof)
+            return;
+
+        // Blocks are taken from the file under the lock, which keeps them in
+        // ring order; only inflating happens concurrently.
+        Slot &slot = *ring[tail++ % ring.size()];
+        slot.state = Slot::INFLATING;
+        slot.eof = false;
+        slot.error = nullptr;
+        try {
+            uint8_t const *block;
+            uint32_t block_length;
+            if(reader.read(coffset, &block, &block_length, &slot.header_length)) {
+                slot.block.assign(block, block + block_length);
+                coffset += block_length;
+            } else {
+                slot.eof = eof = true;
+            }
+        } catch(...) {
+            slot.error = std::current_exception();
+            eof = true;
+        }
+
+        if(!slot.eof && !slot.error) {
+            guard.unlock();
+            try {
+                slot.len = inflater.inflate(slot.block.data(), slot.block.size(), slot.header_length, slot.buf);
+            } catch(...) {
+                slot.error = std::current_exception();
+            }
+            guard.lock();
+        }
+
+        slot.state = Slot::READY;
+        slotReady.notify_all();
+        if(eof)
+            slotFree.notify_all();
+    }
+}
+
+/**********************************************************************
+ *
+ * CLASS BgzfWriter
+ *
+ **********************************************************************/
+BgzfWriter::BgzfWriter(shared_ptr<File> file_)
+    : file(file_) {
+
+    memset(&zs, 0, sizeof(zs));
+    if(Z_OK != deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY))
+        raise_oom("Failed initializing deflate");
+}
+
+BgzfWriter::~BgzfWriter() {
+    deflateEnd(&zs);
+}
+
+void BgzfWriter::write(char const *buffer, uint64_t length) {
+    while(length > 0) {
+        uint32_t n = (uint32_t)std::min(uint64_t(sizeof(cache.buf) - cache.len), length);
+        memcpy(cache.buf + cache.len, buffer, n);
+        cache.len += n;
+        buffer += n;
+        length -= n;
+
+        if(cache.len == sizeof(cache.buf))
+            flushBlock();
+    }
+}
+
+void BgzfWriter::close() {
+    if(!file)
+        return;
+
+    flushBlock();
+
+    // An empty block marks the end of the file.
+    static uint8_t const eof_block[] = {
+        31, 139, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0, 0x1b, 0,
+        3, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    };
+    // Closed even if writing fails, which close() reports.
+    shared_ptr<File> f = file;
+    file = nullptr;
+    f->write(eof_block, sizeof(eof_block));
+    f->close();
+}
+
+void BgzfWriter::flushBlock() {
+    if(cache.len == 0)
+        return;
+
+    uint8_t const header_length = 18;
+    uint8_t block[BGZF_MAX_BLOCK_SIZE];
+
+    if(Z_OK != deflateReset(&zs))
+        raise_io("Failed resetting deflate");
+
+    zs.next_in = (Bytef *)cache.buf;
+    zs.avail_in = cache.len;
+    zs.next_out = block + header_length;
+    zs.avail_out = sizeof(block) - header_length - GZIP_FOOTER_LENGTH;
+    if(Z_STREAM_END != deflate(&zs, Z_FINISH))
+        raise_io("Failed compressing BGZF block");
+
+    uint32_t block_length = header_length + zs.total_out + GZIP_FOOTER_LENGTH;
+
+    uint8_t const header[] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0};
+    memcpy(block, header, sizeof(header));
+    put_le16(block + 16, uint16_t(block_length - 1));
+    put_le32(block + block_length - 8, crc32(crc32(0L, Z_NULL, 0), (Bytef const *)cache.buf, cache.len));
+    put_le32(block + block_length - 4, cache.len);
+
+    file->write(block, block_length);
+
+    cache.len = 0;
+}
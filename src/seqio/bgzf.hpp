@@ -0,0 +1,239 @@
+#pragma once
+
+#include "source.hpp"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <zlib.h>
+
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace seqio {
+    namespace impl {
+
+        bool is_bgzf_file_content(char const *path, seqio_io_backend const *backend = nullptr);
+
+        // Largest uncompressed (and compressed) size of a BGZF block.
+        const uint32_t BGZF_MAX_BLOCK_SIZE = 64 * 1024;
+
+/**********************************************************************
+ *
+ * CLASS BgzfIndex
+ *
+ * Uncompressed offsets of the blocks in a BGZF file, as stored in a
+ * htslib-compatible .gzi. If no .gzi is loaded, the index is built on
+ * demand by scanning the block headers, which doesn't require inflating
+ * anything. A .gzi is only kept beside a file in the file system.
+ *
+ **********************************************************************/
+        class BgzfIndex {
+        public:
+            BgzfIndex(char const *bgzf_path, seqio_io_backend const *backend_);
+
+            // Conventional location of the index for a BGZF file.
+            static std::string getIndexPath(char const *bgzf_path);
+
+            // Loads, builds or saves the index for bgzf_path according to mode.
+            static std::shared_ptr<BgzfIndex> open(char const *bgzf_path,
+                                                   seqio_io_backend const *backend,
+                                                   seqio_index_mode mode);
+
+            void load(char const *path);
+            void save(char const *path);
+
+            // Finds the block containing an uncompressed offset.
+            void find(uint64_t offset,
+                      uint64_t *block_coffset,
+                      uint64_t *block_uoffset);
+
+        private:
+            void build();
+
+            struct Block {
+                uint64_t coffset;
+                uint64_t uoffset;
+            };
+
+            std::string path;
+            seqio_io_backend const backend;
+            std::mutex lock;
+            bool built = false;
+            std::vector<Block> blocks;
+        };
+
+/**********************************************************************
+ *
+ * CLASS BgzfBlockReader
+ *
+ * Buffered access to whole compressed blocks.
+ *
+ **********************************************************************/
+        class BgzfBlockReader {
+        public:
+            // With drop_behind, the file is dropped from the page cache as it's
+            // read.
+            BgzfBlockReader(std::shared_ptr<File> file_, bool drop_behind = false);
+            ~BgzfBlockReader();
+
+            // Obtain the compressed block beginning at coffset, which remains
+            // valid until the next call. Returns false at end of file.
+            bool read(uint64_t coffset,
+                      uint8_t const **block,
+                      uint32_t *block_length,
+                      uint32_t *header_length);
+
+            // Uncompressed size of a block obtained from read().
+            static uint32_t getUncompressedLength(uint8_t const *block,
+                                                  uint32_t block_length);
+
+        private:
+            uint64_t load(uint64_t offset, uint32_t length);
+
+            std::shared_ptr<File> file;
+            bool const dropBehind;
+            struct {
+                std::vector<uint8_t> data;
+                uint64_t offset = 0;
+                uint64_t len = 0;
+            } buf;
+        };
+
+/**********************************************************************
+ *
+ * CLASS BgzfInflater
+ *
+ **********************************************************************/
+        class BgzfInflater {
+        public:
+            BgzfInflater();
+            ~BgzfInflater();
+
+            // Inflates a block obtained from BgzfBlockReader::read() into out,
+            // which must have room for BGZF_MAX_BLOCK_SIZE bytes. Returns the
+            // number of bytes inflated.
+            uint32_t inflate(uint8_t const *block,
+                             uint32_t block_length,
+                             uint32_t header_length,
+                             char *out);
+
+        private:
+            z_stream zs;
+        };
+
+/**********************************************************************
+ *
+ * CLASS BgzfSource
+ *
+ * Inflates only the blocks that are actually read, so seeking costs at
+ * most one block regardless of the offset.
+ *
+ **********************************************************************/
+        class BgzfSource : public ISource {
+        public:
+            BgzfSource(std::shared_ptr<File> file,
+                       std::shared_ptr<BgzfIndex> index_,
+                       bool drop_behind = false);
+            virtual ~BgzfSource();
+
+            virtual bool next(char const **data, uint64_t *length) override;
+            virtual void seek(uint64_t offset) override;
+
+        private:
+            BgzfBlockReader reader;
+            BgzfInflater inflater;
+            std::shared_ptr<BgzfIndex> index;
+            uint64_t coffset = 0;
+            uint64_t skip = 0;
+            char buf[BGZF_MAX_BLOCK_SIZE];
+        };
+
+/**********************************************************************
+ *
+ * CLASS ParallelBgzfSource
+ *
+ * Inflates blocks on a pool of worker threads. Workers take blocks from
+ * the file in order, each into the next free slot of a bounded ring, and
+ * the slots are handed out in ring order, so the content is delivered
+ * in file order no matter which worker finishes first.
+ *
+ **********************************************************************/
+        class ParallelBgzfSource : public ISource {
+        public:
+            ParallelBgzfSource(std::shared_ptr<File> file,
+                               std::shared_ptr<BgzfIndex> index_,
+                               uint32_t nthreads_,
+                               bool drop_behind = false);
+            virtual ~ParallelBgzfSource();
+
+            virtual bool next(char const **data, uint64_t *length) override;
+            virtual void seek(uint64_t offset) override;
+
+        private:
+            void start();
+            void stop();
+            void work();
+
+            struct Slot {
+                enum {FREE, INFLATING, READY} state = FREE;
+                // Set in the slot following the last block.
+                bool eof = false;
+                std::exception_ptr error;
+                std::vector<uint8_t> block;
+                uint32_t header_length;
+                uint32_t len;
+                char buf[BGZF_MAX_BLOCK_SIZE];
+            };
+
+            BgzfBlockReader reader;
+            std::shared_ptr<BgzfIndex> index;
+            uint32_t const nthreads;
+
+            std::mutex lock;
+            std::condition_variable slotFree;
+            std::condition_variable slotReady;
+            std::vector<std::thread> workers;
+            std::vector<std::unique_ptr<Slot>> ring;
+            // Next slot to be handed out, and next slot to be filled.
+            uint64_t head = 0;
+            uint64_t tail = 0;
+            // Whether the consumer is still using the head slot.
+            bool holdingHead = false;
+            bool stopping = false;
+            bool eof = false;
+            uint64_t coffset = 0;
+            uint64_t skip = 0;
+        };
+
+/**********************************************************************
+ *
+ * CLASS BgzfWriter
+ *
+ **********************************************************************/
+        class BgzfWriter {
+        public:
+            BgzfWriter(std::shared_ptr<File> file_);
+            ~BgzfWriter();
+
+            void write(char const *buffer, uint64_t length);
+            void close();
+
+        private:
+            void flushBlock();
+
+            // Null once closed.
+            std::shared_ptr<File> file;
+            z_stream zs;
+            struct {
+                char buf[0xff00];
+                uint32_t len = 0;
+            } cache;
+        };
+
+    }
+}
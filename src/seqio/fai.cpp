@@ -0,0 +1,252 @@
+#include "fai.hpp"
+
+#include "fasta.hpp"
+#include "simd.hpp"
+#include "util.h"
+
+#include <string.h>
+#include <sys/stat.h>
+
+using std::shared_ptr;
+using std::string;
+using std::vector;
+using namespace seqio::impl;
+
+/**********************************************************************
+ *
+ * CLASS FaiIndex
+ *
+ **********************************************************************/
+string FaiIndex::getIndexPath(char const *fasta_path) {
+    return string(fasta_path) + ".fai";
+}
+
+FaiIndex FaiIndex::build(char const *fasta_path,
+                         SourceFactory const &factory) {
+    FaiIndex index;
+    FastaRawStream stream(factory, 0);
+
+    Entry entry;
+    bool inSequence = false;
+    // Set once a line shorter than the first line is found, which must be
+    // the sequence's last line.
+    bool lastLine = false;
+    struct {
+        uint64_t bases;
+        uint64_t width;
+    } line = {0, 0};
+
+    auto endLine = [&] () {
+        if(inSequence && (line.width > 0)) {
+            if(lastLine) {
+                if(line.bases > 0)
+                    raise_parm("Cannot index %s: sequence %s has inconsistent line lengths.",
+                               fasta_path, entry.name.c_str());
+            } else if(entry.line_width == 0) {
+                entry.line_bases = line.bases;
+                entry.line_width = line.width;
+                lastLine = (line.bases == 0);
+            } else if((line.bases != entry.line_bases) || (line.width != entry.line_width)) {
+                if((line.bases > entry.line_bases)
+                   || ((line.width - line.bases) != (entry.line_width - entry.line_bases)))
+                    raise_parm("Cannot index %s: sequence %s has inconsistent line lengths.",
+                               fasta_path, entry.name.c_str());
+                lastLine = true;
+            }
+            entry.length += line.bases;
+        }
+        line.bases = line.width = 0;
+    };
+
+    auto endSequence = [&] () {
+        if(inSequence) {
+            index.add(entry);
+            inSequence = false;
+        }
+    };
+
+    bool firstCol = true;
+    char const *begin, *end;
+    while(stream.peek(&begin, &end)) {
+        if(firstCol && (*begin == '>')) {
+            endLine();
+            endSequence();
+            stream.consume(1);
+
+            entry.name.clear();
+            int c;
+            while(!isspace(c = stream.nextChar()) && (c > -1)) {
+                entry.name += c;
+            }
+            while((c != '\n') && (c > -1)) {
+                c = stream.nextChar();
+            }
+
+            entry.length = 0;
+            entry.offset = stream.tell_abs();
+            entry.line_bases = 0;
+            entry.line_width = 0;
+            inSequence = true;
+            lastLine = false;
+            continue;
+        }
+
+        char const *special = find_nongraph(begin, end);
+        uint64_t run = special - begin;
+        line.bases += run;
+        line.width += run;
+        if(special == end) {
+            firstCol = false;
+        } else {
+            line.width++;
+            run++;
+            if(*special == '\n') {
+                endLine();
+                firstCol = true;
+            } else {
+                firstCol = false;
+            }
+        }
+        stream.consume(run);
+    }
+    endLine();
+    endSequence();
+
+    return index;
+}
+
+shared_ptr<FaiIndex> FaiIndex::open(char const *fasta_path,
+                                    SourceFactory const &factory,
+                                    seqio_index_mode mode,
+                                    seqio_io_backend const *backend) {
+    if(mode == SEQIO_INDEX_NONE)
+        return nullptr;
+
+    if(!is_file_backend(backend)) {
+        if(mode != SEQIO_INDEX_BUILD)
+            return nullptr;
+        return std::make_shared<FaiIndex>(build(fasta_path, factory));
+    }
+
+    string index_path = getIndexPath(fasta_path);
+    struct stat fasta_stat, index_stat;
+    bool exists = (0 == stat(index_path.c_str(), &index_stat));
+    bool stale = exists
+        && (0 == stat(fasta_path, &fasta_stat))
+        && (index_stat.st_mtime < fasta_stat.st_mtime);
+
+    shared_ptr<FaiIndex> index = std::make_shared<FaiIndex>();
+
+    if(exists && !(stale && (mode == SEQIO_INDEX_BUILD))) {
+        index->load(index_path.c_str());
+    } else if(mode == SEQIO_INDEX_BUILD) {
+        *index = build(fasta_path, factory);
+        try {
+            index->save(index_path.c_str());
+        } catch(Exception x) {
+            // The index is still usable even if it can't be saved (e.g. the
+            // FASTA is in a read-only directory).
+        }
+    } else {
+        return nullptr;
+    }
+
+    return index;
+}
+
+void FaiIndex::load(char const *path) {
+    FILE *f = fopen(path, "r");
+    if(!f)
+        raise_io("Failed opening %s", path);
+
+    entries.clear();
+    names.clear();
+
+    // Lines are as long as the names in them, which needn't fit any buffer.
+    // A name is everything before the first tab, and may be empty.
+    char *line = nullptr;
+    size_t capacity = 0;
+    for(int lineno = 1; getline(&line, &capacity, f) >= 0; lineno++) {
+        char const *tab = strchr(line, '\t');
+        unsigned long long fields[4];
+        if(!tab || (4 != sscanf(tab + 1, "%llu %llu %llu %llu",
+                                &fields[0], &fields[1], &fields[2], &fields[3]))) {
+            free(line);
+            fclose(f);
+            raise_io("Invalid index entry at %s:%d", path, lineno);
+        }
+
+        Entry entry;
+        entry.name.assign(line, tab - line);
+        entry.length = fields[0];
+        entry.offset = fields[1];
+        entry.line_bases = fields[2];
+        entry.line_width = fields[3];
+        try {
+            add(entry);
+        } catch(Exception &) {
+            free(line);
+            fclose(f);
+            throw;
+        }
+    }
+
+    free(line);
+    fclose(f);
+}
+
+void FaiIndex::save(char const *path) const {
+    FILE *f = fopen(path, "w");
+    if(!f)
+        raise_io("Failed opening %s", path);
+
+    for(Entry const &entry: entries) {
+        if(0 > fprintf(f, "%s\t%llu\t%llu\t%llu\t%llu\n",
+                       entry.name.c_str(),
+                       (unsigned long long)entry.length,
+                       (unsigned long long)entry.offset,
+                       (unsigned long long)entry.line_bases,
+                       (unsigned long long)entry.line_width)) {
+            fclose(f);
+            raise_io("Failed writing %s", path);
+        }
+    }
+
+    if(0 != fclose(f))
+        raise_io("Failed writing %s", path);
+}
+
+uint64_t FaiIndex::size() const {
+    return entries.size();
+}
+
+FaiIndex::Entry const &FaiIndex::getEntry(uint64_t index) const {
+    if(index >= entries.size())
+        raise_parm("Index out of bounds");
+
+    return entries[index];
+}
+
+FaiIndex::Entry const *FaiIndex::find(char const *name) const {
+    auto it = names.find(name);
+    if(it == names.end())
+        return nullptr;
+
+    return &entries[it->second];
+}
+
+uint64_t FaiIndex::getFileOffset(Entry const &entry, uint64_t base_offset) {
+    if(entry.line_bases == 0)
+        return entry.offset;
+
+    return entry.offset
+        + (base_offset / entry.line_bases) * entry.line_width
+        + (base_offset % entry.line_bases);
+}
+
+void FaiIndex::add(Entry const &entry) {
+    if(!names.insert(std::make_pair(entry.name, entries.size())).second)
+        raise_parm("Duplicate sequence name in index: %s", entry.name.c_str());
+
+    entries.push_back(entry);
+}
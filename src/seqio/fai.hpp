@@ -0,0 +1,69 @@
+#pragma once
+
+#include "seqio_impl.hpp"
+#include "source.hpp"
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace seqio {
+    namespace impl {
+
+/**********************************************************************
+ *
+ * CLASS FaiIndex
+ *
+ * A samtools-compatible .fai index of a FASTA file. For each sequence
+ * it records the offset of the first base and the line geometry, which
+ * allows the file offset of any base to be computed directly.
+ *
+ **********************************************************************/
+        class FaiIndex {
+        public:
+            struct Entry {
+                std::string name;
+                uint64_t length;
+                uint64_t offset;
+                uint64_t line_bases;
+                uint64_t line_width;
+            };
+
+            // Conventional location of the index for a FASTA file.
+            static std::string getIndexPath(char const *fasta_path);
+
+            // Scans a FASTA file and builds its index.
+            static FaiIndex build(char const *fasta_path,
+                                  SourceFactory const &factory);
+
+            // Loads the index for fasta_path according to mode, building and
+            // saving it if requested. Returns nullptr if there is no index to use.
+            // Sidecar .fai files are only used with the file backend; other
+            // backends can only build an index in memory.
+            static std::shared_ptr<FaiIndex> open(char const *fasta_path,
+                                                  SourceFactory const &factory,
+                                                  seqio_index_mode mode,
+                                                  seqio_io_backend const *backend = nullptr);
+
+            void load(char const *path);
+            void save(char const *path) const;
+
+            uint64_t size() const;
+            Entry const &getEntry(uint64_t index) const;
+            Entry const *find(char const *name) const;
+
+            // File offset of the base at base_offset within a sequence.
+            static uint64_t getFileOffset(Entry const &entry, uint64_t base_offset);
+
+        private:
+            void add(Entry const &entry);
+
+            std::vector<Entry> entries;
+            std::map<std::string, uint64_t> names;
+        };
+
+    }
+}
@@ -1,9 +1,14 @@
 #include "fasta.hpp"
 
+#include "batch.hpp"
+#include "bgzf.hpp"
+#include "simd.hpp"
 #include "util.h"
 
 #include <string.h>
 
+#include <algorithm>
+
 using std::function;
 using std::string;
 using std::vector;
@@ -22,39 +27,22 @@ namespace seqio {
         };
 
 
-        bool is_fasta_file_content(char const *path) {
+        bool is_fasta_file_content(char const *path, seqio_io_backend const *backend) {
             bool firstCol = true;
             char buf[4*1024];
-            gzFile f;
-            int rc;
-
-            f = gzopen(path, "r");
-            if(!f)
-                goto fail;
+            uint64_t n = read_content_prefix(path, backend, buf, sizeof(buf));
 
-            rc = gzread(f, buf, sizeof(buf));
-            if(rc < 1)
-                goto fail;
-
-            for(int i = 0; i < rc; i++) {
+            for(uint64_t i = 0; i < n; i++) {
                 char c = buf[i];
                 if(c == '>' && firstCol)
-                    goto succeed;
+                    return true;
                 else if(c == '\n')
                     firstCol = true;
                 else if(c <= 0)
-                    goto fail;
+                    return false;
                 else
                     firstCol = false;
             }
-            goto fail;
-
-        succeed:
-            gzclose(f);
-            return true;
-
-        fail:
-            if(f) gzclose(f);
             return false;
         }
 
@@ -74,74 +62,82 @@ namespace seqio {
             return false;
         }
 
+        void parse_fasta_header(char const *begin,
+                                char const *end,
+                                string &name,
+                                string &comment) {
+            char const *name_end = begin;
+            while((name_end < end) && !isspace(*name_end))
+                name_end++;
+            name.assign(begin, name_end);
+
+            // Carriage returns are dropped, wherever they are in the comment.
+            comment.clear();
+            if((name_end < end) && (*name_end != '\r')) {
+                comment.assign(name_end + 1, end);
+                if(memchr(comment.data(), '\r', comment.size()))
+                    comment.erase(std::remove(comment.begin(), comment.end(), '\r'), comment.end());
+            }
+        }
+
     }
 }
 /**********************************************************************
  *
- * CLASS FileHandle
+ * CLASS FastaRawStream
  *
  **********************************************************************/
-__FileHandle::__FileHandle(gzFile f_)
-    : f(f_) {
-}
+FastaRawStream::FastaRawStream(SourceFactory const &factory_,
+                               z_off_t start)
+    : factory(factory_)
+    , source(factory_()) {
 
-__FileHandle::~__FileHandle() {
-    gzclose(f);
-    f = 0;
+    if(start != 0) {
+        seek_abs(start);
+    }
 }
 
-__FileHandle::operator gzFile() {
-    return f;
+int FastaRawStream::nextChar() {
+    if(!fill()) {
+        return -1;
+    }
+
+    return (int)cache.buf[cache.index++];
 }
 
-/**********************************************************************
- *
- * CLASS FastaRawStream
- *
- **********************************************************************/
-FastaRawStream::FastaRawStream(FileHandle f_,
-                               z_off_t start_)
-    : f(f_)
-    , start(start_) {
+bool FastaRawStream::peek(char const **begin, char const **end) {
+    if(!fill()) {
+        return false;
+    }
 
-    fstate.read_offset = start;
-    cache.len = 0;
-    cache.index = 0;
+    *begin = cache.buf + cache.index;
+    *end = cache.buf + cache.len;
+    return true;
 }
 
-FastaRawStream *FastaRawStream::createSubstream() {
-    FastaRawStream *substream = new FastaRawStream;
-    substream->cache = cache;
-    substream->fstate = fstate;
-    substream->f = f;
-    substream->start = tell_abs();
-    return substream;
+void FastaRawStream::consume(uint64_t n) {
+    cache.index += n;
 }
 
-int FastaRawStream::nextChar() {
+bool FastaRawStream::fill() {
     if(fstate.eof) {
-        return -1;
+        return false;
     }
 
-    if(cache.index == cache.len) {
-        z_off_t read_offset = fstate.read_offset + cache.len;
-        z_off_t off = gzseek(*f, read_offset, SEEK_SET);
-        if(off != read_offset) raise_io("Failed seeking to offset %zu", (size_t)off);
-
-        int rc = gzread(*f, cache.buf, sizeof(cache.buf));
-        if(rc < 0) {
-            raise(IO, "Failed reading from file.");
-        }
-        if(rc == 0) {
+    // The stream has exclusive use of its source, so the source is always
+    // positioned at the end of the cache.
+    while(cache.index == cache.len) {
+        fstate.read_offset += cache.len;
+        cache.index = 0;
+        cache.len = 0;
+        if(!source->next(&cache.buf, &cache.len)) {
             fstate.eof = true;
-            return -1;
+            return false;
         }
-        cache.index = 0;
-        cache.len = rc;
-        fstate.read_offset = read_offset;
+        fstate.bytes_read += cache.len;
     }
 
-    return (int)cache.buf[cache.index++];
+    return true;
 }
 
 z_off_t FastaRawStream::tell_abs() {
@@ -149,18 +145,51 @@ z_off_t FastaRawStream::tell_abs() {
 }
 
 void FastaRawStream::seek_abs(z_off_t offset) {
-    if(offset != gzseek(*f, offset, SEEK_SET)) raise_io("Failed seeking");
+    source->seek(offset);
     fstate.read_offset  = offset;
+    fstate.eof = false;
     cache.len = 0;
     cache.index = 0;
 }
 
+bool FastaRawStream::isRandomAccess() {
+    return source->isRandomAccess();
+}
+
+SourceFactory const &FastaRawStream::getFactory() {
+    return factory;
+}
+
+uint64_t FastaRawStream::getBytesRead() {
+    return fstate.bytes_read;
+}
+
 /**********************************************************************
  *
  * CLASS CharInterpreter
  *
  **********************************************************************/
-CharInterpreter::CharInterpreter(seqio_base_transform transform) {
+CharInterpreter::CharInterpreter(seqio_base_transform transform,
+                                 seqio_strand strand_)
+    : base_transform(transform)
+    , strand(strand_) {
+
+    // IUPAC complements. Anything else, including N, S and W, is its own
+    // complement.
+    char complement[256];
+    for(int c = 0; c < 256; c++) {
+        complement[c] = c;
+    }
+    char const pairs[] = "ATCGRYKMBVDH";
+    for(int i = 0; pairs[i]; i += 2) {
+        for(int lower = 0; lower <= 0x20; lower += 0x20) {
+            complement[pairs[i] | lower] = pairs[i + 1] | lower;
+            complement[pairs[i + 1] | lower] = pairs[i] | lower;
+        }
+    }
+    complement[int('U')] = 'A';
+    complement[int('u')] = 'a';
+
     for(int c = 0; c < 256; c++) {
         char base = c;
         Action firstCol;
@@ -175,28 +204,63 @@ CharInterpreter::CharInterpreter(seqio_base_transform transform) {
             otherCol = APPEND_SEQUENCE;
         } else {
             firstCol = otherCol = APPEND_SEQUENCE;
-            if(transform == SEQIO_BASE_TRANSFORM_CAPS_GATCN) {
-                base = toupper(c);
-                switch(base) {
-                case 'G':
-                case 'A':
-                case 'T':
-                case 'C':
-                    // no-op
-                    break;
-                default:
-                    base = 'N';
-                    break;
-                }
+        }
+
+        if(transform == SEQIO_BASE_TRANSFORM_CAPS_GATCN) {
+            base = toupper(c);
+            switch(base) {
+            case 'G':
+            case 'A':
+            case 'T':
+            case 'C':
+                // no-op
+                break;
+            default:
+                base = 'N';
+                break;
             }
         }
 
         bases[c] = base;
+        complements[c] = complement[base & 0xFF];
         actions_firstCol[c] = firstCol;
         actions_otherCol[c] = otherCol;
     }
 }
 
+void CharInterpreter::transform(char const *src, uint64_t len, char *dst) const {
+    switch(base_transform) {
+    case SEQIO_BASE_TRANSFORM_NONE:
+        memcpy(dst, src, len);
+        break;
+    case SEQIO_BASE_TRANSFORM_CAPS_GATCN:
+        transform_caps_gatcn(src, len, dst);
+        break;
+    default:
+        for(uint64_t i = 0; i < len; i++) {
+            dst[i] = bases[src[i] & 0xFF];
+        }
+        break;
+    }
+}
+
+void CharInterpreter::reverseComplement(char const *src, uint64_t len, char *dst) const {
+    switch(base_transform) {
+    case SEQIO_BASE_TRANSFORM_CAPS_GATCN:
+        reverse_complement_caps_gatcn(src, len, dst);
+        break;
+    default:
+        // Swap from both ends, which works in place.
+        for(uint64_t i = 0, j = len; i < j; i++, j--) {
+            char front = src[i];
+            char back = src[j - 1];
+            dst[i] = complements[back & 0xFF];
+            dst[j - 1] = complements[front & 0xFF];
+        }
+        break;
+    }
+}
+
 /**********************************************************************
  *
  * CLASS FastaMetadata
@@ -207,6 +271,10 @@ FastaMetadata::FastaMetadata(string name_, string comment_)
     , comment(comment_) {
 }
 
+FastaMetadata::FastaMetadata(std::shared_ptr<string const> line_)
+    : line(line_) {
+}
+
 FastaMetadata::~FastaMetadata() {
 }
 
@@ -232,6 +300,11 @@ char const *FastaMetadata::getKey(uint32_t key_index) const {
 }
 
 char const *FastaMetadata::getValue(char const *key) const {
+    if(line) {
+        parse_fasta_header(line->data(), line->data() + line->size(), name, comment);
+        line.reset();
+    }
+
     if(0 == strcmp(key, SEQIO_KEY_NAME)) {
         return name.c_str();
     } else if(0 == strcmp(key, SEQIO_KEY_COMMENT)) {
@@ -246,22 +319,126 @@ char const *FastaMetadata::getValue(char const *key) const {
  * CLASS FastaSequence
  *
  **********************************************************************/
+// Reads the bases of a sequence until the buffer is full or the sequence
+// ends, which sets eos.
+// Used to read bases that are transformed later.
+static CharInterpreter const raw_interpreter(SEQIO_BASE_TRANSFORM_NONE);
+
+static uint64_t read_bases(FastaRawStream &stream,
+                           CharInterpreter const &interpreter,
+                           bool &firstCol,
+                           bool &eos,
+                           char *buffer,
+                           uint64_t buffer_length) {
+    uint64_t n = 0;
+    char const *begin, *end;
+
+    // Rather than interpreting one character at a time, find the next
+    // character that isn't a base (e.g. a newline) and move the whole
+    // run of bases preceding it into the buffer at once.
+    while((n < buffer_length) && stream.peek(&begin, &end)) {
+        if(firstCol && (*begin == '>')) {
+            eos = true;
+            return n;
+        }
+
+        if(uint64_t(end - begin) > (buffer_length - n))
+            end = begin + (buffer_length - n);
+
+        char const *special = find_nongraph(begin, end);
+        uint64_t run = special - begin;
+        if(run) {
+            interpreter.transform(begin, run, buffer + n);
+            n += run;
+            firstCol = false;
+        }
+
+        if(special != end) {
+            switch(interpreter.getAction(*special, firstCol)) {
+            case CharInterpreter::IGNORE:
+                firstCol = false;
+                break;
+            case CharInterpreter::NEWLINE:
+                firstCol = true;
+                break;
+            default:
+                panic();
+            }
+            run++;
+        }
+
+        stream.consume(run);
+    }
+
+    if(n < buffer_length) {
+        eos = true;
+    }
+
+    return n;
+}
+
+// Counts the bases of a sequence through its end, as read_bases() would read
+// them, without transforming or copying them.
+static uint64_t count_bases(FastaRawStream &stream,
+                            bool &firstCol) {
+    uint64_t n = 0;
+    char const *begin, *end;
+
+    while(stream.peek(&begin, &end)) {
+        if(firstCol && (*begin == '>'))
+            break;
+
+        // Find where the record ends as findHeader() does, and count what
+        // precedes it in bulk rather than a line at a time.
+        char const *stop = end;
+        for(char const *gt = begin + 1; (gt = (char const *)memchr(gt, '>', end - gt)); gt++) {
+            if(gt[-1] == '\n') {
+                stop = gt;
+                break;
+            }
+        }
+
+        n += count_graph(begin, stop);
+        firstCol = (stop[-1] == '\n');
+        stream.consume(stop - begin);
+        if(stop != end)
+            break;
+    }
+
+    return n;
+}
+
 FastaSequence::FastaSequence(FastaMetadata const &metadata_,
-                             FastaRawStream *stream_,
+                             std::shared_ptr<FastaRawStream> stream_,
                              CharInterpreter const *interpreter_,
-                             function<void (FastaSequence *sequence)> onClose_)
+                             function<void (FastaSequence *sequence)> onClose_,
+                             std::shared_ptr<FaiIndex> index_,
+                             FaiIndex::Entry const *entry_,
+                             std::shared_ptr<string> loadBuffer_)
     : metadata(metadata_)
     , stream(stream_)
     , interpreter(interpreter_)
-    , onClose(onClose_) {
+    , onClose(onClose_)
+    , index(index_)
+    , entry(entry_) {
 
     parse.firstCol = true;
     parse.eos = false;
+    scan.scanned = false;
+    scan.counted = false;
+    scan.length = 0;
+    loaded.done = false;
+    loaded.bases = loadBuffer_;
+    loaded.length = 0;
+    loaded.remaining = 0;
+    reverse.windowed = false;
+    reverse.end = 0;
+    reverse.cached = 0;
 }
 
 FastaSequence::~FastaSequence() {
-    onClose(this);
-    delete stream;
+    if(onClose)
+        onClose(this);
 }
 
 IConstDictionary const &FastaSequence::getMetadata() {
@@ -270,57 +447,196 @@ IConstDictionary const &FastaSequence::getMetadata() {
 
 uint64_t FastaSequence::read(char *buffer,
                              uint64_t buffer_length) {
+    if(interpreter->isReverseComplement()) {
+        if(reverse.windowed)
+            return readReverse(buffer, buffer_length);
+        loadBases();
+        uint64_t n = std::min(buffer_length, loaded.remaining);
+        loaded.remaining -= n;
+        interpreter->reverseComplement(loaded.bases->data() + loaded.remaining, n, buffer);
+        return n;
+    }
+
+    if(loaded.done) {
+        uint64_t n = std::min(buffer_length, loaded.remaining);
+        interpreter->transform(loaded.bases->data() + (loaded.length - loaded.remaining), n, buffer);
+        loaded.remaining -= n;
+        return n;
+    }
+
+    return readForward(*interpreter, buffer, buffer_length);
+}
+
+uint64_t FastaSequence::readForward(CharInterpreter const &interpreter,
+                                    char *buffer,
+                                    uint64_t buffer_length) {
     if(parse.eos)
         return 0;
 
+    if(!stream) {
+        stream = std::make_shared<FastaRawStream>(detached.factory, detached.offset);
+    }
+
+    return read_bases(*stream, interpreter, parse.firstCol, parse.eos, buffer, buffer_length);
+}
+
+void FastaSequence::loadBases() {
+    if(loaded.done)
+        return;
+
+    // The first base of the reverse complement is the last in the file, so
+    // the rest of the sequence is read up front. The bases are kept as they
+    // are in the file and transformed as they're handed out, which is fused
+    // with reversing and complementing them.
+    //
+    // The buffer may have been used by a previous sequence, so it's only ever
+    // grown: its size is its usable capacity, and shrinking it would just
+    // mean zero-filling it again.
+    if(!loaded.bases)
+        loaded.bases = std::make_shared<string>();
+    string &bases = *loaded.bases;
+    if(entry && (bases.size() <= entry->length))
+        bases.resize(entry->length + 1);
+
     uint64_t n = 0;
-    int c;
+    while(!parse.eos) {
+        if(n == bases.size())
+            bases.resize(std::max(bases.size() * 2, size_t(64 * 1024)));
+        n += readForward(raw_interpreter, &bases[n], bases.size() - n);
+    }
+    loaded.length = loaded.remaining = n;
+    loaded.done = true;
+}
 
-    while((n < buffer_length) && (c = stream->nextChar()) != -1) {
-        CharInterpreter::Action action = interpreter->getAction(c, parse.firstCol);
+uint64_t FastaSequence::readReverse(char *buffer,
+                                    uint64_t buffer_length) {
+    if(!loaded.bases)
+        loaded.bases = std::make_shared<string>();
+    string &bases = *loaded.bases;
 
-        switch(action) {
-        case CharInterpreter::IGNORE:
-            parse.firstCol = false;
-            break;
-        case CharInterpreter::NEWLINE:
-            parse.firstCol = true;
-            break;
-        case CharInterpreter::APPEND_SEQUENCE:
-            parse.firstCol = false;
-            buffer[n++] = interpreter->getBase(c);
-            break;
-        case CharInterpreter::HEADER:
-            parse.eos = true;
-            parse.eos_offset = stream->tell_abs() - 1;
-            goto break_outer;
-        default:
-            panic();
+    uint64_t n = 0;
+    while((n < buffer_length) && (reverse.end > 0)) {
+        if(reverse.cached == 0) {
+            uint64_t window = std::min(reverse.end, uint64_t(64 * 1024));
+            if(bases.size() < window)
+                bases.resize(window);
+            seekStream(reverse.end - window);
+            while(reverse.cached < window) {
+                uint64_t k = readForward(raw_interpreter, &bases[reverse.cached], window - reverse.cached);
+                if(k == 0)
+                    raise_io("FASTA sequence %s is shorter than its index says.",
+                             metadata.getValue(SEQIO_KEY_NAME));
+                reverse.cached += k;
+            }
         }
-    }
-break_outer:
 
-    if(c == -1) {
-        parse.eos = true;
-        parse.eos_offset = stream->tell_abs();
+        uint64_t m = std::min(buffer_length - n, reverse.cached);
+        reverse.cached -= m;
+        reverse.end -= m;
+        interpreter->reverseComplement(bases.data() + reverse.cached, m, buffer + n);
+        n += m;
     }
-
     return n;
 }
 
-z_off_t FastaSequence::tellEnd() {
-    if(!parse.eos) {
-        z_off_t offset = stream->tell_abs();
+char const *FastaSequence::getQuality(uint64_t *length) {
+    raise_state("FASTA sequences have no quality values.");
+}
 
-        char buf[1024];
-        while(!parse.eos)
-            read(buf, sizeof(buf));
+bool FastaSequence::hasQuality() {
+    return false;
+}
+
+uint64_t FastaSequence::getLength() {
+    if(scan.counted)
+        return scan.length;
+    if(loaded.done)
+        return loaded.length;
+    if(!entry)
+        raise_state("FASTA sequence length isn't known without an index.");
+    return entry->length;
+}
 
-        parse.eos = false;
-        stream->seek_abs(offset);
+void FastaSequence::getPacked(seqio_packed_sequence *packed) {
+    raise_state("FASTA sequences have no packed bases.");
+}
+
+void FastaSequence::setScanned(bool counted, uint64_t length) {
+    scan.scanned = true;
+    scan.counted = counted;
+    scan.length = length;
+    parse.eos = true;
+}
+
+void FastaSequence::setLoaded(uint64_t length) {
+    loaded.done = true;
+    loaded.length = loaded.remaining = length;
+    parse.eos = true;
+}
+
+void FastaSequence::seek(uint64_t offset) {
+    if(scan.scanned)
+        raise_state("Cannot seek in a FASTA sequence found by a scan.");
+    if(!entry)
+        raise_state("Cannot seek in FASTA sequence without an index.");
+    if(offset > entry->length)
+        raise_parm("Seek offset %zu exceeds sequence length %zu.",
+                   size_t(offset), size_t(entry->length));
+
+    // Offsets along the reverse complement count back from the end of the
+    // sequence. Unless the bases are already in memory, they're read back
+    // from there a window at a time. Content that can only be inflated
+    // forward from its start is loaded instead, as reading it does anyway.
+    if(interpreter->isReverseComplement()) {
+        if(!loaded.done && !reverse.windowed) {
+            if(!stream)
+                stream = std::make_shared<FastaRawStream>(detached.factory, detached.offset);
+            if(stream->isRandomAccess())
+                reverse.windowed = true;
+            else
+                loadBases();
+        }
+        if(reverse.windowed) {
+            reverse.end = entry->length - offset;
+            reverse.cached = 0;
+        } else {
+            loaded.remaining = loaded.length - offset;
+        }
+        return;
     }
 
-    return parse.eos_offset;
+    seekStream(offset);
+}
+
+void FastaSequence::seekStream(uint64_t offset) {
+    // We can't move the iterator's stream, so switch to a private one.
+    if(onClose) {
+        onClose(this);
+        detach();
+    }
+
+    z_off_t file_offset = FaiIndex::getFileOffset(*entry, offset);
+    if(stream) {
+        stream->seek_abs(file_offset);
+    } else {
+        stream = std::make_shared<FastaRawStream>(detached.factory, file_offset);
+    }
+
+    parse.firstCol = (entry->line_bases == 0) || (offset % entry->line_bases == 0);
+    parse.eos = false;
+}
+
+bool FastaSequence::isFirstCol() {
+    return parse.firstCol;
+}
+
+void FastaSequence::detach() {
+    if(stream) {
+        detached.factory = stream->getFactory();
+        detached.offset = stream->tell_abs();
+    }
+    stream.reset();
+    onClose = nullptr;
 }
 
 /**********************************************************************
@@ -328,90 +644,324 @@ z_off_t FastaSequence::tellEnd() {
  * CLASS FastaSequenceIterator
  *
  **********************************************************************/
-FastaSequenceIterator::FastaSequenceIterator(char const *path,
-                                             seqio_base_transform transform)
-    : interpreter(transform) {
+FastaSequenceIterator::FastaSequenceIterator(char const *path_,
+                                             seqio_sequence_options const &options)
+    : factory(create_source_factory(path_, options))
+    , interpreter(options.base_transform, options.strand)
+    , scanMode(options.scan_mode)
+    , filter(options) {
 
     callback = std::make_shared<Callback>(this);
 
-    FileHandle f = std::make_shared<__FileHandle>( gzopen(path, "r") );
-    if(!f->f) raise_io("Failed opening %s", path);
-    
-    stream = new FastaRawStream(f, 0);
+    index = FaiIndex::open(path_, factory, options.index_mode, options.io_backend);
+    stream = std::make_shared<FastaRawStream>(factory, 0);
+    currSequence = nullptr;
+    firstCol = true;
+}
+
+FastaSequenceIterator::FastaSequenceIterator(SourceFactory const &factory_,
+                                             seqio_sequence_options const &options)
+    : factory(factory_)
+    , interpreter(options.base_transform, options.strand)
+    , scanMode(options.scan_mode)
+    , filter(options) {
+
+    callback = std::make_shared<Callback>(this);
+
+    stream = std::make_shared<FastaRawStream>(factory, 0);
     currSequence = nullptr;
-    eos_offset = 0;
+    firstCol = true;
 }
 
 FastaSequenceIterator::~FastaSequenceIterator() {
     callback->iteratorClosing();
+}
 
-    delete stream;
+uint64_t FastaSequenceIterator::getBytesRead() {
+    return stream->getBytesRead();
 }
 
+bool FastaSequenceIterator::findHeader() {
+    char const *begin, *end;
+
+    while(stream->peek(&begin, &end)) {
+        // Headers are rare, so rather than visit every line, search for a
+        // '>' and check that it begins a line.
+        char const *gt = begin;
+        while( (gt = (char const *)memchr(gt, '>', end - gt)) ) {
+            if((gt == begin) ? firstCol : (gt[-1] == '\n')) {
+                stream->consume(gt + 1 - begin);
+                return true;
+            }
+            gt++;
+        }
 
-ISequence *FastaSequenceIterator::nextSequence() {
+        firstCol = (end[-1] == '\n');
+        stream->consume(end - begin);
+    }
+
+    return false;
+}
+
+uint64_t FastaSequenceIterator::scanBases() {
+    firstCol = true;
+
+    // Without counting, findHeader() skips the bases on the way to the next
+    // header.
+    if((scanMode == SEQIO_SCAN_HEADERS) && !filter.filtersLengths())
+        return 0;
+    return count_bases(*stream, firstCol);
+}
+
+bool FastaSequenceIterator::preloadBases(uint64_t *length) {
+    if(!loadBuffer || (loadBuffer.use_count() > 1))
+        loadBuffer = std::make_shared<string>();
+    string &bases = *loadBuffer;
+
+    // As in FastaSequence::loadBases(), the buffer is only ever grown.
+    uint64_t n = 0;
+    bool eos = false;
+    firstCol = true;
+    while(!eos) {
+        if(filter.exceedsLength(n))
+            return false;
+        if(n == bases.size())
+            bases.resize(std::max(bases.size() * 2, size_t(64 * 1024)));
+        n += read_bases(*stream, raw_interpreter, firstCol, eos, &bases[n], bases.size() - n);
+    }
+
+    *length = n;
+    return filter.acceptsLength(n);
+}
+
+bool FastaSequenceIterator::acceptsHeader(bool parse) {
+    header.entry = nullptr;
+    if(!parse && !index && !filter.filtersNames())
+        return true;
+
+    parse_fasta_header(header.line->data(), header.line->data() + header.line->size(),
+                       header.name, header.comment);
+    if(index)
+        header.entry = index->find(header.name.c_str());
+
+    if(filter.filtersNames() && !filter.acceptsName(header.name))
+        return false;
+    // Without an index, the length isn't known until the bases are read.
+    if(header.entry && !filter.acceptsLength(header.entry->length))
+        return false;
+    return true;
+}
+
+bool FastaSequenceIterator::nextHeader(bool parse) {
+    // The current sequence shares our stream, so wherever it stopped reading
+    // is where we resume looking for the next header. It is detached rather
+    // than read to its end and rewound, so no byte is ever read twice.
     if(currSequence) {
-        eos_offset = currSequence->tellEnd();
+        firstCol = currSequence->isFirstCol();
+        currSequence->detach();
         currSequence = nullptr;
     }
 
-    stream->seek_abs(eos_offset);
-
-    // ---
-    // --- Find next header
-    // ---
-    {
-        bool firstCol = true;
-        bool foundHeader = false;
-        int c;
-        while((c = stream->nextChar()) > -1) {
-            if(c == '\n') {
-                firstCol = true;
-            } else if((c == '>') && firstCol) {
-                foundHeader = true;
+    while(true) {
+        if(!findHeader()) return false;
+
+        // The line is copied a span at a time, and only split into name and
+        // comment if they're asked for. Its buffer is reused unless a sequence
+        // that hasn't been disposed still holds it.
+        if(!header.line || (header.line.use_count() > 1))
+            header.line = std::make_shared<string>();
+        header.line->clear();
+
+        char const *begin, *end;
+        while(true) {
+            // A header cut off by the end of the file isn't a record.
+            if(!stream->peek(&begin, &end)) return false;
+
+            char const *newline = (char const *)memchr(begin, '\n', end - begin);
+            if(newline) {
+                header.line->append(begin, newline - begin);
+                stream->consume(newline + 1 - begin);
                 break;
-            } else {
-                firstCol = false;
             }
+            header.line->append(begin, end - begin);
+            stream->consume(end - begin);
         }
 
-        if(!foundHeader) return nullptr;
+        if(acceptsHeader(parse))
+            return true;
+
+        // A rejected record's bases are skipped by findHeader() on the way
+        // to the next header.
+        firstCol = true;
     }
+}
 
-    // ---
-    // --- Get name and comment
-    // ---
-    string name;
-    string comment;
-    {
-        int c;
-        while(!isspace(c = stream->nextChar()) && (c > -1)) {
-            name += c;
+ISequence *FastaSequenceIterator::nextSequence() {
+    while(nextHeader(false)) {
+        FaiIndex::Entry const *entry = header.entry;
+
+        if(scanMode != SEQIO_SCAN_BASES) {
+            uint64_t length = scanBases();
+            if(filter.filtersLengths() && !filter.acceptsLength(length))
+                continue;
+
+            FastaSequence *sequence = new FastaSequence(FastaMetadata(header.line),
+                                                        nullptr,
+                                                        &interpreter,
+                                                        nullptr,
+                                                        index,
+                                                        entry);
+            sequence->setScanned(scanMode == SEQIO_SCAN_LENGTHS, length);
+            return sequence;
         }
-        if(c == -1) return nullptr;
 
-        if((c != '\n') && (c != '\r')) {
-            while(((c = stream->nextChar()) != '\n') && (c > -1)) {
-                if(c != '\r')
-                    comment += c;
+        // Without an index, the filter needs the bases counted before the
+        // sequence is handed out, so they're read up front rather than read
+        // twice.
+        if(filter.filtersLengths() && !entry) {
+            uint64_t length;
+            if(!preloadBases(&length))
+                continue;
+
+            FastaSequence *sequence = new FastaSequence(FastaMetadata(header.line),
+                                                        nullptr,
+                                                        &interpreter,
+                                                        nullptr,
+                                                        index,
+                                                        entry,
+                                                        loadBuffer);
+            sequence->setLoaded(length);
+            return sequence;
+        }
+
+        // The functor will maintain a shared pointer to the callback, meaning
+        // the callback will still be valid even if the iterator has been disposed.
+        std::shared_ptr<Callback> callback_ = callback;
+        auto onClose = [callback_] (FastaSequence *sequence) {
+            callback_->sequenceClosing(sequence);
+        };
+
+        // Hand the reverse complement buffer to the new sequence unless it's
+        // still held by one that hasn't been disposed.
+        if(interpreter.isReverseComplement() && (!loadBuffer || (loadBuffer.use_count() > 1)))
+            loadBuffer = std::make_shared<string>();
+
+        currSequence = new FastaSequence(FastaMetadata(header.line),
+                                         stream,
+                                         &interpreter,
+                                         onClose,
+                                         index,
+                                         entry,
+                                         loadBuffer);
+
+        return currSequence;
+    }
+
+    return nullptr;
+}
+
+uint64_t FastaSequenceIterator::nextBatch(BatchBuilder &builder,
+                                          uint64_t max_records) {
+    seqio_batch *batch = builder.batch;
+    uint64_t n = 0;
+
+    while((n < max_records) && nextHeader(true)) {
+        uint64_t i = builder.addRecord();
+        batch->names[i] = builder.append(header.name.data(), header.name.size());
+        batch->comments[i] = builder.append(header.comment.data(), header.comment.size());
+
+        if(scanMode != SEQIO_SCAN_BASES) {
+            uint64_t length = scanBases();
+            if(filter.filtersLengths() && !filter.acceptsLength(length)) {
+                builder.dropRecord();
+                continue;
             }
-            if(c == -1) return nullptr;
+            batch->lengths[i] = (scanMode == SEQIO_SCAN_LENGTHS) ? length : 0;
+            batch->bases[i] = builder.finish(builder.tell());
+            n++;
+            continue;
         }
+
+        // Parse the bases straight into the arena. A reverse complement is
+        // produced in place once the sequence's end is found. Without an
+        // index, a record the filter rejects by length is dropped once it's
+        // known to be too long or has ended; findHeader() skips whatever is
+        // left of it.
+        bool const reverse = interpreter.isReverseComplement();
+        uint64_t start = builder.tell();
+        bool eos = false;
+        firstCol = true;
+        while(!eos && !filter.exceedsLength(builder.tell() - start)) {
+            uint64_t const length = 64 * 1024;
+            builder.extend(read_bases(*stream, reverse ? raw_interpreter : interpreter,
+                                      firstCol, eos, builder.reserve(length), length));
+        }
+        if(!filter.acceptsLength(builder.tell() - start)) {
+            builder.dropRecord();
+            continue;
+        }
+        if(reverse) {
+            char *bases = batch->arena + start;
+            interpreter.reverseComplement(bases, builder.tell() - start, bases);
+        }
+        batch->bases[i] = builder.finish(start);
+        batch->lengths[i] = batch->bases[i].length;
+        n++;
     }
 
-    // The functor will maintain a shared pointer to the callback, meaning
-    // the callback will still be valid even if the iterator has been disposed.
-    std::shared_ptr<Callback> callback_ = callback;
-    auto onClose = [callback_] (FastaSequence *sequence) {
-        callback_->sequenceClosing(sequence);
-    };
+    return n;
+}
+
+ISequence *FastaSequenceIterator::openSequence(char const *name) {
+    if(!index)
+        raise_state("Cannot open FASTA sequence by name without an index.");
+
+    FaiIndex::Entry const *entry = index->find(name);
+    if(!entry)
+        raise_parm("No sequence named %s", name);
+
+    // The index doesn't include the comment, so we need the header line
+    // that precedes the first base. Read a window ending at the first base,
+    // growing it until it contains the start of the header.
+    std::shared_ptr<FastaRawStream> seqstream = std::make_shared<FastaRawStream>(factory, 0);
+    string header;
+    for(uint64_t window = 4 * 1024; ; window *= 2) {
+        z_off_t start = entry->offset > window ? entry->offset - window : 0;
+        seqstream->seek_abs(start);
+
+        string text;
+        char const *begin, *end;
+        while((uint64_t(seqstream->tell_abs()) < entry->offset) && seqstream->peek(&begin, &end)) {
+            uint32_t n = (uint32_t)std::min(uint64_t(end - begin), entry->offset - seqstream->tell_abs());
+            text.append(begin, n);
+            seqstream->consume(n);
+        }
 
-    currSequence = new FastaSequence(FastaMetadata(name, comment),
-                                     stream->createSubstream(),
-                                     &interpreter,
-                                     onClose);
+        size_t header_start = text.size() > 1 ? text.rfind('\n', text.size() - 2) : string::npos;
+        if(header_start != string::npos) {
+            header = text.substr(header_start + 1);
+            break;
+        } else if(start == 0) {
+            header = text;
+            break;
+        }
+    }
 
-    return currSequence;
+    string header_name, comment;
+    {
+        size_t begin = (!header.empty() && (header[0] == '>')) ? 1 : 0;
+        size_t end = header.find('\n', begin);
+        if(end == string::npos)
+            end = header.size();
+        parse_fasta_header(header.data() + begin, header.data() + end, header_name, comment);
+    }
+
+    return new FastaSequence(FastaMetadata(name, comment),
+                             seqstream,
+                             &interpreter,
+                             nullptr,
+                             index,
+                             entry);
 }
 
 FastaSequenceIterator::Callback::Callback(FastaSequenceIterator *thiz_)
@@ -420,7 +970,7 @@ FastaSequenceIterator::Callback::Callback(FastaSequenceIterator *thiz_)
 
 void FastaSequenceIterator::Callback::sequenceClosing(FastaSequence *sequence) {
     if(thiz && (sequence == thiz->currSequence)) {
-        thiz->eos_offset = sequence->tellEnd();
+        thiz->firstCol = sequence->isFirstCol();
         thiz->currSequence = nullptr;
     }
 }
@@ -436,34 +986,32 @@ void FastaSequenceIterator::Callback::iteratorClosing() {
  **********************************************************************/
 
 FastaWriter::FastaWriter(char const *path,
-                         seqio_file_format file_format) {
+                         seqio_file_format file_format,
+                         seqio_io_backend const *backend) {
     inSequence = false;
 
     switch(file_format) {
     case SEQIO_FILE_FORMAT_FASTA: {
-        FILE *f = fopen(path, "w");
+        std::shared_ptr<File> f = File::open(backend, path, true);
 
         doWrite = [=] (char const *buffer, uint32_t len) {
-            size_t rc = fwrite(buffer, 1, len, f);
-            if(rc != len)
-                raise_io("Failed writing to %s", path);
+            f->write(buffer, len);
         };
 
         doClose = [=] () {
-            fclose(f);
+            f->close();
         };
     } break;
     case SEQIO_FILE_FORMAT_FASTA_GZIP: {
-        gzFile f = gzopen(path, "w");
+        // BGZF is valid gzip, but can also be indexed for random access.
+        std::shared_ptr<BgzfWriter> f = std::make_shared<BgzfWriter>(File::open(backend, path, true));
 
         doWrite = [=] (char const *buffer, uint32_t len) {
-            size_t rc = gzwrite(f, buffer, len);
-            if(rc != len)
-                raise_io("Failed writing to %s", path);
+            f->write(buffer, len);
         };
 
         doClose = [=] () {
-            gzclose(f);
+            f->close();
         };
     } break;
     default:
@@ -472,7 +1020,11 @@ FastaWriter::FastaWriter(char const *path,
 }
 
 FastaWriter::~FastaWriter() {
-    doClose();
+    try {
+        close();
+    } catch(Exception &) {
+        // Can't raise from a destructor.
+    }
 }
 
 void FastaWriter::createSequence(IConstDictionary const *metadata) {
@@ -505,6 +1057,10 @@ void FastaWriter::write(char const *buffer,
     }
 }
 
+void FastaWriter::close() {
+    doClose();
+}
+
 void FastaWriter::writeMetadata() {
     if(name.length() == 0)
         raise_state("Must specify sequence name");
@@ -1,11 +1,15 @@
 #pragma once
 
+#include "fai.hpp"
+#include "filter.hpp"
 #include "seqio_impl.hpp"
+#include "source.hpp"
 
 #include <ctype.h>
 #include <stdint.h>
 #include <zlib.h>
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
@@ -13,25 +17,15 @@
 namespace seqio {
     namespace impl {
 
-        bool is_fasta_file_content(char const *path);
+        bool is_fasta_file_content(char const *path, seqio_io_backend const *backend = nullptr);
         bool is_fasta_file_name(char const *path);
         bool is_fasta_gzip_file_name(char const *path);
-
-/**********************************************************************
- *
- * CLASS FileHandle
- *
- **********************************************************************/
-        struct __FileHandle {
-            __FileHandle(gzFile f_);
-            ~__FileHandle();
-
-            operator gzFile();
-
-            gzFile f;
-        };
-
-        typedef std::shared_ptr<__FileHandle> FileHandle;
+        // Splits a header line, without its '>' and newline, into the name and
+        // the comment that follows it.
+        void parse_fasta_header(char const *begin,
+                                char const *end,
+                                std::string &name,
+                                std::string &comment);
 
 /**********************************************************************
  *
@@ -40,31 +34,41 @@ namespace seqio {
  **********************************************************************/
         class FastaRawStream {
         public:
-            FastaRawStream(FileHandle f_,
-                           z_off_t start_);
+            FastaRawStream(SourceFactory const &factory_,
+                           z_off_t start);
 
             int nextChar();
+            // Bulk access to the cache. peek() refills the cache if it has been
+            // consumed and returns false at EOF; consume() advances past bytes
+            // obtained from peek().
+            bool peek(char const **begin, char const **end);
+            void consume(uint64_t n);
             z_off_t tell_abs();
             void seek_abs(z_off_t offset);
+            bool isRandomAccess();
 
-            FastaRawStream *createSubstream();
+            SourceFactory const &getFactory();
+            // Number of (decompressed) bytes read from the file by this stream.
+            uint64_t getBytesRead();
 
         private:
-            FastaRawStream() {}
+            bool fill();
 
+            // Spans handed out by the source, which are not copied.
             struct {
-                char buf[1024*64];
-                uint32_t len;
-                uint32_t index;
+                char const *buf = nullptr;
+                uint64_t len = 0;
+                uint64_t index = 0;
             } cache;
 
             struct {
-                z_off_t read_offset;
+                z_off_t read_offset = 0;
                 bool eof = false;
+                uint64_t bytes_read = 0;
             } fstate;
 
-            FileHandle f;
-            z_off_t start;
+            SourceFactory factory;
+            std::unique_ptr<ISource> source;
         };
 
 /**********************************************************************
@@ -81,12 +85,24 @@ namespace seqio {
                 HEADER
             };
 
-            CharInterpreter(seqio_base_transform transform);
+            CharInterpreter(seqio_base_transform transform,
+                            seqio_strand strand = SEQIO_STRAND_FORWARD);
 
             inline char getBase(char c) const {
                 return bases[c & 0xFF];
             }
 
+            // Transforms a span of APPEND_SEQUENCE characters into dst.
+            void transform(char const *src, uint64_t len, char *dst) const;
+            // Transforms a span of APPEND_SEQUENCE characters into dst in
+            // reverse order, complementing each base. src and dst may be the
+            // same buffer.
+            void reverseComplement(char const *src, uint64_t len, char *dst) const;
+
+            inline bool isReverseComplement() const {
+                return strand == SEQIO_STRAND_REVERSE_COMPLEMENT;
+            }
+
             inline Action getAction(char c, bool firstCol) const {
                 if(firstCol) 
                     return actions_firstCol[c & 0xFF];
@@ -95,7 +111,10 @@ namespace seqio {
             }
 
         private:
+            seqio_base_transform base_transform;
+            seqio_strand strand;
             char bases[256];
+            char complements[256];
             Action actions_firstCol[256];
             Action actions_otherCol[256];
         };
@@ -104,10 +123,14 @@ namespace seqio {
  *
  * CLASS FastaMetadata
  *
+ * Either the name and comment, or the header line they're parsed from
+ * the first time either is asked for.
+ *
  **********************************************************************/
         class FastaMetadata : public IConstDictionary {
         public:
             FastaMetadata(std::string name, std::string comment);
+            FastaMetadata(std::shared_ptr<std::string const> line);
             virtual ~FastaMetadata();
 
             virtual bool hasKey(char const *key) const override;
@@ -116,8 +139,10 @@ namespace seqio {
             virtual char const *getValue(char const *key) const override;
 
         private:
-            std::string name;
-            std::string comment;
+            // Released once parsed, so the iterator can recycle it.
+            mutable std::shared_ptr<std::string const> line;
+            mutable std::string name;
+            mutable std::string comment;
         };
 
 /**********************************************************************
@@ -128,26 +153,92 @@ namespace seqio {
         class FastaSequence : public ISequence {
         public:
             FastaSequence(FastaMetadata const &metadata_,
-                          FastaRawStream *stream_,
+                          std::shared_ptr<FastaRawStream> stream_,
                           CharInterpreter const *interpreter_,
-                          std::function<void (FastaSequence *sequence)> onClose_);
+                          std::function<void (FastaSequence *sequence)> onClose_,
+                          std::shared_ptr<FaiIndex> index_,
+                          FaiIndex::Entry const *entry_,
+                          std::shared_ptr<std::string> loadBuffer_ = nullptr);
             virtual ~FastaSequence();
 
             virtual IConstDictionary const &getMetadata() override;
             virtual uint64_t read(char *buffer,
                                   uint64_t buffer_length) override;
-            z_off_t tellEnd();
+            virtual char const *getQuality(uint64_t *length) override;
+            virtual bool hasQuality() override;
+            // Known with an index, or once the bases have been counted by a
+            // scan.
+            virtual uint64_t getLength() override;
+            virtual void getPacked(seqio_packed_sequence *packed) override;
+
+            // Marks the sequence as found by a scan, so it has no bases.
+            // length is what the scan counted, if it counted them.
+            void setScanned(bool counted, uint64_t length);
+            // Marks the sequence's bases as already read, untransformed, into
+            // the first length characters of the buffer it was given.
+            void setLoaded(uint64_t length);
+
+            // Requires an index.
+            virtual void seek(uint64_t offset) override;
+
+            // Whether the next character in the stream begins a line.
+            bool isFirstCol();
+            // Stop reading from the stream shared with the iterator. If the
+            // sequence hasn't been read to its end, subsequent reads will come
+            // from a private stream that is opened on demand.
+            void detach();
 
         private:
+            uint64_t readForward(CharInterpreter const &interpreter,
+                                 char *buffer,
+                                 uint64_t buffer_length);
+            // Reads the rest of the sequence into loaded.bases.
+            void loadBases();
+            // Hands out the reverse complement back from reverse.end, reading a
+            // window of the bases before it when those cached run out.
+            uint64_t readReverse(char *buffer,
+                                 uint64_t buffer_length);
+            // Positions a private stream at a forward offset. Requires an index.
+            void seekStream(uint64_t offset);
+
             FastaMetadata metadata;
-            FastaRawStream * const stream;
+            std::shared_ptr<FastaRawStream> stream;
             CharInterpreter const * const interpreter;
             std::function<void (FastaSequence *sequence)> onClose;
+            std::shared_ptr<FaiIndex> index;
+            FaiIndex::Entry const *entry;
             struct {
                 bool firstCol;
                 bool eos;
-                z_off_t eos_offset;
             } parse;
+            struct {
+                bool scanned;
+                bool counted;
+                uint64_t length;
+            } scan;
+            struct {
+                SourceFactory factory;
+                z_off_t offset;
+            } detached;
+            // Untransformed bases of a reverse complemented sequence, which
+            // are handed out from remaining back to the start, or of one whose
+            // length had to be known before it was handed out, which are
+            // handed out from the start.
+            struct {
+                bool done;
+                std::shared_ptr<std::string> bases;
+                uint64_t length;
+                uint64_t remaining;
+            } loaded;
+            // Set by seeking along the reverse complement of an indexed file
+            // that can be read from anywhere, so the sequence needn't be loaded.
+            // The cached bases before end, a forward offset, are the last of a
+            // window read forward into loaded.bases.
+            struct {
+                bool windowed;
+                uint64_t end;
+                uint64_t cached;
+            } reverse;
         };
 
 /**********************************************************************
@@ -157,13 +248,39 @@ namespace seqio {
  **********************************************************************/
         class FastaSequenceIterator : public ISequenceIterator {
         public:
-            FastaSequenceIterator(char const *path,
-                                  seqio_base_transform transform);
+            FastaSequenceIterator(char const *path_,
+                                  seqio_sequence_options const &options);
+            // Content without a path has no index, so sequences can't be
+            // opened by name.
+            FastaSequenceIterator(SourceFactory const &factory_,
+                                  seqio_sequence_options const &options);
             virtual ~FastaSequenceIterator();
 
             virtual ISequence *nextSequence() override;
+            virtual ISequence *openSequence(char const *name) override;
+            virtual uint64_t nextBatch(BatchBuilder &builder,
+                                       uint64_t max_records) override;
+
+            // Number of (decompressed) bytes the iterator and the sequences
+            // attached to it have read from the file.
+            uint64_t getBytesRead();
 
         private:
+            // Positions the stream after the next header the filter accepts
+            // by name, copying the line into header.line. It's split into
+            // header.name and header.comment if parse is set, or if that's
+            // needed to look up header.entry or apply the filter.
+            bool nextHeader(bool parse);
+            bool findHeader();
+            bool acceptsHeader(bool parse);
+            // Skips the bases following the header just read, returning how
+            // many there are if the scan or the filter counts them.
+            uint64_t scanBases();
+            // Reads the bases following the header just read into loadBuffer,
+            // untransformed, returning whether the filter accepts their number.
+            // Stops early once there are too many.
+            bool preloadBases(uint64_t *length);
+
             class Callback {
             public:
                 Callback(FastaSequenceIterator *thiz_);
@@ -176,10 +293,25 @@ namespace seqio {
             };
             std::shared_ptr<Callback> callback;
 
-            FastaRawStream *stream;
+            SourceFactory factory;
+            std::shared_ptr<FastaRawStream> stream;
+            std::shared_ptr<FaiIndex> index;
             CharInterpreter interpreter;
+            seqio_scan_mode scanMode;
+            SequenceFilter filter;
             FastaSequence *currSequence;
-            z_off_t eos_offset;
+            // Recycled from one sequence that's read up front to the next.
+            std::shared_ptr<std::string> loadBuffer;
+            bool firstCol;
+            struct {
+                // Handed to the sequence, and recycled like loadBuffer.
+                std::shared_ptr<std::string> line;
+                // Parsed only when needed, and reused from one header to the
+                // next.
+                std::string name;
+                std::string comment;
+                FaiIndex::Entry const *entry;
+            } header;
         };
 
 /**********************************************************************
@@ -190,12 +322,14 @@ namespace seqio {
         class FastaWriter : public IWriter {
         public:
             FastaWriter(char const *path,
-                        seqio_file_format file_format);
+                        seqio_file_format file_format,
+                        seqio_io_backend const *backend = nullptr);
             virtual ~FastaWriter();
 
             virtual void createSequence(IConstDictionary const *metadata) override;
             virtual void write(char const *buffer,
                                uint64_t length) override;
+            virtual void close() override;
 
         private:
             void writeMetadata();
@@ -0,0 +1,335 @@
+#include "fasta_parallel.hpp"
+
+#include "batch.hpp"
+#include "simd.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+
+using std::shared_ptr;
+using std::string;
+using std::vector;
+using namespace seqio::impl;
+
+#define MIN_CHUNK_SIZE (1024 * 1024)
+// Chunks per thread, so that a chunk holding a long sequence doesn't leave
+// the other threads idle.
+#define CHUNKS_PER_THREAD 16
+
+// Returns the offset of the first record ('>' at the start of a line) in
+// [offset, limit), or limit if there is none.
+static uint64_t find_record(char const *data, uint64_t offset, uint64_t limit) {
+    while(offset < limit) {
+        char const *gt = (char const *)memchr(data + offset, '>', limit - offset);
+        if(!gt)
+            break;
+
+        uint64_t i = gt - data;
+        if((i == 0) || (data[i - 1] == '\n'))
+            return i;
+        offset = i + 1;
+    }
+    return limit;
+}
+
+/**********************************************************************
+ *
+ * CLASS ParsedFastaSequence
+ *
+ **********************************************************************/
+ParsedFastaSequence::ParsedFastaSequence(FastaMetadata const &metadata_,
+                                         string &&bases_)
+    : metadata(metadata_)
+    , bases(std::move(bases_))
+    , offset(0) {
+}
+
+ParsedFastaSequence::~ParsedFastaSequence() {
+}
+
+IConstDictionary const &ParsedFastaSequence::getMetadata() {
+    return metadata;
+}
+
+uint64_t ParsedFastaSequence::read(char *buffer,
+                                   uint64_t buffer_length) {
+    uint64_t n = std::min(buffer_length, bases.size() - offset);
+    memcpy(buffer, bases.data() + offset, n);
+    offset += n;
+    return n;
+}
+
+char const *ParsedFastaSequence::getQuality(uint64_t *length) {
+    raise_state("FASTA sequences have no quality values.");
+}
+
+bool ParsedFastaSequence::hasQuality() {
+    return false;
+}
+
+uint64_t ParsedFastaSequence::getLength() {
+    return bases.size();
+}
+
+void ParsedFastaSequence::seek(uint64_t offset_) {
+    if(offset_ > bases.size())
+        raise_parm("Seek offset %zu exceeds sequence length %zu.",
+                   size_t(offset_), size_t(bases.size()));
+    offset = offset_;
+}
+
+void ParsedFastaSequence::getPacked(seqio_packed_sequence *packed) {
+    raise_state("FASTA sequences have no packed bases.");
+}
+
+/**********************************************************************
+ *
+ * CLASS ParallelFastaSequenceIterator
+ *
+ **********************************************************************/
+ParallelFastaSequenceIterator::ParallelFastaSequenceIterator(char const *path,
+                                                             seqio_sequence_options const &options)
+    : mapping(std::make_shared<FileMapping>(File::open(options.io_backend, path)))
+    , interpreter(options.base_transform, options.strand)
+    , nthreads(options.num_threads)
+    , ordered(options.record_order == SEQIO_RECORD_ORDER_FILE)
+    , dropBehind(options.page_cache != SEQIO_PAGE_CACHE_KEEP)
+    , filter(options)
+    , serial(path, options) {
+
+    setup();
+}
+
+ParallelFastaSequenceIterator::ParallelFastaSequenceIterator(shared_ptr<FileMapping> mapping_,
+                                                             seqio_sequence_options const &options)
+    : mapping(mapping_)
+    , interpreter(options.base_transform, options.strand)
+    , nthreads(options.num_threads)
+    , ordered(options.record_order == SEQIO_RECORD_ORDER_FILE)
+    , dropBehind(false)
+    , filter(options)
+    , serial([mapping_] () -> ISource * {return new MmapSource(mapping_);}, options) {
+
+    setup();
+}
+
+ParallelFastaSequenceIterator::~ParallelFastaSequenceIterator() {
+    stop();
+}
+
+void ParallelFastaSequenceIterator::setup() {
+    uint64_t length = mapping->getLength();
+    chunkSize = std::max(length / (nthreads * CHUNKS_PER_THREAD), uint64_t(MIN_CHUNK_SIZE));
+    chunkCount = (length + chunkSize - 1) / chunkSize;
+
+    // Enough slots that every worker can be parsing while the consumer
+    // holds one and others wait to be consumed.
+    for(uint32_t i = 0; i < 2 * nthreads; i++) {
+        slots.emplace_back(new Slot());
+    }
+}
+
+ISequence *ParallelFastaSequenceIterator::nextSequence() {
+    Record *record;
+    if(!nextRecord(&record))
+        return nullptr;
+
+    return new ParsedFastaSequence(FastaMetadata(record->name, record->comment),
+                                   std::move(record->bases));
+}
+
+ISequence *ParallelFastaSequenceIterator::openSequence(char const *name) {
+    return serial.openSequence(name);
+}
+
+uint64_t ParallelFastaSequenceIterator::nextBatch(BatchBuilder &builder,
+                                                  uint64_t max_records) {
+    seqio_batch *batch = builder.batch;
+    uint64_t n = 0;
+    Record *record;
+
+    for(; (n < max_records) && nextRecord(&record); n++) {
+        uint64_t i = builder.addRecord();
+        batch->names[i] = builder.append(record->name.data(), record->name.size());
+        batch->comments[i] = builder.append(record->comment.data(), record->comment.size());
+        batch->bases[i] = builder.append(record->bases.data(), record->bases.size());
+        batch->lengths[i] = record->bases.size();
+    }
+
+    return n;
+}
+
+bool ParallelFastaSequenceIterator::nextRecord(Record **record) {
+    if(workers.empty())
+        start();
+
+    if(current && (currentIndex < current->count)) {
+        *record = &current->records[currentIndex++];
+        return true;
+    }
+
+    std::unique_lock<std::mutex> guard(lock);
+    while(true) {
+        if(current) {
+            current->state = Slot::FREE;
+            current = nullptr;
+            consumedChunks++;
+            slotFree.notify_all();
+        }
+
+        if(consumedChunks == chunkCount)
+            return false;
+
+        // In file order, the next slot is the one holding the chunk after
+        // the last consumed; otherwise it's whichever finished first.
+        slotReady.wait(guard, [this] () {
+                for(auto &slot: slots) {
+                    if((slot->state == Slot::READY) && (!ordered || (slot->chunk == consumedChunks))) {
+                        current = slot.get();
+                        return true;
+                    }
+                }
+                return false;
+            });
+        currentIndex = 0;
+
+        if(current->error)
+            std::rethrow_exception(current->error);
+
+        // Chunks within a long sequence have no records of their own, and
+        // the filter may have rejected all of a chunk's records.
+        if(current->count > 0) {
+            *record = &current->records[currentIndex++];
+            return true;
+        }
+    }
+}
+
+void ParallelFastaSequenceIterator::start() {
+    for(uint32_t i = 0; i < nthreads; i++) {
+        workers.emplace_back(&ParallelFastaSequenceIterator::work, this);
+    }
+}
+
+void ParallelFastaSequenceIterator::stop() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    slotFree.notify_all();
+
+    for(auto &worker: workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+void ParallelFastaSequenceIterator::work() {
+    std::unique_lock<std::mutex> guard(lock);
+
+    while(true) {
+        Slot *slot = nullptr;
+        slotFree.wait(guard, [this, &slot] () {
+                if(stopping || (nextChunk == chunkCount))
+                    return true;
+                for(auto &s: slots) {
+                    if(s->state == Slot::FREE) {
+                        slot = s.get();
+                        return true;
+                    }
+                }
+                return false;
+            });
+        if(stopping || (nextChunk == chunkCount))
+            return;
+
+        // Chunks are claimed under the lock, which keeps them in file order;
+        // only parsing happens concurrently.
+        slot->state = Slot::PARSING;
+        slot->chunk = nextChunk++;
+        slot->error = nullptr;
+
+        guard.unlock();
+        try {
+            parseChunk(slot->chunk, slot->records, &slot->count);
+            // Records are copied out of the mapping, so its pages are done
+            // with. A record running into later chunks is dropped as those
+            // chunks are parsed.
+            if(dropBehind)
+                mapping->dropCached(slot->chunk * chunkSize, chunkSize);
+        } catch(...) {
+            slot->error = std::current_exception();
+        }
+        guard.lock();
+
+        slot->state = Slot::READY;
+        slotReady.notify_all();
+    }
+}
+
+void ParallelFastaSequenceIterator::parseChunk(uint64_t chunk,
+                                               vector<Record> &records,
+                                               uint64_t *count) {
+    char const *data = mapping->getData();
+    uint64_t length = mapping->getLength();
+    uint64_t chunk_begin = chunk * chunkSize;
+    uint64_t chunk_end = std::min(chunk_begin + chunkSize, length);
+
+    *count = 0;
+    uint64_t begin = find_record(data, chunk_begin, chunk_end);
+    while(begin < chunk_end) {
+        // The record ends where the next begins, which may be in a later chunk.
+        uint64_t end = find_record(data, begin + 1, length);
+
+        // As with the sequential iterator, a header cut off by the end of
+        // the file isn't a record.
+        if(!memchr(data + begin, '\n', end - begin))
+            break;
+
+        if(*count == records.size())
+            records.emplace_back();
+        if(parseRecord(data + begin, data + end, records[*count]))
+            (*count)++;
+        begin = end;
+    }
+}
+
+bool ParallelFastaSequenceIterator::parseRecord(char const *begin,
+                                                 char const *end,
+                                                 Record &record) {
+    char const *line_end = (char const *)memchr(begin, '\n', end - begin);
+
+    // ---
+    // --- Get name and comment
+    // ---
+    parse_fasta_header(begin + 1, line_end, record.name, record.comment);
+    if(filter.filtersNames() && !filter.acceptsName(record.name))
+        return false;
+    // The whole record is mapped, so its bases can be counted before any
+    // are copied.
+    if(filter.filtersLengths() && !filter.acceptsLength(count_graph(line_end + 1, end)))
+        return false;
+
+    // ---
+    // --- Get bases
+    // ---
+    // A reverse complement is transformed once the record is complete.
+    bool const reverse = interpreter.isReverseComplement();
+    record.bases.resize(end - (line_end + 1));
+    uint64_t n = 0;
+    for(char const *p = line_end + 1; p < end; ) {
+        char const *special = find_nongraph(p, end);
+        if(reverse)
+            memcpy(&record.bases[n], p, special - p);
+        else
+            interpreter.transform(p, special - p, &record.bases[n]);
+        n += special - p;
+        p = special + 1;
+    }
+    record.bases.resize(n);
+
+    if(reverse)
+        interpreter.reverseComplement(&record.bases[0], n, &record.bases[0]);
+    return true;
+}
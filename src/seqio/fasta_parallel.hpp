@@ -0,0 +1,135 @@
+#pragma once
+
+#include "fasta.hpp"
+#include "seqio_impl.hpp"
+#include "source.hpp"
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace seqio {
+    namespace impl {
+
+/**********************************************************************
+ *
+ * CLASS ParsedFastaSequence
+ *
+ * A FASTA record that was parsed in its entirety by a worker thread.
+ *
+ **********************************************************************/
+        class ParsedFastaSequence : public ISequence {
+        public:
+            ParsedFastaSequence(FastaMetadata const &metadata_,
+                                std::string &&bases_);
+            virtual ~ParsedFastaSequence();
+
+            virtual IConstDictionary const &getMetadata() override;
+            virtual uint64_t read(char *buffer,
+                                  uint64_t buffer_length) override;
+            virtual char const *getQuality(uint64_t *length) override;
+            virtual bool hasQuality() override;
+            virtual uint64_t getLength() override;
+            virtual void seek(uint64_t offset) override;
+            virtual void getPacked(seqio_packed_sequence *packed) override;
+
+        private:
+            FastaMetadata metadata;
+            std::string bases;
+            uint64_t offset;
+        };
+
+/**********************************************************************
+ *
+ * CLASS ParallelFastaSequenceIterator
+ *
+ * Parses an uncompressed FASTA file on a pool of worker threads. The
+ * mapped file is divided into fixed-size chunks, and a chunk owns the
+ * records whose '>' falls within it, however far past the chunk those
+ * records extend. Workers claim chunks in file order, each into a free
+ * slot of a bounded set, and parse them into memory. The slots are
+ * handed out in chunk order, or as they finish if the caller doesn't
+ * need file order.
+ *
+ **********************************************************************/
+        class ParallelFastaSequenceIterator : public ISequenceIterator {
+        public:
+            ParallelFastaSequenceIterator(char const *path,
+                                          seqio_sequence_options const &options);
+            // Parses content the caller holds in memory, standing in for the
+            // mapped file.
+            ParallelFastaSequenceIterator(std::shared_ptr<FileMapping> mapping_,
+                                          seqio_sequence_options const &options);
+            virtual ~ParallelFastaSequenceIterator();
+
+            virtual ISequence *nextSequence() override;
+            virtual ISequence *openSequence(char const *name) override;
+            virtual uint64_t nextBatch(BatchBuilder &builder,
+                                       uint64_t max_records) override;
+
+        private:
+            struct Record {
+                std::string name;
+                std::string comment;
+                std::string bases;
+            };
+
+            // Makes the next record available as *record, returning false
+            // once all have been handed out.
+            bool nextRecord(Record **record);
+
+            // Divides the content into chunks and allocates the slots.
+            void setup();
+            void start();
+            void stop();
+            void work();
+            void parseChunk(uint64_t chunk, std::vector<Record> &records, uint64_t *count);
+            // Returns false, leaving the bases unparsed, if the filter rejects
+            // the record.
+            bool parseRecord(char const *begin, char const *end, Record &record);
+
+            struct Slot {
+                enum {FREE, PARSING, READY} state = FREE;
+                uint64_t chunk;
+                std::exception_ptr error;
+                // Only the first count records are valid; the rest keep their
+                // capacity for reuse.
+                std::vector<Record> records;
+                uint64_t count;
+            };
+
+            std::shared_ptr<FileMapping> mapping;
+            CharInterpreter interpreter;
+            uint32_t const nthreads;
+            bool const ordered;
+            bool const dropBehind;
+            SequenceFilter const filter;
+            uint64_t chunkSize;
+            uint64_t chunkCount;
+            // Opens sequences by name.
+            FastaSequenceIterator serial;
+
+            std::mutex lock;
+            std::condition_variable slotFree;
+            std::condition_variable slotReady;
+            std::vector<std::thread> workers;
+            std::vector<std::unique_ptr<Slot>> slots;
+            // Next chunk to be claimed by a worker, and the number of chunks
+            // that have been handed out.
+            uint64_t nextChunk = 0;
+            uint64_t consumedChunks = 0;
+            bool stopping = false;
+
+            // The slot whose records are being handed out.
+            Slot *current = nullptr;
+            uint64_t currentIndex = 0;
+        };
+
+    }
+}
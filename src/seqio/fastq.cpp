@@ -0,0 +1,314 @@
+#include "fastq.hpp"
+
+#include "batch.hpp"
+#include "simd.hpp"
+
+#include <ctype.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iterator>
+
+using std::string;
+using namespace seqio::impl;
+
+namespace seqio {
+    namespace impl {
+
+        bool is_fastq_file_content(char const *path, seqio_io_backend const *backend) {
+            char buf[4*1024];
+            uint64_t n = read_content_prefix(path, backend, buf, sizeof(buf));
+
+            for(uint64_t i = 0; i < n; i++) {
+                if(!isspace(buf[i]))
+                    return buf[i] == '@';
+            }
+            return false;
+        }
+
+    }
+}
+
+/**********************************************************************
+ *
+ * CLASS FastqSequence
+ *
+ **********************************************************************/
+FastqSequence::FastqSequence(FastaMetadata const &metadata_,
+                             string &&bases_,
+                             string &&quality_,
+                             uint64_t length_)
+    : metadata(metadata_)
+    , bases(std::move(bases_))
+    , quality(std::move(quality_))
+    , length(length_)
+    , offset(0) {
+}
+
+FastqSequence::~FastqSequence() {
+}
+
+IConstDictionary const &FastqSequence::getMetadata() {
+    return metadata;
+}
+
+uint64_t FastqSequence::read(char *buffer,
+                             uint64_t buffer_length) {
+    uint64_t n = std::min(buffer_length, bases.size() - offset);
+    memcpy(buffer, bases.data() + offset, n);
+    offset += n;
+    return n;
+}
+
+char const *FastqSequence::getQuality(uint64_t *length) {
+    *length = quality.size();
+    return quality.c_str();
+}
+
+bool FastqSequence::hasQuality() {
+    return true;
+}
+
+uint64_t FastqSequence::getLength() {
+    return length;
+}
+
+void FastqSequence::seek(uint64_t offset_) {
+    if(bases.size() != length)
+        raise_state("Cannot seek in a FASTQ sequence found by a scan.");
+    if(offset_ > length)
+        raise_parm("Seek offset %zu exceeds sequence length %zu.",
+                   size_t(offset_), size_t(length));
+    offset = offset_;
+}
+
+void FastqSequence::getPacked(seqio_packed_sequence *packed) {
+    raise_state("FASTQ sequences have no packed bases.");
+}
+
+/**********************************************************************
+ *
+ * CLASS FastqSequenceIterator
+ *
+ **********************************************************************/
+FastqSequenceIterator::FastqSequenceIterator(char const *path,
+                                             seqio_sequence_options const &options)
+    : stream(create_source_factory(path, options), 0)
+    , interpreter(options.base_transform, options.strand)
+    , scanMode(options.scan_mode)
+    , filter(options) {
+}
+
+FastqSequenceIterator::FastqSequenceIterator(SourceFactory const &factory,
+                                             seqio_sequence_options const &options)
+    : stream(factory, 0)
+    , interpreter(options.base_transform, options.strand)
+    , scanMode(options.scan_mode)
+    , filter(options) {
+}
+
+FastqSequenceIterator::~FastqSequenceIterator() {
+}
+
+ISequence *FastqSequenceIterator::nextSequence() {
+    if(!nextRecord())
+        return nullptr;
+
+    return new FastqSequence(FastaMetadata(record.name, record.comment),
+                             std::move(record.bases),
+                             std::move(record.quality),
+                             record.length);
+}
+
+ISequence *FastqSequenceIterator::openSequence(char const *name) {
+    raise_state("Cannot open FASTQ sequence by name.");
+}
+
+uint64_t FastqSequenceIterator::nextBatch(BatchBuilder &builder,
+                                          uint64_t max_records) {
+    seqio_batch *batch = builder.batch;
+    uint64_t n = 0;
+
+    // The record's strings keep their capacity from one record to the next,
+    // so the only per-record cost beyond parsing is copying into the arena.
+    for(; (n < max_records) && nextRecord(); n++) {
+        uint64_t i = builder.addRecord();
+        batch->names[i] = builder.append(record.name.data(), record.name.size());
+        batch->comments[i] = builder.append(record.comment.data(), record.comment.size());
+        batch->bases[i] = builder.append(record.bases.data(), record.bases.size());
+        batch->qualities[i] = builder.append(record.quality.data(), record.quality.size());
+        batch->lengths[i] = scanMode == SEQIO_SCAN_HEADERS ? 0 : record.length;
+    }
+
+    return n;
+}
+
+bool FastqSequenceIterator::nextRecord() {
+    while(parseFourLines() || parseRecord()) {
+        if(record.accepted)
+            return true;
+    }
+    return false;
+}
+
+bool FastqSequenceIterator::parseFourLines() {
+    char const *begin, *end;
+    if(!stream.peek(&begin, &end) || (*begin != '@'))
+        return false;
+
+    char const *eol[4];
+    char const *p = begin;
+    for(int i = 0; i < 4; i++) {
+        eol[i] = (char const *)memchr(p, '\n', end - p);
+        if(!eol[i])
+            return false;
+        p = eol[i] + 1;
+    }
+
+    struct local {
+        static char const *trim_cr(char const *begin, char const *end) {
+            return ((end > begin) && (end[-1] == '\r')) ? end - 1 : end;
+        }
+    };
+
+    char const *seq = eol[0] + 1;
+    char const *seq_end = local::trim_cr(seq, eol[1]);
+    char const *plus = eol[1] + 1;
+    char const *qual = eol[2] + 1;
+    char const *qual_end = local::trim_cr(qual, eol[3]);
+
+    if((*plus != '+')
+       || ((qual_end - qual) != (seq_end - seq))
+       || (find_nongraph(seq, seq_end) != seq_end)
+       || (find_nongraph(qual, qual_end) != qual_end))
+        return false;
+
+    setHeader(begin + 1, local::trim_cr(begin, eol[0]));
+    record.length = seq_end - seq;
+    record.accepted = filter.accepts(record.name, record.length);
+    if(!record.accepted || (scanMode != SEQIO_SCAN_BASES)) {
+        record.bases.clear();
+        record.quality.clear();
+    } else if(interpreter.isReverseComplement()) {
+        record.bases.resize(seq_end - seq);
+        typedef std::reverse_iterator<char const *> reverse;
+        interpreter.reverseComplement(seq, seq_end - seq, &record.bases[0]);
+        record.quality.assign(reverse(qual_end), reverse(qual));
+    } else {
+        record.bases.resize(seq_end - seq);
+        interpreter.transform(seq, seq_end - seq, &record.bases[0]);
+        record.quality.assign(qual, qual_end);
+    }
+
+    stream.consume(p - begin);
+    return true;
+}
+
+bool FastqSequenceIterator::parseRecord() {
+    do {
+        if(!readLine(line))
+            return false;
+    } while(line.empty());
+
+    if(line[0] != '@')
+        raise_parm("Invalid FASTQ: expected '@' at start of record, found '%c'", line[0]);
+    setHeader(line.data() + 1, line.data() + line.size());
+
+    record.bases.clear();
+    while(true) {
+        if(!readLine(line))
+            raise_parm("Invalid FASTQ: record %s has no quality.", record.name.c_str());
+        if(!line.empty() && (line[0] == '+'))
+            break;
+        appendBases(line.data(), line.data() + line.size());
+    }
+
+    // A quality line can begin with '@', so the only way to know where the
+    // qualities end is to count them.
+    record.quality.clear();
+    while(record.quality.size() < record.bases.size()) {
+        if(!readLine(line))
+            break;
+        appendQuality(line.data(), line.data() + line.size());
+    }
+
+    if(record.quality.size() != record.bases.size())
+        raise_parm("Invalid FASTQ: record %s has %zu bases but %zu quality values.",
+                   record.name.c_str(), record.bases.size(), record.quality.size());
+
+    // Records of other layouts are rare, so they're parsed in full even
+    // when scanning or rejected.
+    record.length = record.bases.size();
+    record.accepted = filter.accepts(record.name, record.length);
+    if(!record.accepted || (scanMode != SEQIO_SCAN_BASES)) {
+        record.bases.clear();
+        record.quality.clear();
+    } else if(interpreter.isReverseComplement()) {
+        interpreter.reverseComplement(&record.bases[0], record.bases.size(), &record.bases[0]);
+        std::reverse(record.quality.begin(), record.quality.end());
+    }
+
+    return true;
+}
+
+// Reads through the next newline, excluding the line terminator from the
+// result. Returns false only at EOF.
+bool FastqSequenceIterator::readLine(string &line) {
+    char const *begin, *end;
+    bool found = false;
+
+    line.clear();
+    while(stream.peek(&begin, &end)) {
+        found = true;
+        char const *newline = (char const *)memchr(begin, '\n', end - begin);
+        if(newline) {
+            line.append(begin, newline);
+            stream.consume(newline + 1 - begin);
+            break;
+        }
+        line.append(begin, end);
+        stream.consume(end - begin);
+    }
+
+    if(!line.empty() && (line.back() == '\r'))
+        line.pop_back();
+
+    return found;
+}
+
+void FastqSequenceIterator::appendBases(char const *begin, char const *end) {
+    while(begin < end) {
+        char const *special = find_nongraph(begin, end);
+        uint64_t run = special - begin;
+        if(run) {
+            uint64_t n = record.bases.size();
+            record.bases.resize(n + run);
+            // A reverse complement is transformed once the record is complete.
+            if(interpreter.isReverseComplement())
+                memcpy(&record.bases[n], begin, run);
+            else
+                interpreter.transform(begin, run, &record.bases[n]);
+        }
+        begin = special + (special != end);
+    }
+}
+
+void FastqSequenceIterator::appendQuality(char const *begin, char const *end) {
+    while(begin < end) {
+        char const *special = find_nongraph(begin, end);
+        record.quality.append(begin, special);
+        begin = special + (special != end);
+    }
+}
+
+void FastqSequenceIterator::setHeader(char const *begin, char const *end) {
+    char const *name_end = begin;
+    while((name_end < end) && !isspace(*name_end))
+        name_end++;
+
+    record.name.assign(begin, name_end);
+    if(name_end < end)
+        record.comment.assign(name_end + 1, end);
+    else
+        record.comment.clear();
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "fasta.hpp"
+#include "filter.hpp"
+#include "seqio_impl.hpp"
+
+#include <stdint.h>
+
+#include <string>
+
+namespace seqio {
+    namespace impl {
+
+        bool is_fastq_file_content(char const *path, seqio_io_backend const *backend = nullptr);
+
+/**********************************************************************
+ *
+ * CLASS FastqSequence
+ *
+ * FASTQ records are short, so they are parsed in their entirety by the
+ * iterator and the sequence simply owns the result.
+ *
+ **********************************************************************/
+        class FastqSequence : public ISequence {
+        public:
+            // The bases and quality are empty when scanning, in which case
+            // length is still that of the record.
+            FastqSequence(FastaMetadata const &metadata_,
+                          std::string &&bases_,
+                          std::string &&quality_,
+                          uint64_t length_);
+            virtual ~FastqSequence();
+
+            virtual IConstDictionary const &getMetadata() override;
+            virtual uint64_t read(char *buffer,
+                                  uint64_t buffer_length) override;
+            virtual char const *getQuality(uint64_t *length) override;
+            virtual bool hasQuality() override;
+            virtual uint64_t getLength() override;
+            virtual void seek(uint64_t offset) override;
+            virtual void getPacked(seqio_packed_sequence *packed) override;
+
+        private:
+            FastaMetadata metadata;
+            std::string bases;
+            std::string quality;
+            uint64_t length;
+            uint64_t offset;
+        };
+
+/**********************************************************************
+ *
+ * CLASS FastqSequenceIterator
+ *
+ **********************************************************************/
+        class FastqSequenceIterator : public ISequenceIterator {
+        public:
+            FastqSequenceIterator(char const *path,
+                                  seqio_sequence_options const &options);
+            FastqSequenceIterator(SourceFactory const &factory,
+                                  seqio_sequence_options const &options);
+            virtual ~FastqSequenceIterator();
+
+            virtual ISequence *nextSequence() override;
+            virtual ISequence *openSequence(char const *name) override;
+            virtual uint64_t nextBatch(BatchBuilder &builder,
+                                       uint64_t max_records) override;
+
+        private:
+            // Parses records until one the filter accepts.
+            bool nextRecord();
+            // Parses a record laid out as exactly four lines that are all in
+            // the stream's cache. Returns false, consuming nothing, otherwise.
+            bool parseFourLines();
+            // Parses a record of any layout.
+            bool parseRecord();
+            bool readLine(std::string &line);
+            void appendBases(char const *begin, char const *end);
+            void appendQuality(char const *begin, char const *end);
+            void setHeader(char const *begin, char const *end);
+
+            FastaRawStream stream;
+            CharInterpreter interpreter;
+            seqio_scan_mode scanMode;
+            SequenceFilter filter;
+
+            struct {
+                std::string name;
+                std::string comment;
+                // Empty when scanning or rejected by the filter.
+                std::string bases;
+                std::string quality;
+                uint64_t length;
+                bool accepted;
+            } record;
+            std::string line;
+        };
+
+    }
+}
@@ -0,0 +1,49 @@
+#include "filter.hpp"
+
+using std::string;
+using namespace seqio::impl;
+
+/**********************************************************************
+ *
+ * CLASS SequenceFilter
+ *
+ **********************************************************************/
+SequenceFilter::SequenceFilter(seqio_sequence_options const &options)
+    : hasNames(options.names != nullptr)
+    , hasRegex(false)
+    , minLength(options.min_length)
+    , maxLength(options.max_length) {
+
+    if(maxLength && (minLength > maxLength))
+        raise_parm("min_length %zu exceeds max_length %zu.",
+                   size_t(minLength), size_t(maxLength));
+
+    for(uint32_t i = 0; hasNames && (i < options.num_names); i++) {
+        if(!options.names[i])
+            raise_parm("Null name in filter.");
+        names.insert(options.names[i]);
+    }
+
+    if(options.name_regex) {
+        int err = regcomp(&regex, options.name_regex, REG_EXTENDED | REG_NOSUB);
+        if(err) {
+            char msg[256];
+            regerror(err, &regex, msg, sizeof(msg));
+            raise_parm("Invalid name_regex '%s': %s", options.name_regex, msg);
+        }
+        hasRegex = true;
+    }
+}
+
+SequenceFilter::~SequenceFilter() {
+    if(hasRegex)
+        regfree(&regex);
+}
+
+bool SequenceFilter::acceptsName(string const &name) const {
+    if(hasNames && (names.find(name) == names.end()))
+        return false;
+    if(hasRegex && (0 != regexec(&regex, name.c_str(), 0, nullptr, 0)))
+        return false;
+    return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "seqio_impl.hpp"
+
+#include <regex.h>
+#include <stdint.h>
+
+#include <string>
+#include <unordered_set>
+
+namespace seqio {
+    namespace impl {
+
+/**********************************************************************
+ *
+ * CLASS SequenceFilter
+ *
+ * The name and length criteria of seqio_sequence_options, which
+ * iterators apply as they parse so that rejected records cost no more
+ * than finding where they end. Safe to use from several threads once
+ * constructed.
+ *
+ **********************************************************************/
+        class SequenceFilter {
+        public:
+            SequenceFilter(seqio_sequence_options const &options);
+            ~SequenceFilter();
+
+            SequenceFilter(SequenceFilter const &) = delete;
+            SequenceFilter &operator=(SequenceFilter const &) = delete;
+
+            inline bool filtersNames() const {
+                return hasNames || hasRegex;
+            }
+            inline bool filtersLengths() const {
+                return (minLength != 0) || (maxLength != 0);
+            }
+
+            bool acceptsName(std::string const &name) const;
+            inline bool accepts(std::string const &name, uint64_t length) const {
+                return (!filtersNames() || acceptsName(name)) && acceptsLength(length);
+            }
+            inline bool acceptsLength(uint64_t length) const {
+                return (length >= minLength) && ((maxLength == 0) || (length <= maxLength));
+            }
+            // Whether length is past the maximum, so that parsing a record
+            // can stop as soon as it has too many bases.
+            inline bool exceedsLength(uint64_t length) const {
+                return (maxLength != 0) && (length > maxLength);
+            }
+
+        private:
+            bool hasNames;
+            std::unordered_set<std::string> names;
+            bool hasRegex;
+            regex_t regex;
+            uint64_t minLength;
+            uint64_t maxLength;
+        };
+
+    }
+}
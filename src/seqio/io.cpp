@@ -0,0 +1,767 @@
+#include "io.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define SEQIO_HAVE_IO_URING
+#endif
+#endif
+
+using std::shared_ptr;
+using namespace seqio::impl;
+
+// Satisfies O_DIRECT on the usual file systems and block devices.
+#define DIRECT_IO_ALIGNMENT 4096
+// The largest folio the page cache uses for a file.
+#define DROP_CACHED_ALIGNMENT (2 * 1024 * 1024)
+// Writes smaller than this are gathered before reaching the backend.
+#define FILE_WRITE_BUFFER_LENGTH (64 * 1024)
+
+//
+// SEQIO_FILE_IO_BACKEND, whose handles hold a file descriptor.
+//
+struct FileHandle {
+    int fd;
+};
+
+static void *file_open(void *context, char const *path, int writable) {
+    int fd = writable
+        ? ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666)
+        : ::open(path, O_RDONLY);
+    if(fd < 0)
+        return nullptr;
+    return new FileHandle{fd};
+}
+
+static int64_t file_read(void *handle, void *buffer, uint64_t length) {
+    while(true) {
+        ssize_t n = ::read(((FileHandle *)handle)->fd, buffer, length);
+        if((n >= 0) || (errno != EINTR))
+            return n;
+    }
+}
+
+static int64_t file_pread(void *handle, void *buffer, uint64_t length, uint64_t offset) {
+    while(true) {
+        ssize_t n = ::pread(((FileHandle *)handle)->fd, buffer, length, off_t(offset));
+        if((n >= 0) || (errno != EINTR))
+            return n;
+    }
+}
+
+static int file_seek(void *handle, uint64_t offset) {
+    return (::lseek(((FileHandle *)handle)->fd, off_t(offset), SEEK_SET) < 0) ? -1 : 0;
+}
+
+static int64_t file_write(void *handle, void const *buffer, uint64_t length) {
+    while(true) {
+        ssize_t n = ::write(((FileHandle *)handle)->fd, buffer, length);
+        if((n >= 0) || (errno != EINTR))
+            return n;
+    }
+}
+
+static int64_t file_size(void *handle) {
+    struct stat s;
+    if(0 != fstat(((FileHandle *)handle)->fd, &s))
+        return -1;
+    return s.st_size;
+}
+
+static int file_close(void *handle) {
+    int rc = ::close(((FileHandle *)handle)->fd);
+    delete (FileHandle *)handle;
+    return rc;
+}
+
+seqio_io_backend const SEQIO_FILE_IO_BACKEND = {
+    nullptr,
+    file_open,
+    file_read,
+    file_pread,
+    file_seek,
+    file_write,
+    file_size,
+    file_close
+};
+
+namespace seqio {
+    namespace impl {
+
+        void drop_cached(int fd, uint64_t offset, uint64_t length) {
+            if(length == 0)
+                return;
+
+            // A large folio is only dropped if all of it is in the range, so
+            // one straddling the start of the range (left over from the
+            // previous drop of a sequential read) is included.
+            uint64_t begin = offset / DROP_CACHED_ALIGNMENT * DROP_CACHED_ALIGNMENT;
+            // Only advice, so a failure isn't worth reporting.
+            posix_fadvise(fd, off_t(begin), off_t(offset + length - begin), POSIX_FADV_DONTNEED);
+        }
+
+        bool is_file_backend(seqio_io_backend const *backend) {
+            // A copy of it is it too, but not a copy with any callback replaced.
+            return !backend
+                || ((backend->open == file_open)
+                    && (backend->read == file_read)
+                    && (backend->pread == file_pread)
+                    && (backend->seek == file_seek)
+                    && (backend->write == file_write)
+                    && (backend->size == file_size)
+                    && (backend->close == file_close));
+        }
+
+    }
+}
+
+/**********************************************************************
+ *
+ * CLASS File
+ *
+ **********************************************************************/
+shared_ptr<File> File::open(seqio_io_backend const *backend,
+                            char const *path,
+                            bool writable) {
+    if(!backend)
+        backend = &SEQIO_FILE_IO_BACKEND;
+
+    errno = 0;
+    void *handle = backend->open(backend->context, path, writable ? 1 : 0);
+    if(!handle) {
+        if(errno == ENOENT)
+            raise(FILE_NOT_FOUND, "No such file: %s", path);
+        raise_io("Failed opening %s", path);
+    }
+
+    shared_ptr<File> file(new File(*backend, handle, path));
+    if(writable)
+        file->writeBuffer.reserve(FILE_WRITE_BUFFER_LENGTH);
+    return file;
+}
+
+bool File::exists(seqio_io_backend const *backend, char const *path) {
+    try {
+        open(backend, path);
+        return true;
+    } catch(Exception &) {
+        return false;
+    }
+}
+
+File::File(seqio_io_backend const &backend_, void *handle_, char const *path_)
+    : backend(backend_)
+    , handle(handle_)
+    , path(path_) {
+}
+
+File::~File() {
+    if(!handle)
+        return;
+    try {
+        flush();
+    } catch(Exception &) {
+        // Can't raise from a destructor.
+    }
+    backend.close(handle);
+}
+
+char const *File::getPath() {
+    return path.c_str();
+}
+
+int File::getFd() {
+    if(!is_file_backend(&backend))
+        return -1;
+    return ((FileHandle *)handle)->fd;
+}
+
+uint64_t File::read(void *buffer, uint64_t length) {
+    uint64_t n = 0;
+    while(n < length) {
+        int64_t rc = backend.read(handle, (char *)buffer + n, length - n);
+        if(rc < 0)
+            raise_io("Failed reading %s", path.c_str());
+        if(rc == 0)
+            break;
+        n += uint64_t(rc);
+    }
+    position += n;
+    return n;
+}
+
+uint64_t File::pread(void *buffer, uint64_t length, uint64_t offset) {
+    uint64_t n = 0;
+    while(n < length) {
+        int64_t rc = backend.pread(handle, (char *)buffer + n, length - n, offset + n);
+        if(rc < 0)
+            raise_io("Failed reading %s at %zu", path.c_str(), size_t(offset + n));
+        if(rc == 0)
+            break;
+        n += uint64_t(rc);
+    }
+    return n;
+}
+
+void File::seek(uint64_t offset) {
+    flush();
+    if(0 != backend.seek(handle, offset))
+        raise_io("Failed seeking to %zu in %s", size_t(offset), path.c_str());
+    position = offset;
+}
+
+uint64_t File::tell() {
+    return position + writeBuffer.size();
+}
+
+void File::write(void const *buffer, uint64_t length) {
+    if(writeBuffer.size() + length > FILE_WRITE_BUFFER_LENGTH) {
+        flush();
+        // Too large to be worth gathering.
+        if(length >= FILE_WRITE_BUFFER_LENGTH) {
+            writeAll(buffer, length);
+            return;
+        }
+    }
+    writeBuffer.insert(writeBuffer.end(), (char const *)buffer, (char const *)buffer + length);
+}
+
+void File::flush() {
+    if(writeBuffer.empty())
+        return;
+
+    // Buffered content that fails to be written is lost either way.
+    std::vector<char> buffer;
+    buffer.swap(writeBuffer);
+    writeBuffer.reserve(FILE_WRITE_BUFFER_LENGTH);
+    writeAll(buffer.data(), buffer.size());
+}
+
+void File::writeAll(void const *buffer, uint64_t length) {
+    uint64_t n = 0;
+    while(n < length) {
+        int64_t rc = backend.write(handle, (char const *)buffer + n, length - n);
+        if(rc <= 0)
+            raise_io("Failed writing %s", path.c_str());
+        n += uint64_t(rc);
+    }
+    position += n;
+}
+
+uint64_t File::size() {
+    flush();
+    int64_t n = backend.size(handle);
+    if(n < 0)
+        raise_io("Failed getting length of %s", path.c_str());
+    return uint64_t(n);
+}
+
+void File::close() {
+    if(!handle)
+        return;
+
+    bool ok = true;
+    try {
+        flush();
+    } catch(Exception &) {
+        ok = false;
+    }
+    void *h = handle;
+    handle = nullptr;
+    if((0 != backend.close(h)) || !ok)
+        raise_io("Failed writing %s", path.c_str());
+}
+
+/**********************************************************************
+ *
+ * CLASS IoQueue
+ *
+ **********************************************************************/
+IoQueue *IoQueue::create(shared_ptr<File> file,
+                         seqio_io_engine engine,
+                         uint32_t nbuffers,
+                         uint32_t buflen,
+                         uint32_t alignment,
+                         bool drop_behind) {
+    if(engine == SEQIO_IO_ENGINE_URING) {
+        IoQueue *queue = UringQueue::create(file, nbuffers, buflen, alignment, drop_behind);
+        if(queue)
+            return queue;
+    }
+    return new PreadQueue(file, nbuffers, buflen, alignment, drop_behind);
+}
+
+IoQueue::IoQueue(shared_ptr<File> file_,
+                 uint32_t nbuffers_,
+                 uint32_t buflen_,
+                 uint32_t alignment_,
+                 bool dropBehind_)
+    : file(file_)
+    , fd(file_->getFd())
+    , nbuffers(nbuffers_)
+    , buflen(buflen_)
+    , alignment(alignment_)
+    , dropBehind(dropBehind_)
+    , spans(nbuffers_) {
+
+    // Page-aligned, which registered buffers needn't be but direct I/O is.
+    void *addr;
+    if(0 != posix_memalign(&addr, DIRECT_IO_ALIGNMENT, uint64_t(nbuffers) * getBufferCapacity()))
+        raise_oom("Failed allocating I/O buffers.");
+    buffers = (char *)addr;
+}
+
+IoQueue::~IoQueue() {
+    free(buffers);
+}
+
+uint32_t IoQueue::getBufferCount() {
+    return nbuffers;
+}
+
+uint32_t IoQueue::getBufferLength() {
+    return buflen;
+}
+
+char const *IoQueue::getData(uint32_t index) {
+    return getBuffer(index) + spans[index].skew;
+}
+
+char *IoQueue::getBuffer(uint32_t index) {
+    return buffers + uint64_t(index) * getBufferCapacity();
+}
+
+uint32_t IoQueue::getBufferCapacity() {
+    // A widened read can gain up to an alignment at either end.
+    return alignment ? buflen + 2 * alignment : buflen;
+}
+
+void IoQueue::submit(uint32_t index, uint64_t offset, uint32_t length) {
+    Span &span = spans[index];
+    span.offset = offset;
+    span.length = length;
+    span.skew = alignment ? uint32_t(offset % alignment) : 0;
+
+    uint64_t read_offset = offset - span.skew;
+    uint32_t read_length = span.skew + length;
+    if(alignment)
+        read_length = (read_length + alignment - 1) / alignment * alignment;
+
+    queueRead(index, read_offset, read_length);
+    outstanding++;
+}
+
+uint32_t IoQueue::wait(uint32_t *length) {
+    if(outstanding == 0)
+        raise_state("No reads outstanding.");
+
+    // Even a failed read is no longer outstanding.
+    outstanding--;
+    uint32_t n;
+    uint32_t index = awaitRead(&n);
+
+    Span const &span = spans[index];
+    if(dropBehind && (fd >= 0))
+        drop_cached(fd, span.offset - span.skew, n);
+    *length = n > span.skew ? std::min(n - span.skew, span.length) : 0;
+    return index;
+}
+
+uint32_t IoQueue::getOutstandingCount() {
+    return outstanding;
+}
+
+void IoQueue::drain() {
+    uint32_t length;
+    flush();
+    while(outstanding) {
+        wait(&length);
+    }
+}
+
+uint32_t IoQueue::read(uint32_t index, uint64_t offset, uint32_t length) {
+    submit(index, offset, length);
+    uint32_t n;
+    wait(&n);
+    return n;
+}
+
+/**********************************************************************
+ *
+ * CLASS PreadQueue
+ *
+ **********************************************************************/
+PreadQueue::PreadQueue(shared_ptr<File> file_,
+                       uint32_t nbuffers_,
+                       uint32_t buflen_,
+                       uint32_t alignment_,
+                       bool dropBehind_)
+    : IoQueue(file_, nbuffers_, buflen_, alignment_, dropBehind_) {
+}
+
+PreadQueue::~PreadQueue() {
+}
+
+seqio_io_engine PreadQueue::getEngine() {
+    return SEQIO_IO_ENGINE_PREAD;
+}
+
+void PreadQueue::queueRead(uint32_t index, uint64_t offset, uint32_t length) {
+    pending.push_back({index, offset, length});
+}
+
+void PreadQueue::flush() {
+}
+
+uint32_t PreadQueue::awaitRead(uint32_t *length) {
+    Request request = pending.front();
+    pending.pop_front();
+
+    *length = uint32_t(file->pread(getBuffer(request.index), request.length, request.offset));
+    return request.index;
+}
+
+/**********************************************************************
+ *
+ * CLASS UringQueue
+ *
+ **********************************************************************/
+#ifdef SEQIO_HAVE_IO_URING
+
+UringQueue *UringQueue::create(shared_ptr<File> file,
+                               uint32_t nbuffers,
+                               uint32_t buflen,
+                               uint32_t alignment,
+                               bool dropBehind) {
+    if(file->getFd() < 0)
+        return nullptr;
+
+    UringQueue *queue = new UringQueue(file, nbuffers, buflen, alignment, dropBehind);
+    if(!queue->setup()) {
+        delete queue;
+        return nullptr;
+    }
+    return queue;
+}
+
+UringQueue::UringQueue(shared_ptr<File> file_,
+                       uint32_t nbuffers_,
+                       uint32_t buflen_,
+                       uint32_t alignment_,
+                       bool dropBehind_)
+    : IoQueue(file_, nbuffers_, buflen_, alignment_, dropBehind_)
+    , fileLength(file_->size())
+    , reads(nbuffers_) {
+}
+
+UringQueue::~UringQueue() {
+    // The kernel may still be writing to the buffers.
+    if(sqes.addr) {
+        try {
+            drain();
+        } catch(Exception &) {
+        }
+    }
+
+    if(sqes.addr)
+        munmap(sqes.addr, sqes.length);
+    if(cq.addr && (cq.addr != sq.addr))
+        munmap(cq.addr, cq.length);
+    if(sq.addr)
+        munmap(sq.addr, sq.length);
+    if(ringfd >= 0)
+        close(ringfd);
+}
+
+// Returns false, leaving the destructor to clean up, if any step isn't
+// supported or permitted.
+bool UringQueue::setup() {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ringfd = int(syscall(__NR_io_uring_setup, nbuffers, &params));
+    if(ringfd < 0)
+        return false;
+
+    sq.length = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq.length = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+        sq.length = cq.length = std::max(sq.length, cq.length);
+
+    sq.addr = mmap(nullptr, sq.length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ringfd, IORING_OFF_SQ_RING);
+    if(sq.addr == MAP_FAILED) {
+        sq.addr = nullptr;
+        return false;
+    }
+    if(params.features & IORING_FEAT_SINGLE_MMAP) {
+        cq.addr = sq.addr;
+    } else {
+        cq.addr = mmap(nullptr, cq.length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ringfd, IORING_OFF_CQ_RING);
+        if(cq.addr == MAP_FAILED) {
+            cq.addr = nullptr;
+            return false;
+        }
+    }
+    sqes.length = params.sq_entries * sizeof(io_uring_sqe);
+    sqes.addr = mmap(nullptr, sqes.length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ringfd, IORING_OFF_SQES);
+    if(sqes.addr == MAP_FAILED) {
+        sqes.addr = nullptr;
+        return false;
+    }
+
+    char *sqbase = (char *)sq.addr;
+    sq.head = (uint32_t *)(sqbase + params.sq_off.head);
+    sq.tail = (uint32_t *)(sqbase + params.sq_off.tail);
+    sq.mask = (uint32_t *)(sqbase + params.sq_off.ring_mask);
+    sq.array = (uint32_t *)(sqbase + params.sq_off.array);
+    char *cqbase = (char *)cq.addr;
+    cq.head = (uint32_t *)(cqbase + params.cq_off.head);
+    cq.tail = (uint32_t *)(cqbase + params.cq_off.tail);
+    cq.mask = (uint32_t *)(cqbase + params.cq_off.ring_mask);
+    cq.cqes = cqbase + params.cq_off.cqes;
+
+    std::vector<iovec> iovecs(nbuffers);
+    for(uint32_t i = 0; i < nbuffers; i++) {
+        iovecs[i].iov_base = getBuffer(i);
+        iovecs[i].iov_len = getBufferCapacity();
+    }
+    if(0 != syscall(__NR_io_uring_register, ringfd, IORING_REGISTER_BUFFERS, iovecs.data(), nbuffers))
+        return false;
+    if(0 != syscall(__NR_io_uring_register, ringfd, IORING_REGISTER_FILES, &fd, 1))
+        return false;
+
+    return true;
+}
+
+seqio_io_engine UringQueue::getEngine() {
+    return SEQIO_IO_ENGINE_URING;
+}
+
+void UringQueue::queueRead(uint32_t index, uint64_t offset, uint32_t length) {
+    reads[index] = {offset, length, 0};
+    queueRemainder(index);
+}
+
+void UringQueue::queueRemainder(uint32_t index) {
+    Read const &read = reads[index];
+    // There are as many entries as buffers, and a buffer has at most one read
+    // in flight, so there's always room.
+    uint32_t tail = *sq.tail;
+    uint32_t slot = tail & *sq.mask;
+    io_uring_sqe *sqe = (io_uring_sqe *)sqes.addr + slot;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->fd = 0;
+    sqe->addr = uint64_t(getBuffer(index) + read.done);
+    sqe->len = read.length - read.done;
+    sqe->off = read.offset + read.done;
+    sqe->buf_index = uint16_t(index);
+    sqe->user_data = index;
+    sq.array[slot] = slot;
+    __atomic_store_n(sq.tail, tail + 1, __ATOMIC_RELEASE);
+    queued++;
+}
+
+void UringQueue::flush() {
+    if(queued)
+        enter(0);
+}
+
+uint32_t UringQueue::awaitRead(uint32_t *length) {
+    while(true) {
+        uint32_t head = *cq.head;
+        if(head == __atomic_load_n(cq.tail, __ATOMIC_ACQUIRE)) {
+            do {
+                enter(1);
+            } while(head == __atomic_load_n(cq.tail, __ATOMIC_ACQUIRE));
+        }
+
+        io_uring_cqe *cqe = (io_uring_cqe *)cq.cqes + (head & *cq.mask);
+        int32_t res = cqe->res;
+        uint32_t index = uint32_t(cqe->user_data);
+        __atomic_store_n(cq.head, head + 1, __ATOMIC_RELEASE);
+
+        if(res < 0)
+            raise_io("Failed reading %s at %zu: %s",
+                     file->getPath(), size_t(reads[index].offset + reads[index].done), strerror(-res));
+
+        // As with pread, a read can complete short of what was asked before
+        // end of file. It's known to have reached the end when it gets there,
+        // and with direct I/O when it stops off a block boundary, where the
+        // rest couldn't be asked for anyway.
+        Read &read = reads[index];
+        read.done += uint32_t(res);
+        if((res == 0) || (read.done == read.length)
+           || (read.offset + read.done >= fileLength)
+           || (alignment && (read.done % alignment))) {
+            *length = read.done;
+            return index;
+        }
+        queueRemainder(index);
+        enter(0);
+    }
+}
+
+void UringQueue::enter(uint32_t min_complete) {
+    uint32_t flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    while(true) {
+        long rc = syscall(__NR_io_uring_enter, ringfd, queued, min_complete, flags, nullptr, 0);
+        if(rc >= 0) {
+            queued -= uint32_t(rc);
+            return;
+        }
+        if(errno != EINTR)
+            raise_io("Failed submitting reads: %s", strerror(errno));
+    }
+}
+
+#else
+
+UringQueue *UringQueue::create(shared_ptr<File> file,
+                               uint32_t nbuffers,
+                               uint32_t buflen,
+                               uint32_t alignment,
+                               bool dropBehind) {
+    return nullptr;
+}
+
+UringQueue::UringQueue(shared_ptr<File> file_,
+                       uint32_t nbuffers_,
+                       uint32_t buflen_,
+                       uint32_t alignment_,
+                       bool dropBehind_)
+    : IoQueue(file_, nbuffers_, buflen_, alignment_, dropBehind_) {
+}
+
+UringQueue::~UringQueue() {
+}
+
+bool UringQueue::setup() {
+    return false;
+}
+
+seqio_io_engine UringQueue::getEngine() {
+    return SEQIO_IO_ENGINE_URING;
+}
+
+void UringQueue::queueRead(uint32_t index, uint64_t offset, uint32_t length) {
+}
+
+void UringQueue::flush() {
+}
+
+uint32_t UringQueue::awaitRead(uint32_t *length) {
+    return 0;
+}
+
+void UringQueue::enter(uint32_t min_complete) {
+}
+
+#endif
+
+/**********************************************************************
+ *
+ * CLASS IoQueuePool
+ *
+ **********************************************************************/
+IoQueuePool::IoQueuePool(seqio_io_backend const *backend,
+                         char const *path,
+                         seqio_io_engine engine_,
+                         uint32_t nbuffers_,
+                         uint32_t buflen_,
+                         seqio_page_cache page_cache)
+    : engine(engine_)
+    , nbuffers(nbuffers_)
+    , buflen(buflen_)
+    , pageCache(page_cache) {
+
+    file = File::open(backend, path);
+    length = file->size();
+
+    // The pool has the descriptor to itself, so its flags can be changed.
+    int fd = file->getFd();
+    if(fd < 0) {
+        pageCache = SEQIO_PAGE_CACHE_KEEP;
+    } else if(pageCache == SEQIO_PAGE_CACHE_BYPASS) {
+        // Some file systems (e.g. tmpfs) refuse O_DIRECT when it's set, and
+        // some only when reading.
+        int flags = fcntl(fd, F_GETFL);
+        bool direct = (flags >= 0) && (0 == fcntl(fd, F_SETFL, flags | O_DIRECT));
+        if(direct) {
+            void *probe;
+            if(0 != posix_memalign(&probe, DIRECT_IO_ALIGNMENT, DIRECT_IO_ALIGNMENT))
+                raise_oom("Failed allocating I/O buffer.");
+            direct = pread(fd, probe, DIRECT_IO_ALIGNMENT, 0) >= 0;
+            free(probe);
+            if(!direct)
+                fcntl(fd, F_SETFL, flags);
+        }
+        if(!direct)
+            pageCache = SEQIO_PAGE_CACHE_DROP_BEHIND;
+    }
+}
+
+IoQueuePool::~IoQueuePool() {
+    for(IoQueue *queue: queues) {
+        delete queue;
+    }
+}
+
+shared_ptr<IoQueue> IoQueuePool::acquire() {
+    IoQueue *queue = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if(!queues.empty()) {
+            queue = queues.back();
+            queues.pop_back();
+        }
+    }
+
+    if(!queue)
+        queue = IoQueue::create(file,
+                                engine,
+                                nbuffers,
+                                buflen,
+                                pageCache == SEQIO_PAGE_CACHE_BYPASS ? DIRECT_IO_ALIGNMENT : 0,
+                                pageCache == SEQIO_PAGE_CACHE_DROP_BEHIND);
+
+    shared_ptr<IoQueuePool> pool = shared_from_this();
+    return shared_ptr<IoQueue>(queue, [pool] (IoQueue *queue) {pool->release(queue);});
+}
+
+uint64_t IoQueuePool::getFileLength() {
+    return length;
+}
+
+seqio_page_cache IoQueuePool::getPageCache() {
+    return pageCache;
+}
+
+void IoQueuePool::release(IoQueue *queue) {
+    // A queue with reads in flight (e.g. reading ahead) can't be reused
+    // until they've landed. If that fails, it can't be reused at all.
+    try {
+        queue->drain();
+    } catch(Exception &) {
+        delete queue;
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    queues.push_back(queue);
+}
@@ -0,0 +1,301 @@
+#pragma once
+
+#include "seqio_impl.hpp"
+
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace seqio {
+    namespace impl {
+
+        // Drops a range of a file from the page cache, for content that has been
+        // read and won't be again.
+        void drop_cached(int fd, uint64_t offset, uint64_t length);
+
+        // Whether a backend is SEQIO_FILE_IO_BACKEND, which null stands for.
+        bool is_file_backend(seqio_io_backend const *backend);
+
+/**********************************************************************
+ *
+ * CLASS File
+ *
+ * A file opened through an I/O backend, which is how every file is read
+ * and written. Writes are buffered, so the backend sees large writes
+ * however small the writer's are.
+ *
+ **********************************************************************/
+        class File {
+        public:
+            // A null backend is SEQIO_FILE_IO_BACKEND. Raises FILE_NOT_FOUND if
+            // there's no such file.
+            static std::shared_ptr<File> open(seqio_io_backend const *backend,
+                                              char const *path,
+                                              bool writable = false);
+            static bool exists(seqio_io_backend const *backend, char const *path);
+            ~File();
+
+            char const *getPath();
+            // The file descriptor of a file opened by SEQIO_FILE_IO_BACKEND, for
+            // what only a kernel file allows (mapping, io_uring, page cache
+            // management), and -1 for any other backend.
+            int getFd();
+
+            // Returns less than length only at end of file.
+            uint64_t read(void *buffer, uint64_t length);
+            // Doesn't move the position, and may be called from several threads
+            // at once. Returns less than length only at end of file.
+            uint64_t pread(void *buffer, uint64_t length, uint64_t offset);
+            void seek(uint64_t offset);
+            uint64_t tell();
+            void write(void const *buffer, uint64_t length);
+            uint64_t size();
+            // Closes the file, raising if written content couldn't be stored,
+            // which the destructor can't report.
+            void close();
+
+        private:
+            File(seqio_io_backend const &backend_, void *handle_, char const *path_);
+            void flush();
+            void writeAll(void const *buffer, uint64_t length);
+
+            seqio_io_backend const backend;
+            void *handle;
+            std::string const path;
+            // Of the backend's handle, which excludes buffered writes.
+            uint64_t position = 0;
+            std::vector<char> writeBuffer;
+        };
+
+/**********************************************************************
+ *
+ * CLASS IoQueue
+ *
+ * Positional reads of a file into a fixed set of buffers owned by the
+ * queue. Several reads may be submitted before waiting on any, and they
+ * may complete in any order. For a file opened with O_DIRECT, reads are
+ * widened to the alignment it requires, which callers don't see.
+ *
+ **********************************************************************/
+        class IoQueue {
+        public:
+            // Creates an io_uring queue if that's the engine asked for and the
+            // kernel allows it, and a pread queue otherwise. alignment is
+            // nonzero for an O_DIRECT file. With drop_behind, content is
+            // dropped from the page cache once it's been read into a buffer.
+            static IoQueue *create(std::shared_ptr<File> file,
+                                   seqio_io_engine engine,
+                                   uint32_t nbuffers,
+                                   uint32_t buflen,
+                                   uint32_t alignment = 0,
+                                   bool drop_behind = false);
+            virtual ~IoQueue();
+
+            // The engine actually in use.
+            virtual seqio_io_engine getEngine() = 0;
+            uint32_t getBufferCount();
+            // The most that can be read into a buffer at once.
+            uint32_t getBufferLength();
+            // The content read into a buffer by the last read.
+            char const *getData(uint32_t index);
+
+            // Queues a read of length bytes at offset into a buffer, which must
+            // not have a read outstanding.
+            void submit(uint32_t index, uint64_t offset, uint32_t length);
+            // Starts any queued reads without waiting for them.
+            virtual void flush() = 0;
+            // Waits for an outstanding read to complete, returning its buffer.
+            // *length is less than requested only at end of file.
+            uint32_t wait(uint32_t *length);
+            uint32_t getOutstandingCount();
+            // Waits for all outstanding reads, discarding their results.
+            void drain();
+
+            // Reads into a buffer and waits for it. There must be no other
+            // reads outstanding.
+            uint32_t read(uint32_t index, uint64_t offset, uint32_t length);
+
+        protected:
+            IoQueue(std::shared_ptr<File> file_,
+                    uint32_t nbuffers_,
+                    uint32_t buflen_,
+                    uint32_t alignment_,
+                    bool dropBehind_);
+
+            // The read as issued, after any widening.
+            virtual void queueRead(uint32_t index, uint64_t offset, uint32_t length) = 0;
+            virtual uint32_t awaitRead(uint32_t *length) = 0;
+            char *getBuffer(uint32_t index);
+            // Size of each buffer, including room for widening.
+            uint32_t getBufferCapacity();
+
+            std::shared_ptr<File> const file;
+            // -1 unless the file was opened by SEQIO_FILE_IO_BACKEND.
+            int const fd;
+            uint32_t const nbuffers;
+            uint32_t const buflen;
+            uint32_t const alignment;
+            bool const dropBehind;
+            char *buffers;
+            uint32_t outstanding = 0;
+            // The reads asked for, by buffer, with where in the buffer their
+            // content begins.
+            struct Span {
+                uint64_t offset;
+                uint32_t length;
+                uint32_t skew;
+            };
+            std::vector<Span> spans;
+        };
+
+/**********************************************************************
+ *
+ * CLASS PreadQueue
+ *
+ * Reads synchronously, when they're waited on.
+ *
+ **********************************************************************/
+        class PreadQueue : public IoQueue {
+        public:
+            PreadQueue(std::shared_ptr<File> file_,
+                       uint32_t nbuffers_,
+                       uint32_t buflen_,
+                       uint32_t alignment_,
+                       bool dropBehind_);
+            virtual ~PreadQueue();
+
+            virtual seqio_io_engine getEngine() override;
+            virtual void flush() override;
+
+        protected:
+            virtual void queueRead(uint32_t index, uint64_t offset, uint32_t length) override;
+            virtual uint32_t awaitRead(uint32_t *length) override;
+
+        private:
+            struct Request {
+                uint32_t index;
+                uint64_t offset;
+                uint32_t length;
+            };
+            std::deque<Request> pending;
+        };
+
+/**********************************************************************
+ *
+ * CLASS UringQueue
+ *
+ * Reads through an io_uring instance, with the file and the buffers
+ * registered so the kernel needn't look them up or map them per read.
+ * Queued reads are submitted in a single system call.
+ *
+ **********************************************************************/
+        class UringQueue : public IoQueue {
+        public:
+            // Returns null if io_uring isn't available, or the file has no
+            // descriptor.
+            static UringQueue *create(std::shared_ptr<File> file,
+                                      uint32_t nbuffers,
+                                      uint32_t buflen,
+                                      uint32_t alignment,
+                                      bool dropBehind);
+            virtual ~UringQueue();
+
+            virtual seqio_io_engine getEngine() override;
+            virtual void flush() override;
+
+        protected:
+            virtual void queueRead(uint32_t index, uint64_t offset, uint32_t length) override;
+            virtual uint32_t awaitRead(uint32_t *length) override;
+
+        private:
+            UringQueue(std::shared_ptr<File> file_,
+                       uint32_t nbuffers_,
+                       uint32_t buflen_,
+                       uint32_t alignment_,
+                       bool dropBehind_);
+            bool setup();
+            // Queues the part of a buffer's read that hasn't completed yet.
+            void queueRemainder(uint32_t index);
+            void enter(uint32_t min_complete);
+
+            int ringfd = -1;
+            struct {
+                void *addr = nullptr;
+                uint64_t length = 0;
+                uint32_t *head;
+                uint32_t *tail;
+                uint32_t *mask;
+                uint32_t *array;
+            } sq;
+            struct {
+                void *addr = nullptr;
+                uint64_t length = 0;
+                uint32_t *head;
+                uint32_t *tail;
+                uint32_t *mask;
+                void *cqes;
+            } cq;
+            struct {
+                void *addr = nullptr;
+                uint64_t length = 0;
+            } sqes;
+            uint32_t queued = 0;
+            // Where a short completion must be end of file.
+            uint64_t fileLength;
+            // The read issued into each buffer. A completion can be short
+            // before end of file, in which case the rest is read again.
+            struct Read {
+                uint64_t offset;
+                uint32_t length;
+                uint32_t done;
+            };
+            std::vector<Read> reads;
+        };
+
+/**********************************************************************
+ *
+ * CLASS IoQueuePool
+ *
+ * Queues over one file, handed out to readers and taken back when they're
+ * done, so that setting up a queue isn't paid for every sequence opened.
+ * Pools are owned by shared_ptr, which the queues handed out hold too.
+ * The pool opens the file according to the page cache mode, which for
+ * SEQIO_PAGE_CACHE_BYPASS means O_DIRECT if the file system allows it.
+ * A file from another backend than SEQIO_FILE_IO_BACKEND is read with
+ * pread and cached as usual.
+ *
+ **********************************************************************/
+        class IoQueuePool : public std::enable_shared_from_this<IoQueuePool> {
+        public:
+            IoQueuePool(seqio_io_backend const *backend,
+                        char const *path,
+                        seqio_io_engine engine_,
+                        uint32_t nbuffers_,
+                        uint32_t buflen_,
+                        seqio_page_cache page_cache = SEQIO_PAGE_CACHE_KEEP);
+            ~IoQueuePool();
+
+            std::shared_ptr<IoQueue> acquire();
+            uint64_t getFileLength();
+            // The mode actually in effect.
+            seqio_page_cache getPageCache();
+
+        private:
+            void release(IoQueue *queue);
+
+            std::shared_ptr<File> file;
+            uint64_t length;
+            seqio_io_engine const engine;
+            uint32_t const nbuffers;
+            uint32_t const buflen;
+            seqio_page_cache pageCache;
+            std::mutex lock;
+            std::vector<IoQueue *> queues;
+        };
+
+    }
+}
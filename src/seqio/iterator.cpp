@@ -0,0 +1,250 @@
+#include "iterator.hpp"
+
+#include "batch.hpp"
+#include "fasta.hpp"
+#include "fasta_parallel.hpp"
+#include "fastq.hpp"
+#include "pna_impl.hpp"
+#include "source.hpp"
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+using std::string;
+using std::vector;
+using namespace seqio::impl;
+
+// How much of the next file is read ahead while the current one is read.
+#define PREFETCH_LENGTH (4 * 1024 * 1024)
+
+// Whether the first character of the content that isn't whitespace begins
+// a FASTQ record.
+static bool is_fastq_content(SourceFactory const &factory) {
+    std::unique_ptr<ISource> source(factory());
+    char const *data;
+    uint64_t length;
+
+    while(source->next(&data, &length)) {
+        for(uint64_t i = 0; i < length; i++) {
+            if(!isspace(data[i]))
+                return data[i] == '@';
+        }
+    }
+    return false;
+}
+
+namespace seqio {
+    namespace impl {
+
+        ISequenceIterator *create_sequence_iterator(char const *path,
+                                                    seqio_sequence_options options) {
+            seqio_io_backend const *backend = options.io_backend;
+            if(!File::exists(backend, path)) {
+                raise(FILE_NOT_FOUND, "No such file: %s", path);
+            }
+
+            if(options.file_format == SEQIO_FILE_FORMAT_DEDUCE) {
+                if(is_pna_file_content(path, backend)) {
+                    options.file_format = SEQIO_FILE_FORMAT_PNA;
+                } else if(is_fastq_file_content(path, backend)) {
+                    options.file_format = SEQIO_FILE_FORMAT_FASTQ;
+                } else {
+                    options.file_format = SEQIO_FILE_FORMAT_FASTA;
+                }
+            }
+
+            switch(options.file_format) {
+            case SEQIO_FILE_FORMAT_FASTA:
+            case SEQIO_FILE_FORMAT_FASTA_GZIP:
+                // Scans are done serially, and parallel parsing needs the file
+                // mapped.
+                if((options.num_threads > 1)
+                   && (options.scan_mode == SEQIO_SCAN_BASES)
+                   && is_file_backend(backend)
+                   && !is_gzip_file_content(path))
+                    return new ParallelFastaSequenceIterator(path, options);
+                else
+                    return new FastaSequenceIterator(path, options);
+            case SEQIO_FILE_FORMAT_FASTQ:
+            case SEQIO_FILE_FORMAT_FASTQ_GZIP:
+                return new FastqSequenceIterator(path, options);
+            case SEQIO_FILE_FORMAT_PNA:
+                return new PnaSequenceIterator(path, options);
+            default:
+                raise_parm("Invalid file format.");
+            }
+        }
+
+        ISequenceIterator *create_memory_sequence_iterator(void const *data,
+                                                           uint64_t length,
+                                                           seqio_sequence_options options) {
+            if(is_pna_content(data, length)
+               && ((options.file_format == SEQIO_FILE_FORMAT_DEDUCE)
+                   || (options.file_format == SEQIO_FILE_FORMAT_PNA))) {
+                return new PnaSequenceIterator(data, length, options);
+            }
+
+            SourceFactory factory = create_memory_source_factory(data, length);
+            if(options.file_format == SEQIO_FILE_FORMAT_DEDUCE) {
+                if(is_fastq_content(factory)) {
+                    options.file_format = SEQIO_FILE_FORMAT_FASTQ;
+                } else {
+                    options.file_format = SEQIO_FILE_FORMAT_FASTA;
+                }
+            }
+
+            switch(options.file_format) {
+            case SEQIO_FILE_FORMAT_FASTA:
+            case SEQIO_FILE_FORMAT_FASTA_GZIP:
+                if((options.num_threads > 1)
+                   && (options.scan_mode == SEQIO_SCAN_BASES)
+                   && !is_gzip_content(data, length)) {
+                    return new ParallelFastaSequenceIterator(std::make_shared<FileMapping>(data, length),
+                                                             options);
+                } else {
+                    return new FastaSequenceIterator(factory, options);
+                }
+            case SEQIO_FILE_FORMAT_FASTQ:
+            case SEQIO_FILE_FORMAT_FASTQ_GZIP:
+                return new FastqSequenceIterator(factory, options);
+            case SEQIO_FILE_FORMAT_PNA:
+                // Only reached for content without the PNA signature.
+                raise_io("PNA file signature not found.");
+            default:
+                raise_parm("Invalid file format.");
+            }
+        }
+
+    }
+}
+
+/**********************************************************************
+ *
+ * CLASS MultiSequenceIterator
+ *
+ **********************************************************************/
+MultiSequenceIterator::MultiSequenceIterator(vector<string> const &paths_,
+                                             seqio_sequence_options const &options_)
+    : paths(paths_)
+    , options(options_) {
+}
+
+MultiSequenceIterator::~MultiSequenceIterator() {
+    if(next.thread.joinable())
+        next.thread.join();
+}
+
+ISequence *MultiSequenceIterator::nextSequence() {
+    while(true) {
+        if(first)
+            return first.release();
+
+        if(current) {
+            ISequence *sequence = current->nextSequence();
+            if(sequence)
+                return sequence;
+        }
+
+        if(!nextFile())
+            return nullptr;
+    }
+}
+
+ISequence *MultiSequenceIterator::openSequence(char const *name) {
+    raise_state("Cannot open a sequence by name from multiple files.");
+}
+
+uint64_t MultiSequenceIterator::nextBatch(BatchBuilder &builder,
+                                          uint64_t max_records) {
+    uint64_t n = 0;
+
+    while(n < max_records) {
+        if(first) {
+            builder.appendSequence(first.get(), options.scan_mode);
+            first.reset();
+            n++;
+            continue;
+        }
+
+        if(current) {
+            uint64_t count = current->nextBatch(builder, max_records - n);
+            n += count;
+            if(count > 0)
+                continue;
+        }
+
+        if(!nextFile())
+            break;
+    }
+
+    return n;
+}
+
+uint64_t MultiSequenceIterator::getFileIndex() {
+    return fileIndex;
+}
+
+bool MultiSequenceIterator::nextFile() {
+    first.reset();
+    current.reset();
+
+    while(nextIndex < paths.size()) {
+        // Only the first file, or one following a file that failed to open,
+        // isn't already being prefetched.
+        if(!next.thread.joinable())
+            prefetch(nextIndex);
+        next.thread.join();
+
+        uint64_t index = nextIndex++;
+        if(next.error) {
+            std::exception_ptr error = next.error;
+            next.error = nullptr;
+            next.first.reset();
+            next.iterator.reset();
+            std::rethrow_exception(error);
+        }
+
+        fileIndex = index;
+        current = std::move(next.iterator);
+        first = std::move(next.first);
+        if(nextIndex < paths.size())
+            prefetch(nextIndex);
+
+        if(first)
+            return true;
+        // No sequences in the file.
+        current.reset();
+    }
+
+    return false;
+}
+
+void MultiSequenceIterator::prefetch(uint64_t index) {
+    next.index = index;
+    next.error = nullptr;
+    next.thread = std::thread(&MultiSequenceIterator::prefetchWork, this);
+}
+
+void MultiSequenceIterator::prefetchWork() {
+    char const *path = paths[next.index].c_str();
+
+    try {
+        // Have the kernel start reading the file while its iterator is
+        // set up, which for some formats reads only a header.
+        if((options.page_cache == SEQIO_PAGE_CACHE_KEEP)
+           && is_file_backend(options.io_backend)) {
+            int fd = open(path, O_RDONLY);
+            if(fd >= 0) {
+                posix_fadvise(fd, 0, PREFETCH_LENGTH, POSIX_FADV_WILLNEED);
+                close(fd);
+            }
+        }
+
+        next.iterator.reset(create_sequence_iterator(path, options));
+        next.first.reset(next.iterator->nextSequence());
+    } catch(...) {
+        next.error = std::current_exception();
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "seqio_impl.hpp"
+
+#include <stdint.h>
+
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace seqio {
+    namespace impl {
+
+        // Creates an iterator for the file's format, deducing it from the content
+        // if options don't specify it.
+        ISequenceIterator *create_sequence_iterator(char const *path,
+                                                    seqio_sequence_options options);
+        // Creates an iterator over content the caller holds in memory, which
+        // must outlive the iterator and its sequences.
+        ISequenceIterator *create_memory_sequence_iterator(void const *data,
+                                                           uint64_t length,
+                                                           seqio_sequence_options options);
+
+/**********************************************************************
+ *
+ * CLASS MultiSequenceIterator
+ *
+ * Iterates over the sequences of several files in turn, each read with
+ * its own iterator. While one file is consumed, the next is opened on a
+ * background thread, which also obtains its first sequence so that the
+ * file's first reads are done by the time it's needed.
+ *
+ **********************************************************************/
+        class MultiSequenceIterator : public ISequenceIterator {
+        public:
+            MultiSequenceIterator(std::vector<std::string> const &paths_,
+                                  seqio_sequence_options const &options_);
+            virtual ~MultiSequenceIterator();
+
+            virtual ISequence *nextSequence() override;
+            virtual ISequence *openSequence(char const *name) override;
+            virtual uint64_t nextBatch(BatchBuilder &builder,
+                                       uint64_t max_records) override;
+
+            // Index into paths of the file the last sequence came from.
+            uint64_t getFileIndex();
+
+        private:
+            // Makes the next file with any sequences the current one, returning
+            // false once all have been read.
+            bool nextFile();
+            void prefetch(uint64_t index);
+            void prefetchWork();
+
+            std::vector<std::string> const paths;
+            seqio_sequence_options const options;
+
+            // The current file, and the next to become current.
+            uint64_t fileIndex = 0;
+            uint64_t nextIndex = 0;
+            std::unique_ptr<ISequenceIterator> current;
+            // The current file's first sequence, if it hasn't been handed out.
+            std::unique_ptr<ISequence> first;
+
+            // Only the prefetch thread touches this until it's joined.
+            struct {
+                std::thread thread;
+                uint64_t index;
+                std::unique_ptr<ISequenceIterator> iterator;
+                std::unique_ptr<ISequence> first;
+                std::exception_ptr error;
+            } next;
+        };
+
+    }
+}
@@ -10,6 +10,7 @@
 
 #include "pna.hpp"
 #include "seqio_impl.hpp"
+#include "simd.hpp"
 #include "util.h"
 
 using namespace std;
@@ -21,25 +22,23 @@ using namespace seqio::pna;
 namespace seqio {
     namespace pna {
 
-        bool is_pna_file_content(char const *path) {
-            FILE *f = fopen(path, "r");
+        bool is_pna_file_content(char const *path, seqio_io_backend const *backend) {
+            try {
+                header_t header;
+                uint64_t n = seqio::impl::File::open(backend, path)->pread(&header, sizeof(header), 0);
+                return is_pna_content(&header, n);
+            } catch(seqio::impl::Exception &) {
+                return false;
+            }
+        }
 
-            if(!f)
-                goto fail;
-    
+        bool is_pna_content(void const *data, uint64_t length) {
             header_t header;
-            if(1 != fread(&header, sizeof(header), 1, f))
-                goto fail;
+            if(length < sizeof(header))
+                return false;
 
-            if(header.signature != PNA_FILE_SIGNATURE)
-                goto fail;
-
-            fclose(f);
-            return true;
-
-        fail:
-            if(f) fclose(f);
-            return false;
+            memcpy(&header, data, sizeof(header));
+            return header.signature == PNA_FILE_SIGNATURE;
         }
 
         bool is_pna_file_name(char const *path) {
@@ -105,127 +104,56 @@ const char *PnaMetadata::value(const char *key) const {
     return result ? strings + ((metadata_entry_t *)result)->value : nullptr;
 }
 
-FilePointerGuard::FilePointerGuard(FilePointerPool *pool_,
-                                   FILE *f_)
-    : pool(pool_)
-    , f(f_)
-{
-}
-
-FilePointerGuard::~FilePointerGuard() {
-    if(f_managed && *f_managed) {
-        *f_managed = nullptr;
-        f_managed = nullptr;
-
-        pool->release(f);
-    }
-}
-
-void FilePointerGuard::manage(FILE **field) {
-    f_managed = field;
-    *f_managed = f;
-}
-
-void FilePointerGuard::manual_release() {
-    if(f_managed && *f_managed) {
-        *f_managed = nullptr;
-        f_managed = nullptr;
-
-        pool->release(f);
-    }
-}
-
-FilePointerPool::FilePointerPool(const std::string &path_)
-    : path(path_)
-{
-}
-
-FilePointerPool::~FilePointerPool() {
-    for(auto f: handles) {
-        fclose(f);
-    }
-}
-
-FilePointerGuard FilePointerPool::acquire() {
-    FILE *f = nullptr;
-
-    while (lock.test_and_set(std::memory_order_acquire))  // acquire lock
-        ; // spin
-
-    if(!handles.empty()) {
-        f = handles.back();
-        handles.pop_back();
-    }
-
-    lock.clear(std::memory_order_release);               // release lock
-
-    if(f == nullptr) {
-        f = fopen(path.c_str(), "r");
-        if(f == nullptr) {
-            raise_io("Failed opening %s", path.c_str());
-        }
-    }
-
-    return FilePointerGuard(this, f);
-}
-
-void FilePointerPool::release(FILE *f) {
-    while (lock.test_and_set(std::memory_order_acquire))  // acquire lock
-        ; // spin
-
-    handles.push_back(f);
-
-    lock.clear(std::memory_order_release);               // release lock
-}
-
-PnaSequenceReader::PnaSequenceReader(FilePointerGuard fguard_,
+PnaSequenceReader::PnaSequenceReader(shared_ptr<seqio::impl::File> file_,
+                                     shared_ptr<seqio::impl::FileMapping> mapping_,
+                                     const uint8_t *image_,
+                                     shared_ptr<seqio::impl::IoQueue> queue_,
+                                     bool dropBehind_,
                                      const sequence_t &sequence_,
                                      const PnaMetadata &metadata_,
                                      uint32_t flags_)
-    : fguard(fguard_)
+    : file(file_)
+    , mapping(mapping_)
+    , image(image_)
+    , queue(queue_)
+    , dropBehind(dropBehind_)
     , sequence(sequence_)
     , metadata(metadata_)
     , flags(flags_)
 {
-    fguard.manage(&fpna);
-
-    seqfragments.begin = new seqfragment_t[sequence.seqfragments_count];
-    if(0 != fseeko(fpna, sequence.seqfragments_filepos, SEEK_SET))
-        raise_io("Failed seeking to seqfragments");
-    if(1 != fread(seqfragments.begin, sizeof(seqfragment_t) * sequence.seqfragments_count, 1, fpna))
-        raise_io("Failed reading seqfragments");
+    // Fragments are packed, so they can be used in place at any alignment.
+    if(image) {
+        seqfragments.begin = (const seqfragment_t *)(image + sequence.seqfragments_filepos);
+    } else {
+        seqfragments.copy.resize(sequence.seqfragments_count);
+        uint64_t length = sizeof(seqfragment_t) * sequence.seqfragments_count;
+        if(length != file->pread(seqfragments.copy.data(), length, sequence.seqfragments_filepos))
+            raise_io("Failed reading seqfragments");
+        seqfragments.begin = seqfragments.copy.data();
+    }
+    if(dropBehind)
+        seqio::impl::drop_cached(file->getFd(),
+                                 sequence.seqfragments_filepos,
+                                 sizeof(seqfragment_t) * sequence.seqfragments_count);
     seqfragments.next = sequence.seqfragments_count > 0 ? &seqfragments.begin[0] : nullptr;
     seqfragments.end = &seqfragments.begin[sequence.seqfragments_count];
-
-    packedCache.buf = new unsigned char[READBUF_CAPACITY];
-
-    this->packedByteLookup = new uint32_t[256];
-    // todo: safer init
-    char baseChar[] = {'A', 'C', 'G', 'T'};
-    for(unsigned char b0 = 0; b0 < 4; b0++) {
-        for(unsigned char b1 = 0; b1 < 4; b1++) {
-            for(unsigned char b2 = 0; b2 < 4; b2++) {
-                for(unsigned char b3 = 0; b3 < 4; b3++) {
-                    unsigned char baseByte = (b0 << 6) | (b1 << 4) | (b2 << 2) | (b3);
-                    char baseChars[] = {baseChar[b3], baseChar[b2], baseChar[b1], baseChar[b0]};
-                    memcpy(packedByteLookup + baseByte, baseChars, 4);
-                }
-            }
-        }
+    if(flags & ReverseComplement) {
+        // Fragments are walked backwards, starting with the last.
+        seqfragments.next = sequence.seqfragments_count > 0 ? seqfragments.end - 1 : nullptr;
     }
 
-    if(0 != fseeko(fpna, sequence.packed_bases_filepos, SEEK_SET))
-        raise_io("Failed seeking to bases");
+    // With a queue, the cache is whichever of its buffers was last read, and
+    // in memory it's the packed bases themselves.
+    packedCache.buf = (queue || image) ? nullptr : new unsigned char[READBUF_CAPACITY];
 }
 
 PnaSequenceReader::~PnaSequenceReader() {
-    delete seqfragments.begin;
-    delete packedCache.buf;
-    delete packedByteLookup;
+    if(!queue && !image)
+        delete[] packedCache.buf;
 }
 
 void PnaSequenceReader::close() {
-    fguard.manual_release();
+    file.reset();
 }
 
 uint64_t PnaSequenceReader::size() {
@@ -234,18 +162,23 @@ uint64_t PnaSequenceReader::size() {
 
 #define NEXT_BYTE()                                                     \
     if(packedCache.index == packedCache.len) {                          \
-        if((packedCache.bases_offset+packedCache.len) >= sequence.packed_bases_length) \
-            raise_io("Attempting to read base byte when none remain!"); \
-        packedCache.bases_offset += packedCache.len;                    \
-        packedCache.len = min(uint64_t(READBUF_CAPACITY),               \
-                              sequence.packed_bases_length - packedCache.bases_offset); \
-        if(1 != fread(packedCache.buf, packedCache.len, 1, fpna))       \
-            raise_io("Failed filling read buffer.");                    \
-        packedCache.index = 0;                                          \
+        next_cache();                                                   \
     }                                                                   \
     packedCache.curr = packedCache.buf[packedCache.index++];
 
-seqfragment_t *PnaSequenceReader::find_next_seqfragment(uint64_t offset) {
+void PnaSequenceReader::next_cache() {
+    if((packedCache.bases_offset+packedCache.len) >= sequence.packed_bases_length)
+        raise_io("Attempting to read base byte when none remain!");
+    bool sequential = packedCache.len > 0;
+    packedCache.bases_offset += packedCache.len;
+    packedCache.len = sequence.packed_bases_length - packedCache.bases_offset;
+    if(!image)
+        packedCache.len = min(uint64_t(READBUF_CAPACITY), packedCache.len);
+    packedCache.index = 0;
+    load_cache(sequential);
+}
+
+const seqfragment_t *PnaSequenceReader::find_next_seqfragment(uint64_t offset) {
     struct local {
         static bool comp(const seqfragment_t &a, const seqfragment_t &b) {
             return (a.sequence_offset+a.bases_count) < b.sequence_offset;
@@ -253,13 +186,36 @@ seqfragment_t *PnaSequenceReader::find_next_seqfragment(uint64_t offset) {
     };
     seqfragment_t searchval;
     searchval.sequence_offset = offset;
-    seqfragment_t *result = lower_bound(seqfragments.begin, seqfragments.end,
+    const seqfragment_t *result = lower_bound(seqfragments.begin, seqfragments.end,
                                         searchval, local::comp);
 
     return result == seqfragments.end ? nullptr : result;
 }
 
+// Returns the last fragment that begins before offset.
+const seqfragment_t *PnaSequenceReader::find_prev_seqfragment(uint64_t offset) {
+    struct local {
+        static bool comp(uint64_t offset, const seqfragment_t &a) {
+            return offset <= a.sequence_offset;
+        }
+    };
+    const seqfragment_t *result = upper_bound(seqfragments.begin, seqfragments.end,
+                                        offset, local::comp);
+
+    return result == seqfragments.begin ? nullptr : result - 1;
+}
+
 void PnaSequenceReader::seek(uint64_t seekOffset) {
+    if(seekOffset > sequence.bases_count)
+        raise_parm("Seek offset %zu exceeds sequence length %zu.",
+                   size_t(seekOffset), size_t(sequence.bases_count));
+
+    if(flags & ReverseComplement) {
+        seqfragments.next = find_prev_seqfragment(sequence.bases_count - seekOffset);
+        seqOffset = seekOffset;
+        return;
+    }
+
     if(sequence.seqfragments_count == 0) {
         seqOffset = seekOffset;
         return;
@@ -295,11 +251,7 @@ void PnaSequenceReader::seek(uint64_t seekOffset) {
             }
         }
 
-
-        uint64_t packed_bases_filepos = sequence.packed_bases_filepos + packed_bases_offset;
-        if(0 != fseeko(fpna, packed_bases_filepos, SEEK_SET))
-            raise_io("Failed seeking to %lu.", packed_bases_filepos);
-
+        // The cache is loaded from the new position on the next byte.
         RESET_CACHE(packed_bases_offset);
 
         if(shift) {
@@ -349,6 +301,9 @@ void PnaSequenceReader::seek(uint64_t seekOffset) {
     }
 
 uint64_t PnaSequenceReader::read(char * buf, uint64_t buflen) {
+    if(flags & ReverseComplement)
+        return read_reverse_complement(buf, buflen);
+
     char *buf0 = buf;
     uint64_t endOffset = seqOffset + min(buflen, sequence.bases_count - seqOffset);
 
@@ -388,17 +343,18 @@ uint64_t PnaSequenceReader::read(char * buf, uint64_t buflen) {
                 fragment_bases_count -= n;
             }
 
-            // Unpack 4 bases at a time
+            // Unpack whole bytes, a cached run of them at a time
             {
-                uint32_t *intbuf = (uint32_t *)buf;
-                uint64_t n = fragment_bases_count / sizeof(uint32_t);
-                uint32_t *intbuf_end = intbuf + n;
-                while(intbuf < intbuf_end) {
-                    NEXT_BYTE();
-                    *intbuf = packedByteLookup[packedCache.curr];
-                    intbuf++;
+                uint64_t nbytes = fragment_bases_count / 4;
+                while(nbytes > 0) {
+                    if(packedCache.index == packedCache.len)
+                        next_cache();
+                    uint64_t n = min(nbytes, uint64_t(packedCache.len - packedCache.index));
+                    seqio::impl::unpack_2bit(packedCache.buf + packedCache.index, n, buf);
+                    packedCache.index += n;
+                    buf += n * 4;
+                    nbytes -= n;
                 }
-                buf = (char *)intbuf;
             }
 
             // Unpack 1 base at a time for remainder
@@ -420,32 +376,191 @@ uint64_t PnaSequenceReader::read(char * buf, uint64_t buflen) {
     return buf - buf0;
 }
 
+// seqOffset counts the bases of the reverse complement that have been read,
+// which are the bases before pos in the sequence itself. seqfragments.next
+// is the last fragment beginning before pos.
+uint64_t PnaSequenceReader::read_reverse_complement(char *buf, uint64_t buflen) {
+    char *buf0 = buf;
+    char *buf_end = buf + buflen;
+    uint64_t pos = sequence.bases_count - seqOffset;
+
+    while((buf < buf_end) && (pos > 0)) {
+        const seqfragment_t *fragment = seqfragments.next;
+        uint64_t fragment_end = fragment ? fragment->sequence_offset + fragment->bases_count : 0;
+
+        if(pos > fragment_end) {
+            // We're in an 'N' region, which is preceded by the fragment.
+            uint64_t ncount = pos - fragment_end;
+            if(!(flags & IgnoreN)) {
+                ncount = min(ncount, uint64_t(buf_end - buf));
+                memset(buf, 'N', ncount);
+                buf += ncount;
+            }
+            pos -= ncount;
+            continue;
+        }
+
+        // Bases are numbered by their position in the packed bytes, 4 per byte.
+        uint64_t count = min(pos - fragment->sequence_offset, uint64_t(buf_end - buf));
+        uint64_t last = (fragment->packed_bases_offset * 4) + (fragment->shift / 2)
+            + (pos - fragment->sequence_offset);
+        unpack_reverse_complement(last - count, last, buf);
+        buf += count;
+        pos -= count;
+
+        if(pos == fragment->sequence_offset) {
+            // We're at the start of the fragment.
+            seqfragments.next = (fragment == seqfragments.begin) ? nullptr : fragment - 1;
+        }
+    }
+
+    seqOffset = sequence.bases_count - pos;
+    return buf - buf0;
+}
+
+// Writes the complements of packed bases [first, last) in reverse order.
+void PnaSequenceReader::unpack_reverse_complement(uint64_t first, uint64_t last, char *buf) {
+    char const complements[] = {'T', 'G', 'C', 'A'};
+
+#define UNPACK_REVERSE_COMPLEMENT() {                                   \
+        last--;                                                         \
+        uint8_t packed = *cache_packed_byte(last / 4);                  \
+        *buf++ = complements[(packed >> ((last % 4) * 2)) & 0x3];       \
+    }
+
+    // Unpack 1 base at a time until we're at a byte boundary
+    while((last > first) && (last % 4)) {
+        UNPACK_REVERSE_COMPLEMENT();
+    }
+
+    // Unpack whole bytes, a cached run of them at a time
+    while((last - first) >= 4) {
+        const uint8_t *packed = cache_packed_byte(last / 4 - 1);
+        uint64_t n = min((last - first) / 4, uint64_t(last / 4 - packedCache.bases_offset));
+        seqio::impl::unpack_2bit_reverse_complement(packed + 1 - n, n, buf);
+        buf += n * 4;
+        last -= n * 4;
+    }
+
+    // Unpack 1 base at a time for remainder
+    while(last > first) {
+        UNPACK_REVERSE_COMPLEMENT();
+    }
+
+#undef UNPACK_REVERSE_COMPLEMENT
+}
+
+// Returns the packed byte at index, filling the cache with the bytes leading
+// up to it if it isn't already there.
+const uint8_t *PnaSequenceReader::cache_packed_byte(uint64_t index) {
+    if((index < packedCache.bases_offset) || (index >= packedCache.bases_offset + packedCache.len)) {
+        if(index >= sequence.packed_bases_length)
+            raise_io("Attempting to read base byte when none remain!");
+        uint64_t end = index + 1;
+        packedCache.bases_offset = (!image && (end > READBUF_CAPACITY)) ? end - READBUF_CAPACITY : 0;
+        packedCache.len = end - packedCache.bases_offset;
+        packedCache.index = 0;
+        load_cache(false);
+    }
+
+    return packedCache.buf + (index - packedCache.bases_offset);
+}
+
+// Reads the packed bytes described by the cache's bases_offset and len.
+// sequential means the cache follows on from the previous one, so with
+// io_uring the cache after it is read ahead.
+void PnaSequenceReader::load_cache(bool sequential) {
+    if(image) {
+        packedCache.buf = (unsigned char *)image + sequence.packed_bases_filepos + packedCache.bases_offset;
+        return;
+    }
+
+    if(!queue) {
+        uint64_t packed_bases_filepos = sequence.packed_bases_filepos + packedCache.bases_offset;
+        if(packedCache.len != file->pread(packedCache.buf, packedCache.len, packed_bases_filepos))
+            raise_io("Failed filling read buffer.");
+        return;
+    }
+
+    uint32_t index, n;
+    if(readAhead.pending && (readAhead.bases_offset == packedCache.bases_offset)) {
+        index = queue->wait(&n);
+    } else {
+        queue->drain();
+        index = readAhead.pending ? 1 - readAhead.index : 0;
+        n = queue->read(index, sequence.packed_bases_filepos + packedCache.bases_offset, packedCache.len);
+    }
+    readAhead.pending = false;
+    if(n < packedCache.len)
+        raise_io("Failed filling read buffer.");
+    packedCache.buf = (unsigned char *)queue->getData(index);
+
+    uint64_t next = packedCache.bases_offset + packedCache.len;
+    if(sequential
+       && (queue->getEngine() == SEQIO_IO_ENGINE_URING)
+       && (next < sequence.packed_bases_length)) {
+        readAhead.pending = true;
+        readAhead.index = 1 - index;
+        readAhead.bases_offset = next;
+        queue->submit(readAhead.index,
+                      sequence.packed_bases_filepos + next,
+                      uint32_t(min(uint64_t(READBUF_CAPACITY), sequence.packed_bases_length - next)));
+        queue->flush();
+    }
+}
+
 const PnaMetadata PnaSequenceReader::getMetadata() {
     return metadata;
 }
 
-PnaSequenceReader::packed_read_result_t PnaSequenceReader::packed_read(uint8_t *packed_buf, uint64_t buflen) {
-    if(buflen < sequence.packed_bases_length)
-        raise_parm("Buffer too small.");
-
+PnaSequenceReader::packed_read_result_t PnaSequenceReader::packed_result() {
     packed_read_result_t result;
 
     result.bases_count = sequence.bases_count;
     result.seqfragments.begin = seqfragments.begin;
     result.seqfragments.count = sequence.seqfragments_count;
-    result.packed_bases.begin = packed_buf;
+    result.packed_bases.begin = nullptr;
     result.packed_bases.buflen = sequence.packed_bases_length;
+    result.packed_bases.count = 0;
 
     if(result.seqfragments.count) {
-        seqfragment_t *last = seqfragments.end - 1;
+        const seqfragment_t *last = seqfragments.end - 1;
         result.packed_bases.count =
             (last->packed_bases_offset * 4) + (last->shift / 2) + last->bases_count;
     }
 
-    if(0 != fseeko(fpna, sequence.packed_bases_filepos, SEEK_SET))
-        raise_io("Failed seeking to bases");
-    if(1 != fread(packed_buf, sequence.packed_bases_length, 1, fpna))
+    return result;
+}
+
+PnaSequenceReader::packed_read_result_t PnaSequenceReader::packed_view(std::vector<uint8_t> &buf) {
+    if(!image) {
+        buf.resize(sequence.packed_bases_length);
+        return packed_read(buf.data(), buf.size());
+    }
+
+    packed_read_result_t result = packed_result();
+    result.packed_bases.begin = image + sequence.packed_bases_filepos;
+    return result;
+}
+
+PnaSequenceReader::packed_read_result_t PnaSequenceReader::packed_read(uint8_t *packed_buf, uint64_t buflen) {
+    if(buflen < sequence.packed_bases_length)
+        raise_parm("Buffer too small.");
+
+    packed_read_result_t result = packed_result();
+    result.packed_bases.begin = packed_buf;
+
+    if(image) {
+        memcpy(packed_buf, image + sequence.packed_bases_filepos, sequence.packed_bases_length);
+        return result;
+    }
+
+    if(sequence.packed_bases_length != file->pread(packed_buf,
+                                                   sequence.packed_bases_length,
+                                                   sequence.packed_bases_filepos))
         raise_io("Failed reading packed bases");
+    if(dropBehind)
+        seqio::impl::drop_cached(file->getFd(), sequence.packed_bases_filepos, sequence.packed_bases_length);
 
     return result;
 }
@@ -453,43 +568,62 @@ PnaSequenceReader::packed_read_result_t PnaSequenceReader::packed_read(uint8_t *
 #undef UNPACK
 #undef NEXT_BYTE
 
-PnaReader::PnaReader(const char *path_)
+PnaReader::PnaReader(const char *path_,
+                     seqio_io_backend const *backend,
+                     seqio_io_engine io_engine,
+                     seqio_page_cache page_cache)
     : path(path_)
-    , fpool(path)
+    , file(seqio::impl::File::open(backend, path_))
+    , dropBehind((page_cache != SEQIO_PAGE_CACHE_KEEP) && (file->getFd() >= 0))
 {
-    FILE *f;
-    FilePointerGuard guard = fpool.acquire();
-    guard.manage(&f);
+    // Two buffers, so that one can be read ahead while the other is
+    // unpacked. The cache can only be managed for reads made by queue.
+    if((io_engine != SEQIO_IO_ENGINE_DEFAULT) || dropBehind) {
+        if(io_engine == SEQIO_IO_ENGINE_DEFAULT)
+            io_engine = SEQIO_IO_ENGINE_PREAD;
+        queues = make_shared<seqio::impl::IoQueuePool>(backend, path_, io_engine, 2, READBUF_CAPACITY, page_cache);
+    }
 
     //
     // Read header
     //
-    if(0 != fseeko(f, 0, SEEK_SET))
-        raise_io("Failed seeking to header of %s.", path.c_str());
-    if(1 != fread(&header, sizeof(header), 1, f))
+    if(sizeof(header) != file->pread(&header, sizeof(header), 0))
         raise_io("Failed reading header of %s.", path.c_str());
 
-    if(header.signature != PNA_FILE_SIGNATURE) {
-        raise_io("PNA file signature not found.");
-    }
-    if(header.version != PNA_VERSION) {
-        raise_io("Unsupported PNA version: %zu", size_t(header.version));
-    }
-
-    //
-    // mmap strings, metadata, and sequence_t
-    //
-    {
-        int fd = fileno(f);
-        if(fd < 0)
-            raise_io("Failed getting fd");
+    checkHeader();
+
+    uint64_t offset = header.string_storage.filepos;
+    uint64_t end = header.sequences_filepos + (header.sequences_count * sizeof(sequence_t));
+    int fd = file->getFd();
+    if((fd >= 0) && !queues) {
+        //
+        // mmap the whole file, so packed bases are unpacked straight from the
+        // page cache
+        //
+        mapping = make_shared<seqio::impl::FileMapping>(file);
+        image = (const uint8_t *)mapping->getData();
+        imageLength = mapping->getLength();
+        useImage();
+        return;
+    } else if(fd < 0) {
+        //
+        // Read strings, metadata, and sequence_t
+        //
+        tables.resize(end - offset);
+        if(tables.size() != file->pread(tables.data(), tables.size(), offset))
+            raise_io("Failed reading tables of %s.", path.c_str());
+        mmap.file_start = tables.data() - offset;
 
+        strings = (const char *)mmap.file_start + header.string_storage.filepos;
+        sequences = (const sequence_t *)(mmap.file_start + header.sequences_filepos);
+    } else {
+        //
+        // mmap strings, metadata, and sequence_t
+        //
         long page_size = sysconf(_SC_PAGE_SIZE);
         if(page_size < 1)
             raise_io("Failed determining system page size.");
 
-        uint64_t offset = header.string_storage.filepos;
-        uint64_t end = header.sequences_filepos + (header.sequences_count * sizeof(sequence_t));
         offset = (offset / page_size) * page_size;
         mmap.length = end - offset;
 
@@ -512,10 +646,44 @@ PnaReader::PnaReader(const char *path_)
                            strings);
 }
 
+PnaReader::PnaReader(const void *data, uint64_t length)
+    : dropBehind(false)
+    , image((const uint8_t *)data)
+    , imageLength(length)
+{
+    if(length < sizeof(header))
+        raise_io("PNA content is truncated.");
+    memcpy(&header, image, sizeof(header));
+    checkHeader();
+    useImage();
+}
+
+void PnaReader::useImage() {
+    uint64_t end = header.sequences_filepos + (header.sequences_count * sizeof(sequence_t));
+    if((end > imageLength) || (header.string_storage.filepos > imageLength))
+        raise_io("PNA content is truncated.");
+    mmap.file_start = (uint8_t *)image;
+    strings = (const char *)mmap.file_start + header.string_storage.filepos;
+    sequences = (const sequence_t *)(mmap.file_start + header.sequences_filepos);
+
+    metadata = PnaMetadata(header.metadata,
+                           mmap.file_start,
+                           strings);
+}
+
+void PnaReader::checkHeader() {
+    if(header.signature != PNA_FILE_SIGNATURE) {
+        raise_io("PNA file signature not found.");
+    }
+    if(header.version != PNA_VERSION) {
+        raise_io("Unsupported PNA version: %zu", size_t(header.version));
+    }
+}
+
 PnaReader::~PnaReader() {
     if(mmap.addr) {
-        if(0 != munmap(mmap.addr, mmap.length))
-            raise_io("Failed munmap'ing");
+        // Can't raise from a destructor.
+        munmap(mmap.addr, mmap.length);
     }
 }
 
@@ -544,14 +712,30 @@ const PnaMetadata PnaReader::getSequenceMetadata(uint64_t index) {
                        strings);
 }
 
+uint64_t PnaReader::getSequenceLength(uint64_t index) {
+    if(index >= header.sequences_count)
+        raise_parm("Index out of bounds");
+
+    return sequences[index].bases_count;
+}
+
 shared_ptr<PnaSequenceReader> PnaReader::openSequence(uint64_t index, uint32_t flags) {
     if(index >= header.sequences_count)
         raise_parm("Index out of bounds");
 
     const sequence_t &sequence = sequences[index];
+    if(image
+       && ((sequence.seqfragments_filepos + (sequence.seqfragments_count * sizeof(seqfragment_t)) > imageLength)
+           || (sequence.packed_bases_filepos + sequence.packed_bases_length > imageLength)))
+        raise_io("PNA content is truncated.");
+
     // make_shared is causing internal compiler error (gcc 4.7.3)
     return shared_ptr<PnaSequenceReader>(
-        new PnaSequenceReader(fpool.acquire(),
+        new PnaSequenceReader(file,
+                              mapping,
+                              image,
+                              queues ? queues->acquire() : nullptr,
+                              dropBehind,
                               sequence,
                               getSequenceMetadata(index),
                               flags));
@@ -577,8 +761,8 @@ stringid_t StringStorageWriter::getId(const char *str) {
     return result;
 }
 
-void StringStorageWriter::write(FILE *f, string_storage_t &header) {
-    header.filepos = ftello(f);
+void StringStorageWriter::write(seqio::impl::File *f, string_storage_t &header) {
+    header.filepos = f->tell();
 
     uint32_t offset = 0;
     for(auto &idpair: ids) {
@@ -589,13 +773,12 @@ void StringStorageWriter::write(FILE *f, string_storage_t &header) {
         if((uint64_t(offset) + len) > MAX_STRING_STORAGE)
             raise_oom("String storage capacity exceeded.");
 
-        if(1 != fwrite(str.c_str(), len, 1, f))
-            raise_io("Failed writing string storage");
+        f->write(str.c_str(), len);
         offsets[id] = offset;
         offset += len;
     }
 
-    if((ftello(f) - header.filepos) != offset)
+    if((f->tell() - header.filepos) != offset)
         raise_io("Ended at invalid location in building string storage");
 
     header.length = offset;
@@ -612,10 +795,10 @@ void MetadataWriter::addMetadata(const char *key, const char *value) {
     idmap[strings.getId(key)] = strings.getId(value);
 }
 
-void MetadataWriter::write(FILE *f) {
+void MetadataWriter::write(seqio::impl::File *f) {
     uint32_t nentries = idmap.size();
 
-    metadata.entries_filepos = ftello(f);
+    metadata.entries_filepos = f->tell();
     metadata.entries_count = nentries;
 
     if(nentries) {
@@ -638,12 +821,11 @@ void MetadataWriter::write(FILE *f) {
 
         sort(entries, entries + nentries, local::comp);
 
-        if(1 != fwrite(entries, sizeof(entries), 1, f))
-            raise_io("Failed writing metadata entries");
+        f->write(entries, sizeof(entries));
     }
 }
 
-PnaSequenceWriter::PnaSequenceWriter(FILE *f,
+PnaSequenceWriter::PnaSequenceWriter(seqio::impl::File *f,
                                      sequence_t &sequence_,
                                      MetadataWriter &metadata_)
     : fpna(f)
@@ -663,11 +845,15 @@ PnaSequenceWriter::PnaSequenceWriter(FILE *f,
     base_map['T'] = T;
     base_map['t'] = T;
 
-    sequence.packed_bases_filepos = ftello(fpna);
+    sequence.packed_bases_filepos = fpna->tell();
 }
 
 PnaSequenceWriter::~PnaSequenceWriter() {
-    close();
+    try {
+        close();
+    } catch(seqio::impl::Exception &) {
+        // Can't raise from a destructor.
+    }
 }
 
 void PnaSequenceWriter::write(char const *buf, uint64_t buflen) {
@@ -680,7 +866,7 @@ void PnaSequenceWriter::write(char const *buf, uint64_t buflen) {
 #define START_FRAGMENT()                                                \
             in_seqfragment = true;                                        \
             seqfragment.sequence_offset = seqOffset;                                \
-            seqfragment.packed_bases_offset = (ftello(fpna) + packedCache.len) - sequence.packed_bases_filepos;        \
+            seqfragment.packed_bases_offset = (fpna->tell() + packedCache.len) - sequence.packed_bases_filepos;        \
             seqfragment.shift = shift;                                        \
             seqfragment.bases_count = 1;                                        \
             
@@ -733,7 +919,7 @@ uint64_t PnaSequenceWriter::getByteCount() {
     return
         sizeof(sequence_t)
         + sizeof(seqfragment_t) * seqfragments.size()
-        + ftello(fpna) - sequence.packed_bases_filepos;
+        + fpna->tell() - sequence.packed_bases_filepos;
 }
 
 void PnaSequenceWriter::close() {
@@ -746,20 +932,18 @@ void PnaSequenceWriter::close() {
     flushCache();
 
     sequence.bases_count = seqOffset;
-    sequence.packed_bases_length = ftello(fpna) - sequence.packed_bases_filepos;
+    sequence.packed_bases_length = fpna->tell() - sequence.packed_bases_filepos;
 
     if(in_seqfragment) {
         seqfragment.bases_count = seqOffset - seqfragment.sequence_offset;
         seqfragments.push_back(seqfragment);
     }
 
-    sequence.seqfragments_filepos = ftello(fpna);
+    sequence.seqfragments_filepos = fpna->tell();
     sequence.seqfragments_count = seqfragments.size();
 
-    for(seqfragment_t seqfragment: seqfragments) {
-        if(1 != fwrite(&seqfragment, sizeof(seqfragment_t), 1, fpna))
-            raise_io("Failed writing seqfragment");
-    }
+    if(!seqfragments.empty())
+        fpna->write(seqfragments.data(), sizeof(seqfragment_t) * seqfragments.size());
 
     fpna = nullptr;
 }
@@ -773,28 +957,38 @@ void PnaSequenceWriter::addPackedByte() {
 
 void PnaSequenceWriter::flushCache() {
     if(packedCache.len) {
-        if(1 != fwrite(packedCache.buf, packedCache.len, 1, fpna))
-            raise_io("Failed writing packed cache!!!\n");
+        fpna->write(packedCache.buf, packedCache.len);
         packedCache.len = 0;
     }
 }
 
-PnaWriter::PnaWriter(const char *path) // todo: const string &
+PnaWriter::PnaWriter(const char *path, seqio_io_backend const *backend) // todo: const string &
     : metadata(header.metadata, strings)
 {
-    f = fopen(path, "w");
+    f = seqio::impl::File::open(backend, path, true);
     memset(&header, 0, sizeof(header));
 
+    // Reserve the header, which is written once everything it locates is.
+    f->write(&header, sizeof(header));
+
     header.signature = PNA_FILE_SIGNATURE;
     header.version = PNA_VERSION;
-
-    if(0 != fseeko(f, sizeof(header), SEEK_SET))
-        raise_io("Failed seeking past header");
-    header.sequences_filepos = ftello(f);
+    header.sequences_filepos = f->tell();
 }
 
 PnaWriter::~PnaWriter() {
-    close();
+    try {
+        close();
+    } catch(seqio::impl::Exception &) {
+        // Can't raise from a destructor.
+    }
+
+    for(auto metadata: sequences_metadata) {
+        delete metadata;
+    }
+    for(auto sequence: sequences) {
+        delete sequence;
+    }
 }
 
 shared_ptr<PnaSequenceWriter> PnaWriter::createSequence() {
@@ -806,7 +1000,7 @@ shared_ptr<PnaSequenceWriter> PnaWriter::createSequence() {
     sequences.push_back(sequence);
     sequences_metadata.push_back(metadata);
 
-    shared_ptr<PnaSequenceWriter> writer(new PnaSequenceWriter(f, *sequence, *metadata));
+    shared_ptr<PnaSequenceWriter> writer(new PnaSequenceWriter(f.get(), *sequence, *metadata));
     activeSequenceWriter = writer;
     return writer;
 }
@@ -829,52 +1023,48 @@ void PnaWriter::close() {
     if(!f)
         return;
 
+    // Finished whether or not writing succeeds, which is raised only once.
+    shared_ptr<seqio::impl::File> closing = f;
+    f.reset();
+
     closeSequence();
 
     //
     // Write strings storage
     //
-    strings.write(f, header.string_storage);
+    strings.write(closing.get(), header.string_storage);
 
     //
     // Write metadata entries
     //
     for(auto metadata: sequences_metadata) {
-        metadata->write(f);
-        delete metadata;
+        metadata->write(closing.get());
     }
-    sequences_metadata.clear();
 
-    metadata.write(f);
+    metadata.write(closing.get());
 
     //
     // Write sequence_t set
     //
-    header.sequences_filepos = ftello(f);
+    header.sequences_filepos = closing->tell();
     header.sequences_count = sequences.size();
 
     for(auto sequence: sequences) {
-        if(1 != fwrite(sequence, sizeof(sequence_t), 1, f))
-            raise_io("Failed writing sequence");
+        closing->write(sequence, sizeof(sequence_t));
         header.max_seqfragments_count = max(header.max_seqfragments_count,
                                             sequence->seqfragments_count);
         header.max_packed_bases_length = max(header.max_packed_bases_length,
                                              sequence->packed_bases_length);
-        delete sequence;
     }
-    sequences.clear();
 
     //
     // Write header
     //
-    if(0 != fseeko(f, 0, SEEK_SET))
-        raise_io("Failed seeking to header");
-    if(1 != fwrite(&header, sizeof(header), 1, f))
-        raise_io("Failed writing header");
+    closing->seek(0);
+    closing->write(&header, sizeof(header));
 
     //
     // Done
     //
-    fclose(f);
-    f = nullptr;
+    closing->close();
 }
@@ -1,11 +1,11 @@
 #pragma once
 
+#include "io.hpp"
 #include "pna_layout.h"
+#include "source.hpp"
 
 #include <stdint.h>
-#include <stdio.h>
 
-#include <atomic>
 #include <map>
 #include <memory>
 #include <string>
@@ -14,7 +14,8 @@
 namespace seqio {
     namespace pna {
 
-        bool is_pna_file_content(char const *path);
+        bool is_pna_file_content(char const *path, seqio_io_backend const *backend = nullptr);
+        bool is_pna_content(void const *data, uint64_t length);
         bool is_pna_file_name(char const *path);
 
         // todo: confirm can be same
@@ -44,50 +45,23 @@ namespace seqio {
             const char *strings;
         };
 
-        class FilePointerPool;
-
-        class FilePointerGuard {
-            friend class FilePointerPool;
-
-            FilePointerGuard(FilePointerPool *pool, FILE *f);
-        public:
-            ~FilePointerGuard();
-
-            void manage(FILE **field);
-            void manual_release();
-
-        private:
-            FilePointerPool *pool;
-            FILE *f;
-            FILE **f_managed = nullptr;
-        };
-
-        class FilePointerPool {
-        public:
-            FilePointerPool(const std::string &path);
-            ~FilePointerPool();
-
-            FilePointerGuard acquire();
-
-        private:
-            friend class FilePointerGuard;
-            void release(FILE *);
-
-            std::string path;
-            std::atomic_flag lock = ATOMIC_FLAG_INIT;
-            std::vector<FILE *> handles;
-        };
-
         class PnaSequenceReader {
         public:
             enum Flags {
                 Standard = 0,
-                IgnoreN = (1 << 0)
+                IgnoreN = (1 << 0),
+                // read() produces the reverse complement, and seek() offsets
+                // are into the reverse complement.
+                ReverseComplement = (1 << 1)
             };
         private:
             friend class PnaReader;
 
-            PnaSequenceReader(FilePointerGuard fguard,
+            PnaSequenceReader(std::shared_ptr<seqio::impl::File> file,
+                              std::shared_ptr<seqio::impl::FileMapping> mapping,
+                              const uint8_t *image,
+                              std::shared_ptr<seqio::impl::IoQueue> queue,
+                              bool dropBehind,
                               const sequence_t &sequence,
                               const PnaMetadata &metadata,
                               uint32_t flags);
@@ -108,42 +82,82 @@ namespace seqio {
                     uint64_t count;
                 } seqfragments;
                 struct {
-                    uint8_t *begin;
+                    const uint8_t *begin;
                     uint64_t buflen;
                     uint64_t count;
                 } packed_bases;
             };
 
             packed_read_result_t packed_read(uint8_t *packed_buf, uint64_t buflen);
+            // As packed_read(), but the packed bases are used in place if the
+            // file is mapped or in memory, and are otherwise read into buf.
+            packed_read_result_t packed_view(std::vector<uint8_t> &buf);
 
         private:
-            seqfragment_t *find_next_seqfragment(uint64_t offset);
-
-            FilePointerGuard fguard;
-            FILE *fpna;
+            packed_read_result_t packed_result();
+            const seqfragment_t *find_next_seqfragment(uint64_t offset);
+            const seqfragment_t *find_prev_seqfragment(uint64_t offset);
+            uint64_t read_reverse_complement(char *buf, uint64_t buflen);
+            void unpack_reverse_complement(uint64_t first, uint64_t last, char *buf);
+            const uint8_t *cache_packed_byte(uint64_t index);
+            // Loads the packed bytes following the cache once it's consumed.
+            void next_cache();
+            void load_cache(bool sequential);
+
+            // Shared by every reader of the file, which is safe because they
+            // only pread from it.
+            std::shared_ptr<seqio::impl::File> file;
+            // Keeps image valid when it's the mapped file.
+            std::shared_ptr<seqio::impl::FileMapping> mapping;
+            // The entire file, if it's mapped or in memory, in which case it's
+            // read instead of file, and fragments and packed bases are used in
+            // place.
+            const uint8_t *image;
+            // Reads packed bases instead of file if not null.
+            std::shared_ptr<seqio::impl::IoQueue> queue;
+            // Whether bases read through file are dropped from the page cache.
+            bool dropBehind;
+            struct {
+                bool pending = false;
+                uint32_t index;
+                uint64_t bases_offset;
+            } readAhead;
             sequence_t sequence;
             PnaMetadata metadata;
             uint32_t flags;
             struct {
-                seqfragment_t *begin;
-                seqfragment_t *next;
-                seqfragment_t *end;
+                const seqfragment_t *begin;
+                const seqfragment_t *next;
+                const seqfragment_t *end;
+                // The fragments, when they aren't used in place.
+                std::vector<seqfragment_t> copy;
             } seqfragments;
             uint8_t shift = 0;
             uint64_t seqOffset = 0;
-            uint32_t *packedByteLookup;
+            // With an image, the cache spans the rest of the packed bases
+            // rather than READBUF_CAPACITY of them.
             struct {
                 unsigned char *buf;
-                uint16_t len = 0;
-                uint16_t index = 0;
+                uint64_t len = 0;
+                uint64_t index = 0;
                 uint64_t bases_offset = 0;
                 unsigned char curr;
             } packedCache;
         };
 
+        // May be shared by threads, which can open sequences at once: its
+        // tables aren't modified after construction, and sequence readers
+        // only pread from the shared file or read from the image. Each
+        // sequence reader must be used by one thread at a time.
         class PnaReader {
         public:
-            PnaReader(const char *path);
+            PnaReader(const char *path,
+                      seqio_io_backend const *backend = nullptr,
+                      seqio_io_engine io_engine = SEQIO_IO_ENGINE_DEFAULT,
+                      seqio_page_cache page_cache = SEQIO_PAGE_CACHE_KEEP);
+            // Reads content the caller holds in memory, which must outlive the
+            // reader and the sequence readers it opens.
+            PnaReader(const void *data, uint64_t length);
             ~PnaReader();
 
             uint64_t getSequenceCount();
@@ -151,21 +165,36 @@ namespace seqio {
             uint64_t getMaxPackedBasesLength();
             const PnaMetadata getMetadata();
             const PnaMetadata getSequenceMetadata(uint64_t index);
+            uint64_t getSequenceLength(uint64_t index);
             std::shared_ptr<PnaSequenceReader> openSequence(uint64_t index,
                                                             uint32_t flags = PnaSequenceReader::Standard);
 
         private:
+            void checkHeader();
+            // Uses the tables in image, which holds the whole file.
+            void useImage();
+
             std::string path;
-            FilePointerPool fpool;
+            std::shared_ptr<seqio::impl::File> file;
+            std::shared_ptr<seqio::impl::IoQueuePool> queues;
+            // The whole file, unless it's read through queues or the backend
+            // has no file descriptor.
+            std::shared_ptr<seqio::impl::FileMapping> mapping;
+            bool dropBehind;
             header_t header;
             const sequence_t *sequences;
             PnaMetadata metadata;
             const char *strings;
+            // Set for content that's mapped or in memory.
+            const uint8_t *image = nullptr;
+            uint64_t imageLength = 0;
             struct {
                 void *addr = nullptr;
                 uint64_t length;
                 uint8_t *file_start;
             } mmap;
+            // The tables, when the backend can't map them.
+            std::vector<uint8_t> tables;
         };
 
 // todo: move inside class
@@ -174,7 +203,7 @@ namespace seqio {
         class StringStorageWriter {
         public:
             stringid_t getId(const char *str);
-            void write(FILE *f, string_storage_t &header);
+            void write(seqio::impl::File *f, string_storage_t &header);
             uint32_t getOffset(stringid_t id);
     
         private:
@@ -193,7 +222,7 @@ namespace seqio {
                            StringStorageWriter &strings);
 
             void addMetadata(const char *key, const char *value);
-            void write(FILE *f);
+            void write(seqio::impl::File *f);
 
         private:
             metadata_t &metadata;
@@ -204,7 +233,7 @@ namespace seqio {
         class PnaSequenceWriter {
             friend class PnaWriter;
 
-            PnaSequenceWriter(FILE *f,
+            PnaSequenceWriter(seqio::impl::File *f,
                               sequence_t &sequence,
                               MetadataWriter &metadata);
 
@@ -221,7 +250,7 @@ namespace seqio {
             void addPackedByte();
             void flushCache();
 
-            FILE *fpna;
+            seqio::impl::File *fpna;
             base_t base_map[256];
             uint64_t seqOffset = 0;
             unsigned char packedByte = 0;
@@ -239,7 +268,7 @@ namespace seqio {
 
         class PnaWriter {
         public:
-            PnaWriter(const char *path);
+            PnaWriter(const char *path, seqio_io_backend const *backend = nullptr);
             ~PnaWriter();
 
             void addMetadata(const char *key, const char *value);
@@ -251,7 +280,7 @@ namespace seqio {
         private:
             void closeSequence();
 
-            FILE *f = nullptr;
+            std::shared_ptr<seqio::impl::File> f;
             header_t header;
             std::vector<sequence_t *> sequences;
             StringStorageWriter strings;
@@ -1,13 +1,23 @@
 #include "pna_impl.hpp"
 
+#include "batch.hpp"
+
+#include <string.h>
+
+#include <memory>
+
 using namespace seqio;
 using namespace seqio::impl;
 
 namespace seqio {
     namespace impl {
 
-        bool is_pna_file_content(char const *path) {
-            return pna::is_pna_file_content(path);
+        bool is_pna_file_content(char const *path, seqio_io_backend const *backend) {
+            return pna::is_pna_file_content(path, backend);
+        }
+
+        bool is_pna_content(void const *data, uint64_t length) {
+            return pna::is_pna_content(data, length);
         }
 
         bool is_pna_file_name(char const *path) {
@@ -64,7 +74,14 @@ char const *PnaMetadata::getValue(char const *key) const {
  **********************************************************************/
 PnaSequence::PnaSequence(std::shared_ptr<pna::PnaSequenceReader> reader_)
     : reader(reader_)
-    , metadata(reader_->getMetadata()) {
+    , metadata(reader_->getMetadata())
+    , length(reader_->size()) {
+}
+
+PnaSequence::PnaSequence(pna::PnaMetadata const &metadata_,
+                         uint64_t length_)
+    : metadata(metadata_)
+    , length(length_) {
 }
 
 PnaSequence::~PnaSequence() {
@@ -76,7 +93,52 @@ IConstDictionary const &PnaSequence::getMetadata() {
 
 uint64_t PnaSequence::read(char *buffer,
                            uint64_t buffer_length) {
-    return reader->read(buffer, buffer_length);
+    return reader ? reader->read(buffer, buffer_length) : 0;
+}
+
+char const *PnaSequence::getQuality(uint64_t *length) {
+    raise_state("PNA sequences have no quality values.");
+}
+
+bool PnaSequence::hasQuality() {
+    return false;
+}
+
+uint64_t PnaSequence::getLength() {
+    return length;
+}
+
+void PnaSequence::seek(uint64_t offset) {
+    if(!reader)
+        raise_state("Cannot seek in a PNA sequence found by a scan.");
+    reader->seek(offset);
+}
+
+void PnaSequence::getPacked(seqio_packed_sequence *packed_) {
+    if(!reader)
+        raise_state("Sequence was scanned without its bases.");
+
+    if(!packed.done) {
+        pna::PnaSequenceReader::packed_read_result_t result = reader->packed_view(packed.bases);
+
+        packed.fragments.resize(result.seqfragments.count);
+        for(uint64_t i = 0; i < result.seqfragments.count; i++) {
+            pna::seqfragment_t const &fragment = result.seqfragments.begin[i];
+            seqio_packed_fragment &out = packed.fragments[i];
+            out.sequence_offset = fragment.sequence_offset;
+            out.packed_offset = (fragment.packed_bases_offset * 4) + (fragment.shift / 2);
+            out.length = fragment.bases_count;
+        }
+
+        packed.sequence.length = result.bases_count;
+        packed.sequence.packed = result.packed_bases.begin;
+        packed.sequence.packed_length = result.packed_bases.buflen;
+        packed.sequence.fragments = packed.fragments.data();
+        packed.sequence.fragment_count = packed.fragments.size();
+        packed.done = true;
+    }
+
+    *packed_ = packed.sequence;
 }
 
 /**********************************************************************
@@ -85,32 +147,103 @@ uint64_t PnaSequence::read(char *buffer,
  *
  **********************************************************************/
 PnaSequenceIterator::PnaSequenceIterator(char const *path,
-                                         seqio_base_transform transform)
-    : reader(std::make_shared<pna::PnaReader>(path))
-    , index(0) {
+                                         seqio_sequence_options const &options)
+    : reader(std::make_shared<pna::PnaReader>(path,
+                                                    options.io_backend,
+                                                    options.io_engine,
+                                                    options.page_cache))
+    , index(0)
+    , flags(pna::PnaSequenceReader::Standard)
+    , scanMode(options.scan_mode)
+    , filter(options) {
+
+    // Bases are always unpacked as GATCN, so no transform is needed.
+    if(options.strand == SEQIO_STRAND_REVERSE_COMPLEMENT)
+        flags |= pna::PnaSequenceReader::ReverseComplement;
+}
+
+PnaSequenceIterator::PnaSequenceIterator(void const *data,
+                                         uint64_t length,
+                                         seqio_sequence_options const &options)
+    : reader(std::make_shared<pna::PnaReader>(data, length))
+    , index(0)
+    , flags(pna::PnaSequenceReader::Standard)
+    , scanMode(options.scan_mode)
+    , filter(options) {
+
+    if(options.strand == SEQIO_STRAND_REVERSE_COMPLEMENT)
+        flags |= pna::PnaSequenceReader::ReverseComplement;
 }
 
 PnaSequenceIterator::~PnaSequenceIterator() {
 }
 
+bool PnaSequenceIterator::seekAccepted() {
+    for(; index < reader->getSequenceCount(); index++) {
+        if(filter.filtersLengths() && !filter.acceptsLength(reader->getSequenceLength(index)))
+            continue;
+        if(filter.filtersNames()) {
+            char const *name = reader->getSequenceMetadata(index).value(SEQIO_KEY_NAME);
+            if(!filter.acceptsName(name ? name : ""))
+                continue;
+        }
+        return true;
+    }
+    return false;
+}
+
 ISequence *PnaSequenceIterator::nextSequence() {
-    if(index >= reader->getSequenceCount()) return nullptr;
+    if(!seekAccepted()) return nullptr;
+
+    if(scanMode != SEQIO_SCAN_BASES) {
+        uint64_t i = index++;
+        return new PnaSequence(reader->getSequenceMetadata(i), reader->getSequenceLength(i));
+    }
 
-    PnaSequence *sequence = new PnaSequence(reader->openSequence(index++));
+    PnaSequence *sequence = new PnaSequence(reader->openSequence(index++, flags));
     return sequence;
 }
 
+ISequence *PnaSequenceIterator::openSequence(char const *name) {
+    for(uint64_t i = 0; i < reader->getSequenceCount(); i++) {
+        char const *value = reader->getSequenceMetadata(i).value(SEQIO_KEY_NAME);
+        if(value && (0 == strcmp(value, name))) {
+            return new PnaSequence(reader->openSequence(i, flags));
+        }
+    }
+
+    raise_parm("No sequence named %s", name);
+}
+
+uint64_t PnaSequenceIterator::nextBatch(BatchBuilder &builder,
+                                        uint64_t max_records) {
+    uint64_t n = 0;
+    for(; n < max_records; n++) {
+        std::unique_ptr<ISequence> sequence(nextSequence());
+        if(!sequence)
+            break;
+        builder.appendSequence(sequence.get(), scanMode);
+    }
+    return n;
+}
+
 /**********************************************************************
  *
  * CLASS PnaWriter
  *
  **********************************************************************/
 PnaWriter::PnaWriter(char const *path,
-                     seqio_file_format file_format)
-    : writer(std::make_shared<pna::PnaWriter>(path)) {
+                     seqio_file_format file_format,
+                     seqio_io_backend const *backend)
+    : writer(std::make_shared<pna::PnaWriter>(path, backend)) {
 }
 
 PnaWriter::~PnaWriter() {
+    try {
+        close();
+    } catch(Exception &) {
+        // Can't raise from a destructor.
+    }
 }
 
 void PnaWriter::createSequence(IConstDictionary const *metadata) {
@@ -126,3 +259,8 @@ void PnaWriter::write(char const *buffer,
                       uint64_t length) {
     sequence->write(buffer, length);
 }
+
+void PnaWriter::close() {
+    sequence.reset();
+    writer->close();
+}
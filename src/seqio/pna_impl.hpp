@@ -1,12 +1,14 @@
 #pragma once
 
+#include "filter.hpp"
 #include "pna.hpp"
 #include "seqio_impl.hpp"
 
 namespace seqio {
     namespace impl {
 
-        bool is_pna_file_content(char const *path);
+        bool is_pna_file_content(char const *path, seqio_io_backend const *backend = nullptr);
+        bool is_pna_content(void const *data, uint64_t length);
         bool is_pna_file_name(char const *path);
 
 /**********************************************************************
@@ -36,15 +38,33 @@ namespace seqio {
         class PnaSequence : public ISequence {
         public:
             PnaSequence(std::shared_ptr<pna::PnaSequenceReader> reader_);
+            // A sequence found by a scan, which has no bases, so nothing
+            // beyond the tables needs to be read.
+            PnaSequence(pna::PnaMetadata const &metadata_,
+                        uint64_t length_);
             virtual ~PnaSequence();
 
             virtual IConstDictionary const &getMetadata() override;
             virtual uint64_t read(char *buffer,
                                   uint64_t buffer_length) override;
+            virtual char const *getQuality(uint64_t *length) override;
+            virtual bool hasQuality() override;
+            virtual uint64_t getLength() override;
+            virtual void seek(uint64_t offset) override;
+            virtual void getPacked(seqio_packed_sequence *packed) override;
 
         private:
             std::shared_ptr<pna::PnaSequenceReader> reader;
             PnaMetadata metadata;
+            uint64_t length;
+            // Filled by the first getPacked().
+            struct {
+                bool done = false;
+                seqio_packed_sequence sequence;
+                std::vector<seqio_packed_fragment> fragments;
+                // The packed bases, when they aren't used in place.
+                std::vector<uint8_t> bases;
+            } packed;
         };
 
 /**********************************************************************
@@ -55,14 +75,27 @@ namespace seqio {
         class PnaSequenceIterator : public ISequenceIterator {
         public:
             PnaSequenceIterator(char const *path,
-                                seqio_base_transform transform);
+                                seqio_sequence_options const &options);
+            PnaSequenceIterator(void const *data,
+                                uint64_t length,
+                                seqio_sequence_options const &options);
             virtual ~PnaSequenceIterator();
 
             virtual ISequence *nextSequence() override;
+            virtual ISequence *openSequence(char const *name) override;
+            virtual uint64_t nextBatch(BatchBuilder &builder,
+                                       uint64_t max_records) override;
 
         private:
+            // Advances index to the next sequence the filter accepts, which
+            // only needs the tables.
+            bool seekAccepted();
+
             std::shared_ptr<pna::PnaReader> reader;
             uint64_t index;
+            uint32_t flags;
+            seqio_scan_mode scanMode;
+            SequenceFilter filter;
         };
 
 /**********************************************************************
@@ -73,12 +106,14 @@ namespace seqio {
         class PnaWriter : public IWriter {
         public:
             PnaWriter(char const *path,
-                      seqio_file_format file_format);
+                      seqio_file_format file_format,
+                      seqio_io_backend const *backend = nullptr);
             virtual ~PnaWriter();
 
             virtual void createSequence(IConstDictionary const *metadata) override;
             virtual void write(char const *buffer,
                                uint64_t length) override;
+            virtual void close() override;
 
         private:
             std::shared_ptr<pna::PnaWriter> writer;
@@ -1,15 +1,21 @@
 #include "seqio.h"
 
+#include "batch.hpp"
 #include "fasta.hpp"
+#include "fastq.hpp"
+#include "iterator.hpp"
 #include "pna_impl.hpp"
+#include "io.hpp"
+#include "simd.hpp"
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <map>
 #include <string>
+#include <vector>
 
 #include <sys/types.h>
-#include <sys/stat.h>
 #include <unistd.h>
 
 using namespace seqio::impl;
@@ -18,11 +24,26 @@ using std::string;
 
 seqio_sequence_options const SEQIO_DEFAULT_SEQUENCE_OPTIONS = {
     SEQIO_FILE_FORMAT_DEDUCE,
-    SEQIO_BASE_TRANSFORM_NONE
+    SEQIO_BASE_TRANSFORM_NONE,
+    SEQIO_INDEX_NONE,
+    1,
+    SEQIO_STRAND_FORWARD,
+    SEQIO_RECORD_ORDER_FILE,
+    0,
+    SEQIO_IO_ENGINE_DEFAULT,
+    SEQIO_PAGE_CACHE_KEEP,
+    nullptr,
+    SEQIO_SCAN_BASES,
+    nullptr,
+    0,
+    nullptr,
+    0,
+    0
 };
 
 seqio_writer_options const SEQIO_DEFAULT_WRITER_OPTIONS = {
-    SEQIO_FILE_FORMAT_DEDUCE
+    SEQIO_FILE_FORMAT_DEDUCE,
+    nullptr
 };
 
 static seqio_status  __err_abort(seqio_err_info err_info);
@@ -70,40 +91,77 @@ seqio_status seqio_create_sequence_iterator(char const *path,
     check_null(path);
     check_null(iterator);
 
-    {
-        struct stat buf;
-        if(0 != stat(path, &buf)) {
-            err_fnf("No such file: %s", path);
-        }
+    if(!File::exists(options.io_backend, path)) {
+        err_fnf("No such file: %s", path);
     }
 
     ISequenceIterator *impl;
 
-    if(options.file_format == SEQIO_FILE_FORMAT_DEDUCE) {
-        if(is_pna_file_content(path)) {
-            options.file_format = SEQIO_FILE_FORMAT_PNA;
-        } else {
-            options.file_format = SEQIO_FILE_FORMAT_FASTA;
+    try {
+        impl = create_sequence_iterator(path, options);
+    } catch(Exception x) {
+        return err_handler(x.err_info);
+    }
+
+    *iterator = (seqio_sequence_iterator)impl;
+
+    return SEQIO_SUCCESS;
+}
+
+seqio_status seqio_create_multi_sequence_iterator(char const * const *paths,
+                                                  uint64_t npaths,
+                                                  seqio_sequence_options options,
+                                                  seqio_sequence_iterator *iterator) {
+    check_null(iterator);
+    if(npaths > 0)
+        check_null(paths);
+
+    // Missing files are reported now rather than when reached.
+    std::vector<string> paths_;
+    for(uint64_t i = 0; i < npaths; i++) {
+        check_null(paths[i]);
+        if(!File::exists(options.io_backend, paths[i])) {
+            err_fnf("No such file: %s", paths[i]);
         }
+        paths_.push_back(paths[i]);
     }
 
     try {
-        switch(options.file_format) {
-        case SEQIO_FILE_FORMAT_FASTA:
-        case SEQIO_FILE_FORMAT_FASTA_GZIP:
-            impl = new FastaSequenceIterator(path, options.base_transform);
-            break;
-        case SEQIO_FILE_FORMAT_PNA:
-            impl = new PnaSequenceIterator(path, options.base_transform);
-            break;
-        default:
-            raise_parm("Invalid file format.");
-        }
+        *iterator = (seqio_sequence_iterator)new MultiSequenceIterator(paths_, options);
     } catch(Exception x) {
         return err_handler(x.err_info);
     }
 
-    *iterator = (seqio_sequence_iterator)impl;
+    return SEQIO_SUCCESS;
+}
+
+seqio_status seqio_create_sequence_iterator_from_memory(void const *data,
+                                                        uint64_t length,
+                                                        seqio_sequence_options options,
+                                                        seqio_sequence_iterator *iterator) {
+    check_null(iterator);
+    if(length > 0)
+        check_null(data);
+
+    try {
+        *iterator = (seqio_sequence_iterator)create_memory_sequence_iterator(data, length, options);
+    } catch(Exception x) {
+        return err_handler(x.err_info);
+    }
+
+    return SEQIO_SUCCESS;
+}
+
+seqio_status seqio_get_file_index(seqio_sequence_iterator iterator,
+                                  uint64_t *index) {
+    check_null(iterator);
+    check_null(index);
+
+    MultiSequenceIterator *multi = dynamic_cast<MultiSequenceIterator *>((ISequenceIterator *)iterator);
+    if(!multi) {
+        err_parm("Not a multi-file iterator.");
+    }
+    *index = multi->getFileIndex();
 
     return SEQIO_SUCCESS;
 }
@@ -135,6 +193,53 @@ seqio_status seqio_next_sequence(seqio_sequence_iterator iterator,
     return SEQIO_SUCCESS;    
 }
 
+seqio_status seqio_open_sequence(seqio_sequence_iterator iterator,
+                                 char const *name,
+                                 seqio_sequence *sequence) {
+    check_null(iterator);
+    check_null(name);
+    check_null(sequence);
+
+    try {
+        *sequence = (seqio_sequence)((ISequenceIterator *)iterator)->openSequence(name);
+    } catch(Exception x) {
+        return err_handler(x.err_info);
+    }
+
+    return SEQIO_SUCCESS;
+}
+
+seqio_status seqio_next_batch(seqio_sequence_iterator iterator,
+                              uint64_t max_records,
+                              seqio_batch *batch) {
+    check_null(iterator);
+    check_null(batch);
+
+    try {
+        BatchBuilder builder(batch);
+        ((ISequenceIterator *)iterator)->nextBatch(builder, max_records);
+    } catch(Exception x) {
+        batch->count = 0;
+        return err_handler(x.err_info);
+    }
+
+    return SEQIO_SUCCESS;
+}
+
+seqio_status seqio_dispose_batch(seqio_batch *batch) {
+    if(batch) {
+        free(batch->arena);
+        free(batch->names);
+        free(batch->comments);
+        free(batch->bases);
+        free(batch->qualities);
+        free(batch->lengths);
+        *batch = SEQIO_EMPTY_BATCH;
+    }
+
+    return SEQIO_SUCCESS;
+}
+
 seqio_status seqio_dispose_sequence(seqio_sequence *sequence) {
     if(sequence && *sequence) {
         try {
@@ -163,6 +268,20 @@ seqio_status seqio_get_metadata(seqio_sequence sequence,
     return SEQIO_SUCCESS;
 }
 
+seqio_status seqio_get_length(seqio_sequence sequence,
+                              uint64_t *length) {
+    check_null(sequence);
+    check_null(length);
+
+    try {
+        *length = ((ISequence *)sequence)->getLength();
+    } catch(Exception x) {
+        return err_handler(x.err_info);
+    }
+
+    return SEQIO_SUCCESS;
+}
+
 seqio_status seqio_read(seqio_sequence sequence,
                         char *buffer,
                         uint64_t buffer_length,
@@ -181,6 +300,98 @@ seqio_status seqio_read(seqio_sequence sequence,
     return SEQIO_SUCCESS;    
 }
 
+seqio_status seqio_seek(seqio_sequence sequence,
+                        uint64_t offset) {
+    check_null(sequence);
+
+    try {
+        ((ISequence *)sequence)->seek(offset);
+    } catch(Exception x) {
+        return err_handler(x.err_info);
+    }
+
+    return SEQIO_SUCCESS;
+}
+
+seqio_status seqio_read_region(seqio_sequence sequence,
+                               uint64_t start,
+                               uint64_t length,
+                               char *buffer,
+                               uint64_t *read_length) {
+    check_null(sequence);
+    check_null(buffer);
+    check_null(read_length);
+
+    try {
+        ISequence *seq = (ISequence *)sequence;
+        seq->seek(start);
+
+        uint64_t n = 0;
+        while(n < length) {
+            uint64_t nread = seq->read(buffer + n, length - n);
+            if(nread == 0)
+                break;
+            n += nread;
+        }
+        *read_length = n;
+    } catch(Exception x) {
+        return err_handler(x.err_info);
+    }
+
+    return SEQIO_SUCCESS;
+}
+
+seqio_status seqio_transform(seqio_base_transform transform,
+                             char const *src,
+                             uint64_t length,
+                             char *dst) {
+    check_null(src);
+    check_null(dst);
+
+    switch(transform) {
+    case SEQIO_BASE_TRANSFORM_NONE:
+        memmove(dst, src, length);
+        break;
+    case SEQIO_BASE_TRANSFORM_CAPS_GATCN:
+        transform_caps_gatcn(src, length, dst);
+        break;
+    default:
+        err_parm("Invalid base transform.");
+    }
+
+    return SEQIO_SUCCESS;
+}
+
+seqio_status seqio_get_quality(seqio_sequence sequence,
+                               char const **quality,
+                               uint64_t *length) {
+    check_null(sequence);
+    check_null(quality);
+    check_null(length);
+
+    try {
+        *quality = ((ISequence *)sequence)->getQuality(length);
+    } catch(Exception x) {
+        return err_handler(x.err_info);
+    }
+
+    return SEQIO_SUCCESS;
+}
+
+seqio_status seqio_get_packed(seqio_sequence sequence,
+                              seqio_packed_sequence *packed) {
+    check_null(sequence);
+    check_null(packed);
+
+    try {
+        ((ISequence *)sequence)->getPacked(packed);
+    } catch(Exception x) {
+        return err_handler(x.err_info);
+    }
+
+    return SEQIO_SUCCESS;
+}
+
 seqio_status seqio_read_all(seqio_sequence sequence,
                             char **buffer,
                             uint64_t *buffer_length,
@@ -256,10 +467,10 @@ seqio_status seqio_create_writer(char const *path,
         switch(options.file_format) {
         case SEQIO_FILE_FORMAT_FASTA:
         case SEQIO_FILE_FORMAT_FASTA_GZIP:
-            iwriter = new FastaWriter(path, options.file_format);
+            iwriter = new FastaWriter(path, options.file_format, options.io_backend);
             break;
         case SEQIO_FILE_FORMAT_PNA:
-            iwriter = new PnaWriter(path, options.file_format);
+            iwriter = new PnaWriter(path, options.file_format, options.io_backend);
             break;
         default:
             raise_parm("Invalid file_format specified.");
@@ -276,12 +487,16 @@ seqio_status seqio_create_writer(char const *path,
 
 seqio_status seqio_dispose_writer(seqio_writer *writer) {
     if(writer && *writer) {
+        // Disposed of even if closing fails, which is reported.
+        IWriter *iwriter = (IWriter *)*writer;
+        *writer = nullptr;
         try {
-            delete (IWriter *)*writer;
-            *writer = nullptr;
+            iwriter->close();
         } catch(Exception x) {
+            delete iwriter;
             return err_handler(x.err_info);
         }
+        delete iwriter;
     }
 
     return SEQIO_SUCCESS;
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 /*!
@@ -38,7 +39,9 @@ typedef enum {
     SEQIO_FILE_FORMAT_DEDUCE,
     SEQIO_FILE_FORMAT_FASTA,
     SEQIO_FILE_FORMAT_FASTA_GZIP,
-    SEQIO_FILE_FORMAT_PNA
+    SEQIO_FILE_FORMAT_PNA,
+    SEQIO_FILE_FORMAT_FASTQ,
+    SEQIO_FILE_FORMAT_FASTQ_GZIP
 } seqio_file_format;
 
 /*!
@@ -52,16 +55,178 @@ typedef enum {
     SEQIO_BASE_TRANSFORM_CAPS_GATCN
 } seqio_base_transform;
 
+/*!
+  Specifies the strand of the bases placed in client read buffer.
+*/
+typedef enum {
+    /*! Bases as they appear in the file. */
+    SEQIO_STRAND_FORWARD,
+    /*! The reverse complement of the sequence: the first base read is the complement of
+        its last base. The base transform is applied before complementing. Bases are
+        complemented according to IUPAC (e.g. R and Y are swapped), preserving case;
+        anything else is left as is. For FASTQ, the quality values are reversed to
+        match. */
+    SEQIO_STRAND_REVERSE_COMPLEMENT
+} seqio_strand;
+
+/*!
+  Specifies the order in which records are returned when they are parsed on several
+  threads.
+*/
+typedef enum {
+    /*! The order in which they appear in the file. */
+    SEQIO_RECORD_ORDER_FILE,
+    /*! Whatever order they are parsed in, which saves waiting on a thread that is
+        parsing a long record. */
+    SEQIO_RECORD_ORDER_ANY
+} seqio_record_order;
+
+/*!
+  Specifies how much of each record is read, for building a table of contents without
+  paying for the bases.
+*/
+typedef enum {
+    /*! Headers and bases. */
+    SEQIO_SCAN_BASES,
+    /*! Only headers: sequences have no bases or qualities, and the iterator jumps from
+        one header to the next. */
+    SEQIO_SCAN_HEADERS,
+    /*! Headers and lengths: as SEQIO_SCAN_HEADERS, but the bases of each record are
+        counted, without being transformed or copied, for seqio_get_length() and
+        seqio_batch.lengths. */
+    SEQIO_SCAN_LENGTHS
+} seqio_scan_mode;
+
+/*!
+  Specifies how uncompressed files (plain FASTA and PNA) are read.
+*/
+typedef enum {
+    /*! Plain FASTA and PNA are memory-mapped. */
+    SEQIO_IO_ENGINE_DEFAULT,
+    /*! Blocks are read with pread(). */
+    SEQIO_IO_ENGINE_PREAD,
+    /*! Blocks are read through io_uring into registered buffers. Once reading is
+        sequential, reads of the following blocks are submitted together, ahead of
+        need. Falls back to SEQIO_IO_ENGINE_PREAD where io_uring isn't available. */
+    SEQIO_IO_ENGINE_URING
+} seqio_io_engine;
+
+/*!
+  Specifies what reading a file may leave in the page cache, for scans that shouldn't
+  evict other processes' data.
+*/
+typedef enum {
+    /*! File content is cached as usual. */
+    SEQIO_PAGE_CACHE_KEEP,
+    /*! Content is dropped from the page cache (POSIX_FADV_DONTNEED) once it has been
+        read. */
+    SEQIO_PAGE_CACHE_DROP_BEHIND,
+    /*! Uncompressed files are read with O_DIRECT in large aligned blocks, bypassing the
+        page cache. Compressed files, and file systems that don't support O_DIRECT, are
+        read as with SEQIO_PAGE_CACHE_DROP_BEHIND. */
+    SEQIO_PAGE_CACHE_BYPASS
+} seqio_page_cache;
+
+/*!
+  Storage that files are read from and written to, in place of the file system. Every
+  reader and writer does its I/O through these callbacks; SEQIO_FILE_IO_BACKEND
+  implements them with POSIX file descriptors. Functions that return int64_t or int
+  return -1 on failure.
+*/
+typedef struct {
+    /*! Passed to open(). */
+    void *context;
+    /*! Opens a file for reading or, if writable is nonzero, creates or truncates it for
+        writing. Returns a handle passed to the other callbacks, or null on failure with
+        errno set to ENOENT if there is no such file. */
+    void *(*open)(void *context, char const *path, int writable);
+    /*! Reads up to length bytes at the current position, advancing it. Returns the
+        number read, which is 0 only at end of file. */
+    int64_t (*read)(void *handle, void *buffer, uint64_t length);
+    /*! Reads up to length bytes at offset, without using or moving the current
+        position. May be called from several threads at once. */
+    int64_t (*pread)(void *handle, void *buffer, uint64_t length, uint64_t offset);
+    /*! Moves the current position to an absolute offset. Writers only seek back over
+        content they've written, to fill in headers. */
+    int (*seek)(void *handle, uint64_t offset);
+    /*! Writes up to length bytes at the current position, advancing it. Returns the
+        number written. */
+    int64_t (*write)(void *handle, void const *buffer, uint64_t length);
+    /*! Returns the length of the file. */
+    int64_t (*size)(void *handle);
+    /*! Closes the handle, which reports whether written content was stored. */
+    int (*close)(void *handle);
+} seqio_io_backend;
+
+/*!
+  Specifies use of a samtools-style .fai index (located at the FASTA path + ".fai"),
+  which allows sequences to be opened by name and seeked in constant time.
+  For BGZF-compressed FASTA, the mode also applies to the htslib-style .gzi block
+  index (located at the FASTA path + ".gzi"); if it's missing, the blocks are scanned
+  on the first seek instead.
+  Ignored for file formats that don't need an index (e.g. PNA).
+*/
+typedef enum {
+    /*! Don't use an index. */
+    SEQIO_INDEX_NONE,
+    /*! Use the index if it exists. */
+    SEQIO_INDEX_USE,
+    /*! Use the index, first building and saving it if it doesn't exist or is older than
+        the FASTA file. */
+    SEQIO_INDEX_BUILD
+} seqio_index_mode;
+
 /*!
   Options passed to seqio_create_sequence_iterator().
  */
 typedef struct {
     seqio_file_format file_format;
     seqio_base_transform base_transform;
+    seqio_index_mode index_mode;
+    /*! Number of threads used to decompress BGZF-compressed input, or to parse
+        uncompressed FASTA. With 0 or 1, all work is done on the calling thread. */
+    uint32_t num_threads;
+    seqio_strand strand;
+    /*! Only matters when uncompressed FASTA is parsed on several threads. */
+    seqio_record_order record_order;
+    /*! Number of buffers that a background thread keeps filled with inflated content of
+        gzip-compressed input while the calling thread parses (at least 2 are used). With
+        0, content is inflated on the calling thread as it's needed. For BGZF, this
+        matters only when num_threads is 0 or 1. */
+    uint32_t read_ahead_buffers;
+    /*! Plain FASTA parsed on several threads is always memory-mapped. */
+    seqio_io_engine io_engine;
+    /*! Other than SEQIO_PAGE_CACHE_KEEP, uncompressed FASTA and PNA are read by
+        blocks rather than mmap, with io_engine if it isn't the default and
+        pread otherwise. Plain FASTA parsed on several threads stays mapped, and
+        drops pages behind. */
+    seqio_page_cache page_cache;
+    /*! Storage the files are read from, which must remain valid until the iterator has
+        been disposed; null is SEQIO_FILE_IO_BACKEND. Memory mapping, io_uring and page
+        cache management need file descriptors, so with any other backend files are read
+        as with SEQIO_IO_ENGINE_PREAD and SEQIO_PAGE_CACHE_KEEP, and indexes are neither
+        loaded nor saved; with SEQIO_INDEX_BUILD they're built in memory. */
+    seqio_io_backend const *io_backend;
+    /*! Other than SEQIO_SCAN_BASES, FASTA is always parsed on the calling thread. */
+    seqio_scan_mode scan_mode;
+    /*! If not null, only sequences named one of the num_names names are read. */
+    char const * const *names;
+    uint32_t num_names;
+    /*! If not null, only sequences whose names match this POSIX extended regular
+        expression are read. An unanchored expression matches anywhere in the name. */
+    char const *name_regex;
+    /*! Only sequences with at least min_length bases, and at most max_length unless it's
+        0, are read. Without an index, a FASTA record's bases are counted or parsed before
+        it's known whether to read it. */
+    uint64_t min_length;
+    uint64_t max_length;
 } seqio_sequence_options;
 
 typedef struct {
     seqio_file_format file_format;
+    /*! Storage the file is written to, which must remain valid until the writer has
+        been disposed; null is SEQIO_FILE_IO_BACKEND. */
+    seqio_io_backend const *io_backend;
 } seqio_writer_options;
 
 /*!
@@ -122,6 +287,46 @@ typedef struct {
 */
 typedef seqio_status (*seqio_err_handler)(seqio_err_info err_info);
 
+/*!
+  Location of a field within a seqio_batch arena.
+*/
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+} seqio_span;
+
+/*!
+  A set of records filled by seqio_next_batch(). All names, comments, bases and
+  qualities are packed into a single arena that is reused from one call to the next;
+  each field is followed by a null that isn't included in its length. Record i's name
+  is at arena + names[i].offset, and similarly for the other fields.
+
+  Initialize with SEQIO_EMPTY_BATCH and release with seqio_dispose_batch().
+*/
+typedef struct {
+    /*! Number of records in the batch. */
+    uint64_t count;
+    char *arena;
+    seqio_span *names;
+    seqio_span *comments;
+    seqio_span *bases;
+    /*! Empty for formats without qualities. */
+    seqio_span *qualities;
+    /*! Number of bases of each record: bases[i].length, or with SEQIO_SCAN_LENGTHS the
+        count of bases that weren't read. 0 with SEQIO_SCAN_HEADERS. */
+    uint64_t *lengths;
+
+    /*! Internal allocation sizes; don't modify. */
+    uint64_t arena_length;
+    uint64_t arena_capacity;
+    uint64_t records_capacity;
+} seqio_batch;
+
+/*!
+  Initial value of a seqio_batch.
+*/
+#define SEQIO_EMPTY_BATCH {0, NULL, NULL, NULL, NULL, NULL, NULL, 0, 0, 0}
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -129,17 +334,39 @@ extern "C" {
 /*!
   Provides reasonable default options for seqio_create_sequence_iterator():
   - base_transform: SEQIO_BASE_TRANSFORM_NONE
+  - index_mode: SEQIO_INDEX_NONE
+  - num_threads: 1
+  - strand: SEQIO_STRAND_FORWARD
+  - record_order: SEQIO_RECORD_ORDER_FILE
+  - read_ahead_buffers: 0
+  - io_engine: SEQIO_IO_ENGINE_DEFAULT
+  - page_cache: SEQIO_PAGE_CACHE_KEEP
+  - io_backend: null (SEQIO_FILE_IO_BACKEND)
+  - scan_mode: SEQIO_SCAN_BASES
+  - names, name_regex: null (no filter)
+  - min_length, max_length: 0 (no filter)
+
+  Records rejected by the filters are skipped as they're parsed, as though they weren't
+  in the file, although sequences opened by name aren't filtered. names and name_regex
+  must remain valid until the iterator has been disposed.
 */
 extern seqio_sequence_options const SEQIO_DEFAULT_SEQUENCE_OPTIONS;
 extern seqio_writer_options const SEQIO_DEFAULT_WRITER_OPTIONS;
 
+/*!
+  Reads and writes files in the file system. Its callbacks can be wrapped by another
+  backend, e.g. one that counts or throttles I/O.
+*/
+extern seqio_io_backend const SEQIO_FILE_IO_BACKEND;
+
 extern seqio_err_handler const SEQIO_ERR_HANDLER_ABORT;
 extern seqio_err_handler const SEQIO_ERR_HANDLER_EXIT;
 extern seqio_err_handler const SEQIO_ERR_HANDLER_RETURN;
 
 /*!
   Open a file for reading one or more sequences. The file must be one of the supported formats:
-  - FASTA (may be gzipped)
+  - FASTA (may be gzipped; BGZF-compressed files support random access)
+  - FASTQ (may be gzipped; reading only)
   - PNA
 
   The set of sequences will be lazily populated for inherently sequential formats like FASTA.
@@ -178,6 +405,65 @@ seqio_status seqio_create_sequence_iterator(char const *path,
                                             seqio_sequence_options options,
                                             seqio_sequence_iterator *iterator);
 
+/*!
+  Open several files for reading their sequences in turn, as though they were one file.
+  The format of each file is deduced separately unless options specify it. While one
+  file is being read, the next is opened and its first sequence found in the
+  background, so that moving from one file to the next doesn't wait on I/O.
+
+  \param [in] paths Locations of files in filesystem.
+  \param [in] npaths Number of paths.
+  \param [in] options Options used in processing the sequences of every file.
+  \param [out] iterator Iterator for all sequences found in the files.
+
+  \return SEQIO_SUCCESS if successful, otherwise SEQIO_ERR_*. SEQIO_ERR_FILE_NOT_FOUND is
+  returned if any of the files doesn't exist. Errors in opening a later file are
+  returned by the call that reaches it.
+
+  \note Sequences can't be opened by name from the iterator.
+*/
+seqio_status seqio_create_multi_sequence_iterator(char const * const *paths,
+                                                  uint64_t npaths,
+                                                  seqio_sequence_options options,
+                                                  seqio_sequence_iterator *iterator);
+
+/*!
+  Read sequences from content already in memory, e.g. received over the network,
+  without writing it to a file. The content is in any of the formats accepted by
+  seqio_create_sequence_iterator(), and is deduced the same way unless options specify
+  it. Uncompressed FASTA and FASTQ are parsed in place and PNA bases are unpacked
+  from it in place; gzip and BGZF content is inflated from it.
+
+  \param [in] data Content of a file.
+  \param [in] length Length of the content in bytes.
+  \param [in] options Options used in processing the sequences. index_mode,
+  read_ahead_buffers, io_engine and page_cache don't apply to content in memory.
+  \param [out] iterator Iterator for all sequences found in the content.
+
+  \return SEQIO_SUCCESS if successful, otherwise SEQIO_ERR_*.
+
+  \attention The content isn't copied, so it must not be changed or freed until the
+  iterator and every sequence obtained from it have been disposed.
+
+  \note Sequences can only be opened by name from PNA content.
+*/
+seqio_status seqio_create_sequence_iterator_from_memory(void const *data,
+                                                        uint64_t length,
+                                                        seqio_sequence_options options,
+                                                        seqio_sequence_iterator *iterator);
+
+/*!
+  Get which file the sequence most recently obtained from a multi-file iterator came
+  from.
+
+  \param [in] iterator Iterator created by seqio_create_multi_sequence_iterator().
+  \param [out] index Index into the iterator's paths.
+
+  \return SEQIO_SUCCESS if successful, otherwise SEQIO_ERR_*.
+*/
+seqio_status seqio_get_file_index(seqio_sequence_iterator iterator,
+                                  uint64_t *index);
+
 /*!
   Dispose the iterator. Any sequences that were obtained from it that have not
   been disposed are still valid.
@@ -234,6 +520,27 @@ seqio_status seqio_dispose_sequence_iterator(seqio_sequence_iterator *iterator);
     seqio_status seqio_next_sequence(seqio_sequence_iterator iterator,
                                      seqio_sequence *sequence);
 
+/*!
+  Open a sequence by name, independent of the iterator's position. The iterator
+  remains valid and unaffected.
+
+  \param [in] iterator Sequence iterator.
+  \param [in] name Name of sequence (i.e. its SEQIO_KEY_NAME value).
+  \param [out] sequence Contains the sequence upon return.
+
+  \return SEQIO_SUCCESS if successful, otherwise SEQIO_ERR_*. If no sequence has
+  the name, SEQIO_ERR_INVALID_PARAMETER is returned. For FASTA files, an index must
+  have been requested via seqio_sequence_options.index_mode, otherwise
+  SEQIO_ERR_INVALID_STATE is returned.
+
+  \note For PNA files, several threads may open sequences from one iterator at once,
+  and read them concurrently, as long as each sequence is read by one thread at a
+  time.
+ */
+    seqio_status seqio_open_sequence(seqio_sequence_iterator iterator,
+                                     char const *name,
+                                     seqio_sequence *sequence);
+
 /*!
   Disposes resources associated with a sequence (e.g. read cache).
 
@@ -248,6 +555,19 @@ seqio_status seqio_dispose_sequence_iterator(seqio_sequence_iterator *iterator);
     seqio_status seqio_get_metadata(seqio_sequence sequence,
                                     seqio_const_dictionary *dict);
 
+/*!
+  Get the number of bases of a sequence without reading them.
+
+  \param [in] sequence The sequence.
+  \param [out] length Number of bases.
+
+  \return SEQIO_SUCCESS if successful, otherwise SEQIO_ERR_*. If the length isn't known
+  in advance, which is the case for FASTA without an index unless scanned with
+  SEQIO_SCAN_LENGTHS, SEQIO_ERR_INVALID_STATE is returned.
+ */
+    seqio_status seqio_get_length(seqio_sequence sequence,
+                                  uint64_t *length);
+
 /*!
   Read bases from sequence.
 
@@ -263,6 +583,170 @@ seqio_status seqio_dispose_sequence_iterator(seqio_sequence_iterator *iterator);
                             uint64_t buffer_length,
                             uint64_t *read_length);
 
+/*!
+  Move the position from which seqio_read() reads bases, without reading the bases
+  before it. For SEQIO_STRAND_REVERSE_COMPLEMENT, the offset is into the reverse
+  complement.
+
+  Seeking takes constant time for indexed FASTA, and time logarithmic in the number of
+  N runs for PNA. FASTQ sequences, and FASTA sequences parsed on several threads, are
+  already in memory.
+
+  \param [in] sequence The sequence.
+  \param [in] offset Offset of the next base to be read, up to the sequence's length.
+
+  \return SEQIO_SUCCESS if successful, otherwise SEQIO_ERR_*. If the sequence can't
+  seek without reading the bases before offset, which is the case for FASTA without an
+  index and for sequences found by a scan, SEQIO_ERR_INVALID_STATE is returned. If
+  offset exceeds the length, SEQIO_ERR_INVALID_PARAMETER is returned.
+
+  \note For gzip-compressed FASTA that isn't BGZF, an index locates the sequence, but
+  seeking still inflates the file up to offset, and along the reverse complement to the
+  end of the sequence.
+ */
+    seqio_status seqio_seek(seqio_sequence sequence,
+                            uint64_t offset);
+
+/*!
+  Read the bases of a region of a sequence, as seqio_seek() followed by seqio_read()
+  until the buffer is full or the sequence ends. Reading continues from the end of the
+  region.
+
+  \param [in] sequence The sequence to be read.
+  \param [in] start Offset of the region's first base.
+  \param [in] length Number of bases in the region.
+  \param [in] buffer Destination for bases, of at least length bytes.
+  \param [out] read_length Number of bases read, which is less than length only if the
+                           region extends past the end of the sequence.
+
+  \return SEQIO_SUCCESS if successful, otherwise SEQIO_ERR_*, as for seqio_seek().
+ */
+    seqio_status seqio_read_region(seqio_sequence sequence,
+                                   uint64_t start,
+                                   uint64_t length,
+                                   char *buffer,
+                                   uint64_t *read_length);
+
+/*!
+  Get up to max_records sequences from the iterator in one call, including their
+  bases. This avoids creating a seqio_sequence per record, which dominates the cost of
+  reading files of many short sequences.
+
+  \param [in] iterator Sequence iterator.
+  \param [in] max_records Maximum number of records placed in batch.
+  \param [in,out] batch Receives the records, replacing its previous contents.
+                        batch->count is 0 once the iterator is exhausted.
+
+  \return SEQIO_SUCCESS if successful, otherwise SEQIO_ERR_*.
+
+  \b Example
+  \code
+  seqio_batch batch = SEQIO_EMPTY_BATCH;
+
+  while( (seqio_next_batch(iterator, 1024, &batch) == SEQIO_SUCCESS)
+         && batch.count ) {
+    for(uint64_t i = 0; i < batch.count; i++) {
+      char const *name = batch.arena + batch.names[i].offset;
+      char const *bases = batch.arena + batch.bases[i].offset;
+      uint64_t length = batch.bases[i].length;
+
+      // ... do stuff with sequence data ...
+    }
+  }
+
+  seqio_dispose_batch(&batch);
+  \endcode
+ */
+    seqio_status seqio_next_batch(seqio_sequence_iterator iterator,
+                                  uint64_t max_records,
+                                  seqio_batch *batch);
+
+/*!
+  Release the memory held by a batch, leaving it equal to SEQIO_EMPTY_BATCH.
+ */
+    seqio_status seqio_dispose_batch(seqio_batch *batch);
+
+/*!
+  Apply a base transform to a buffer of bases, as is done when reading sequences. The
+  fastest implementation supported by the CPU is used.
+
+  \param [in] transform The transform to apply.
+  \param [in] src Bases to be transformed.
+  \param [in] length Number of bases.
+  \param [out] dst Destination for transformed bases. May be the same as src.
+
+  \return SEQIO_SUCCESS if successful, otherwise SEQIO_ERR_*.
+ */
+    seqio_status seqio_transform(seqio_base_transform transform,
+                                 char const *src,
+                                 uint64_t length,
+                                 char *dst);
+
+/*!
+  Get the quality values of a FASTQ sequence.
+
+  \param [in] sequence The sequence.
+  \param [out] quality Quality values, one character per base, unaffected by the
+                       base transform. Valid until the sequence is disposed.
+  \param [out] length Number of quality values.
+
+  \return SEQIO_SUCCESS if successful, otherwise SEQIO_ERR_*. If the sequence's
+  format has no quality values, SEQIO_ERR_INVALID_STATE is returned.
+ */
+    seqio_status seqio_get_quality(seqio_sequence sequence,
+                                   char const **quality,
+                                   uint64_t *length);
+
+/*!
+  A run of bases in a PNA sequence that aren't N. The bases of all runs are packed
+  one after another, so the run's bases are packed bases packed_offset through
+  packed_offset + length - 1.
+*/
+typedef struct {
+    /*! Position in the sequence of the run's first base. */
+    uint64_t sequence_offset;
+    /*! Position among the packed bases of the run's first base, which is in byte
+        packed_offset / 4 at bit 2 * (packed_offset % 4). */
+    uint64_t packed_offset;
+    /*! Number of bases in the run. */
+    uint64_t length;
+} seqio_packed_fragment;
+
+/*!
+  The bases of a PNA sequence as they are stored: every base that isn't N, packed four
+  to a byte with the first in the low two bits and coded A = 0, C = 1, G = 2, T = 3,
+  and the runs they form. Bases outside of the runs are N.
+*/
+typedef struct {
+    /*! Number of bases in the sequence, including Ns. */
+    uint64_t length;
+    /*! The packed bases. */
+    uint8_t const *packed;
+    /*! Number of bytes of packed bases. */
+    uint64_t packed_length;
+    /*! The runs, in order. */
+    seqio_packed_fragment const *fragments;
+    /*! Number of runs. */
+    uint64_t fragment_count;
+} seqio_packed_sequence;
+
+/*!
+  Get the packed bases of a PNA sequence, without unpacking them. The bases are
+  always those of the forward strand, whatever the sequence options.
+
+  \param [in] sequence The sequence.
+  \param [out] packed The packed bases and runs. If the file is mapped or in memory,
+                      packed->packed points into it, otherwise the bases are read into
+                      a buffer kept by the sequence. Either way, the pointers are valid
+                      until the sequence is disposed.
+
+  \return SEQIO_SUCCESS if successful, otherwise SEQIO_ERR_*. If the sequence isn't
+  from a PNA file, or was scanned without its bases, SEQIO_ERR_INVALID_STATE is
+  returned.
+ */
+    seqio_status seqio_get_packed(seqio_sequence sequence,
+                                  seqio_packed_sequence *packed);
+
 /*!
   Read entirety of sequence, allocating buffer on client's behalf. If some portion of the
   sequence has already been read via seqio_read(), that portion will not be included in the
@@ -307,6 +791,8 @@ seqio_status seqio_dispose_sequence_iterator(seqio_sequence_iterator *iterator);
                                      seqio_writer_options options,
                                      seqio_writer *writer);
 
+    // Returns SEQIO_ERR_IO if the file couldn't be written in full. The
+    // writer is disposed of either way.
     seqio_status seqio_dispose_writer(seqio_writer *writer);
 
     seqio_status seqio_create_sequence(seqio_writer writer,
@@ -10,6 +10,8 @@
 namespace seqio {
     namespace impl {
 
+        class BatchBuilder;
+
         class Exception {
         public:
             seqio_err_info const err_info;
@@ -48,6 +50,20 @@ namespace seqio {
             virtual IConstDictionary const &getMetadata() = 0;
             virtual uint64_t read(char *buffer,
                                   uint64_t buffer_length) = 0;
+            // Quality values, one per base. Raises an error for formats
+            // without qualities.
+            virtual char const *getQuality(uint64_t *length) = 0;
+            virtual bool hasQuality() = 0;
+            // Number of bases, without reading them. Raises an error if it
+            // isn't known in advance.
+            virtual uint64_t getLength() = 0;
+            // Moves the read position to a base offset, which for the reverse
+            // complement is an offset into the reverse complement. Raises an
+            // error if the sequence can't seek without reading up to offset.
+            virtual void seek(uint64_t offset) = 0;
+            // The bases as stored, without unpacking them. Raises an error
+            // for formats that don't pack bases.
+            virtual void getPacked(seqio_packed_sequence *packed) = 0;
         };
 
         class ISequenceIterator {
@@ -55,6 +71,11 @@ namespace seqio {
             virtual ~ISequenceIterator() {}
 
             virtual ISequence *nextSequence() = 0;
+            virtual ISequence *openSequence(char const *name) = 0;
+            // Adds up to max_records records to the batch, returning how many
+            // were added.
+            virtual uint64_t nextBatch(BatchBuilder &builder,
+                                       uint64_t max_records) = 0;
         };
 
         class IWriter {
@@ -64,13 +85,16 @@ namespace seqio {
             virtual void createSequence(IConstDictionary const *metadata) = 0;
             virtual void write(char const *buffer,
                                uint64_t length) = 0;
+            // Raises if written content couldn't be stored, which the
+            // destructor can't report.
+            virtual void close() = 0;
         };
     }
 }
 
 #define raise(STATUS, MSG...) {                                         \
             char message[4096];                                         \
-            sprintf(message, MSG);                                      \
+            snprintf(message, sizeof(message), MSG);                    \
             seqio_err_info err_info = {SEQIO_ERR_##STATUS, message};    \
             throw seqio::impl::Exception(err_info);                     \
         }
@@ -0,0 +1,670 @@
+#include "simd.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SEQIO_SIMD_X86
+#include <immintrin.h>
+#endif
+
+using namespace seqio::impl;
+
+#define GRAPH_FIRST 0x21
+#define GRAPH_LAST 0x7e
+
+/**********************************************************************
+ *
+ * KERNEL find_nongraph
+ *
+ **********************************************************************/
+static inline char const *find_nongraph_scalar(char const *begin, char const *end) {
+    for(char const *p = begin; p < end; p++) {
+        uint8_t c = (uint8_t)*p;
+        if((c < GRAPH_FIRST) || (c > GRAPH_LAST))
+            return p;
+    }
+    return end;
+}
+
+#ifdef SEQIO_SIMD_X86
+// Wider kernels finish with the narrower ones, which must be inlined rather
+// than called: entering non-VEX SSE code with the upper halves of the vector
+// registers dirty incurs a transition penalty on every call.
+#define SEQIO_INLINE_TARGET(ISA) __attribute__((always_inline, target(ISA))) static inline
+
+// Bytes are biased so that the graph range maps onto the bottom of the signed
+// range. A byte is then in the graph range iff its biased value is less than
+// the biased value of GRAPH_LAST + 1, which is a single signed compare.
+#define GRAPH_BIAS int8_t(0x80 - GRAPH_FIRST)
+#define GRAPH_LIMIT int8_t(GRAPH_LAST + 1 + GRAPH_BIAS)
+
+SEQIO_INLINE_TARGET("sse2")
+char const *find_nongraph_sse2_inline(char const *begin, char const *end) {
+    __m128i const bias = _mm_set1_epi8(GRAPH_BIAS);
+    __m128i const limit = _mm_set1_epi8(GRAPH_LIMIT);
+
+    char const *p = begin;
+    for(; p + 16 <= end; p += 16) {
+        __m128i v = _mm_add_epi8(_mm_loadu_si128((__m128i const *)p), bias);
+        uint32_t graph = (uint32_t)_mm_movemask_epi8(_mm_cmplt_epi8(v, limit));
+        if(graph != 0xFFFF)
+            return p + __builtin_ctz(~graph);
+    }
+    return find_nongraph_scalar(p, end);
+}
+
+__attribute__((target("sse2")))
+static char const *find_nongraph_sse2(char const *begin, char const *end) {
+    return find_nongraph_sse2_inline(begin, end);
+}
+
+__attribute__((target("avx2")))
+static char const *find_nongraph_avx2(char const *begin, char const *end) {
+    __m256i const bias = _mm256_set1_epi8(GRAPH_BIAS);
+    __m256i const limit = _mm256_set1_epi8(GRAPH_LIMIT);
+
+    char const *p = begin;
+    for(; p + 32 <= end; p += 32) {
+        __m256i v = _mm256_add_epi8(_mm256_loadu_si256((__m256i const *)p), bias);
+        uint32_t graph = (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(limit, v));
+        if(graph != 0xFFFFFFFF)
+            return p + __builtin_ctz(~graph);
+    }
+    return find_nongraph_sse2_inline(p, end);
+}
+#endif
+
+/**********************************************************************
+ *
+ * KERNEL count_graph
+ *
+ * Each vector's compare result (-1 per graph byte) is subtracted from
+ * byte counters, which are summed into 64-bit lanes before they can
+ * overflow.
+ *
+ **********************************************************************/
+static inline uint64_t count_graph_scalar(char const *begin, char const *end) {
+    uint64_t n = 0;
+    for(char const *p = begin; p < end; p++) {
+        uint8_t c = (uint8_t)*p;
+        n += (c >= GRAPH_FIRST) && (c <= GRAPH_LAST);
+    }
+    return n;
+}
+
+#ifdef SEQIO_SIMD_X86
+SEQIO_INLINE_TARGET("sse2")
+uint64_t count_graph_sse2_inline(char const *begin, char const *end) {
+    __m128i const bias = _mm_set1_epi8(GRAPH_BIAS);
+    __m128i const limit = _mm_set1_epi8(GRAPH_LIMIT);
+    __m128i const zero = _mm_setzero_si128();
+    __m128i total = zero;
+
+    char const *p = begin;
+    while(end - p >= 16) {
+        char const *stop = p + 16 * std::min(uint64_t(255), uint64_t(end - p) / 16);
+        __m128i counts = zero;
+        for(; p < stop; p += 16) {
+            __m128i v = _mm_add_epi8(_mm_loadu_si128((__m128i const *)p), bias);
+            counts = _mm_sub_epi8(counts, _mm_cmplt_epi8(v, limit));
+        }
+        total = _mm_add_epi64(total, _mm_sad_epu8(counts, zero));
+    }
+    return uint64_t(_mm_cvtsi128_si64(total))
+        + uint64_t(_mm_cvtsi128_si64(_mm_unpackhi_epi64(total, total)))
+        + count_graph_scalar(p, end);
+}
+
+__attribute__((target("sse2")))
+static uint64_t count_graph_sse2(char const *begin, char const *end) {
+    return count_graph_sse2_inline(begin, end);
+}
+
+__attribute__((target("avx2")))
+static uint64_t count_graph_avx2(char const *begin, char const *end) {
+    __m256i const bias = _mm256_set1_epi8(GRAPH_BIAS);
+    __m256i const limit = _mm256_set1_epi8(GRAPH_LIMIT);
+    __m256i const zero = _mm256_setzero_si256();
+    __m256i total = zero;
+
+    char const *p = begin;
+    while(end - p >= 32) {
+        char const *stop = p + 32 * std::min(uint64_t(255), uint64_t(end - p) / 32);
+        __m256i counts = zero;
+        for(; p < stop; p += 32) {
+            __m256i v = _mm256_add_epi8(_mm256_loadu_si256((__m256i const *)p), bias);
+            counts = _mm256_sub_epi8(counts, _mm256_cmpgt_epi8(limit, v));
+        }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(counts, zero));
+    }
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+    return uint64_t(_mm_cvtsi128_si64(half))
+        + uint64_t(_mm_cvtsi128_si64(_mm_unpackhi_epi64(half, half)))
+        + count_graph_sse2_inline(p, end);
+}
+#endif
+
+/**********************************************************************
+ *
+ * KERNEL transform_caps_gatcn
+ *
+ **********************************************************************/
+namespace {
+    struct CapsTable {
+        char bases[256];
+        // The complement of each byte's transformed base.
+        char complements[256];
+
+        CapsTable() {
+            for(int c = 0; c < 256; c++) {
+                bases[c] = complements[c] = 'N';
+            }
+            char const gatc[] = "GATC";
+            char const ctag[] = "CTAG";
+            for(int i = 0; i < 4; i++) {
+                bases[uint8_t(gatc[i])] = gatc[i];
+                bases[uint8_t(gatc[i] | 0x20)] = gatc[i];
+                complements[uint8_t(gatc[i])] = ctag[i];
+                complements[uint8_t(gatc[i] | 0x20)] = ctag[i];
+            }
+        }
+    } const caps_table;
+}
+
+static inline void transform_caps_gatcn_scalar(char const *src, uint64_t len, char *dst) {
+    for(uint64_t i = 0; i < len; i++) {
+        dst[i] = caps_table.bases[uint8_t(src[i])];
+    }
+}
+
+#ifdef SEQIO_SIMD_X86
+// Clearing bit 5 uppercases the GATC letters, and no other byte becomes one of
+// them, so a byte survives iff its uppercased value equals one of the four.
+//
+// The transform is idempotent, so rather than finishing with scalar code the
+// kernels redo an overlapping final vector, which is also safe in place.
+#define CASE_MASK char(0xDF)
+
+SEQIO_INLINE_TARGET("sse4.1")
+void caps_gatcn_128(char const *src, char *dst) {
+    __m128i v = _mm_and_si128(_mm_loadu_si128((__m128i const *)src), _mm_set1_epi8(CASE_MASK));
+    __m128i base = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('A')),
+                                              _mm_cmpeq_epi8(v, _mm_set1_epi8('C'))),
+                                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('G')),
+                                             _mm_cmpeq_epi8(v, _mm_set1_epi8('T'))));
+    _mm_storeu_si128((__m128i *)dst, _mm_blendv_epi8(_mm_set1_epi8('N'), v, base));
+}
+
+SEQIO_INLINE_TARGET("sse4.1")
+void transform_caps_gatcn_sse41_inline(char const *src, uint64_t len, char *dst) {
+    if(len < 16) {
+        transform_caps_gatcn_scalar(src, len, dst);
+        return;
+    }
+
+    for(uint64_t i = 0; i + 16 <= len; i += 16) {
+        caps_gatcn_128(src + i, dst + i);
+    }
+    if(len % 16) {
+        caps_gatcn_128(src + len - 16, dst + len - 16);
+    }
+}
+
+__attribute__((target("sse4.1")))
+static void transform_caps_gatcn_sse41(char const *src, uint64_t len, char *dst) {
+    transform_caps_gatcn_sse41_inline(src, len, dst);
+}
+
+SEQIO_INLINE_TARGET("avx2")
+void caps_gatcn_256(char const *src, char *dst) {
+    __m256i v = _mm256_and_si256(_mm256_loadu_si256((__m256i const *)src), _mm256_set1_epi8(CASE_MASK));
+    __m256i base = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('A')),
+                                                   _mm256_cmpeq_epi8(v, _mm256_set1_epi8('C'))),
+                                   _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('G')),
+                                                   _mm256_cmpeq_epi8(v, _mm256_set1_epi8('T'))));
+    _mm256_storeu_si256((__m256i *)dst, _mm256_blendv_epi8(_mm256_set1_epi8('N'), v, base));
+}
+
+__attribute__((target("avx2")))
+static void transform_caps_gatcn_avx2(char const *src, uint64_t len, char *dst) {
+    if(len < 32) {
+        transform_caps_gatcn_sse41_inline(src, len, dst);
+        return;
+    }
+
+    for(uint64_t i = 0; i + 32 <= len; i += 32) {
+        caps_gatcn_256(src + i, dst + i);
+    }
+    if(len % 32) {
+        caps_gatcn_256(src + len - 32, dst + len - 32);
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void transform_caps_gatcn_avx512(char const *src, uint64_t len, char *dst) {
+    __m512i const case_mask = _mm512_set1_epi8(CASE_MASK);
+    __m512i const a = _mm512_set1_epi8('A');
+    __m512i const c = _mm512_set1_epi8('C');
+    __m512i const g = _mm512_set1_epi8('G');
+    __m512i const t = _mm512_set1_epi8('T');
+    __m512i const n = _mm512_set1_epi8('N');
+
+    // Masked loads and stores handle the tail without touching bytes
+    // outside the buffers.
+    for(uint64_t i = 0; i < len; i += 64) {
+        __mmask64 mask = (len - i >= 64) ? ~__mmask64(0) : (~__mmask64(0) >> (64 - (len - i)));
+        __m512i v = _mm512_and_si512(_mm512_maskz_loadu_epi8(mask, src + i), case_mask);
+        __mmask64 base = _mm512_cmpeq_epi8_mask(v, a) | _mm512_cmpeq_epi8_mask(v, c)
+            | _mm512_cmpeq_epi8_mask(v, g) | _mm512_cmpeq_epi8_mask(v, t);
+        _mm512_mask_storeu_epi8(dst + i, mask, _mm512_mask_blend_epi8(base, n, v));
+    }
+}
+#endif
+
+/**********************************************************************
+ *
+ * KERNEL reverse_complement_caps_gatcn
+ *
+ * Bytes are taken pairwise from both ends of the buffer and swapped,
+ * which also makes it safe for src and dst to be the same buffer. The
+ * vector kernels do the same with a vector from each end, leaving a middle
+ * too short for two vectors to the narrower kernels.
+ *
+ **********************************************************************/
+static inline void reverse_complement_caps_gatcn_scalar(char const *src, uint64_t len, char *dst) {
+    for(uint64_t i = 0, j = len; i < j; i++, j--) {
+        char front = src[i];
+        char back = src[j - 1];
+        dst[i] = caps_table.complements[uint8_t(back)];
+        dst[j - 1] = caps_table.complements[uint8_t(front)];
+    }
+}
+
+#ifdef SEQIO_SIMD_X86
+// A base's complement is one XOR away once it's uppercased: A and T differ
+// by 0x15, C and G by 0x04.
+#define COMPLEMENT_AT char(0x15)
+#define COMPLEMENT_CG char(0x04)
+
+SEQIO_INLINE_TARGET("sse4.1")
+__m128i reverse_complement_caps_gatcn_128(__m128i v) {
+    v = _mm_shuffle_epi8(v, _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+    v = _mm_and_si128(v, _mm_set1_epi8(CASE_MASK));
+    __m128i at = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('A')),
+                              _mm_cmpeq_epi8(v, _mm_set1_epi8('T')));
+    __m128i cg = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('C')),
+                              _mm_cmpeq_epi8(v, _mm_set1_epi8('G')));
+    __m128i complement = _mm_or_si128(_mm_and_si128(at, _mm_set1_epi8(COMPLEMENT_AT)),
+                                      _mm_and_si128(cg, _mm_set1_epi8(COMPLEMENT_CG)));
+    return _mm_blendv_epi8(_mm_set1_epi8('N'), _mm_xor_si128(v, complement), _mm_or_si128(at, cg));
+}
+
+SEQIO_INLINE_TARGET("sse4.1")
+void reverse_complement_caps_gatcn_sse41_inline(char const *src, uint64_t len, char *dst) {
+    uint64_t i = 0;
+    for(; len - 2 * i >= 32; i += 16) {
+        __m128i front = _mm_loadu_si128((__m128i const *)(src + i));
+        __m128i back = _mm_loadu_si128((__m128i const *)(src + len - i - 16));
+        _mm_storeu_si128((__m128i *)(dst + i), reverse_complement_caps_gatcn_128(back));
+        _mm_storeu_si128((__m128i *)(dst + len - i - 16), reverse_complement_caps_gatcn_128(front));
+    }
+    reverse_complement_caps_gatcn_scalar(src + i, len - 2 * i, dst + i);
+}
+
+__attribute__((target("sse4.1")))
+static void reverse_complement_caps_gatcn_sse41(char const *src, uint64_t len, char *dst) {
+    reverse_complement_caps_gatcn_sse41_inline(src, len, dst);
+}
+
+SEQIO_INLINE_TARGET("avx2")
+__m256i reverse_complement_caps_gatcn_256(__m256i v) {
+    // Reverse within each lane, then swap the lanes.
+    v = _mm256_shuffle_epi8(v, _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                                15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+    v = _mm256_permute4x64_epi64(v, 0x4E);
+    v = _mm256_and_si256(v, _mm256_set1_epi8(CASE_MASK));
+    __m256i at = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('A')),
+                                 _mm256_cmpeq_epi8(v, _mm256_set1_epi8('T')));
+    __m256i cg = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('C')),
+                                 _mm256_cmpeq_epi8(v, _mm256_set1_epi8('G')));
+    __m256i complement = _mm256_or_si256(_mm256_and_si256(at, _mm256_set1_epi8(COMPLEMENT_AT)),
+                                         _mm256_and_si256(cg, _mm256_set1_epi8(COMPLEMENT_CG)));
+    return _mm256_blendv_epi8(_mm256_set1_epi8('N'), _mm256_xor_si256(v, complement), _mm256_or_si256(at, cg));
+}
+
+SEQIO_INLINE_TARGET("avx2")
+void reverse_complement_caps_gatcn_avx2_inline(char const *src, uint64_t len, char *dst) {
+    uint64_t i = 0;
+    for(; len - 2 * i >= 64; i += 32) {
+        __m256i front = _mm256_loadu_si256((__m256i const *)(src + i));
+        __m256i back = _mm256_loadu_si256((__m256i const *)(src + len - i - 32));
+        _mm256_storeu_si256((__m256i *)(dst + i), reverse_complement_caps_gatcn_256(back));
+        _mm256_storeu_si256((__m256i *)(dst + len - i - 32), reverse_complement_caps_gatcn_256(front));
+    }
+    reverse_complement_caps_gatcn_sse41_inline(src + i, len - 2 * i, dst + i);
+}
+
+__attribute__((target("avx2")))
+static void reverse_complement_caps_gatcn_avx2(char const *src, uint64_t len, char *dst) {
+    reverse_complement_caps_gatcn_avx2_inline(src, len, dst);
+}
+
+SEQIO_INLINE_TARGET("avx512f,avx512bw")
+__m512i reverse_complement_caps_gatcn_512(__m512i v) {
+    // Reverse within each lane, then reverse the order of the lanes. (The
+    // maskz form avoids a spurious uninitialized warning from GCC's headers.)
+    v = _mm512_shuffle_epi8(v, _mm512_set_epi64(0x0001020304050607, 0x08090A0B0C0D0E0F,
+                                                0x0001020304050607, 0x08090A0B0C0D0E0F,
+                                                0x0001020304050607, 0x08090A0B0C0D0E0F,
+                                                0x0001020304050607, 0x08090A0B0C0D0E0F));
+    v = _mm512_maskz_shuffle_i64x2(0xFF, v, v, 0x1B);
+    v = _mm512_and_si512(v, _mm512_set1_epi8(CASE_MASK));
+    __mmask64 at = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('A'))
+        | _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('T'));
+    __mmask64 cg = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('C'))
+        | _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('G'));
+    v = _mm512_xor_si512(v, _mm512_maskz_mov_epi8(at, _mm512_set1_epi8(COMPLEMENT_AT)));
+    v = _mm512_xor_si512(v, _mm512_maskz_mov_epi8(cg, _mm512_set1_epi8(COMPLEMENT_CG)));
+    return _mm512_mask_blend_epi8(at | cg, _mm512_set1_epi8('N'), v);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void reverse_complement_caps_gatcn_avx512(char const *src, uint64_t len, char *dst) {
+    uint64_t i = 0;
+    for(; len - 2 * i >= 128; i += 64) {
+        __m512i front = _mm512_loadu_si512(src + i);
+        __m512i back = _mm512_loadu_si512(src + len - i - 64);
+        _mm512_storeu_si512(dst + i, reverse_complement_caps_gatcn_512(back));
+        _mm512_storeu_si512(dst + len - i - 64, reverse_complement_caps_gatcn_512(front));
+    }
+    reverse_complement_caps_gatcn_avx2_inline(src + i, len - 2 * i, dst + i);
+}
+#endif
+
+/**********************************************************************
+ *
+ * KERNEL unpack_2bit
+ *
+ **********************************************************************/
+namespace {
+    struct UnpackTable {
+        // The 4 bases of each packed byte.
+        char bases[256][4];
+        // Their reverse complement. A base's complement is 3 minus its code.
+        char complements[256][4];
+
+        UnpackTable() {
+            char const acgt[] = "ACGT";
+            for(int b = 0; b < 256; b++) {
+                for(int i = 0; i < 4; i++) {
+                    bases[b][i] = acgt[(b >> (2 * i)) & 0x3];
+                    complements[b][3 - i] = acgt[3 - ((b >> (2 * i)) & 0x3)];
+                }
+            }
+        }
+    } const unpack_table;
+}
+
+static inline void unpack_2bit_scalar(uint8_t const *src, uint64_t len, char *dst) {
+    for(uint64_t i = 0; i < len; i++) {
+        memcpy(dst + 4 * i, unpack_table.bases[src[i]], 4);
+    }
+}
+
+static inline void unpack_2bit_reverse_complement_scalar(uint8_t const *src, uint64_t len, char *dst) {
+    for(uint64_t i = 0; i < len; i++) {
+        memcpy(dst + 4 * i, unpack_table.complements[src[len - 1 - i]], 4);
+    }
+}
+
+#ifdef SEQIO_SIMD_X86
+// Each of a vector's 4 bit pairs is looked up with a shuffle, giving 4
+// vectors that hold the bytes' first bases, second bases and so on.
+// Interleaving them bytewise and then by pairs puts each byte's bases side
+// by side in order. For the reverse complement, the bytes are reversed, the
+// bit pairs are looked up in "TGCA" and interleaved last to first.
+SEQIO_INLINE_TARGET("sse4.1")
+void unpack_2bit_128(__m128i v, bool reverse, char *dst) {
+    __m128i const lut = reverse
+        ? _mm_setr_epi8('T', 'G', 'C', 'A', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        : _mm_setr_epi8('A', 'C', 'G', 'T', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    __m128i const mask = _mm_set1_epi8(0x3);
+
+    if(reverse)
+        v = _mm_shuffle_epi8(v, _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+    __m128i b[4];
+    for(int k = 0; k < 4; k++) {
+        b[reverse ? 3 - k : k] = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 2 * k), mask));
+    }
+    __m128i lo01 = _mm_unpacklo_epi8(b[0], b[1]);
+    __m128i hi01 = _mm_unpackhi_epi8(b[0], b[1]);
+    __m128i lo23 = _mm_unpacklo_epi8(b[2], b[3]);
+    __m128i hi23 = _mm_unpackhi_epi8(b[2], b[3]);
+    __m128i *out = (__m128i *)dst;
+    _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(lo01, lo23));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo01, lo23));
+    _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi01, hi23));
+    _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi01, hi23));
+}
+
+SEQIO_INLINE_TARGET("sse4.1")
+void unpack_2bit_sse41_inline(uint8_t const *src, uint64_t len, char *dst) {
+    uint64_t i = 0;
+    for(; i + 16 <= len; i += 16) {
+        unpack_2bit_128(_mm_loadu_si128((__m128i const *)(src + i)), false, dst + 4 * i);
+    }
+    unpack_2bit_scalar(src + i, len - i, dst + 4 * i);
+}
+
+__attribute__((target("sse4.1")))
+static void unpack_2bit_sse41(uint8_t const *src, uint64_t len, char *dst) {
+    unpack_2bit_sse41_inline(src, len, dst);
+}
+
+SEQIO_INLINE_TARGET("sse4.1")
+void unpack_2bit_reverse_complement_sse41_inline(uint8_t const *src, uint64_t len, char *dst) {
+    uint64_t i = 0;
+    for(; i + 16 <= len; i += 16) {
+        unpack_2bit_128(_mm_loadu_si128((__m128i const *)(src + len - i - 16)), true, dst + 4 * i);
+    }
+    unpack_2bit_reverse_complement_scalar(src, len - i, dst + 4 * i);
+}
+
+__attribute__((target("sse4.1")))
+static void unpack_2bit_reverse_complement_sse41(uint8_t const *src, uint64_t len, char *dst) {
+    unpack_2bit_reverse_complement_sse41_inline(src, len, dst);
+}
+
+// As above, but the interleaving is within lanes, which leaves bytes 0-3
+// and 16-19 in one vector, and so on, so the lanes are regrouped at the end.
+SEQIO_INLINE_TARGET("avx2")
+void unpack_2bit_256(__m256i v, bool reverse, char *dst) {
+    __m256i const lut = reverse
+        ? _mm256_setr_epi8('T', 'G', 'C', 'A', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                           'T', 'G', 'C', 'A', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        : _mm256_setr_epi8('A', 'C', 'G', 'T', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                           'A', 'C', 'G', 'T', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    __m256i const mask = _mm256_set1_epi8(0x3);
+
+    if(reverse) {
+        v = _mm256_shuffle_epi8(v, _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                                    15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+        v = _mm256_permute4x64_epi64(v, 0x4E);
+    }
+    __m256i b[4];
+    for(int k = 0; k < 4; k++) {
+        b[reverse ? 3 - k : k] = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 2 * k), mask));
+    }
+    __m256i lo01 = _mm256_unpacklo_epi8(b[0], b[1]);
+    __m256i hi01 = _mm256_unpackhi_epi8(b[0], b[1]);
+    __m256i lo23 = _mm256_unpacklo_epi8(b[2], b[3]);
+    __m256i hi23 = _mm256_unpackhi_epi8(b[2], b[3]);
+    __m256i q0 = _mm256_unpacklo_epi16(lo01, lo23);
+    __m256i q1 = _mm256_unpackhi_epi16(lo01, lo23);
+    __m256i q2 = _mm256_unpacklo_epi16(hi01, hi23);
+    __m256i q3 = _mm256_unpackhi_epi16(hi01, hi23);
+    __m256i *out = (__m256i *)dst;
+    _mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(q0, q1, 0x20));
+    _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(q2, q3, 0x20));
+    _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(q0, q1, 0x31));
+    _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(q2, q3, 0x31));
+}
+
+__attribute__((target("avx2")))
+static void unpack_2bit_avx2(uint8_t const *src, uint64_t len, char *dst) {
+    uint64_t i = 0;
+    for(; i + 32 <= len; i += 32) {
+        unpack_2bit_256(_mm256_loadu_si256((__m256i const *)(src + i)), false, dst + 4 * i);
+    }
+    unpack_2bit_sse41_inline(src + i, len - i, dst + 4 * i);
+}
+
+__attribute__((target("avx2")))
+static void unpack_2bit_reverse_complement_avx2(uint8_t const *src, uint64_t len, char *dst) {
+    uint64_t i = 0;
+    for(; i + 32 <= len; i += 32) {
+        unpack_2bit_256(_mm256_loadu_si256((__m256i const *)(src + len - i - 32)), true, dst + 4 * i);
+    }
+    unpack_2bit_reverse_complement_sse41_inline(src, len - i, dst + 4 * i);
+}
+#endif
+
+/**********************************************************************
+ *
+ * DISPATCH
+ *
+ **********************************************************************/
+namespace {
+    // Ordered so that each instruction set includes those before it.
+    enum isa_t {
+        ISA_SCALAR,
+        ISA_SSE2,
+        ISA_SSE41,
+        ISA_AVX2,
+        ISA_AVX512
+    };
+
+    char const *isa_names[] = {"scalar", "sse2", "sse4.1", "avx2", "avx512bw"};
+
+    isa_t detect_isa() {
+#ifdef SEQIO_SIMD_X86
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx512bw"))
+            return ISA_AVX512;
+        if(__builtin_cpu_supports("avx2"))
+            return ISA_AVX2;
+        if(__builtin_cpu_supports("sse4.1"))
+            return ISA_SSE41;
+        if(__builtin_cpu_supports("sse2"))
+            return ISA_SSE2;
+#endif
+        return ISA_SCALAR;
+    }
+
+    isa_t const supported_isa = detect_isa();
+
+    struct Kernels {
+        isa_t isa;
+        char const *(*find_nongraph)(char const *, char const *);
+        uint64_t (*count_graph)(char const *, char const *);
+        void (*transform_caps_gatcn)(char const *, uint64_t, char *);
+        void (*reverse_complement_caps_gatcn)(char const *, uint64_t, char *);
+        void (*unpack_2bit)(uint8_t const *, uint64_t, char *);
+        void (*unpack_2bit_reverse_complement)(uint8_t const *, uint64_t, char *);
+
+        Kernels(isa_t isa_) {
+            select(isa_);
+        }
+
+        void select(isa_t isa_) {
+            isa = isa_;
+            find_nongraph = find_nongraph_scalar;
+            count_graph = count_graph_scalar;
+            transform_caps_gatcn = transform_caps_gatcn_scalar;
+            reverse_complement_caps_gatcn = reverse_complement_caps_gatcn_scalar;
+            unpack_2bit = unpack_2bit_scalar;
+            unpack_2bit_reverse_complement = unpack_2bit_reverse_complement_scalar;
+#ifdef SEQIO_SIMD_X86
+            if(isa >= ISA_AVX2)
+                find_nongraph = find_nongraph_avx2;
+            else if(isa >= ISA_SSE2)
+                find_nongraph = find_nongraph_sse2;
+
+            if(isa >= ISA_AVX2)
+                count_graph = count_graph_avx2;
+            else if(isa >= ISA_SSE2)
+                count_graph = count_graph_sse2;
+
+            if(isa >= ISA_AVX512)
+                transform_caps_gatcn = transform_caps_gatcn_avx512;
+            else if(isa >= ISA_AVX2)
+                transform_caps_gatcn = transform_caps_gatcn_avx2;
+            else if(isa >= ISA_SSE41)
+                transform_caps_gatcn = transform_caps_gatcn_sse41;
+
+            if(isa >= ISA_AVX512)
+                reverse_complement_caps_gatcn = reverse_complement_caps_gatcn_avx512;
+            else if(isa >= ISA_AVX2)
+                reverse_complement_caps_gatcn = reverse_complement_caps_gatcn_avx2;
+            else if(isa >= ISA_SSE41)
+                reverse_complement_caps_gatcn = reverse_complement_caps_gatcn_sse41;
+
+            if(isa >= ISA_AVX2)
+                unpack_2bit = unpack_2bit_avx2;
+            else if(isa >= ISA_SSE41)
+                unpack_2bit = unpack_2bit_sse41;
+
+            if(isa >= ISA_AVX2)
+                unpack_2bit_reverse_complement = unpack_2bit_reverse_complement_avx2;
+            else if(isa >= ISA_SSE41)
+                unpack_2bit_reverse_complement = unpack_2bit_reverse_complement_sse41;
+#endif
+        }
+    } kernels(supported_isa);
+}
+
+namespace seqio {
+    namespace impl {
+
+        char const *find_nongraph(char const *begin, char const *end) {
+            return kernels.find_nongraph(begin, end);
+        }
+
+        uint64_t count_graph(char const *begin, char const *end) {
+            return kernels.count_graph(begin, end);
+        }
+
+        void transform_caps_gatcn(char const *src, uint64_t len, char *dst) {
+            kernels.transform_caps_gatcn(src, len, dst);
+        }
+
+        void reverse_complement_caps_gatcn(char const *src, uint64_t len, char *dst) {
+            kernels.reverse_complement_caps_gatcn(src, len, dst);
+        }
+
+        void unpack_2bit(uint8_t const *src, uint64_t len, char *dst) {
+            kernels.unpack_2bit(src, len, dst);
+        }
+
+        void unpack_2bit_reverse_complement(uint8_t const *src, uint64_t len, char *dst) {
+            kernels.unpack_2bit_reverse_complement(src, len, dst);
+        }
+
+        char const *simd_isa() {
+            return isa_names[kernels.isa];
+        }
+
+        bool set_simd_isa(char const *name) {
+            for(int i = ISA_SCALAR; i <= supported_isa; i++) {
+                if(0 == strcmp(name, isa_names[i])) {
+                    kernels.select(isa_t(i));
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace seqio {
+    namespace impl {
+
+/**********************************************************************
+ *
+ * SIMD KERNELS
+ *
+ * Each kernel has a scalar implementation and, on x86, vectorized
+ * implementations. The widest implementation supported by the CPU is
+ * selected once at load time.
+ *
+ **********************************************************************/
+
+        // Returns a pointer to the first byte in [begin, end) that is not a
+        // printable, non-space ASCII character (i.e. not in 0x21..0x7e), or end
+        // if there is no such byte. Newlines, carriage returns and other
+        // whitespace are all "non-graph" bytes.
+        char const *find_nongraph(char const *begin, char const *end);
+
+        // Returns the number of printable, non-space ASCII characters in
+        // [begin, end), which for FASTA sequence lines is the number of bases.
+        uint64_t count_graph(char const *begin, char const *end);
+
+        // Applies SEQIO_BASE_TRANSFORM_CAPS_GATCN to len bytes: g, a, t and c are
+        // uppercased and every byte other than GATC becomes N. src and dst may
+        // be the same buffer.
+        void transform_caps_gatcn(char const *src, uint64_t len, char *dst);
+
+        // Applies SEQIO_BASE_TRANSFORM_CAPS_GATCN and writes the reverse
+        // complement of the result, so that dst[0] is the complement of the
+        // transformed src[len - 1]. src and dst may be the same buffer.
+        void reverse_complement_caps_gatcn(char const *src, uint64_t len, char *dst);
+
+        // Expands len bytes of 2-bit packed bases into 4 * len characters of
+        // ACGT (0 through 3), taking each byte's bases from its low bits up.
+        void unpack_2bit(uint8_t const *src, uint64_t len, char *dst);
+        // As unpack_2bit(), but writes the reverse complement, so that dst[0]
+        // is the complement of the last base of src[len - 1].
+        void unpack_2bit_reverse_complement(uint8_t const *src, uint64_t len, char *dst);
+
+        // Name of the instruction set used by the kernels (e.g. "avx2").
+        char const *simd_isa();
+        // Switches the kernels to a narrower instruction set (e.g. "scalar"), so
+        // that each implementation can be tested and benchmarked. Returns false
+        // if the CPU doesn't support it.
+        bool set_simd_isa(char const *name);
+    }
+}
@@ -0,0 +1,573 @@
+#include "source.hpp"
+
+#include "bgzf.hpp"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+using std::shared_ptr;
+using namespace seqio::impl;
+
+#define QUEUE_SOURCE_BUFFERS 8
+#define QUEUE_SOURCE_BUFFER_LENGTH (64 * 1024)
+// Reads following a seek are often short, e.g. the header of an indexed
+// sequence or a region of it, so the first read is just a page.
+#define QUEUE_SOURCE_SEEK_READ_LENGTH 4096
+// Reads that bypass the page cache get no read-ahead from the kernel, so
+// they're made larger.
+#define BYPASS_SOURCE_BUFFERS 4
+#define BYPASS_SOURCE_BUFFER_LENGTH (1024 * 1024)
+#define CACHE_PAGE_SIZE 4096
+// How much compressed content is read from a file at once.
+#define GZIP_INPUT_LENGTH (128 * 1024)
+
+namespace seqio {
+    namespace impl {
+
+        SourceFactory create_source_factory(char const *path_,
+                                            seqio_sequence_options const &options) {
+            std::string path = path_;
+            // Sources may outlive the options, so they keep their own copy.
+            seqio_io_backend const backend = options.io_backend ? *options.io_backend : SEQIO_FILE_IO_BACKEND;
+            bool const local = is_file_backend(&backend);
+
+            // Compressed files are read through zlib or in whole blocks, which
+            // can't be done with O_DIRECT, so bypassing is dropping behind.
+            // Only files in the file system have a page cache to manage.
+            bool const drop_behind = local && (options.page_cache != SEQIO_PAGE_CACHE_KEEP);
+
+            if(is_bgzf_file_content(path_, &backend)) {
+                shared_ptr<BgzfIndex> index = BgzfIndex::open(path_, &backend, options.index_mode);
+                uint32_t nthreads = options.num_threads;
+                if((nthreads > 1) || (options.read_ahead_buffers > 0)) {
+                    // A single worker is a read-ahead thread.
+                    nthreads = std::max(nthreads, uint32_t(1));
+                    return [path, backend, index, nthreads, drop_behind] () -> ISource * {
+                        return new ParallelBgzfSource(File::open(&backend, path.c_str()), index, nthreads, drop_behind);
+                    };
+                }
+                return [path, backend, index, drop_behind] () -> ISource * {
+                    return new BgzfSource(File::open(&backend, path.c_str()), index, drop_behind);
+                };
+            }
+
+            if(is_gzip_file_content(path_, &backend)) {
+                uint32_t nbuffers = options.read_ahead_buffers;
+                if(nbuffers > 0) {
+                    // One buffer is held by the consumer, so fewer than two
+                    // wouldn't read ahead at all.
+                    nbuffers = std::max(nbuffers, uint32_t(2));
+                    return [path, backend, nbuffers, drop_behind] () -> ISource * {
+                        return new ReadAheadGzipSource(File::open(&backend, path.c_str()), nbuffers, drop_behind);
+                    };
+                }
+                return [path, backend, drop_behind] () -> ISource * {
+                    return new GzipSource(File::open(&backend, path.c_str()), drop_behind);
+                };
+            }
+
+            // A mapping leaves its pages cached, so managing the cache means
+            // reading blocks, with pread unless another engine was asked for.
+            // Only files in the file system can be mapped.
+            if((options.io_engine != SEQIO_IO_ENGINE_DEFAULT) || drop_behind || !local) {
+                seqio_io_engine engine = options.io_engine;
+                if(engine == SEQIO_IO_ENGINE_DEFAULT)
+                    engine = SEQIO_IO_ENGINE_PREAD;
+                bool const bypass = options.page_cache == SEQIO_PAGE_CACHE_BYPASS;
+                shared_ptr<IoQueuePool> pool = std::make_shared<IoQueuePool>(&backend,
+                                                                             path_,
+                                                                             engine,
+                                                                             bypass ? BYPASS_SOURCE_BUFFERS : QUEUE_SOURCE_BUFFERS,
+                                                                             bypass ? BYPASS_SOURCE_BUFFER_LENGTH : QUEUE_SOURCE_BUFFER_LENGTH,
+                                                                             options.page_cache);
+                return [pool] () -> ISource * {
+                    return new QueueSource(pool->acquire(), pool->getFileLength());
+                };
+            }
+
+            shared_ptr<FileMapping> mapping = std::make_shared<FileMapping>(File::open(&backend, path_));
+            return [mapping] () -> ISource * {
+                return new MmapSource(mapping);
+            };
+        }
+
+        SourceFactory create_memory_source_factory(void const *data, uint64_t length) {
+            if(is_gzip_content(data, length)) {
+                return [data, length] () -> ISource * {
+                    return new GzipSource(data, length);
+                };
+            }
+
+            shared_ptr<FileMapping> mapping = std::make_shared<FileMapping>(data, length);
+            return [mapping] () -> ISource * {
+                return new MmapSource(mapping);
+            };
+        }
+
+        bool is_gzip_file_content(char const *path, seqio_io_backend const *backend) {
+            uint8_t magic[2];
+            uint64_t n;
+
+            try {
+                n = File::open(backend, path)->pread(magic, sizeof(magic), 0);
+            } catch(Exception &) {
+                return false;
+            }
+
+            return is_gzip_content(magic, n);
+        }
+
+        uint64_t read_content_prefix(char const *path,
+                                     seqio_io_backend const *backend,
+                                     char *buffer,
+                                     uint64_t length) {
+            try {
+                shared_ptr<File> file = File::open(backend, path);
+                uint8_t magic[2];
+                if(is_gzip_content(magic, file->pread(magic, sizeof(magic), 0)))
+                    return GzipInflater(file).inflate(buffer, length);
+                return file->pread(buffer, length, 0);
+            } catch(Exception &) {
+                return 0;
+            }
+        }
+
+        bool is_gzip_content(void const *data, uint64_t length) {
+            uint8_t const *magic = (uint8_t const *)data;
+            return (length >= 2) && (magic[0] == 31) && (magic[1] == 139);
+        }
+
+    }
+}
+
+/**********************************************************************
+ *
+ * CLASS GzipInflater
+ *
+ **********************************************************************/
+GzipInflater::GzipInflater(shared_ptr<File> file_, bool drop_behind)
+    : file(file_)
+    , dropBehind(drop_behind && (file_->getFd() >= 0))
+    , input(GZIP_INPUT_LENGTH) {
+
+    init();
+}
+
+GzipInflater::GzipInflater(void const *data_, uint64_t length_)
+    : dropBehind(false)
+    , data((uint8_t const *)data_)
+    , length(length_) {
+
+    init();
+}
+
+GzipInflater::~GzipInflater() {
+    inflateEnd(&zs);
+}
+
+void GzipInflater::init() {
+    memset(&zs, 0, sizeof(zs));
+    // Accept a gzip header only.
+    if(Z_OK != inflateInit2(&zs, 15 + 16))
+        raise_oom("Failed initializing zlib.");
+    restart();
+}
+
+uint64_t GzipInflater::inflate(char *out, uint64_t length_) {
+    uint64_t n = 0;
+
+    while((n < length_) && !eof) {
+        if((zs.avail_in == 0) && !fill()) {
+            if(inMember)
+                raise_io("Truncated gzip content%s%s", file ? " in " : "", file ? file->getPath() : "");
+            eof = true;
+            break;
+        }
+
+        zs.next_out = (Bytef *)out + n;
+        // avail_out is only 32 bits.
+        zs.avail_out = uInt(std::min(length_ - n, uint64_t(1) << 30));
+        uInt avail_out = zs.avail_out;
+        int rc = ::inflate(&zs, Z_NO_FLUSH);
+        n += avail_out - zs.avail_out;
+
+        if(rc == Z_STREAM_END) {
+            inflateReset(&zs);
+            inMember = false;
+            memberEnded = true;
+        } else if((rc == Z_DATA_ERROR) && memberEnded && !inMember) {
+            // Not another member.
+            eof = true;
+        } else if(rc != Z_OK) {
+            raise_io("Failed inflating%s%s: %s",
+                     file ? " " : "", file ? file->getPath() : "",
+                     zs.msg ? zs.msg : "unknown error");
+        } else {
+            inMember = true;
+        }
+    }
+
+    position += n;
+    return n;
+}
+
+void GzipInflater::seek(uint64_t offset) {
+    if(offset < position)
+        restart();
+
+    // The content before the offset is inflated and discarded.
+    while(position < offset) {
+        scratch.resize(64 * 1024);
+        if(0 == inflate(scratch.data(), std::min(offset - position, uint64_t(scratch.size()))))
+            break;
+    }
+}
+
+void GzipInflater::restart() {
+    inflateReset(&zs);
+    if(file) {
+        file->seek(0);
+        inputEnd = 0;
+        zs.next_in = input.data();
+    } else {
+        zs.next_in = (Bytef *)data;
+    }
+    zs.avail_in = 0;
+    inMember = false;
+    memberEnded = false;
+    eof = false;
+    position = 0;
+}
+
+bool GzipInflater::fill() {
+    if(!file) {
+        uint64_t consumed = zs.next_in - data;
+        if(consumed == length)
+            return false;
+        // avail_in is only 32 bits.
+        zs.avail_in = uInt(std::min(length - consumed, uint64_t(1) << 30));
+        return true;
+    }
+
+    // All the input read so far has been consumed, so its pages are done.
+    if(dropBehind) {
+        uint64_t end = inputEnd / CACHE_PAGE_SIZE * CACHE_PAGE_SIZE;
+        if(end > dropped) {
+            drop_cached(file->getFd(), dropped, end - dropped);
+            dropped = end;
+        }
+    }
+
+    uint64_t n = file->read(input.data(), input.size());
+    if(n == 0)
+        return false;
+    inputEnd += n;
+    zs.next_in = input.data();
+    zs.avail_in = uInt(n);
+    return true;
+}
+
+/**********************************************************************
+ *
+ * CLASS GzipSource
+ *
+ **********************************************************************/
+GzipSource::GzipSource(shared_ptr<File> file, bool drop_behind)
+    : inflater(file, drop_behind) {
+}
+
+GzipSource::GzipSource(void const *data, uint64_t length)
+    : inflater(data, length) {
+}
+
+GzipSource::~GzipSource() {
+}
+
+bool GzipSource::next(char const **data, uint64_t *length) {
+    uint64_t n = inflater.inflate(buf, sizeof(buf));
+    *data = buf;
+    *length = n;
+    return n > 0;
+}
+
+void GzipSource::seek(uint64_t offset) {
+    inflater.seek(offset);
+}
+
+bool GzipSource::isRandomAccess() {
+    return false;
+}
+
+/**********************************************************************
+ *
+ * CLASS ReadAheadGzipSource
+ *
+ **********************************************************************/
+ReadAheadGzipSource::ReadAheadGzipSource(shared_ptr<File> file,
+                                         uint32_t nbuffers,
+                                         bool drop_behind)
+    : inflater(file, drop_behind) {
+
+    for(uint32_t i = 0; i < nbuffers; i++) {
+        ring.emplace_back(new Slot());
+    }
+}
+
+ReadAheadGzipSource::~ReadAheadGzipSource() {
+    stop();
+}
+
+bool ReadAheadGzipSource::next(char const **data, uint64_t *length) {
+    if(!worker.joinable())
+        start();
+
+    std::unique_lock<std::mutex> guard(lock);
+    if(holdingHead) {
+        ring[head % ring.size()]->state = Slot::FREE;
+        head++;
+        holdingHead = false;
+        slotFree.notify_one();
+    }
+
+    Slot &slot = *ring[head % ring.size()];
+    slotReady.wait(guard, [&slot] () {return slot.state == Slot::READY;});
+
+    if(slot.error)
+        std::rethrow_exception(slot.error);
+    if(slot.len == 0)
+        return false;
+
+    holdingHead = true;
+    *data = slot.buf;
+    *length = slot.len;
+    return true;
+}
+
+void ReadAheadGzipSource::seek(uint64_t offset) {
+    stop();
+    inflater.seek(offset);
+}
+
+bool ReadAheadGzipSource::isRandomAccess() {
+    return false;
+}
+
+void ReadAheadGzipSource::start() {
+    for(auto &slot: ring) {
+        slot->state = Slot::FREE;
+    }
+    head = tail = 0;
+    holdingHead = false;
+    stopping = false;
+    eof = false;
+
+    worker = std::thread(&ReadAheadGzipSource::work, this);
+}
+
+void ReadAheadGzipSource::stop() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    slotFree.notify_one();
+
+    if(worker.joinable())
+        worker.join();
+}
+
+void ReadAheadGzipSource::work() {
+    std::unique_lock<std::mutex> guard(lock);
+
+    while(true) {
+        slotFree.wait(guard, [this] () {
+                return stopping || eof || (ring[tail % ring.size()]->state == Slot::FREE);
+            });
+        if(stopping || eof)
+            return;
+
+        Slot &slot = *ring[tail++ % ring.size()];
+        slot.state = Slot::INFLATING;
+        slot.error = nullptr;
+
+        guard.unlock();
+        uint64_t n = 0;
+        try {
+            n = inflater.inflate(slot.buf, sizeof(slot.buf));
+        } catch(...) {
+            slot.error = std::current_exception();
+        }
+        guard.lock();
+
+        slot.len = uint32_t(n);
+        eof = (n == 0);
+        slot.state = Slot::READY;
+        slotReady.notify_one();
+    }
+}
+
+/**********************************************************************
+ *
+ * CLASS FileMapping
+ *
+ **********************************************************************/
+FileMapping::FileMapping(shared_ptr<File> file_)
+    : file(file_)
+    , addr(nullptr)
+    , length(0) {
+
+    int fd = file->getFd();
+    if(fd < 0)
+        raise_parm("Only files in the file system can be mapped.");
+    length = file->size();
+
+    // A zero-length mapping isn't allowed, but there's nothing to map anyway.
+    if(length > 0) {
+        addr = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+        if(addr == MAP_FAILED)
+            raise_io("Failed mmap'ing %s", file->getPath());
+        madvise(addr, length, MADV_SEQUENTIAL);
+    }
+}
+
+FileMapping::FileMapping(void const *data, uint64_t length_)
+    : addr((void *)data)
+    , length(length_) {
+}
+
+FileMapping::~FileMapping() {
+    if(file && addr)
+        munmap(addr, length);
+}
+
+char const *FileMapping::getData() {
+    return (char const *)addr;
+}
+
+uint64_t FileMapping::getLength() {
+    return length;
+}
+
+void FileMapping::dropCached(uint64_t offset, uint64_t length_) {
+    uint64_t begin = (offset + CACHE_PAGE_SIZE - 1) / CACHE_PAGE_SIZE * CACHE_PAGE_SIZE;
+    uint64_t end = std::min(offset + length_, length);
+    // The last page of the file may be partial.
+    if(end != length)
+        end = end / CACHE_PAGE_SIZE * CACHE_PAGE_SIZE;
+    if(!addr || !file || (begin >= end))
+        return;
+
+    // Pages still mapped can't be evicted, so unmap them first. Touching
+    // them again just faults them back in.
+    madvise((char *)addr + begin, end - begin, MADV_DONTNEED);
+    drop_cached(file->getFd(), begin, end - begin);
+}
+
+/**********************************************************************
+ *
+ * CLASS MmapSource
+ *
+ **********************************************************************/
+MmapSource::MmapSource(shared_ptr<FileMapping> mapping_)
+    : mapping(mapping_) {
+}
+
+MmapSource::~MmapSource() {
+}
+
+bool MmapSource::next(char const **data, uint64_t *length) {
+    if(offset >= mapping->getLength())
+        return false;
+
+    *data = mapping->getData() + offset;
+    *length = mapping->getLength() - offset;
+    offset = mapping->getLength();
+    return true;
+}
+
+void MmapSource::seek(uint64_t offset_) {
+    offset = offset_;
+}
+
+/**********************************************************************
+ *
+ * CLASS QueueSource
+ *
+ **********************************************************************/
+QueueSource::QueueSource(shared_ptr<IoQueue> queue_, uint64_t length_)
+    : queue(queue_)
+    , length(length_) {
+
+    for(uint32_t i = 0; i < queue->getBufferCount(); i++) {
+        freeBuffers.push_back(i);
+    }
+}
+
+QueueSource::~QueueSource() {
+}
+
+bool QueueSource::next(char const **data, uint64_t *length_) {
+    if(holdingFirst) {
+        freeBuffers.push_back(blocks.front().index);
+        blocks.pop_front();
+        holdingFirst = false;
+    }
+
+    // Read ahead only once the consumer has moved on from the first block.
+    uint64_t const nahead = sequential ? queue->getBufferCount() : 1;
+    uint32_t const buflen = sequential ? queue->getBufferLength() : QUEUE_SOURCE_SEEK_READ_LENGTH;
+    while((blocks.size() < nahead) && (offset < length) && !freeBuffers.empty()) {
+        uint32_t index = freeBuffers.back();
+        freeBuffers.pop_back();
+        uint32_t n = uint32_t(std::min(uint64_t(buflen), length - offset));
+        queue->submit(index, offset, n);
+        blocks.push_back({index, false, 0});
+        offset += n;
+    }
+    queue->flush();
+
+    if(blocks.empty())
+        return false;
+
+    // Reads may complete in any order.
+    while(!blocks.front().done) {
+        uint32_t len;
+        uint32_t index = queue->wait(&len);
+        for(Block &block: blocks) {
+            if(block.index == index) {
+                block.done = true;
+                block.len = len;
+                break;
+            }
+        }
+    }
+
+    holdingFirst = true;
+    sequential = true;
+
+    // Only if the file has been truncated since it was opened.
+    if(blocks.front().len == 0)
+        return false;
+
+    *data = queue->getData(blocks.front().index);
+    *length_ = blocks.front().len;
+    return true;
+}
+
+void QueueSource::seek(uint64_t offset_) {
+    queue->drain();
+    blocks.clear();
+    freeBuffers.clear();
+    for(uint32_t i = 0; i < queue->getBufferCount(); i++) {
+        freeBuffers.push_back(i);
+    }
+
+    offset = offset_;
+    holdingFirst = false;
+    sequential = false;
+}
@@ -0,0 +1,273 @@
+#pragma once
+
+#include "io.hpp"
+#include "seqio_impl.hpp"
+
+#include <stdint.h>
+#include <zlib.h>
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace seqio {
+    namespace impl {
+
+/**********************************************************************
+ *
+ * CLASS ISource
+ *
+ * Sequential access to the (decompressed) content of a file, handed out
+ * as spans of the source's own buffers.
+ *
+ **********************************************************************/
+        class ISource {
+        public:
+            virtual ~ISource() {}
+
+            // Obtain the next span of content. The span remains valid until the
+            // next call to next() or seek(). Returns false at end of file.
+            virtual bool next(char const **data, uint64_t *length) = 0;
+            // Position at an absolute offset into the content.
+            virtual void seek(uint64_t offset) = 0;
+            // Whether seeking back is cheap, rather than inflating the content
+            // again from its start.
+            virtual bool isRandomAccess() {return true;}
+        };
+
+        // Creates independent sources over the same file. Any state that can be
+        // shared between sources (e.g. a block index) is owned by the factory.
+        typedef std::function<ISource *()> SourceFactory;
+
+        // Files are opened through options.io_backend.
+        SourceFactory create_source_factory(char const *path,
+                                            seqio_sequence_options const &options);
+
+        // Creates sources over content the caller holds in memory, which must
+        // outlive them. Uncompressed content is handed out in place.
+        SourceFactory create_memory_source_factory(void const *data, uint64_t length);
+
+        bool is_gzip_file_content(char const *path, seqio_io_backend const *backend = nullptr);
+        // Reads the beginning of a file's content, inflating it if it's gzip,
+        // for deducing its format. Returns 0 if the file can't be read.
+        uint64_t read_content_prefix(char const *path,
+                                     seqio_io_backend const *backend,
+                                     char *buffer,
+                                     uint64_t length);
+        bool is_gzip_content(void const *data, uint64_t length);
+
+/**********************************************************************
+ *
+ * CLASS GzipInflater
+ *
+ * Inflates gzip content read from a file or held in memory. Concatenated
+ * members, as in BGZF, are inflated in turn, and anything following the
+ * last member that isn't another member is ignored, as gzread() does.
+ *
+ **********************************************************************/
+        class GzipInflater {
+        public:
+            // With drop_behind, the compressed file is dropped from the page
+            // cache as it's inflated.
+            GzipInflater(std::shared_ptr<File> file_, bool drop_behind = false);
+            GzipInflater(void const *data_, uint64_t length_);
+            ~GzipInflater();
+
+            // Inflates the content following that last inflated, returning less
+            // than length only at the end.
+            uint64_t inflate(char *out, uint64_t length);
+            // Positions at an offset into the inflated content. Going backwards
+            // inflates again from the start.
+            void seek(uint64_t offset);
+
+        private:
+            void init();
+            void restart();
+            // Makes more compressed content available to zlib, returning false
+            // at its end.
+            bool fill();
+
+            std::shared_ptr<File> file;
+            bool const dropBehind;
+            // All of the compressed content if it's in memory.
+            uint8_t const *data = nullptr;
+            uint64_t length = 0;
+            // Compressed content read from the file, and the offset following it.
+            std::vector<uint8_t> input;
+            uint64_t inputEnd = 0;
+            uint64_t dropped = 0;
+            z_stream zs;
+            // Whether part of the current member has been consumed, and whether
+            // any member has ended.
+            bool inMember;
+            bool memberEnded;
+            bool eof;
+            // Offset into the inflated content of what's inflated next.
+            uint64_t position;
+            std::vector<char> scratch;
+        };
+
+/**********************************************************************
+ *
+ * CLASS GzipSource
+ *
+ **********************************************************************/
+        class GzipSource : public ISource {
+        public:
+            GzipSource(std::shared_ptr<File> file, bool drop_behind = false);
+            GzipSource(void const *data, uint64_t length);
+            virtual ~GzipSource();
+
+            virtual bool next(char const **data, uint64_t *length) override;
+            virtual void seek(uint64_t offset) override;
+            virtual bool isRandomAccess() override;
+
+        private:
+            GzipInflater inflater;
+            char buf[1024*64];
+        };
+
+/**********************************************************************
+ *
+ * CLASS ReadAheadGzipSource
+ *
+ * Inflates on a background thread into a ring of buffers, so that the
+ * consumer parses one buffer while the next ones are inflated. gzip
+ * streams can only be inflated serially, so there is a single thread.
+ *
+ **********************************************************************/
+        class ReadAheadGzipSource : public ISource {
+        public:
+            ReadAheadGzipSource(std::shared_ptr<File> file,
+                                uint32_t nbuffers,
+                                bool drop_behind = false);
+            virtual ~ReadAheadGzipSource();
+
+            virtual bool next(char const **data, uint64_t *length) override;
+            virtual void seek(uint64_t offset) override;
+            virtual bool isRandomAccess() override;
+
+        private:
+            void start();
+            void stop();
+            void work();
+
+            struct Slot {
+                enum {FREE, INFLATING, READY} state = FREE;
+                std::exception_ptr error;
+                // Zero in the slot following the end of the content.
+                uint32_t len;
+                char buf[1024*256];
+            };
+
+            // Only the worker uses the inflater while it's running.
+            GzipInflater inflater;
+
+            std::mutex lock;
+            std::condition_variable slotFree;
+            std::condition_variable slotReady;
+            std::thread worker;
+            std::vector<std::unique_ptr<Slot>> ring;
+            // Next slot to be handed out, and next slot to be filled.
+            uint64_t head = 0;
+            uint64_t tail = 0;
+            // Whether the consumer is still using the head slot.
+            bool holdingHead = false;
+            bool stopping = false;
+            bool eof = false;
+        };
+
+/**********************************************************************
+ *
+ * CLASS FileMapping
+ *
+ * A read-only mapping of an entire file, shared by all the sources over
+ * that file, which must have been opened by SEQIO_FILE_IO_BACKEND. Content
+ * already in memory can stand in for the mapping, in which case it's left
+ * to its owner.
+ *
+ **********************************************************************/
+        class FileMapping {
+        public:
+            FileMapping(std::shared_ptr<File> file_);
+            FileMapping(void const *data, uint64_t length_);
+            ~FileMapping();
+
+            char const *getData();
+            uint64_t getLength();
+            // Releases the pages of a range that has been read and won't be
+            // again, both from the mapping and from the page cache. Only pages
+            // entirely within the range are released.
+            void dropCached(uint64_t offset, uint64_t length);
+
+        private:
+            // Null for content not mapped by us.
+            std::shared_ptr<File> file;
+            void *addr;
+            uint64_t length;
+        };
+
+/**********************************************************************
+ *
+ * CLASS MmapSource
+ *
+ * Hands out the mapped file itself, so the content is never copied.
+ *
+ **********************************************************************/
+        class MmapSource : public ISource {
+        public:
+            MmapSource(std::shared_ptr<FileMapping> mapping_);
+            virtual ~MmapSource();
+
+            virtual bool next(char const **data, uint64_t *length) override;
+            virtual void seek(uint64_t offset) override;
+
+        private:
+            std::shared_ptr<FileMapping> mapping;
+            uint64_t offset = 0;
+        };
+
+/**********************************************************************
+ *
+ * CLASS QueueSource
+ *
+ * Reads blocks through an IoQueue, handing them out in file order. After a
+ * seek, a single page is read; once the consumer asks for the block
+ * after it, reads of the following blocks are kept in flight in all of the
+ * queue's buffers.
+ *
+ **********************************************************************/
+        class QueueSource : public ISource {
+        public:
+            QueueSource(std::shared_ptr<IoQueue> queue_, uint64_t length_);
+            virtual ~QueueSource();
+
+            virtual bool next(char const **data, uint64_t *length) override;
+            virtual void seek(uint64_t offset) override;
+
+        private:
+            std::shared_ptr<IoQueue> queue;
+            uint64_t const length;
+
+            struct Block {
+                uint32_t index;
+                bool done;
+                uint32_t len;
+            };
+            // Blocks in flight or read, in file order.
+            std::deque<Block> blocks;
+            std::vector<uint32_t> freeBuffers;
+            // Offset of the next block to be read.
+            uint64_t offset = 0;
+            // Whether the consumer is still using the first block.
+            bool holdingFirst = false;
+            bool sequential = false;
+        };
+
+    }
+}
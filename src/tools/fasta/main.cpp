@@ -27,6 +27,7 @@ void usage(string msg = "") {
     epf("       fasta [--transform (none|caps_gatcn)] cat <fasta...>");
     epf("       fasta [--transform (none|caps_gatcn)] read <fasta...>");
     epf("       fasta [--transform (none|caps_gatcn)] split fasta outdir");
+    epf("       fasta index <fasta...>");
 
     if(msg.length() > 0) {
         ep(msg.c_str());
@@ -133,28 +134,34 @@ int main(int argc, const char **argv) {
         char *buf = nullptr;
         uint64_t buflen;
 
+        seqio_sequence_iterator iterator;
+        seqio_sequence sequence;
+        seqio_create_multi_sequence_iterator(argv + argi, argc - argi, opts, &iterator);
+
+        while( (0 == seqio_next_sequence(iterator, &sequence)) && sequence) {
+            uint64_t seqlen;
+            seqio_read_all(sequence, &buf, &buflen, &seqlen);
+
+            if(mode == "cat") {
+                errif(1 != fwrite(buf, seqlen, 1, stdout),
+                      "Failed writing to stdout");
+            }
+
+            seqio_dispose_sequence(&sequence);
+        }
+
+        seqio_dispose_sequence_iterator(&iterator);
+
+    } else if(mode == "index") {
+        opts.index_mode = SEQIO_INDEX_BUILD;
+
         for(; argi < argc; argi++) {
             const char *path = argv[argi];
 
             seqio_sequence_iterator iterator;
-            seqio_sequence sequence;
             seqio_create_sequence_iterator(path, opts, &iterator);
-
-            while( (0 == seqio_next_sequence(iterator, &sequence)) && sequence) {
-                uint64_t seqlen;
-                seqio_read_all(sequence, &buf, &buflen, &seqlen);
-                
-                if(mode == "cat") {
-                    errif(1 != fwrite(buf, seqlen, 1, stdout),
-                          "Failed writing to stdout");
-                }
-
-                seqio_dispose_sequence(&sequence);
-            }
-
             seqio_dispose_sequence_iterator(&iterator);
         }
-
     } else if(mode == "split") {
         if( (argc - argi) != 2) {
             usage();
@@ -66,44 +66,50 @@ int main(int argc, const char **argv) {
             errif(!boost::filesystem::is_directory(output_dir),
                   "Not a directory: %s", output_dir.c_str());
 
-            for(; argi < argc; argi++) {
-                string path_fasta = argv[argi];
-
-                cout << "Processing " << path_fasta << "..." << endl;
-
-                seqio_sequence_iterator iterator;
-                seqio_create_sequence_iterator(path_fasta.c_str(),
-                                               fasta_options,
-                                               &iterator);
-                seqio_sequence sequence;
-                for(int iseq = 0;
-                    (0 == seqio_next_sequence(iterator, &sequence)) && sequence;
-                    iseq++) {
-
-                    char const *name, *comment;
-                    seqio_const_dictionary metadata;
-                    seqio_get_metadata(sequence, &metadata);
-                    seqio_get_value(metadata, SEQIO_KEY_NAME, &name);
-                    seqio_get_value(metadata, SEQIO_KEY_COMMENT, &comment);
-
-                    map<string,string> attrs;
-                    errif(!parse_ncbi_comment(comment, attrs),
-                          "Cannot determine assembly of %s in %s\n"
-                          "comment=%s",
-                          name, path_fasta.c_str(), comment);
-
-                    string assembly = join(split(attrs["assembly"]), "-");
-                    string species = join(split(attrs["species"]), "_");
-                    string path_assembly = pathcat(output_dir, species+"_"+assembly+".pna");
-                    shared_ptr<PnaWriter> fwriter = fwriters[path_assembly];
-                    if(!fwriter) {
-                        fwriter = create_writer(path_assembly);
-                        fwriters[path_assembly] = fwriter;
-                    }
+            // Each file is opened while the one before it is read.
+            seqio_sequence_iterator iterator;
+            seqio_create_multi_sequence_iterator(argv + argi,
+                                                 argc - argi,
+                                                 fasta_options,
+                                                 &iterator);
+            seqio_sequence sequence;
+            uint64_t ifile = uint64_t(-1);
+            string path_fasta;
+            int iseq = 0;
+            while((0 == seqio_next_sequence(iterator, &sequence)) && sequence) {
+                uint64_t index;
+                seqio_get_file_index(iterator, &index);
+                if(index != ifile) {
+                    ifile = index;
+                    path_fasta = argv[argi + ifile];
+                    iseq = 0;
+                    cout << "Processing " << path_fasta << "..." << endl;
+                }
 
-                    write_seq(sequence, path_fasta, iseq, fwriter);
+                char const *name, *comment;
+                seqio_const_dictionary metadata;
+                seqio_get_metadata(sequence, &metadata);
+                seqio_get_value(metadata, SEQIO_KEY_NAME, &name);
+                seqio_get_value(metadata, SEQIO_KEY_COMMENT, &comment);
+
+                map<string,string> attrs;
+                errif(!parse_ncbi_comment(comment, attrs),
+                      "Cannot determine assembly of %s in %s\n"
+                      "comment=%s",
+                      name, path_fasta.c_str(), comment);
+
+                string assembly = join(split(attrs["assembly"]), "-");
+                string species = join(split(attrs["species"]), "_");
+                string path_assembly = pathcat(output_dir, species+"_"+assembly+".pna");
+                shared_ptr<PnaWriter> fwriter = fwriters[path_assembly];
+                if(!fwriter) {
+                    fwriter = create_writer(path_assembly);
+                    fwriters[path_assembly] = fwriter;
                 }
+
+                write_seq(sequence, path_fasta, iseq++, fwriter);
             }
+            seqio_dispose_sequence_iterator(&iterator);
         } else if((mode == "c") || (mode == "create")) {
             if((argc - argi) < 2) {
                 usage("Missing create arguments");
@@ -111,22 +117,28 @@ int main(int argc, const char **argv) {
             string path_pna = argv[argi++];
             shared_ptr<PnaWriter> fwriter = create_writer(path_pna);
 
-            for(; argi < argc; argi++) {
-                string path_fasta = argv[argi];
-                cout << "Importing " << path_fasta << endl;
-
-                seqio_sequence_iterator iterator;
-                seqio_create_sequence_iterator(path_fasta.c_str(),
-                                               fasta_options,
-                                               &iterator);
-
-                seqio_sequence sequence;
-                for(int iseq = 0;
-                    (0 == seqio_next_sequence(iterator, &sequence)) && sequence;
-                    iseq++) {
-                    write_seq(sequence, path_fasta, iseq, fwriter);
+            // Each file is opened while the one before it is read.
+            seqio_sequence_iterator iterator;
+            seqio_create_multi_sequence_iterator(argv + argi,
+                                                 argc - argi,
+                                                 fasta_options,
+                                                 &iterator);
+            seqio_sequence sequence;
+            uint64_t ifile = uint64_t(-1);
+            string path_fasta;
+            int iseq = 0;
+            while((0 == seqio_next_sequence(iterator, &sequence)) && sequence) {
+                uint64_t index;
+                seqio_get_file_index(iterator, &index);
+                if(index != ifile) {
+                    ifile = index;
+                    path_fasta = argv[argi + ifile];
+                    iseq = 0;
+                    cout << "Importing " << path_fasta << endl;
                 }
+                write_seq(sequence, path_fasta, iseq++, fwriter);
             }
+            seqio_dispose_sequence_iterator(&iterator);
         } else if((mode == "t") || (mode == "table")) {
             bool summary = false;
             for(; argi < argc; argi++) {
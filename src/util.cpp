@@ -1,5 +1,6 @@
 #include "util.h"
 
+#include <math.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -1,11 +1,248 @@
 #include "test_util.hpp"
 
+#include "bgzf.hpp"
+#include "fasta.hpp"
+#include "io.hpp"
+#include "pna.hpp"
 #include "seqio.h"
+#include "simd.hpp"
+#include "util.h"
 
 #include <assert.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <thread>
 
 using namespace std;
 
+/**********************************************************************
+ *
+ * Fixtures
+ *
+ * Files in /tmp shared by several tests. Each is written the first time a
+ * test asks for it, so no test depends on the order tests run in or on
+ * files left by an earlier run.
+ *
+ **********************************************************************/
+
+// /tmp/seqio_rc.fa, .fa.gz and .pna: N runs at either end and between
+// fragments of every alignment within a packed byte, and fragments spanning
+// many reads from a PNA file.
+struct rc_fixture_t {
+    string bases1;
+    string bases2;
+};
+
+rc_fixture_t const &rc_fixture() {
+    static rc_fixture_t fixture;
+    static bool written = false;
+    if(!written) {
+        char *long_bases = create_random_bases(100000, 7);
+        fixture.bases1 = string("NNNN") + long_bases + "NNNNNNNN" + "ACGTA" + "N" + "C" + "NN" + "GGTAC" + "NNN";
+        fixture.bases2 = string("acgtRYKMBVDHSWNu") + long_bases;
+        free(long_bases);
+        vector<seqspec_t> specs = {
+            {"seq1", "comment", fixture.bases1.c_str()},
+            {"seq2", "", fixture.bases2.c_str()},
+            {"seq3", "", ""},
+            {"seq4", "", "T"},
+            {"seq5", "", "NNNNN"},
+        };
+        write_file("/tmp/seqio_rc.fa", specs);
+        write_file("/tmp/seqio_rc.fa.gz", specs);
+        write_file("/tmp/seqio_rc.pna", specs);
+        unlink("/tmp/seqio_rc.fa.fai");
+        written = true;
+    }
+    return fixture;
+}
+
+// /tmp/seqio_headers.fa and .fa.gz: a header longer than any source's
+// buffer, and lines that the writer doesn't produce.
+struct headers_fixture_t {
+    string long_name;
+    string long_comment;
+};
+
+headers_fixture_t const &headers_fixture() {
+    static headers_fixture_t fixture;
+    static bool written = false;
+    if(!written) {
+        fixture.long_name = string(100 * 1024, 'n');
+        fixture.long_comment = string(300 * 1024, 'c');
+        FILE *f = fopen("/tmp/seqio_headers.fa", "w");
+        assert(f);
+        fputs(">plain\nACGT\n", f);
+        fputs(">tab\tcomment  with\tspaces \nACGT\n", f);
+        fputs(">cr\r\nACGT\r\n", f);
+        fputs(">crcomment x\ry\r\nACGT\r\n", f);
+        fprintf(f, ">%s %s\nACGT\n", fixture.long_name.c_str(), fixture.long_comment.c_str());
+        fputs(">\nACGT\n", f);
+        fclose(f);
+        SH("gzip -c /tmp/seqio_headers.fa > /tmp/seqio_headers.fa.gz");
+        written = true;
+    }
+    return fixture;
+}
+
+// /tmp/seqio_single_pass.fa, its plain gzip .fa.gz and a BGZF
+// _bgzf.fa.gz: 8 sequences of 100,000 random bases, as verify_single_pass()
+// expects. Our writer produces BGZF, so plain gzip comes from the gzip
+// command.
+void single_pass_fixture() {
+    static bool written = false;
+    if(!written) {
+        uint64_t const seqlen = 100 * 1000;
+        vector<string> bases;
+        vector<string> names;
+        for(int i = 0; i < 8; i++) {
+            char *seq = create_random_bases(seqlen, i + 1);
+            bases.push_back(seq);
+            free(seq);
+            names.push_back("seq" + to_string(i + 1));
+        }
+        vector<seqspec_t> specs;
+        for(int i = 0; i < 8; i++) {
+            specs.push_back({names[i].c_str(), "comment", bases[i].c_str()});
+        }
+        write_file("/tmp/seqio_single_pass.fa", specs);
+        SH("gzip -c /tmp/seqio_single_pass.fa > /tmp/seqio_single_pass.fa.gz");
+        write_file("/tmp/seqio_single_pass_bgzf.fa.gz", specs);
+        written = true;
+    }
+}
+
+// /tmp/seqio_bgzf.fa and its BGZF .fa.gz, without indexes: sequences long
+// enough to span several BGZF blocks.
+struct bgzf_fixture_t {
+    vector<string> names;
+    vector<string> comments;
+    vector<string> bases;
+};
+
+bgzf_fixture_t const &bgzf_fixture() {
+    static bgzf_fixture_t fixture;
+    static bool written = false;
+    if(!written) {
+        uint64_t const seqlens[] = {200000, 70000, 7, 0, 81};
+        for(int i = 0; i < 5; i++) {
+            char *seq = create_random_bases(seqlens[i], i + 1);
+            fixture.bases.push_back(seq);
+            free(seq);
+            fixture.names.push_back("seq" + to_string(i + 1));
+            fixture.comments.push_back(i % 2 ? "" : "comment");
+        }
+        vector<seqspec_t> specs;
+        for(int i = 0; i < 5; i++) {
+            specs.push_back({fixture.names[i].c_str(), fixture.comments[i].c_str(), fixture.bases[i].c_str()});
+        }
+        write_file("/tmp/seqio_bgzf.fa", specs);
+        write_file("/tmp/seqio_bgzf.fa.gz", specs);
+        unlink("/tmp/seqio_bgzf.fa.fai");
+        unlink("/tmp/seqio_bgzf.fa.gz.fai");
+        unlink("/tmp/seqio_bgzf.fa.gz.gzi");
+        written = true;
+    }
+    return fixture;
+}
+
+// /tmp/seqio.fq and .fq.gz: enough records to span many reads from the
+// file, mixing the 4-line layout with wrapped records and CRLF line endings.
+// Record i is named readi, with a comment when i is odd.
+struct fastq_fixture_t {
+    vector<string> bases;
+    vector<string> quals;
+};
+
+fastq_fixture_t const &fastq_fixture() {
+    static fastq_fixture_t fixture;
+    static bool written = false;
+    if(!written) {
+        int const nrecords = 20000;
+        FILE *f = fopen("/tmp/seqio.fq", "w");
+        assert(f);
+        for(int i = 0; i < nrecords; i++) {
+            uint64_t len = 1 + (i * 37) % 300;
+            char *seq = create_random_bases(len, i + 1);
+            string qual;
+            for(uint64_t j = 0; j < len; j++)
+                qual += char('!' + (i + j) % 42);
+            fixture.bases.push_back(seq);
+            fixture.quals.push_back(qual);
+            free(seq);
+
+            string const &bases = fixture.bases[i];
+            char const *eol = (i % 5 == 0) ? "\r\n" : "\n";
+            fprintf(f, "@read%d%s%s", i, (i % 2) ? " comment" : "", eol);
+            if(i % 7 == 0) {
+                uint64_t half = len / 2;
+                fprintf(f, "%.*s%s%s%s+%s", int(half), bases.c_str(), eol, bases.c_str() + half, eol, eol);
+                fprintf(f, "%.*s%s%s%s", int(half), qual.c_str(), eol, qual.c_str() + half, eol);
+            } else {
+                fprintf(f, "%s%s+%s%s%s", bases.c_str(), eol, eol, qual.c_str(), eol);
+            }
+        }
+        fclose(f);
+        SH("gzip -c /tmp/seqio.fq > /tmp/seqio.fq.gz");
+        written = true;
+    }
+    return fixture;
+}
+
+// /tmp/seqio_batch.fa and .pna: 100 sequences of up to 5000 bases.
+void batch_fixture() {
+    static bool written = false;
+    if(!written) {
+        vector<string> bases;
+        vector<string> names;
+        for(int i = 0; i < 100; i++) {
+            char *seq = create_random_bases(1 + (i * 997) % 5000, i + 1);
+            bases.push_back(seq);
+            free(seq);
+            names.push_back("seq" + to_string(i));
+        }
+        vector<seqspec_t> specs;
+        for(int i = 0; i < 100; i++) {
+            specs.push_back({names[i].c_str(), i % 2 ? "" : "comment", bases[i].c_str()});
+        }
+        write_file("/tmp/seqio_batch.fa", specs);
+        write_file("/tmp/seqio_batch.pna", specs);
+        written = true;
+    }
+}
+
+// /tmp/seqio_parallel.fa: enough data for many chunks of a parallel parse,
+// with records much smaller than a chunk as well as one that spans several,
+// and lines that the writer doesn't produce.
+void parallel_fixture() {
+    static bool written = false;
+    if(!written) {
+        vector<string> bases;
+        vector<string> names;
+        for(int i = 0; i < 1000; i++) {
+            uint64_t seqlen = (i == 500) ? 3 * 1024 * 1024 : 1 + (i * 7919) % 8000;
+            char *seq = create_random_bases(seqlen, i + 1);
+            bases.push_back(seq);
+            free(seq);
+            names.push_back("seq" + to_string(i));
+        }
+        vector<seqspec_t> specs;
+        for(int i = 0; i < 1000; i++) {
+            specs.push_back({names[i].c_str(), i % 3 ? "" : "comment >not a header", bases[i].c_str()});
+        }
+        specs.push_back({"empty", "", ""});
+        write_file("/tmp/seqio_parallel.fa", specs);
+
+        FILE *f = fopen("/tmp/seqio_parallel.fa", "a");
+        assert(f);
+        fputs(">crlf\tcomment\r\nACGT\r\nNNac\r\n\n>\n>last", f);
+        fclose(f);
+        written = true;
+    }
+}
 
 void test_fasta_plain__sequential() {
     seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
@@ -39,6 +276,244 @@ void test_fasta_transform_caps_gatcn() {
                     "AACCGGTTNNNNNNNN");
 }
 
+void test_transform_caps_gatcn__exhaustive() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    seqio::impl::CharInterpreter interpreter(SEQIO_BASE_TRANSFORM_CAPS_GATCN);
+    string const isa = seqio::impl::simd_isa();
+
+    // Every byte value at every position within a vector, with lengths that
+    // leave every possible tail for the scalar code.
+    char src[256 + 128];
+    char dst[sizeof(src)];
+    for(uint64_t i = 0; i < sizeof(src); i++)
+        src[i] = char(i * 7 + 3);
+
+    char const *isas[] = {"scalar", "sse2", "sse4.1", "avx2", "avx512bw"};
+    for(char const *name: isas) {
+        if(!seqio::impl::set_simd_isa(name))
+            continue;
+
+        for(uint64_t offset = 0; offset < 64; offset++) {
+            for(uint64_t len = 256; len <= sizeof(src) - offset; len++) {
+                seqio_transform(SEQIO_BASE_TRANSFORM_CAPS_GATCN, src + offset, len, dst);
+                for(uint64_t i = 0; i < len; i++)
+                    assert(dst[i] == interpreter.getBase(src[offset + i]));
+            }
+        }
+
+        // In place
+        memcpy(dst, src, sizeof(src));
+        seqio_transform(SEQIO_BASE_TRANSFORM_CAPS_GATCN, dst, sizeof(dst), dst);
+        for(uint64_t i = 0; i < sizeof(src); i++)
+            assert(dst[i] == interpreter.getBase(src[i]));
+    }
+
+    assert(seqio::impl::set_simd_isa(isa.c_str()));
+}
+
+void test_count_graph__exhaustive() {
+    string const isa = seqio::impl::simd_isa();
+
+    // Every byte value, with lengths long enough for the byte counters to be
+    // summed more than once.
+    string src(255 * 32 * 2 + 100, '\0');
+    for(uint64_t i = 0; i < src.size(); i++)
+        src[i] = char(i * 7 + 3);
+
+    char const *isas[] = {"scalar", "sse2", "sse4.1", "avx2", "avx512bw"};
+    for(char const *name: isas) {
+        if(!seqio::impl::set_simd_isa(name))
+            continue;
+
+        for(uint64_t offset = 0; offset < 64; offset += 5) {
+            for(uint64_t len: {uint64_t(0), uint64_t(1), uint64_t(31), uint64_t(33), uint64_t(255 * 16),
+                               uint64_t(255 * 32 + 17), src.size() - offset}) {
+                char const *begin = src.data() + offset;
+                uint64_t expected = 0;
+                for(uint64_t i = 0; i < len; i++)
+                    expected += isgraph(begin[i]) ? 1 : 0;
+                assert(expected == seqio::impl::count_graph(begin, begin + len));
+            }
+        }
+    }
+
+    assert(seqio::impl::set_simd_isa(isa.c_str()));
+}
+
+void test_unpack_2bit__exhaustive() {
+    string const isa = seqio::impl::simd_isa();
+
+    // Every byte value, at every alignment and across vector boundaries.
+    vector<uint8_t> src(256 + 64);
+    for(uint64_t i = 0; i < src.size(); i++)
+        src[i] = uint8_t(i * 13 + 5);
+
+    char const acgt[] = "ACGT";
+    char const *isas[] = {"scalar", "sse2", "sse4.1", "avx2", "avx512bw"};
+    for(char const *name: isas) {
+        if(!seqio::impl::set_simd_isa(name))
+            continue;
+
+        for(uint64_t offset = 0; offset < 33; offset++) {
+            for(uint64_t len = 0; offset + len <= src.size(); len += (len < 70) ? 1 : 37) {
+                uint8_t const *begin = src.data() + offset;
+                string expected;
+                for(uint64_t i = 0; i < len; i++)
+                    for(int k = 0; k < 4; k++)
+                        expected += acgt[(begin[i] >> (2 * k)) & 0x3];
+
+                string forward(4 * len, '\0');
+                seqio::impl::unpack_2bit(begin, len, &forward[0]);
+                assert(forward == expected);
+
+                string reverse(4 * len, '\0');
+                seqio::impl::unpack_2bit_reverse_complement(begin, len, &reverse[0]);
+                assert(reverse == reverse_complement(expected));
+            }
+        }
+    }
+
+    assert(seqio::impl::set_simd_isa(isa.c_str()));
+}
+
+void test_reverse_complement_caps_gatcn__exhaustive() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    seqio::impl::CharInterpreter interpreter(SEQIO_BASE_TRANSFORM_CAPS_GATCN);
+    seqio::impl::CharInterpreter reverse(SEQIO_BASE_TRANSFORM_CAPS_GATCN,
+                                         SEQIO_STRAND_REVERSE_COMPLEMENT);
+    string const isa = seqio::impl::simd_isa();
+
+    char src[256 + 128];
+    char dst[sizeof(src)];
+    for(uint64_t i = 0; i < sizeof(src); i++)
+        src[i] = char(i * 7 + 3);
+
+    // Lengths cover every size of middle left between the vectors taken from
+    // each end.
+    char const *isas[] = {"scalar", "sse2", "sse4.1", "avx2", "avx512bw"};
+    for(char const *name: isas) {
+        if(!seqio::impl::set_simd_isa(name))
+            continue;
+
+        for(uint64_t offset = 0; offset < 64; offset += 7) {
+            for(uint64_t len = 0; len <= sizeof(src) - offset; len++) {
+                string expected;
+                for(uint64_t i = 0; i < len; i++)
+                    expected += interpreter.getBase(src[offset + i]);
+                expected = reverse_complement(expected);
+
+                reverse.reverseComplement(src + offset, len, dst);
+                assert(expected == string(dst, len));
+
+                // In place
+                memcpy(dst, src + offset, len);
+                reverse.reverseComplement(dst, len, dst);
+                assert(expected == string(dst, len));
+            }
+        }
+    }
+
+    assert(seqio::impl::set_simd_isa(isa.c_str()));
+}
+
+void test_reverse_complement() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    string const &bases2 = rc_fixture().bases2;
+    fastq_fixture();
+
+    char const *paths[] = {"/tmp/seqio_rc.fa", "/tmp/seqio_rc.fa.gz", "/tmp/seqio_rc.pna",
+                           "input/a.fq", "/tmp/seqio.fq", "/tmp/seqio.fq.gz"};
+    for(char const *path: paths) {
+        verify_reverse_complement(path, SEQIO_BASE_TRANSFORM_NONE);
+        verify_reverse_complement(path, SEQIO_BASE_TRANSFORM_CAPS_GATCN);
+    }
+
+    // Seeking into the reverse complement of an indexed FASTA sequence.
+    seqio_sequence_options opts = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    opts.index_mode = SEQIO_INDEX_BUILD;
+    opts.strand = SEQIO_STRAND_REVERSE_COMPLEMENT;
+    seqio_sequence_iterator iterator;
+    seqio_sequence sequence;
+    seqio_create_sequence_iterator("/tmp/seqio_rc.fa", opts, &iterator);
+    seqio_open_sequence(iterator, "seq2", &sequence);
+    verify_seek(sequence, reverse_complement(bases2).c_str());
+    seqio_dispose_sequence(&sequence);
+    seqio_dispose_sequence_iterator(&iterator);
+}
+
+void test_fasta_headers() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    string const &long_name = headers_fixture().long_name;
+    string const &long_comment = headers_fixture().long_comment;
+
+    char const *names[] = {"plain", "tab", "cr", "crcomment", long_name.c_str(), ""};
+    char const *comments[] = {"", "comment  with\tspaces ", "", "xy", long_comment.c_str(), ""};
+    uint32_t const count = sizeof(names) / sizeof(names[0]);
+
+    char const *paths[] = {"/tmp/seqio_headers.fa", "/tmp/seqio_headers.fa.gz"};
+    seqio_io_engine const engines[] = {SEQIO_IO_ENGINE_DEFAULT, SEQIO_IO_ENGINE_PREAD};
+    for(char const *path: paths) {
+        for(seqio_io_engine engine: engines) {
+            seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+            options.io_engine = engine;
+
+            // Metadata asked for before and after the following sequences
+            // are opened, and after the iterator is gone.
+            seqio_sequence_iterator iterator;
+            seqio_sequence sequences[count];
+            seqio_create_sequence_iterator(path, options, &iterator);
+            for(uint32_t i = 0; i < count; i++) {
+                seqio_next_sequence(iterator, &sequences[i]);
+                assert(sequences[i]);
+                if(i % 2)
+                    verify_basic_metadata(sequences[i], names[i], comments[i]);
+                verify_bases(sequences[i], "ACGT", 3);
+            }
+            seqio_sequence sequence;
+            seqio_next_sequence(iterator, &sequence);
+            assert(!sequence);
+            seqio_dispose_sequence_iterator(&iterator);
+
+            for(uint32_t i = 0; i < count; i++) {
+                verify_basic_metadata(sequences[i], names[i], comments[i]);
+                seqio_dispose_sequence(&sequences[i]);
+            }
+
+            // Each sequence disposed before the next, so the header buffer is
+            // recycled.
+            seqio_create_sequence_iterator(path, options, &iterator);
+            for(uint32_t i = 0; i < count; i++) {
+                seqio_next_sequence(iterator, &sequence);
+                verify_basic_metadata(sequence, names[i], comments[i]);
+                seqio_dispose_sequence(&sequence);
+            }
+            seqio_dispose_sequence_iterator(&iterator);
+        }
+    }
+
+    // The long name opened through an index that's built and saved, then
+    // loaded.
+    unlink("/tmp/seqio_headers.fa.fai");
+    for(seqio_index_mode mode: {SEQIO_INDEX_BUILD, SEQIO_INDEX_USE}) {
+        seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+        options.index_mode = mode;
+        seqio_sequence_iterator iterator;
+        seqio_sequence sequence;
+        seqio_create_sequence_iterator("/tmp/seqio_headers.fa", options, &iterator);
+        seqio_open_sequence(iterator, long_name.c_str(), &sequence);
+        assert(sequence);
+        verify_basic_metadata(sequence, long_name.c_str(), long_comment.c_str());
+        verify_bases(sequence, "ACGT", 3);
+        seqio_dispose_sequence(&sequence);
+        seqio_dispose_sequence_iterator(&iterator);
+        assert(0 == access("/tmp/seqio_headers.fa.fai", R_OK));
+    }
+}
+
 void test_fasta_write() {
     seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
     uint32_t const seqlen = 1024 * 1024 * 16;
@@ -77,6 +552,951 @@ void test_fasta_write() {
     free(seq);
 }
 
+void test_fasta_single_pass() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    // Plain gzip can't rewind without starting over.
+    single_pass_fixture();
+    assert(!seqio::impl::is_bgzf_file_content("/tmp/seqio_single_pass.fa.gz"));
+    assert(seqio::impl::is_bgzf_file_content("/tmp/seqio_single_pass_bgzf.fa.gz"));
+
+    struct stat buf;
+    assert(0 == stat("/tmp/seqio_single_pass.fa", &buf));
+
+    verify_single_pass("/tmp/seqio_single_pass.fa", buf.st_size);
+    verify_single_pass("/tmp/seqio_single_pass.fa.gz", buf.st_size);
+    verify_single_pass("/tmp/seqio_single_pass_bgzf.fa.gz", buf.st_size);
+}
+
+void test_fasta_fai() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    uint64_t const seqlens[] = {1000, 160, 7, 0, 81};
+    vector<char *> bases;
+    vector<string> names;
+    vector<seqspec_t> specs;
+    for(int i = 0; i < 5; i++) {
+        bases.push_back(create_random_bases(seqlens[i], i + 1));
+        names.push_back("seq" + to_string(i + 1));
+    }
+    for(int i = 0; i < 5; i++) {
+        specs.push_back({names[i].c_str(), i % 2 ? "" : "comment", bases[i]});
+    }
+
+    char const *path = "/tmp/seqio_fai.fa";
+    write_file(path, specs);
+    unlink("/tmp/seqio_fai.fa.fai");
+
+    seqio_sequence_options opts = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    seqio_sequence_iterator iterator;
+    seqio_sequence sequence;
+
+    // Without an index, sequences can't be opened by name.
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_RETURN);
+    seqio_create_sequence_iterator(path, opts, &iterator);
+    assert(SEQIO_ERR_INVALID_STATE == seqio_open_sequence(iterator, "seq1", &sequence));
+    seqio_dispose_sequence_iterator(&iterator);
+
+    // Build the index on first open.
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+    opts.index_mode = SEQIO_INDEX_BUILD;
+    seqio_create_sequence_iterator(path, opts, &iterator);
+    seqio_dispose_sequence_iterator(&iterator);
+
+    {
+        char *fai = load_file("/tmp/seqio_fai.fa.fai");
+        assert(0 == strcmp(fai,
+                           "seq1\t1000\t14\t80\t81\n"
+                           "seq2\t160\t1033\t80\t81\n"
+                           "seq3\t7\t1209\t7\t8\n"
+                           "seq4\t0\t1223\t0\t0\n"
+                           "seq5\t81\t1237\t80\t81\n"));
+        free(fai);
+    }
+
+    // Reuse the index, opening sequences by name and seeking within them.
+    opts.index_mode = SEQIO_INDEX_USE;
+    seqio_create_sequence_iterator(path, opts, &iterator);
+
+    for(int i = 4; i >= 0; i--) {
+        seqio_open_sequence(iterator, names[i].c_str(), &sequence);
+        verify_basic_metadata(sequence, names[i].c_str(), specs[i].comment);
+        verify_seek(sequence, bases[i]);
+        seqio_dispose_sequence(&sequence);
+    }
+
+    // Sequences from the iterator can seek as well.
+    for(int i = 0; i < 5; i++) {
+        seqio_next_sequence(iterator, &sequence);
+        verify_seek(sequence, bases[i]);
+        seqio_dispose_sequence(&sequence);
+    }
+    seqio_next_sequence(iterator, &sequence);
+    assert(!sequence);
+
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_RETURN);
+    assert(SEQIO_ERR_INVALID_PARAMETER == seqio_open_sequence(iterator, "seq6", &sequence));
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    seqio_dispose_sequence_iterator(&iterator);
+
+    for(char *seq: bases)
+        free(seq);
+}
+
+void test_fasta_bgzf() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    bgzf_fixture_t const &fixture = bgzf_fixture();
+    vector<string> const &names = fixture.names;
+    vector<string> const &comments = fixture.comments;
+    vector<string> const &bases = fixture.bases;
+
+    // Indexes left by other tests are rebuilt.
+    char const *plain_path = "/tmp/seqio_bgzf.fa";
+    char const *path = "/tmp/seqio_bgzf.fa.gz";
+    unlink("/tmp/seqio_bgzf.fa.fai");
+    unlink("/tmp/seqio_bgzf.fa.gz.fai");
+    unlink("/tmp/seqio_bgzf.fa.gz.gzi");
+
+    seqio_sequence_options opts = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    seqio_sequence_iterator iterator;
+    seqio_sequence sequence;
+
+    opts.index_mode = SEQIO_INDEX_BUILD;
+    seqio_create_sequence_iterator(plain_path, opts, &iterator);
+    seqio_dispose_sequence_iterator(&iterator);
+    seqio_create_sequence_iterator(path, opts, &iterator);
+    seqio_dispose_sequence_iterator(&iterator);
+
+    // The .fai of a BGZF file refers to uncompressed offsets, so it's the
+    // same as that of the plain file.
+    {
+        char *fai = load_file("/tmp/seqio_bgzf.fa.fai");
+        char *fai_gz = load_file("/tmp/seqio_bgzf.fa.gz.fai");
+        assert(0 == strcmp(fai, fai_gz));
+        free(fai);
+        free(fai_gz);
+    }
+
+    // The .gzi lists every block but the first.
+    {
+        struct stat s;
+        assert(0 == stat(plain_path, &s));
+        uint64_t nblocks = (s.st_size + 0xff00 - 1) / 0xff00;
+        assert(0 == stat("/tmp/seqio_bgzf.fa.gz.gzi", &s));
+        assert(uint64_t(s.st_size) == 8 + 16 * (nblocks - 1));
+    }
+
+    // Seek using the saved .gzi, then again with one built on demand.
+    opts.index_mode = SEQIO_INDEX_USE;
+    for(int pass = 0; pass < 2; pass++) {
+        if(pass == 1)
+            unlink("/tmp/seqio_bgzf.fa.gz.gzi");
+
+        seqio_create_sequence_iterator(path, opts, &iterator);
+        for(int i = 4; i >= 0; i--) {
+            seqio_open_sequence(iterator, names[i].c_str(), &sequence);
+            verify_basic_metadata(sequence, names[i].c_str(), comments[i].c_str());
+            verify_seek(sequence, bases[i].c_str());
+            seqio_dispose_sequence(&sequence);
+        }
+        seqio_dispose_sequence_iterator(&iterator);
+    }
+
+    // Decompress on worker threads, both streaming and seeking.
+    opts.num_threads = 4;
+    seqio_create_sequence_iterator(path, opts, &iterator);
+    for(int i = 0; i < 5; i++) {
+        seqio_next_sequence(iterator, &sequence);
+        verify_sequence(sequence, names[i].c_str(), comments[i].c_str(), bases[i].c_str());
+    }
+    seqio_next_sequence(iterator, &sequence);
+    assert(!sequence);
+    for(int i = 4; i >= 0; i--) {
+        seqio_open_sequence(iterator, names[i].c_str(), &sequence);
+        verify_seek(sequence, bases[i].c_str());
+        seqio_dispose_sequence(&sequence);
+    }
+    seqio_dispose_sequence_iterator(&iterator);
+}
+
+void test_fastq_plain__sequential() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+    verify_a__sequential("input/a.fq");
+}
+
+void test_fastq_gzip__sequential() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+    verify_a__sequential("input/a.fq.gz");
+}
+
+void test_fastq_plain__out_of_order() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+    verify_a__out_of_order("input/a.fq");
+}
+
+void test_fastq_quality() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    seqio_sequence_iterator iterator;
+    seqio_sequence sequence;
+    char const *quality;
+    uint64_t length;
+
+    seqio_create_sequence_iterator("input/a.fq", SEQIO_DEFAULT_SEQUENCE_OPTIONS, &iterator);
+
+    // Multi-line, with a quality line beginning with '@'.
+    seqio_next_sequence(iterator, &sequence);
+    seqio_get_quality(sequence, &quality, &length);
+    assert((length == 8) && (0 == strcmp(quality, "@IIIIIII")));
+    seqio_dispose_sequence(&sequence);
+
+    seqio_next_sequence(iterator, &sequence);
+    seqio_get_quality(sequence, &quality, &length);
+    assert((length == 8) && (0 == strcmp(quality, "!#%&()*+")));
+    seqio_dispose_sequence(&sequence);
+
+    seqio_dispose_sequence_iterator(&iterator);
+
+    // Base transforms apply as they do for FASTA.
+    verify_sequence("input/a.fq",
+                    SEQIO_BASE_TRANSFORM_CAPS_GATCN,
+                    "seq1",
+                    "comment1.0 comment1.1",
+                    "AAGGCCTT");
+
+    // FASTA has no qualities.
+    seqio_create_sequence_iterator("input/a.fa", SEQIO_DEFAULT_SEQUENCE_OPTIONS, &iterator);
+    seqio_next_sequence(iterator, &sequence);
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_RETURN);
+    assert(SEQIO_ERR_INVALID_STATE == seqio_get_quality(sequence, &quality, &length));
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+    seqio_dispose_sequence(&sequence);
+    seqio_dispose_sequence_iterator(&iterator);
+}
+
+void test_fastq_layouts() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    vector<string> const &bases = fastq_fixture().bases;
+    vector<string> const &quals = fastq_fixture().quals;
+    int const nrecords = int(bases.size());
+
+    char const *paths[] = {"/tmp/seqio.fq", "/tmp/seqio.fq.gz"};
+    for(char const *path: paths) {
+        seqio_sequence_iterator iterator;
+        seqio_sequence sequence;
+        char *buf = nullptr;
+        uint64_t buflen;
+        uint64_t seqlen;
+
+        seqio_create_sequence_iterator(path, SEQIO_DEFAULT_SEQUENCE_OPTIONS, &iterator);
+        for(int i = 0; i < nrecords; i++) {
+            seqio_next_sequence(iterator, &sequence);
+            assert(sequence);
+
+            string name = "read" + to_string(i);
+            verify_basic_metadata(sequence, name.c_str(), (i % 2) ? "comment" : "");
+
+            char const *quality;
+            uint64_t length;
+            seqio_get_quality(sequence, &quality, &length);
+            assert(quals[i] == string(quality, length));
+
+            seqio_read_all(sequence, &buf, &buflen, &seqlen);
+            assert(bases[i] == string(buf, seqlen));
+            seqio_dispose_sequence(&sequence);
+        }
+        seqio_next_sequence(iterator, &sequence);
+        assert(!sequence);
+
+        seqio_dispose_sequence_iterator(&iterator);
+        seqio_dispose_buffer(&buf);
+    }
+}
+
+void test_batch() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    batch_fixture();
+    fastq_fixture();
+
+    verify_batch("input/a.fa", 1);
+    verify_batch("input/a.fq", 1);
+    verify_batch("/tmp/seqio_batch.fa", 7);
+    verify_batch("/tmp/seqio_batch.fa", 1000);
+    verify_batch("/tmp/seqio_batch.pna", 16);
+    verify_batch("/tmp/seqio.fq", 256);
+    verify_batch("/tmp/seqio.fq.gz", 256);
+}
+
+void test_fasta_parallel() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    parallel_fixture();
+
+    seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    uint32_t const nthreads[] = {2, 4, 7};
+    for(uint32_t n: nthreads) {
+        options.num_threads = n;
+        options.record_order = SEQIO_RECORD_ORDER_FILE;
+        verify_parallel("/tmp/seqio_parallel.fa", options);
+        options.record_order = SEQIO_RECORD_ORDER_ANY;
+        verify_parallel("/tmp/seqio_parallel.fa", options);
+    }
+
+    options.num_threads = 4;
+    options.record_order = SEQIO_RECORD_ORDER_FILE;
+    options.base_transform = SEQIO_BASE_TRANSFORM_CAPS_GATCN;
+    options.strand = SEQIO_STRAND_REVERSE_COMPLEMENT;
+    verify_parallel("/tmp/seqio_parallel.fa", options);
+    verify_parallel("input/a.fa", options);
+}
+
+void test_read_ahead() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    // Plain gzip, BGZF and gzipped FASTQ.
+    single_pass_fixture();
+    bgzf_fixture();
+    fastq_fixture();
+    char const *paths[] = {"/tmp/seqio_single_pass.fa.gz", "/tmp/seqio_bgzf.fa.gz", "/tmp/seqio.fq.gz"};
+    uint32_t const nbuffers[] = {1, 2, 5};
+    for(char const *path: paths) {
+        for(uint32_t n: nbuffers) {
+            verify_read_ahead(path, n);
+        }
+    }
+}
+
+void test_io_engine() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    rc_fixture();
+    batch_fixture();
+    parallel_fixture();
+    single_pass_fixture();
+
+    // Reads completing in any order land in the right buffers. Whether it's
+    // io_uring depends on the kernel.
+    {
+        char const *path = "/tmp/seqio_parallel.fa";
+        auto file = seqio::impl::File::open(nullptr, path);
+        int fd = file->getFd();
+        assert(fd >= 0);
+        unique_ptr<seqio::impl::IoQueue> queue(seqio::impl::IoQueue::create(file, SEQIO_IO_ENGINE_URING, 3, 4096));
+        cout << "io_uring " << (queue->getEngine() == SEQIO_IO_ENGINE_URING ? "available" : "unavailable") << endl;
+
+        uint64_t const offsets[] = {12345, 0, 1 << 20};
+        for(uint32_t i = 0; i < 3; i++) {
+            queue->submit(i, offsets[i], 4096);
+        }
+        queue->flush();
+        for(uint32_t i = 0; i < 3; i++) {
+            uint32_t length;
+            uint32_t index = queue->wait(&length);
+            assert(length == 4096);
+            char expected[4096];
+            assert(4096 == pread(fd, expected, 4096, offsets[index]));
+            assert(0 == memcmp(expected, queue->getData(index), 4096));
+        }
+        assert(queue->getOutstandingCount() == 0);
+    }
+
+    char const *paths[] = {"/tmp/seqio_rc.fa", "/tmp/seqio_rc.pna", "/tmp/seqio_batch.pna", "/tmp/seqio_parallel.fa"};
+    seqio_io_engine const engines[] = {SEQIO_IO_ENGINE_PREAD, SEQIO_IO_ENGINE_URING};
+    for(seqio_io_engine engine: engines) {
+        for(char const *path: paths) {
+            verify_io_engine(path, engine);
+        }
+
+        // Seeking within an indexed FASTA sequence
+        {
+            seqio_sequence_options opts = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+            opts.index_mode = SEQIO_INDEX_BUILD;
+            opts.io_engine = engine;
+            seqio_sequence_iterator iterator;
+            seqio_sequence sequence;
+            char *bases = create_random_bases(100000, 1);
+            seqio_create_sequence_iterator("/tmp/seqio_single_pass.fa", opts, &iterator);
+            seqio_open_sequence(iterator, "seq1", &sequence);
+            verify_seek(sequence, bases);
+            seqio_dispose_sequence(&sequence);
+            seqio_dispose_sequence_iterator(&iterator);
+            free(bases);
+        }
+
+        // Seeking within a PNA sequence, both into and out of N runs
+        {
+            seqio::pna::PnaReader expected_reader("/tmp/seqio_rc.pna");
+            seqio::pna::PnaReader reader("/tmp/seqio_rc.pna", nullptr, engine);
+            auto expected_sequence = expected_reader.openSequence(0);
+            auto sequence = reader.openSequence(0);
+            uint64_t seqlen = sequence->size();
+            string expected(seqlen, '\0');
+            assert(seqlen == expected_sequence->read(&expected[0], seqlen));
+
+            uint64_t const offsets[] = {seqlen / 2, 0, 3, 4, 5, 4097 * 4, seqlen - 30, 1, seqlen};
+            char buf[20000];
+            for(uint64_t offset: offsets) {
+                sequence->seek(offset);
+                uint64_t n = sequence->read(buf, sizeof(buf));
+                assert(n == min(uint64_t(sizeof(buf)), seqlen - offset));
+                assert(0 == memcmp(buf, expected.data() + offset, n));
+            }
+        }
+    }
+}
+
+void test_pna_concurrent() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    rc_fixture();
+
+    // Threads sharing one reader, each opening and seeking its own sequence
+    // readers.
+    for(seqio_io_engine engine: {SEQIO_IO_ENGINE_DEFAULT, SEQIO_IO_ENGINE_PREAD}) {
+        seqio::pna::PnaReader reader("/tmp/seqio_rc.pna", nullptr, engine);
+        vector<string> expected;
+        for(uint64_t i = 0; i < reader.getSequenceCount(); i++) {
+            auto sequence = reader.openSequence(i);
+            string bases(sequence->size(), '\0');
+            assert(bases.size() == sequence->read(&bases[0], bases.size()));
+            expected.push_back(bases);
+        }
+
+        uint32_t const nthreads = 8;
+        vector<std::thread> threads;
+        for(uint32_t t = 0; t < nthreads; t++) {
+            threads.emplace_back([&reader, &expected, t] () {
+                char buf[5000];
+                for(uint64_t j = 0; j < 200; j++) {
+                    uint64_t index = (t + j) % expected.size();
+                    string const &bases = expected[index];
+                    uint64_t offset = ((t + 1) * (j + 1) * 7919) % (bases.size() + 1);
+                    auto sequence = reader.openSequence(index);
+                    sequence->seek(offset);
+                    uint64_t n = sequence->read(buf, sizeof(buf));
+                    assert(n == std::min(uint64_t(sizeof(buf)), bases.size() - offset));
+                    assert(0 == memcmp(buf, bases.data() + offset, n));
+                }
+            });
+        }
+        for(std::thread &t: threads) {
+            t.join();
+        }
+
+        // The same through the C API, with threads opening sequences by name
+        // from one iterator.
+        vector<string> names;
+        for(uint64_t i = 0; i < reader.getSequenceCount(); i++) {
+            names.push_back(reader.getSequenceMetadata(i).value(SEQIO_KEY_NAME));
+        }
+        seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+        options.io_engine = engine;
+        seqio_sequence_iterator iterator;
+        seqio_create_sequence_iterator("/tmp/seqio_rc.pna", options, &iterator);
+        threads.clear();
+        for(uint32_t t = 0; t < nthreads; t++) {
+            threads.emplace_back([iterator, &names, &expected, t] () {
+                char buf[5000];
+                for(uint64_t j = 0; j < 200; j++) {
+                    uint64_t index = (t + j) % expected.size();
+                    string const &bases = expected[index];
+                    uint64_t offset = ((t + 1) * (j + 1) * 7919) % (bases.size() + 1);
+                    seqio_sequence sequence;
+                    seqio_open_sequence(iterator, names[index].c_str(), &sequence);
+                    uint64_t n;
+                    seqio_read_region(sequence, offset, sizeof(buf), buf, &n);
+                    assert(n == std::min(uint64_t(sizeof(buf)), bases.size() - offset));
+                    assert(0 == memcmp(buf, bases.data() + offset, n));
+                    seqio_dispose_sequence(&sequence);
+                }
+            });
+        }
+        for(std::thread &t: threads) {
+            t.join();
+        }
+        seqio_dispose_sequence_iterator(&iterator);
+    }
+}
+
+void test_page_cache() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    rc_fixture();
+    batch_fixture();
+    parallel_fixture();
+    single_pass_fixture();
+    bgzf_fixture();
+    fastq_fixture();
+
+    // Reads at any offset and length come back as asked for, however they're
+    // widened for O_DIRECT. Whether it's O_DIRECT depends on the file system.
+    {
+        char const *path = "/tmp/seqio_parallel.fa";
+        seqio_io_engine const engines[] = {SEQIO_IO_ENGINE_PREAD, SEQIO_IO_ENGINE_URING};
+        for(seqio_io_engine engine: engines) {
+            auto pool = std::make_shared<seqio::impl::IoQueuePool>(nullptr, path, engine, 2, 8192, SEQIO_PAGE_CACHE_BYPASS);
+            if(engine == SEQIO_IO_ENGINE_PREAD)
+                cout << "O_DIRECT " << (pool->getPageCache() == SEQIO_PAGE_CACHE_BYPASS ? "available" : "unavailable") << endl;
+            auto queue = pool->acquire();
+
+            int fd = open(path, O_RDONLY);
+            assert(fd >= 0);
+            uint64_t const file_length = pool->getFileLength();
+            uint64_t const offsets[] = {0, 1, 4095, 4096, 12345, file_length - 100, file_length};
+            uint32_t const lengths[] = {1, 4096, 8192};
+            for(uint64_t offset: offsets) {
+                for(uint32_t length: lengths) {
+                    char expected[8192];
+                    ssize_t n = pread(fd, expected, length, offset);
+                    assert(n >= 0);
+                    uint32_t index = (offset + length) % 2;
+                    assert(uint32_t(n) == queue->read(index, offset, length));
+                    assert(0 == memcmp(expected, queue->getData(index), n));
+                }
+            }
+            close(fd);
+        }
+    }
+
+    char const *paths[] = {"/tmp/seqio_rc.fa", "/tmp/seqio_rc.pna", "/tmp/seqio_batch.pna",
+                           "/tmp/seqio_parallel.fa", "/tmp/seqio_single_pass.fa.gz",
+                           "/tmp/seqio_bgzf.fa.gz", "/tmp/seqio.fq.gz"};
+    seqio_page_cache const modes[] = {SEQIO_PAGE_CACHE_DROP_BEHIND, SEQIO_PAGE_CACHE_BYPASS};
+    for(seqio_page_cache mode: modes) {
+        for(char const *path: paths) {
+            verify_page_cache(path, mode);
+        }
+        verify_page_cache("/tmp/seqio_parallel.fa", mode, 4);
+        verify_page_cache("/tmp/seqio_bgzf.fa.gz", mode, 2);
+
+        // Seeking within an indexed FASTA sequence
+        {
+            seqio_sequence_options opts = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+            opts.index_mode = SEQIO_INDEX_BUILD;
+            opts.page_cache = mode;
+            seqio_sequence_iterator iterator;
+            seqio_sequence sequence;
+            char *bases = create_random_bases(100000, 1);
+            seqio_create_sequence_iterator("/tmp/seqio_single_pass.fa", opts, &iterator);
+            seqio_open_sequence(iterator, "seq1", &sequence);
+            verify_seek(sequence, bases);
+            seqio_dispose_sequence(&sequence);
+            seqio_dispose_sequence_iterator(&iterator);
+            free(bases);
+        }
+    }
+}
+
+void test_multi_iterator() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    rc_fixture();
+    batch_fixture();
+    parallel_fixture();
+    single_pass_fixture();
+    fastq_fixture();
+
+    // A file without sequences between others.
+    SH("printf '' > /tmp/seqio_multi_empty.fa");
+
+    // Each of the formats.
+    vector<char const *> paths = {"/tmp/seqio_rc.fa", "/tmp/seqio_rc.pna", "/tmp/seqio_multi_empty.fa",
+                                  "/tmp/seqio.fq.gz", "/tmp/seqio_single_pass.fa.gz", "input/a.fa",
+                                  "/tmp/seqio_batch.pna"};
+    seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    verify_multi(paths, options);
+    verify_multi({"input/a.fa"}, options);
+    verify_multi({"input/a.fa", "input/a.fa.gz", "/tmp/seqio_parallel.fa"}, options);
+    verify_multi({"input/a.fq", "input/a.fq"}, options);
+
+    // Lengths of scanned records, which have no bases to read.
+    options.scan_mode = SEQIO_SCAN_LENGTHS;
+    verify_multi(paths, options);
+    verify_multi({"input/a.fa", "input/a.pna"}, options);
+    options.scan_mode = SEQIO_SCAN_BASES;
+
+    options.base_transform = SEQIO_BASE_TRANSFORM_CAPS_GATCN;
+    options.strand = SEQIO_STRAND_REVERSE_COMPLEMENT;
+    options.num_threads = 2;
+    verify_multi(paths, options);
+
+    // No files at all.
+    {
+        seqio_sequence_iterator iterator;
+        seqio_sequence sequence;
+        seqio_create_multi_sequence_iterator(nullptr, 0, options, &iterator);
+        seqio_next_sequence(iterator, &sequence);
+        assert(!sequence);
+        seqio_dispose_sequence_iterator(&iterator);
+    }
+
+    // A missing file is reported up front, and only a multi-file iterator
+    // has a file index.
+    {
+        seqio_set_err_handler(SEQIO_ERR_HANDLER_RETURN);
+        seqio_sequence_iterator iterator;
+        char const *missing[] = {"input/a.fa", "/tmp/seqio_no_such_file.fa"};
+        assert(SEQIO_ERR_FILE_NOT_FOUND == seqio_create_multi_sequence_iterator(missing, 2, options, &iterator));
+
+        uint64_t index;
+        seqio_create_sequence_iterator("input/a.fa", options, &iterator);
+        assert(SEQIO_ERR_INVALID_PARAMETER == seqio_get_file_index(iterator, &index));
+        seqio_dispose_sequence_iterator(&iterator);
+        seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+    }
+}
+
+void test_memory() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    rc_fixture();
+    bgzf_fixture();
+    parallel_fixture();
+    fastq_fixture();
+
+    seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    for(char const *path: {"input/a.fa", "input/a.fa.gz", "input/a.fq", "input/a.pna",
+                           "/tmp/seqio_rc.fa", "/tmp/seqio_rc.pna", "/tmp/seqio_bgzf.fa.gz",
+                           "/tmp/seqio.fq.gz", "/tmp/seqio_parallel.fa"}) {
+        verify_memory(path, options);
+    }
+
+    options.base_transform = SEQIO_BASE_TRANSFORM_CAPS_GATCN;
+    options.strand = SEQIO_STRAND_REVERSE_COMPLEMENT;
+    verify_memory("/tmp/seqio_rc.fa", options);
+    verify_memory("/tmp/seqio_rc.pna", options);
+
+    options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    options.num_threads = 2;
+    verify_memory("/tmp/seqio_parallel.fa", options);
+    options.record_order = SEQIO_RECORD_ORDER_ANY;
+    verify_memory("input/a.fa", options);
+
+    // No content at all, and content that can't be opened by name.
+    {
+        seqio_sequence_iterator iterator;
+        seqio_sequence sequence;
+        seqio_create_sequence_iterator_from_memory(nullptr, 0, SEQIO_DEFAULT_SEQUENCE_OPTIONS, &iterator);
+        seqio_next_sequence(iterator, &sequence);
+        assert(!sequence);
+        seqio_dispose_sequence_iterator(&iterator);
+
+        seqio_set_err_handler(SEQIO_ERR_HANDLER_RETURN);
+        char const fasta[] = ">a\nACGT\n";
+        seqio_create_sequence_iterator_from_memory(fasta, strlen(fasta), SEQIO_DEFAULT_SEQUENCE_OPTIONS, &iterator);
+        assert(SEQIO_ERR_INVALID_STATE == seqio_open_sequence(iterator, "a", &sequence));
+        seqio_dispose_sequence_iterator(&iterator);
+
+        // Too short for a PNA header.
+        options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+        options.file_format = SEQIO_FILE_FORMAT_PNA;
+        assert(SEQIO_ERR_IO == seqio_create_sequence_iterator_from_memory("PNA", 4, options, &iterator));
+        seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+    }
+}
+
+void test_io_backend() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    bgzf_fixture();
+    fastq_fixture();
+
+    map<string, string> files;
+    seqio_io_backend memory = create_memory_backend(&files);
+
+    for(char const *path: {"input/a.fa", "input/a.fa.gz", "input/a.fq", "input/a.pna",
+                           "/tmp/seqio_bgzf.fa.gz", "/tmp/seqio.fq.gz"}) {
+        verify_io_backend(path, &memory, &files);
+    }
+
+    // Engines, page cache modes and threads that need file descriptors are
+    // quietly done without, and indexes are only built in memory.
+    {
+        seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+        options.io_engine = SEQIO_IO_ENGINE_URING;
+        options.page_cache = SEQIO_PAGE_CACHE_BYPASS;
+        verify_io_backend("input/a.pna", &memory, &files, options);
+        options.num_threads = 2;
+        verify_io_backend("input/a.fa", &memory, &files, options);
+        verify_io_backend("/tmp/seqio_bgzf.fa.gz", &memory, &files, options);
+
+        options.index_mode = SEQIO_INDEX_BUILD;
+        options.io_backend = &memory;
+        seqio_sequence_iterator iterator;
+        seqio_sequence sequence;
+        seqio_create_sequence_iterator("input/a.fa", options, &iterator);
+        seqio_open_sequence(iterator, "seq2", &sequence);
+        seqio_dispose_sequence(&sequence);
+        seqio_dispose_sequence_iterator(&iterator);
+        assert(!files.count("input/a.fa.fai"));
+    }
+
+    // A backend that reads real files, but can't be told apart from one
+    // that doesn't.
+    {
+        seqio_io_backend counting = create_counting_backend();
+        seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+        options.num_threads = 2;
+        for(char const *path: {"input/a.fa", "input/a.pna", "/tmp/seqio_bgzf.fa.gz"}) {
+            uint64_t reads = get_counted_reads();
+            verify_io_backend(path, &counting, nullptr, options);
+            assert(get_counted_reads() > reads);
+        }
+    }
+
+    for(auto format: {SEQIO_FILE_FORMAT_FASTA, SEQIO_FILE_FORMAT_FASTA_GZIP, SEQIO_FILE_FORMAT_PNA}) {
+        verify_io_backend_write(format, "/tmp/seqio_io_backend/out", &memory);
+    }
+
+    // What couldn't be stored is reported when the writer is disposed of.
+    for(bool fail_write: {true, false}) {
+        seqio_io_backend failing = create_failing_backend(&files, fail_write);
+        seqio_set_err_handler(SEQIO_ERR_HANDLER_RETURN);
+        for(auto format: {SEQIO_FILE_FORMAT_FASTA, SEQIO_FILE_FORMAT_FASTA_GZIP, SEQIO_FILE_FORMAT_PNA}) {
+            seqio_writer_options writer_options = {format, &failing};
+            seqio_writer writer;
+            assert(SEQIO_SUCCESS == seqio_create_writer("/tmp/seqio_io_backend/out", writer_options, &writer));
+            seqio_dictionary metadata;
+            seqio_create_dictionary(&metadata);
+            seqio_set_value(metadata, SEQIO_KEY_NAME, "seq1");
+            assert(SEQIO_SUCCESS == seqio_create_sequence(writer, metadata));
+            assert(SEQIO_SUCCESS == seqio_write(writer, "ACGT", 4));
+            seqio_dispose_dictionary(&metadata);
+            assert(SEQIO_ERR_IO == seqio_dispose_writer(&writer));
+            assert(!writer);
+        }
+        seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+    }
+
+    // Several files, one of which the backend doesn't have.
+    {
+        vector<char const *> paths = {"input/a.fa", "input/a.pna"};
+        seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+        options.io_backend = &memory;
+        verify_multi(paths, options);
+
+        seqio_set_err_handler(SEQIO_ERR_HANDLER_RETURN);
+        seqio_sequence_iterator iterator;
+        paths.push_back("input/a.fq.gz");
+        assert(SEQIO_ERR_FILE_NOT_FOUND == seqio_create_multi_sequence_iterator(paths.data(), paths.size(), options, &iterator));
+        assert(SEQIO_ERR_FILE_NOT_FOUND == seqio_create_sequence_iterator("input/a.fq.gz", options, &iterator));
+        seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+    }
+}
+
+void test_scan() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    headers_fixture();
+    fastq_fixture();
+    batch_fixture();
+    rc_fixture();
+    bgzf_fixture();
+    parallel_fixture();
+
+    for(char const *path: {"input/a.fa", "input/a.fa.gz", "input/a.fq", "input/a.pna",
+                           "/tmp/seqio_headers.fa", "/tmp/seqio_headers.fa.gz", "/tmp/seqio.fq",
+                           "/tmp/seqio_batch.fa", "/tmp/seqio_batch.pna", "/tmp/seqio_rc.fa",
+                           "/tmp/seqio_bgzf.fa.gz"}) {
+        verify_scan(path);
+    }
+
+    seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    options.num_threads = 4;
+    verify_scan("/tmp/seqio_parallel.fa", options);
+    options.strand = SEQIO_STRAND_REVERSE_COMPLEMENT;
+    verify_scan("input/a.pna", options);
+
+    // '>' that doesn't begin a line, and a record without bases.
+    {
+        FILE *f = fopen("/tmp/seqio_scan.fa", "w");
+        fputs(">a x>y\nAC>GT\n>>b\n> c\n\n>d\nA C\tG\n", f);
+        fclose(f);
+        verify_scan("/tmp/seqio_scan.fa");
+    }
+
+    // Lengths are otherwise only known up front with an index.
+    {
+        seqio_sequence_iterator iterator;
+        seqio_sequence sequence;
+        uint64_t length;
+        seqio_create_sequence_iterator("input/a.fa", SEQIO_DEFAULT_SEQUENCE_OPTIONS, &iterator);
+        seqio_next_sequence(iterator, &sequence);
+        seqio_set_err_handler(SEQIO_ERR_HANDLER_RETURN);
+        assert(SEQIO_ERR_INVALID_STATE == seqio_get_length(sequence, &length));
+        seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+        seqio_dispose_sequence(&sequence);
+        seqio_dispose_sequence_iterator(&iterator);
+
+        seqio_create_sequence_iterator("input/a.pna", SEQIO_DEFAULT_SEQUENCE_OPTIONS, &iterator);
+        seqio_next_sequence(iterator, &sequence);
+        seqio_get_length(sequence, &length);
+        char *buf = nullptr;
+        uint64_t buflen, seqlen;
+        seqio_read_all(sequence, &buf, &buflen, &seqlen);
+        assert(length == seqlen);
+        seqio_dispose_buffer(&buf);
+        seqio_dispose_sequence(&sequence);
+        seqio_dispose_sequence_iterator(&iterator);
+    }
+}
+
+void test_filter() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    batch_fixture();
+    headers_fixture();
+    fastq_fixture();
+    rc_fixture();
+    parallel_fixture();
+
+    for(char const *path: {"input/a.fa", "input/a.pna", "/tmp/seqio_batch.fa", "/tmp/seqio_batch.pna",
+                           "/tmp/seqio_headers.fa.gz", "/tmp/seqio.fq", "/tmp/seqio_rc.fa"}) {
+        verify_filter(path);
+    }
+
+    seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    options.strand = SEQIO_STRAND_REVERSE_COMPLEMENT;
+    verify_filter("/tmp/seqio_rc.fa", options);
+    verify_filter("/tmp/seqio_batch.pna", options);
+    options.strand = SEQIO_STRAND_FORWARD;
+    options.index_mode = SEQIO_INDEX_BUILD;
+    verify_filter("/tmp/seqio_batch.fa", options);
+    options.index_mode = SEQIO_INDEX_NONE;
+    options.num_threads = 4;
+    verify_filter("/tmp/seqio_parallel.fa", options);
+
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_RETURN);
+    seqio_sequence_iterator iterator;
+    options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    options.name_regex = "(";
+    assert(SEQIO_ERR_INVALID_PARAMETER == seqio_create_sequence_iterator("input/a.fa", options, &iterator));
+    options.name_regex = nullptr;
+    options.min_length = 10;
+    options.max_length = 5;
+    assert(SEQIO_ERR_INVALID_PARAMETER == seqio_create_sequence_iterator("input/a.pna", options, &iterator));
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+}
+
+void test_seek() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    rc_fixture();
+    bgzf_fixture();
+    fastq_fixture();
+    parallel_fixture();
+
+    // PNA, mapped and read through a queue, FASTQ, and FASTA parsed on several
+    // threads, along both strands.
+    seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    for(seqio_strand strand: {SEQIO_STRAND_FORWARD, SEQIO_STRAND_REVERSE_COMPLEMENT}) {
+        options.strand = strand;
+        for(seqio_io_engine engine: {SEQIO_IO_ENGINE_DEFAULT, SEQIO_IO_ENGINE_PREAD}) {
+            options.io_engine = engine;
+            verify_seek_all("/tmp/seqio_rc.pna", options);
+            verify_seek_all("input/a.pna", options);
+        }
+        options.io_engine = SEQIO_IO_ENGINE_DEFAULT;
+        verify_seek_all("/tmp/seqio.fq", options);
+        options.num_threads = 2;
+        verify_seek_all("/tmp/seqio_parallel.fa", options);
+        options.num_threads = 1;
+        // Indexed FASTA, uncompressed, BGZF and plain gzip.
+        options.index_mode = SEQIO_INDEX_BUILD;
+        for(char const *path: {"/tmp/seqio_rc.fa", "/tmp/seqio_bgzf.fa.gz", "/tmp/seqio_rc.fa.gz"}) {
+            verify_seek_all(path, options);
+        }
+        options.index_mode = SEQIO_INDEX_NONE;
+    }
+
+    // Sequences that can't seek, and offsets past the end.
+    {
+        seqio_sequence_iterator iterator;
+        seqio_sequence sequence;
+        char buf[10];
+        uint64_t length;
+        options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+        seqio_set_err_handler(SEQIO_ERR_HANDLER_RETURN);
+
+        seqio_create_sequence_iterator("input/a.fa", options, &iterator);
+        seqio_next_sequence(iterator, &sequence);
+        assert(SEQIO_ERR_INVALID_STATE == seqio_seek(sequence, 0));
+        assert(SEQIO_ERR_INVALID_STATE == seqio_read_region(sequence, 0, sizeof(buf), buf, &length));
+        seqio_dispose_sequence(&sequence);
+        seqio_dispose_sequence_iterator(&iterator);
+
+        for(char const *path: {"input/a.pna", "/tmp/seqio.fq"}) {
+            options.scan_mode = SEQIO_SCAN_LENGTHS;
+            seqio_create_sequence_iterator(path, options, &iterator);
+            seqio_next_sequence(iterator, &sequence);
+            assert(SEQIO_ERR_INVALID_STATE == seqio_seek(sequence, 0));
+            seqio_dispose_sequence(&sequence);
+            seqio_dispose_sequence_iterator(&iterator);
+
+            options.scan_mode = SEQIO_SCAN_BASES;
+            seqio_create_sequence_iterator(path, options, &iterator);
+            seqio_next_sequence(iterator, &sequence);
+            seqio_get_length(sequence, &length);
+            assert(SEQIO_SUCCESS == seqio_seek(sequence, length));
+            assert(SEQIO_ERR_INVALID_PARAMETER == seqio_seek(sequence, length + 1));
+            assert(SEQIO_ERR_INVALID_PARAMETER == seqio_read_region(sequence, length + 1, 1, buf, &length));
+            seqio_dispose_sequence(&sequence);
+            seqio_dispose_sequence_iterator(&iterator);
+        }
+
+        seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+    }
+}
+
+void test_packed() {
+    seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+    batch_fixture();
+    rc_fixture();
+
+    // Mapped, and read through a queue.
+    seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    for(seqio_io_engine engine: {SEQIO_IO_ENGINE_DEFAULT, SEQIO_IO_ENGINE_PREAD}) {
+        options.io_engine = engine;
+        for(char const *path: {"input/a.pna", "/tmp/seqio_batch.pna", "/tmp/seqio_rc.pna"}) {
+            verify_packed(path, options);
+        }
+    }
+
+    // Always the forward strand.
+    options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    options.strand = SEQIO_STRAND_REVERSE_COMPLEMENT;
+    verify_packed("/tmp/seqio_rc.pna", options);
+
+    // Formats without packed bases, and scanned sequences.
+    {
+        seqio_sequence_iterator iterator;
+        seqio_sequence sequence;
+        seqio_packed_sequence packed;
+        options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+        options.scan_mode = SEQIO_SCAN_LENGTHS;
+        seqio_set_err_handler(SEQIO_ERR_HANDLER_RETURN);
+        for(char const *path: {"input/a.fa", "input/a.fq"}) {
+            seqio_create_sequence_iterator(path, SEQIO_DEFAULT_SEQUENCE_OPTIONS, &iterator);
+            seqio_next_sequence(iterator, &sequence);
+            assert(SEQIO_ERR_INVALID_STATE == seqio_get_packed(sequence, &packed));
+            seqio_dispose_sequence(&sequence);
+            seqio_dispose_sequence_iterator(&iterator);
+        }
+        seqio_create_sequence_iterator("input/a.pna", options, &iterator);
+        seqio_next_sequence(iterator, &sequence);
+        assert(SEQIO_ERR_INVALID_STATE == seqio_get_packed(sequence, &packed));
+        assert(SEQIO_ERR_INVALID_PARAMETER == seqio_get_packed(sequence, nullptr));
+        seqio_dispose_sequence(&sequence);
+        seqio_dispose_sequence_iterator(&iterator);
+        seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+    }
+}
+
 void test_pna_write() {
     seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
 
@@ -115,8 +1535,12 @@ int main(int argc, const char **argv) {
     test_return_err_handler();
 
     test_fasta_transform_caps_gatcn();
+    test_transform_caps_gatcn__exhaustive();
+    test_count_graph__exhaustive();
+    test_unpack_2bit__exhaustive();
 
     test_pna_write();
+    test_fasta_headers();
     test_fasta_write();
 
     test_read_all__small();
@@ -128,6 +1552,32 @@ int main(int argc, const char **argv) {
     test_fasta_plain__out_of_order();
     test_fasta_gzip__out_of_order();
 
+    test_fasta_single_pass();
+    test_fasta_fai();
+    test_fasta_bgzf();
+
+    test_fastq_plain__sequential();
+    test_fastq_gzip__sequential();
+    test_fastq_plain__out_of_order();
+    test_fastq_quality();
+    test_fastq_layouts();
+
+    test_batch();
+    test_fasta_parallel();
+    test_read_ahead();
+    test_io_engine();
+    test_pna_concurrent();
+    test_page_cache();
+    test_multi_iterator();
+    test_memory();
+    test_io_backend();
+    test_scan();
+    test_filter();
+    test_seek();
+    test_packed();
+    test_reverse_complement_caps_gatcn__exhaustive();
+    test_reverse_complement();
+
     cout << "Test successful." << endl;
 
     return 0;
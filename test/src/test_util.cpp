@@ -1,11 +1,18 @@
 #include "test_util.hpp"
 
+#include "fasta.hpp"
+
 #include <assert.h>
+#include <errno.h>
+#include <regex.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/resource.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cstring>
+#include <map>
 #include <random>
 #include <vector>
 
@@ -273,3 +280,829 @@ void verify_write(seqio_file_format file_format, char const *path) {
 
     free(seq);    
 }
+
+void verify_single_pass(char const *path, uint64_t file_size) {
+    seqio_sequence_iterator iterator;
+    seqio_create_sequence_iterator(path,
+                                   SEQIO_DEFAULT_SEQUENCE_OPTIONS,
+                                   &iterator);
+    seqio::impl::FastaSequenceIterator *fasta_iterator =
+        dynamic_cast<seqio::impl::FastaSequenceIterator *>((seqio::impl::ISequenceIterator *)iterator);
+    assert(fasta_iterator);
+
+    uint64_t const seqlen = 100 * 1000;
+    vector<char *> bases;
+    vector<seqio_sequence> partially_read;
+    uint64_t bytes_read = 0;
+    char buf[1000];
+    uint64_t read_length;
+
+    // Mix reading sequences fully, partially and not at all.
+    for(int i = 0; ; i++) {
+        seqio_sequence sequence;
+        seqio_next_sequence(iterator, &sequence);
+
+        assert(fasta_iterator->getBytesRead() >= bytes_read);
+        bytes_read = fasta_iterator->getBytesRead();
+        assert(bytes_read <= file_size);
+
+        if(!sequence)
+            break;
+
+        bases.push_back(create_random_bases(seqlen, i + 1));
+
+        switch(i % 4) {
+        case 0:
+            verify_bases(sequence, bases[i], sizeof(buf));
+            seqio_dispose_sequence(&sequence);
+            break;
+        case 1:
+            seqio_read(sequence, buf, sizeof(buf), &read_length);
+            assert(read_length == sizeof(buf));
+            assert(0 == strncmp(buf, bases[i], sizeof(buf)));
+            partially_read.push_back(sequence);
+            break;
+        case 2:
+            seqio_dispose_sequence(&sequence);
+            break;
+        case 3:
+            seqio_read(sequence, buf, sizeof(buf), &read_length);
+            seqio_dispose_sequence(&sequence);
+            break;
+        }
+    }
+
+    // Every byte was read exactly once.
+    assert(bytes_read == file_size);
+
+    // Sequences the iterator moved past can still be read.
+    for(size_t i = 0; i < partially_read.size(); i++) {
+        verify_bases(partially_read[i], bases[(i * 4) + 1] + sizeof(buf), sizeof(buf));
+        seqio_dispose_sequence(&partially_read[i]);
+    }
+    assert(fasta_iterator->getBytesRead() == file_size);
+
+    seqio_dispose_sequence_iterator(&iterator);
+
+    for(char *seq: bases)
+        free(seq);
+}
+
+void verify_seek(seqio_sequence sequence, char const *bases) {
+    uint64_t seqlen = strlen(bases);
+    uint64_t offsets[] = {seqlen, seqlen / 2, 0, 79, 80, 81, seqlen - 1, 1};
+    char buf[100];
+    uint64_t read_length;
+
+    for(uint64_t offset: offsets) {
+        if(offset > seqlen)
+            continue;
+
+        seqio_seek(sequence, offset);
+        seqio_read(sequence, buf, sizeof(buf), &read_length);
+        assert(read_length == min(uint64_t(sizeof(buf)), seqlen - offset));
+        assert(0 == strncmp(buf, bases + offset, read_length));
+
+        // A region, which is read in full, and reading continues after it.
+        uint64_t length = min(uint64_t(sizeof(buf)) / 2, seqlen - offset);
+        seqio_read_region(sequence, offset, length, buf, &read_length);
+        assert(read_length == length);
+        assert(0 == strncmp(buf, bases + offset, read_length));
+        seqio_read(sequence, buf, sizeof(buf), &read_length);
+        assert(read_length == min(uint64_t(sizeof(buf)), seqlen - offset - length));
+        assert(0 == strncmp(buf, bases + offset + length, read_length));
+
+        // Past the end of the sequence.
+        seqio_read_region(sequence, offset, sizeof(buf), buf, &read_length);
+        assert(read_length == min(uint64_t(sizeof(buf)), seqlen - offset));
+    }
+
+    // The rest of the sequence, in reads smaller than whatever is read from
+    // the file at a time.
+    uint64_t offset = seqlen / 3;
+    string rest;
+    seqio_seek(sequence, offset);
+    do {
+        seqio_read(sequence, buf, sizeof(buf), &read_length);
+        rest.append(buf, read_length);
+    } while(read_length > 0);
+    assert(rest == bases + offset);
+}
+
+// Compares batches against reading the same file a sequence at a time.
+void verify_batch(char const *path,
+                  uint64_t max_records,
+                  seqio_sequence_options options) {
+    seqio_sequence_iterator iterator, batch_iterator;
+    seqio_create_sequence_iterator(path, options, &iterator);
+    seqio_create_sequence_iterator(path, options, &batch_iterator);
+
+    seqio_batch batch = SEQIO_EMPTY_BATCH;
+    char *buf = nullptr;
+    uint64_t buflen;
+    uint64_t nrecords = 0;
+
+    while(true) {
+        seqio_next_batch(batch_iterator, max_records, &batch);
+        assert(batch.count <= max_records);
+        if(batch.count == 0)
+            break;
+
+        for(uint64_t i = 0; i < batch.count; i++) {
+            seqio_sequence sequence;
+            seqio_next_sequence(iterator, &sequence);
+            assert(sequence);
+
+            char const *name = batch.arena + batch.names[i].offset;
+            char const *comment = batch.arena + batch.comments[i].offset;
+            assert(strlen(name) == batch.names[i].length);
+            assert(strlen(comment) == batch.comments[i].length);
+            verify_basic_metadata(sequence, name, comment);
+
+            uint64_t seqlen;
+            seqio_read_all(sequence, &buf, &buflen, &seqlen);
+            assert(seqlen == batch.bases[i].length);
+            assert(seqlen == batch.lengths[i]);
+            assert(0 == memcmp(buf, batch.arena + batch.bases[i].offset, seqlen));
+            assert(batch.arena[batch.bases[i].offset + seqlen] == '\0');
+
+            char const *quality;
+            uint64_t quality_length = 0;
+            seqio_set_err_handler(SEQIO_ERR_HANDLER_RETURN);
+            if(SEQIO_SUCCESS == seqio_get_quality(sequence, &quality, &quality_length)) {
+                assert(0 == memcmp(quality, batch.arena + batch.qualities[i].offset, quality_length));
+            }
+            seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+            assert(quality_length == batch.qualities[i].length);
+
+            seqio_dispose_sequence(&sequence);
+            nrecords++;
+        }
+    }
+
+    seqio_sequence sequence;
+    seqio_next_sequence(iterator, &sequence);
+    assert(!sequence);
+    assert(nrecords > 0);
+
+    seqio_dispose_batch(&batch);
+    assert(!batch.arena);
+    seqio_dispose_buffer(&buf);
+    seqio_dispose_sequence_iterator(&iterator);
+    seqio_dispose_sequence_iterator(&batch_iterator);
+}
+
+string reverse_complement(string const &bases) {
+    string result;
+    for(auto it = bases.rbegin(); it != bases.rend(); ++it) {
+        char const pairs[] = "ATCGRYKMBVDHatcgrykmbvdh";
+        char const *p = strchr(pairs, *it);
+        if(*it == 'U')
+            result += 'A';
+        else if(*it == 'u')
+            result += 'a';
+        else if(p)
+            result += pairs[(p - pairs) ^ 1];
+        else
+            result += *it;
+    }
+    return result;
+}
+
+// Compares reading every sequence of a file as its reverse complement against
+// reading it forward.
+void verify_reverse_complement(char const *path, seqio_base_transform base_transform) {
+    seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    options.base_transform = base_transform;
+    seqio_sequence_iterator forward_iterator, iterator;
+    seqio_create_sequence_iterator(path, options, &forward_iterator);
+    options.strand = SEQIO_STRAND_REVERSE_COMPLEMENT;
+    seqio_create_sequence_iterator(path, options, &iterator);
+
+    uint64_t const buflens[] = {1, 3, 4, 5, 4096, 1024 * 1024};
+    char *buf = nullptr;
+    uint64_t buflen;
+    uint64_t nsequences = 0;
+
+    while(true) {
+        seqio_sequence forward, sequence;
+        seqio_next_sequence(forward_iterator, &forward);
+        seqio_next_sequence(iterator, &sequence);
+        assert(!forward == !sequence);
+        if(!sequence)
+            break;
+
+        uint64_t seqlen;
+        seqio_read_all(forward, &buf, &buflen, &seqlen);
+        string expected = reverse_complement(string(buf, seqlen));
+        verify_bases(sequence, expected.c_str(), buflens[nsequences % 6]);
+
+        char const *quality, *forward_quality;
+        uint64_t length, forward_length;
+        seqio_set_err_handler(SEQIO_ERR_HANDLER_RETURN);
+        if(SEQIO_SUCCESS == seqio_get_quality(forward, &forward_quality, &forward_length)) {
+            string reversed(forward_quality, forward_length);
+            reverse(reversed.begin(), reversed.end());
+            seqio_get_quality(sequence, &quality, &length);
+            assert(string(quality, length) == reversed);
+        }
+        seqio_set_err_handler(SEQIO_ERR_HANDLER_ABORT);
+
+        seqio_dispose_sequence(&forward);
+        seqio_dispose_sequence(&sequence);
+        nsequences++;
+    }
+    assert(nsequences > 0);
+
+    seqio_dispose_buffer(&buf);
+    seqio_dispose_sequence_iterator(&forward_iterator);
+    seqio_dispose_sequence_iterator(&iterator);
+
+    verify_batch(path, 16, options);
+}
+
+typedef vector<string> record_t;
+
+// Name, comment and bases of every remaining record of an iterator, and
+// for a multi-file iterator the file each came from.
+static vector<record_t> read_records(seqio_sequence_iterator iterator,
+                                     vector<uint64_t> *file_indexes = nullptr) {
+    vector<record_t> records;
+    char *buf = nullptr;
+    uint64_t buflen;
+    while(true) {
+        seqio_sequence sequence;
+        seqio_next_sequence(iterator, &sequence);
+        if(!sequence)
+            break;
+
+        seqio_const_dictionary dict;
+        seqio_get_metadata(sequence, &dict);
+        char const *name, *comment;
+        seqio_get_value(dict, SEQIO_KEY_NAME, &name);
+        seqio_get_value(dict, SEQIO_KEY_COMMENT, &comment);
+        uint64_t seqlen;
+        seqio_read_all(sequence, &buf, &buflen, &seqlen);
+        records.push_back({name, comment, string(buf, seqlen)});
+        if(file_indexes) {
+            uint64_t index;
+            seqio_get_file_index(iterator, &index);
+            file_indexes->push_back(index);
+        }
+
+        seqio_dispose_sequence(&sequence);
+    }
+
+    seqio_dispose_buffer(&buf);
+    return records;
+}
+
+// Name, comment and bases of every record in a file.
+static vector<record_t> read_records(char const *path,
+                                     seqio_sequence_options const &options) {
+    seqio_sequence_iterator iterator;
+    seqio_create_sequence_iterator(path, options, &iterator);
+    vector<record_t> records = read_records(iterator);
+    seqio_dispose_sequence_iterator(&iterator);
+    return records;
+}
+
+// Compares parsing a file on several threads against parsing it serially,
+// record for record when in file order.
+void verify_parallel(char const *path, seqio_sequence_options options) {
+    seqio_sequence_options serial_options = options;
+    serial_options.num_threads = 1;
+    vector<record_t> expected = read_records(path, serial_options);
+    vector<record_t> records = read_records(path, options);
+    assert(!expected.empty());
+
+    if(options.record_order == SEQIO_RECORD_ORDER_ANY) {
+        sort(expected.begin(), expected.end());
+        sort(records.begin(), records.end());
+    }
+    assert(records == expected);
+
+    if(options.record_order == SEQIO_RECORD_ORDER_FILE)
+        verify_batch(path, 16, options);
+}
+
+// Compares reading a file with the given options against the defaults,
+// including reading a sequence after the iterator has moved past it.
+static void verify_same_records(char const *path, seqio_sequence_options const &options) {
+    seqio_sequence_options default_options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    default_options.strand = options.strand;
+    vector<record_t> expected = read_records(path, default_options);
+    vector<record_t> records = read_records(path, options);
+    assert(expected.size() > 1);
+    assert(records == expected);
+
+    seqio_sequence_iterator iterator;
+    seqio_sequence first, second;
+    seqio_create_sequence_iterator(path, options, &iterator);
+    seqio_next_sequence(iterator, &first);
+    seqio_next_sequence(iterator, &second);
+    verify_bases(second, expected[1][2].c_str(), 4096);
+    verify_bases(first, expected[0][2].c_str(), 4096);
+    seqio_dispose_sequence(&first);
+    seqio_dispose_sequence(&second);
+    seqio_dispose_sequence_iterator(&iterator);
+}
+
+void verify_read_ahead(char const *path, uint32_t nbuffers) {
+    seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    options.read_ahead_buffers = nbuffers;
+    verify_same_records(path, options);
+}
+
+// Name, comment, bases, qualities and length of every record in batches of
+// up to max_records.
+static vector<record_t> read_batch_fields(seqio_sequence_iterator iterator, uint64_t max_records) {
+    seqio_batch batch = SEQIO_EMPTY_BATCH;
+    vector<record_t> records;
+    while( (SEQIO_SUCCESS == seqio_next_batch(iterator, max_records, &batch)) && batch.count ) {
+        for(uint64_t i = 0; i < batch.count; i++) {
+            records.push_back({string(batch.arena + batch.names[i].offset, batch.names[i].length),
+                               string(batch.arena + batch.comments[i].offset, batch.comments[i].length),
+                               string(batch.arena + batch.bases[i].offset, batch.bases[i].length),
+                               string(batch.arena + batch.qualities[i].offset, batch.qualities[i].length),
+                               to_string(batch.lengths[i])});
+        }
+    }
+    seqio_dispose_batch(&batch);
+    return records;
+}
+
+// Compares reading files with one iterator against reading each with its
+// own, both by sequence and by batch.
+void verify_multi(vector<char const *> const &paths, seqio_sequence_options const &options) {
+    vector<record_t> expected;
+    vector<uint64_t> expected_indexes;
+    for(uint64_t i = 0; i < paths.size(); i++) {
+        vector<record_t> records = read_records(paths[i], options);
+        expected.insert(expected.end(), records.begin(), records.end());
+        expected_indexes.insert(expected_indexes.end(), records.size(), i);
+    }
+
+    seqio_sequence_iterator iterator;
+    seqio_create_multi_sequence_iterator(paths.data(), paths.size(), options, &iterator);
+    vector<uint64_t> indexes;
+    assert(read_records(iterator, &indexes) == expected);
+    assert(indexes == expected_indexes);
+    seqio_dispose_sequence_iterator(&iterator);
+
+    // Batches that span files, including the first record of each file,
+    // which the iterator has already opened as a sequence.
+    vector<record_t> expected_batch;
+    for(char const *path: paths) {
+        seqio_create_sequence_iterator(path, options, &iterator);
+        vector<record_t> records = read_batch_fields(iterator, 7);
+        expected_batch.insert(expected_batch.end(), records.begin(), records.end());
+        seqio_dispose_sequence_iterator(&iterator);
+    }
+    assert(expected_batch.size() == expected.size());
+    for(uint64_t i = 0; i < expected.size(); i++) {
+        assert(record_t(expected_batch[i].begin(), expected_batch[i].begin() + 3) == expected[i]);
+    }
+    seqio_create_multi_sequence_iterator(paths.data(), paths.size(), options, &iterator);
+    assert(read_batch_fields(iterator, 7) == expected_batch);
+    seqio_dispose_sequence_iterator(&iterator);
+
+    // Disposed before reaching the end, with the next file being prefetched.
+    seqio_create_multi_sequence_iterator(paths.data(), paths.size(), options, &iterator);
+    seqio_sequence sequence;
+    seqio_next_sequence(iterator, &sequence);
+    seqio_dispose_sequence_iterator(&iterator);
+    verify_bases(sequence, expected[0][2].c_str(), 4096);
+    seqio_dispose_sequence(&sequence);
+}
+
+// Compares reading a file's content from memory against reading the file,
+// including reading a sequence after the iterator has moved past it. The
+// content is copied to an odd address, which nothing may depend on.
+void verify_memory(char const *path, seqio_sequence_options const &options) {
+    vector<record_t> expected = read_records(path, options);
+    assert(!expected.empty());
+
+    string content;
+    {
+        FILE *f = fopen(path, "r");
+        assert(f);
+        char buf[64 * 1024];
+        size_t n;
+        while( (n = fread(buf, 1, sizeof(buf), f)) > 0 )
+            content.append(buf, n);
+        fclose(f);
+    }
+    vector<char> storage(content.size() + 1);
+    char *data = storage.data() + 1;
+    memcpy(data, content.data(), content.size());
+
+    seqio_sequence_iterator iterator;
+    seqio_create_sequence_iterator_from_memory(data, content.size(), options, &iterator);
+    assert(read_records(iterator) == expected);
+    seqio_dispose_sequence_iterator(&iterator);
+
+    if(expected.size() > 1) {
+        seqio_sequence first, second;
+        seqio_create_sequence_iterator_from_memory(data, content.size(), options, &iterator);
+        seqio_next_sequence(iterator, &first);
+        seqio_next_sequence(iterator, &second);
+        verify_bases(second, expected[1][2].c_str(), 4096);
+        verify_bases(first, expected[0][2].c_str(), 4096);
+        seqio_dispose_sequence(&first);
+        seqio_dispose_sequence(&second);
+        seqio_dispose_sequence_iterator(&iterator);
+    }
+}
+
+void verify_io_engine(char const *path, seqio_io_engine io_engine) {
+    seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    options.io_engine = io_engine;
+    verify_same_records(path, options);
+    options.strand = SEQIO_STRAND_REVERSE_COMPLEMENT;
+    verify_same_records(path, options);
+}
+
+void verify_page_cache(char const *path, seqio_page_cache page_cache, uint32_t num_threads) {
+    seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    options.page_cache = page_cache;
+    options.num_threads = num_threads;
+    verify_same_records(path, options);
+    options.io_engine = SEQIO_IO_ENGINE_URING;
+    verify_same_records(path, options);
+}
+
+// A file held by the memory backend, and the position of a handle to it.
+struct memory_handle_t {
+    string *content;
+    uint64_t position;
+};
+
+static void *memory_open(void *context, char const *path, int writable) {
+    map<string, string> &files = *(map<string, string> *)context;
+    if(writable) {
+        files[path].clear();
+    } else if(!files.count(path)) {
+        errno = ENOENT;
+        return nullptr;
+    }
+    return new memory_handle_t{&files[path], 0};
+}
+
+static int64_t memory_pread(void *handle, void *buffer, uint64_t length, uint64_t offset) {
+    string const &content = *((memory_handle_t *)handle)->content;
+    if(offset >= content.size())
+        return 0;
+    length = min(length, uint64_t(content.size() - offset));
+    memcpy(buffer, content.data() + offset, length);
+    return length;
+}
+
+static int64_t memory_read(void *handle, void *buffer, uint64_t length) {
+    memory_handle_t *h = (memory_handle_t *)handle;
+    int64_t n = memory_pread(handle, buffer, length, h->position);
+    h->position += n;
+    return n;
+}
+
+static int memory_seek(void *handle, uint64_t offset) {
+    ((memory_handle_t *)handle)->position = offset;
+    return 0;
+}
+
+static int64_t memory_write(void *handle, void const *buffer, uint64_t length) {
+    memory_handle_t *h = (memory_handle_t *)handle;
+    if(h->content->size() < h->position + length)
+        h->content->resize(h->position + length);
+    memcpy(&(*h->content)[h->position], buffer, length);
+    h->position += length;
+    return length;
+}
+
+static int64_t memory_size(void *handle) {
+    return ((memory_handle_t *)handle)->content->size();
+}
+
+static int memory_close(void *handle) {
+    delete (memory_handle_t *)handle;
+    return 0;
+}
+
+seqio_io_backend create_memory_backend(map<string, string> *files) {
+    return {files, memory_open, memory_read, memory_pread, memory_seek,
+            memory_write, memory_size, memory_close};
+}
+
+// The memory backend on a device that's full, or whose files can't be
+// closed.
+static int64_t full_write(void *handle, void const *buffer, uint64_t length) {
+    errno = ENOSPC;
+    return -1;
+}
+
+static int failing_close(void *handle) {
+    memory_close(handle);
+    errno = EIO;
+    return -1;
+}
+
+seqio_io_backend create_failing_backend(map<string, string> *files, bool fail_write) {
+    seqio_io_backend backend = create_memory_backend(files);
+    if(fail_write)
+        backend.write = full_write;
+    else
+        backend.close = failing_close;
+    return backend;
+}
+
+// SEQIO_FILE_IO_BACKEND with every read counted, which the library can't
+// tell apart from a backend without file descriptors.
+static atomic<uint64_t> counted_reads(0);
+
+static int64_t counted_read(void *handle, void *buffer, uint64_t length) {
+    counted_reads++;
+    return SEQIO_FILE_IO_BACKEND.read(handle, buffer, length);
+}
+
+static int64_t counted_pread(void *handle, void *buffer, uint64_t length, uint64_t offset) {
+    counted_reads++;
+    return SEQIO_FILE_IO_BACKEND.pread(handle, buffer, length, offset);
+}
+
+seqio_io_backend create_counting_backend() {
+    seqio_io_backend backend = SEQIO_FILE_IO_BACKEND;
+    backend.read = counted_read;
+    backend.pread = counted_pread;
+    return backend;
+}
+
+uint64_t get_counted_reads() {
+    return counted_reads;
+}
+
+// Compares reading a file through a backend holding a copy of it against
+// reading it from the file system.
+void verify_io_backend(char const *path,
+                       seqio_io_backend const *backend,
+                       map<string, string> *files,
+                       seqio_sequence_options options) {
+    vector<record_t> expected = read_records(path, options);
+    assert(!expected.empty());
+
+    if(files) {
+        string &content = (*files)[path];
+        content.clear();
+        FILE *f = fopen(path, "r");
+        assert(f);
+        char buf[64 * 1024];
+        size_t n;
+        while( (n = fread(buf, 1, sizeof(buf), f)) > 0 )
+            content.append(buf, n);
+        fclose(f);
+    }
+
+    options.io_backend = backend;
+    assert(read_records(path, options) == expected);
+    options.strand = SEQIO_STRAND_REVERSE_COMPLEMENT;
+    vector<record_t> records = read_records(path, options);
+    options.io_backend = nullptr;
+    assert(records == read_records(path, options));
+}
+
+// Writes a file through a backend and reads it back through the same
+// backend.
+void verify_io_backend_write(seqio_file_format file_format,
+                             char const *path,
+                             seqio_io_backend const *backend) {
+    char *bases = create_random_bases(100000, 1);
+    vector<record_t> expected = {
+        {"seq1", "comment1", string(bases, 100000)},
+        {"seq2", "comment2", "ACGTNNNNACGT"}
+    };
+    free(bases);
+
+    seqio_writer_options writer_options = {file_format, backend};
+    seqio_writer writer;
+    seqio_create_writer(path, writer_options, &writer);
+    for(record_t const &record: expected) {
+        seqio_dictionary metadata;
+        seqio_create_dictionary(&metadata);
+        seqio_set_value(metadata, SEQIO_KEY_NAME, record[0].c_str());
+        seqio_set_value(metadata, SEQIO_KEY_COMMENT, record[1].c_str());
+        seqio_create_sequence(writer, metadata);
+        seqio_write(writer, record[2].data(), record[2].size());
+        seqio_dispose_dictionary(&metadata);
+    }
+    seqio_dispose_writer(&writer);
+
+    struct stat buf;
+    assert(0 != stat(path, &buf));
+
+    seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS;
+    options.io_backend = backend;
+    assert(read_records(path, options) == expected);
+}
+
+// Compares scanning a file for headers, and for headers and lengths,
+// against reading it in full, one sequence at a time and in batches.
+void verify_scan(char const *path, seqio_sequence_options options) {
+    vector<record_t> expected = read_records(path, options);
+    assert(!expected.empty());
+
+    for(seqio_scan_mode mode: {SEQIO_SCAN_HEADERS, SEQIO_SCAN_LENGTHS}) {
+        options.scan_mode = mode;
+
+        seqio_sequence_iterator iterator;
+        seqio_create_sequence_iterator(path, options, &iterator);
+        for(record_t const &record: expected) {
+            seqio_sequence sequence;
+            seqio_next_sequence(iterator, &sequence);
+            assert(sequence);
+            verify_basic_metadata(sequence, record[0].c_str(), record[1].c_str());
+            char buf[16];
+            uint64_t n;
+            seqio_read(sequence, buf, sizeof(buf), &n);
+            assert(n == 0);
+            if(mode == SEQIO_SCAN_LENGTHS) {
+                uint64_t length;
+                seqio_get_length(sequence, &length);
+                assert(length == record[2].size());
+            }
+            seqio_dispose_sequence(&sequence);
+        }
+        seqio_sequence sequence;
+        seqio_next_sequence(iterator, &sequence);
+        assert(!sequence);
+        seqio_dispose_sequence_iterator(&iterator);
+
+        seqio_create_sequence_iterator(path, options, &iterator);
+        seqio_batch batch = SEQIO_EMPTY_BATCH;
+        uint64_t i = 0;
+        while( (SEQIO_SUCCESS == seqio_next_batch(iterator, 7, &batch)) && batch.count ) {
+            for(uint64_t j = 0; j < batch.count; j++, i++) {
+                assert(string(batch.arena + batch.names[j].offset, batch.names[j].length) == expected[i][0]);
+                assert(string(batch.arena + batch.comments[j].offset, batch.comments[j].length) == expected[i][1]);
+                assert(batch.bases[j].length == 0);
+                assert(batch.arena[batch.bases[j].offset] == '\0');
+                assert(batch.lengths[j] == ((mode == SEQIO_SCAN_LENGTHS) ? expected[i][2].size() : 0));
+            }
+        }
+        assert(i == expected.size());
+        seqio_dispose_batch(&batch);
+        seqio_dispose_sequence_iterator(&iterator);
+    }
+}
+
+static vector<record_t> read_batch_records(char const *path,
+                                           seqio_sequence_options const &options) {
+    seqio_sequence_iterator iterator;
+    seqio_create_sequence_iterator(path, options, &iterator);
+    seqio_batch batch = SEQIO_EMPTY_BATCH;
+    vector<record_t> records;
+    while( (SEQIO_SUCCESS == seqio_next_batch(iterator, 3, &batch)) && batch.count ) {
+        for(uint64_t j = 0; j < batch.count; j++) {
+            records.push_back({string(batch.arena + batch.names[j].offset, batch.names[j].length),
+                               string(batch.arena + batch.comments[j].offset, batch.comments[j].length),
+                               string(batch.arena + batch.bases[j].offset, batch.bases[j].length)});
+            if(options.scan_mode == SEQIO_SCAN_BASES)
+                assert(batch.lengths[j] == batch.bases[j].length);
+        }
+    }
+    seqio_dispose_batch(&batch);
+    seqio_dispose_sequence_iterator(&iterator);
+    return records;
+}
+
+// Compares reading a file with name and length filters against filtering
+// what's read without them, one sequence at a time, by batch and by scan.
+void verify_filter(char const *path, seqio_sequence_options options) {
+    vector<record_t> all = read_records(path, options);
+    assert(all.size() > 1);
+
+    vector<uint64_t> lengths;
+    for(record_t const &record: all)
+        lengths.push_back(record[2].size());
+    sort(lengths.begin(), lengths.end());
+    uint64_t median = lengths[lengths.size() / 2];
+
+    vector<char const *> names;
+    for(uint64_t i = 0; i < all.size(); i += 2)
+        names.push_back(all[i][0].c_str());
+    names.push_back("not a sequence");
+
+    struct filter_t {
+        vector<char const *> const *names;
+        char const *regex;
+        uint64_t min_length;
+        uint64_t max_length;
+    };
+    vector<filter_t> filters = {
+        {&names, nullptr, 0, 0},
+        {nullptr, "[13579]$|^.$", 0, 0},
+        {nullptr, nullptr, median, 0},
+        {nullptr, nullptr, 0, median},
+        {nullptr, nullptr, lengths[0] + 1, std::max(lengths.back(), lengths[0] + 2) - 1},
+        {&names, "[a-z]", median, median},
+        {nullptr, "^$", 0, 0},
+    };
+
+    for(filter_t const &filter: filters) {
+        options.names = filter.names ? filter.names->data() : nullptr;
+        options.num_names = filter.names ? filter.names->size() : 0;
+        options.name_regex = filter.regex;
+        options.min_length = filter.min_length;
+        options.max_length = filter.max_length;
+
+        regex_t regex;
+        if(filter.regex)
+            assert(0 == regcomp(&regex, filter.regex, REG_EXTENDED | REG_NOSUB));
+        vector<record_t> expected;
+        for(record_t const &record: all) {
+            uint64_t length = record[2].size();
+            if(filter.names && (find_if(filter.names->begin(), filter.names->end(),
+                                        [&record] (char const *name) {return record[0] == name;})
+                                == filter.names->end()))
+                continue;
+            if(filter.regex && (0 != regexec(&regex, record[0].c_str(), 0, nullptr, 0)))
+                continue;
+            if((length < filter.min_length) || (filter.max_length && (length > filter.max_length)))
+                continue;
+            expected.push_back(record);
+        }
+        if(filter.regex)
+            regfree(&regex);
+
+        options.scan_mode = SEQIO_SCAN_BASES;
+        assert(read_records(path, options) == expected);
+        assert(read_batch_records(path, options) == expected);
+
+        options.scan_mode = SEQIO_SCAN_LENGTHS;
+        vector<record_t> scanned = read_batch_records(path, options);
+        assert(scanned.size() == expected.size());
+        for(uint64_t i = 0; i < expected.size(); i++)
+            assert(scanned[i][0] == expected[i][0]);
+    }
+}
+
+void verify_packed(char const *path, seqio_sequence_options const &options) {
+    vector<record_t> expected = read_records(path, SEQIO_DEFAULT_SEQUENCE_OPTIONS);
+
+    seqio_sequence_iterator iterator;
+    seqio_create_sequence_iterator(path, options, &iterator);
+
+    seqio_sequence sequence;
+    for(record_t const &record: expected) {
+        seqio_next_sequence(iterator, &sequence);
+        assert(sequence);
+
+        seqio_packed_sequence packed;
+        seqio_get_packed(sequence, &packed);
+        assert(packed.length == record[2].size());
+
+        string bases(packed.length, 'N');
+        uint64_t prev_end = 0;
+        for(uint64_t i = 0; i < packed.fragment_count; i++) {
+            seqio_packed_fragment const &fragment = packed.fragments[i];
+            assert(fragment.packed_offset == prev_end);
+            assert(fragment.sequence_offset + fragment.length <= packed.length);
+            for(uint64_t j = 0; j < fragment.length; j++) {
+                uint64_t k = fragment.packed_offset + j;
+                assert(k / 4 < packed.packed_length);
+                bases[fragment.sequence_offset + j] = "ACGT"[(packed.packed[k / 4] >> (2 * (k % 4))) & 3];
+            }
+            prev_end = fragment.packed_offset + fragment.length;
+        }
+        assert(bases == record[2]);
+
+        // Filled once, so a second call returns the same pointers.
+        seqio_packed_sequence again;
+        seqio_get_packed(sequence, &again);
+        assert((again.packed == packed.packed) && (again.fragments == packed.fragments));
+
+        seqio_dispose_sequence(&sequence);
+    }
+    seqio_next_sequence(iterator, &sequence);
+    assert(!sequence);
+
+    seqio_dispose_sequence_iterator(&iterator);
+}
+
+// Seeks within every sequence of a file.
+void verify_seek_all(char const *path, seqio_sequence_options const &options) {
+    vector<record_t> expected = read_records(path, options);
+
+    seqio_sequence_iterator iterator;
+    seqio_create_sequence_iterator(path, options, &iterator);
+
+    seqio_sequence sequence;
+    for(record_t const &record: expected) {
+        seqio_next_sequence(iterator, &sequence);
+        assert(sequence);
+        verify_seek(sequence, record[2].c_str());
+        seqio_dispose_sequence(&sequence);
+    }
+    seqio_next_sequence(iterator, &sequence);
+    assert(!sequence);
+
+    seqio_dispose_sequence_iterator(&iterator);
+}
@@ -3,6 +3,8 @@
 #include "seqio.h"
 
 #include <iostream>
+#include <map>
+#include <string>
 #include <vector>
 
 #define SH(CMD) {cout << CMD << endl; int rc = system(CMD); if(rc != 0) exit(rc);}
@@ -30,3 +32,31 @@ void verify_a__sequential(char const *path);
 void verify_a__out_of_order(char const *path);
 void verify_read_all(uint64_t seqlen);
 void verify_write(seqio_file_format file_format, char const *path);
+void verify_single_pass(char const *path, uint64_t file_size);
+void verify_seek(seqio_sequence sequence, char const *bases);
+void verify_seek_all(char const *path, seqio_sequence_options const &options);
+void verify_batch(char const *path,
+                  uint64_t max_records,
+                  seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS);
+std::string reverse_complement(std::string const &bases);
+void verify_reverse_complement(char const *path, seqio_base_transform base_transform);
+void verify_parallel(char const *path, seqio_sequence_options options);
+void verify_read_ahead(char const *path, uint32_t nbuffers);
+void verify_multi(std::vector<char const *> const &paths, seqio_sequence_options const &options);
+void verify_memory(char const *path, seqio_sequence_options const &options);
+void verify_io_engine(char const *path, seqio_io_engine io_engine);
+void verify_page_cache(char const *path, seqio_page_cache page_cache, uint32_t num_threads = 1);
+seqio_io_backend create_memory_backend(std::map<std::string, std::string> *files);
+seqio_io_backend create_failing_backend(std::map<std::string, std::string> *files, bool fail_write);
+seqio_io_backend create_counting_backend();
+uint64_t get_counted_reads();
+void verify_io_backend(char const *path,
+                       seqio_io_backend const *backend,
+                       std::map<std::string, std::string> *files,
+                       seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS);
+void verify_io_backend_write(seqio_file_format file_format,
+                             char const *path,
+                             seqio_io_backend const *backend);
+void verify_scan(char const *path, seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS);
+void verify_filter(char const *path, seqio_sequence_options options = SEQIO_DEFAULT_SEQUENCE_OPTIONS);
+void verify_packed(char const *path, seqio_sequence_options const &options);